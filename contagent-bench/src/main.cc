@@ -0,0 +1,235 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "clipp.h"
+#include "contagent/compressed_graph.h"
+#include "contagent/partitions.h"
+#include "contagent/random.h"
+#include <algorithm>
+#include <chrono>
+#include <glog/logging.h>
+#include <iostream>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+using namespace clipp;
+using namespace contagent;
+
+namespace {
+/// The number of agents either side of an agent that its local friends are
+/// drawn from, so that the gaps between friends are like those of a
+/// reordered network.
+constexpr std::size_t NEIGHBOURHOOD = 1000;
+
+/// A synthetic network in compressed sparse rows.
+struct Network {
+  std::vector<std::size_t> offsets;
+  std::vector<std::uint32_t> friends;
+  std::vector<double_t> weights;
+};
+
+/// Draw a network in which every agent has about degree friends, a fraction
+/// of which are near it, and the rest anywhere.
+Network draw_network(const std::size_t n_agents, const std::size_t degree,
+                     const double_t local, const bool uniform_weights,
+                     const std::uint64_t seed) {
+  Network network;
+  network.offsets.reserve(n_agents + 1);
+  network.offsets.push_back(0);
+  network.friends.reserve(n_agents * degree);
+  network.weights.reserve(n_agents * degree);
+
+  std::vector<std::uint32_t> row;
+  for (std::size_t i = 0; i < n_agents; ++i) {
+    row.clear();
+    for (std::size_t e = 0; e < degree; ++e) {
+      const double_t u = random::uniform(seed, i, 2 * e);
+      const double_t v = random::uniform(seed, i, 2 * e + 1);
+      std::size_t f;
+      if (u < local) {
+        const std::size_t first = i < NEIGHBOURHOOD ? 0 : i - NEIGHBOURHOOD;
+        const std::size_t last = std::min(n_agents, i + NEIGHBOURHOOD + 1);
+        f = first + static_cast<std::size_t>(v * (last - first));
+      } else {
+        f = static_cast<std::size_t>(v * n_agents);
+      }
+      if (f != i) {
+        row.push_back(f);
+      }
+    }
+    std::sort(row.begin(), row.end());
+    row.erase(std::unique(row.begin(), row.end()), row.end());
+
+    for (const auto f : row) {
+      network.friends.push_back(f);
+      network.weights.push_back(
+          uniform_weights
+              ? 1.0
+              : 0.5 + 2.0 * random::uniform(seed ^ 1, i, f));
+    }
+    network.offsets.push_back(network.friends.size());
+  }
+
+  return network;
+}
+
+/// Time rounds of summing the actions of the friends of every agent, as a
+/// tick does, keeping the fastest.
+/// \return The milliseconds of the fastest round.
+template <class Count>
+double_t time_rounds(Partitions &partitions, const std::size_t rounds,
+                     const Count &count) {
+  double_t fastest = std::numeric_limits<double_t>::infinity();
+  for (std::size_t r = 0; r < rounds; ++r) {
+    const auto start = std::chrono::steady_clock::now();
+    partitions.steal([&count](std::size_t, const std::size_t begin,
+                              const std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        count(i);
+      }
+    });
+    fastest = std::min(
+        fastest, std::chrono::duration<double_t, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count());
+  }
+  return fastest;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  FLAGS_alsologtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  std::size_t n_agents = 1000000;
+  std::size_t degree = 10;
+  std::size_t n_behaviours = 4;
+  std::size_t rounds = 10;
+  std::size_t n_threads = 1;
+  double_t local = 0.5;
+  bool uniform_weights = false;
+  std::uint64_t seed = 0;
+
+  auto cli =
+      (option("--agents").doc("The number of agents [default=1000000]") &
+           value("n", n_agents),
+       option("--degree").doc("The number of friends that are drawn for "
+                              "every agent [default=10]") &
+           value("d", degree),
+       option("--behaviours").doc("The number of behaviours [default=4]") &
+           value("k", n_behaviours),
+       option("--local").doc("The fraction of friends that are drawn from "
+                             "near the agent [default=0.5]") &
+           value("fraction", local),
+       option("--uniform-weights")
+           .set(uniform_weights)
+           .doc("Give every friendship the same weight"),
+       option("--rounds").doc("The number of times the actions of friends "
+                              "are summed, the fastest is reported "
+                              "[default=10]") &
+           value("n", rounds),
+       option("-t", "--threads").doc("The number of threads, 0 uses one per "
+                                     "CPU [default=1]") &
+           value("n", n_threads),
+       option("--seed").doc("The seed of the network [default=0]") &
+           value("seed", seed));
+
+  if (!parse(argc, argv, cli)) {
+    std::cout << make_man_page(cli, "contagent-bench");
+    return 1;
+  }
+
+  LOG(INFO) << "Drawing a network of " << n_agents << " agents";
+  const auto network =
+      draw_network(n_agents, degree, local, uniform_weights, seed);
+  const std::size_t n_friendships = network.friends.size();
+
+  std::vector<std::uint32_t> actions(n_agents);
+  for (std::size_t i = 0; i < n_agents; ++i) {
+    actions[i] = static_cast<std::uint32_t>(
+        random::uniform(seed ^ 2, i, 0) * n_behaviours);
+  }
+
+  Partitions partitions(network.offsets, Parallelism{n_threads});
+  const CompressedGraph graph(network.offsets, network.friends,
+                              network.weights, partitions);
+
+  // The same loop as Population::pull_actions_of_friends.
+  std::vector<double_t> csr_counts(n_agents * n_behaviours);
+  LOG(INFO) << "Summing " << n_friendships << " friendships as CSR";
+  const double_t csr_ms = time_rounds(partitions, rounds, [&](std::size_t i) {
+    double_t *counts = csr_counts.data() + i * n_behaviours;
+    std::fill_n(counts, n_behaviours, 0.0);
+    for (std::size_t e = network.offsets[i]; e < network.offsets[i + 1];
+         ++e) {
+      counts[actions[network.friends[e]]] += network.weights[e];
+    }
+  });
+
+  std::vector<double_t> compressed_counts(n_agents * n_behaviours);
+  LOG(INFO) << "Summing " << n_friendships << " friendships compressed";
+  const double_t compressed_ms =
+      time_rounds(partitions, rounds, [&](std::size_t i) {
+        double_t *counts = compressed_counts.data() + i * n_behaviours;
+        std::fill_n(counts, n_behaviours, 0.0);
+        graph.count_actions(i, actions.data(), counts);
+      });
+
+  double_t max_difference = 0.0;
+  for (std::size_t c = 0; c < csr_counts.size(); ++c) {
+    max_difference = std::max(
+        max_difference, std::abs(csr_counts[c] - compressed_counts[c]));
+  }
+
+  const std::size_t csr_bytes = network.offsets.size() * sizeof(std::size_t) +
+                                n_friendships * (sizeof(std::uint32_t) +
+                                                 sizeof(double_t));
+  const auto per_friendship = [n_friendships](const std::size_t bytes) {
+    return n_friendships == 0
+               ? 0.0
+               : static_cast<double_t>(bytes) / n_friendships;
+  };
+
+  nlohmann::json report = {
+      {"agents", n_agents},
+      {"friendships", n_friendships},
+      {"threads", partitions.size()},
+      {"csr",
+       {{"bytes", csr_bytes},
+        {"bytesPerFriendship", per_friendship(csr_bytes)},
+        {"msPerRound", csr_ms}}},
+      {"compressed",
+       {{"bytes", graph.size_bytes()},
+        {"bytesPerFriendship", per_friendship(graph.size_bytes())},
+        {"msPerRound", compressed_ms},
+        {"uniformWeights", graph.has_uniform_weights()}}},
+      {"maxDifference", max_difference}};
+  std::cout << report.dump() << std::endl;
+
+  return 0;
+}
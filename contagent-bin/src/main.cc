@@ -29,9 +29,14 @@
 #include "main.h"
 #include "clipp.h"
 #include "contagent/json/json.h"
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <glog/logging.h>
 #include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
 
 using namespace clipp;
 
@@ -46,6 +51,31 @@ int main(int argc, char *argv[]) {
   std::string output_path;
   bool full_output = false;
   uint_fast8_t compression_level = 3;
+  FileOutput file_output;
+  std::size_t write_buffer_mib = file_output.buffer_size >> 20;
+  std::string sweep_path;
+  std::size_t n_threads = 0;
+  bool pin_threads = false;
+  std::string ordering_name = "input";
+  bool compress_graph = false;
+  bool incremental = false;
+  bool dataflow = false;
+  std::size_t n_processes = 1;
+  std::size_t memory_budget_mib = 0;
+  std::string spill_directory;
+  OutputPipeline output_pipeline;
+  std::string output_agents_path;
+  std::size_t sample_size = 0;
+  bool has_sample_seed = false;
+  std::uint64_t sample_seed = 0;
+  std::string output_beliefs;
+  std::string output_behaviours;
+  std::size_t day_stride = 1;
+  bool compact_output = false;
+  std::size_t shm_capacity_mib = 64;
+  std::uint64_t seed = std::random_device()();
+  std::string precision_name = "float64";
+  bool validate_precision = false;
 
   auto cli =
       (value("start-time", start_time).doc("The start time of the simulation"),
@@ -59,7 +89,136 @@ int main(int argc, char *argv[]) {
            .doc("Whether to fully serialize the agents as the output"),
        option("-Z").doc("zstd output compression level [default=3] between 1 "
                         "and 22 (20-22 have high mem usage).") &
-           value("level", compression_level));
+           value("level", compression_level),
+       option("--async-output")
+           .set(file_output.asynchronous)
+           .doc("Write the output through large buffers that are queued to "
+                "io_uring, or to a pool of pwrite threads without it, while "
+                "the next are filled"),
+       option("--direct-io")
+           .set(file_output.direct)
+           .doc("Bypass the page cache with O_DIRECT when writing the "
+                "output asynchronously"),
+       option("--write-buffers").doc("The number of buffers of "
+                                     "--async-output [default=4]") &
+           value("n", file_output.n_buffers),
+       option("--write-buffer-size").doc("The MiB of every buffer of "
+                                         "--async-output [default=4]") &
+           value("MiB", write_buffer_mib),
+       option("--sweep").doc("Run every scenario of a sweep manifest, writing "
+                             "<output>/<name>.json.zst for each") &
+           value("manifest", sweep_path),
+       option("-j", "--threads").doc("The number of threads, which run the "
+                                     "scenarios of a sweep, or else tick "
+                                     "partitions of the agents "
+                                     "[default=number of cores]") &
+           value("threads", n_threads),
+       option("--pin")
+           .set(pin_threads)
+           .doc("Pin every thread that ticks to a core, so that its agents "
+                "stay on the NUMA node they were placed on"),
+       option("--reorder").doc("Renumber the agents so that friends are "
+                               "stored near each other, input, rcm, bfs or "
+                               "degree [default=input]") &
+           value("ordering", ordering_name),
+       option("--compress-graph")
+           .set(compress_graph)
+           .doc("Store the friendships delta-encoded, with their weights "
+                "quantised to 16 bits, in a few bytes each"),
+       option("--incremental")
+           .set(incremental)
+           .doc("Keep the actions of the friends of every agent, and update "
+                "them only for the agents whose friends changed behaviour"),
+       option("--dataflow")
+           .set(dataflow)
+           .doc("Let every thread start a day once the threads its agents "
+                "are friends with have finished the day before, rather than "
+                "waiting for all of them"),
+       option("--processes").doc("The number of processes to divide the "
+                                 "agents between, which each load only "
+                                 "their own agents and the friends of them, "
+                                 "and exchange the actions of those friends "
+                                 "every day [default=1]") &
+           value("processes", n_processes),
+       option("--memory-budget").doc("The MiB of memory that the process may "
+                                     "keep resident. The agents are loaded "
+                                     "straight into the per-agent arrays of a "
+                                     "tick, which are kept with the history "
+                                     "in memory-mapped files and streamed "
+                                     "from them when over the budget. The "
+                                     "full output and change log load the "
+                                     "agents into RAM [default=0, no limit]") &
+           value("MiB", memory_budget_mib),
+       option("--spill-directory").doc("The directory of the files of "
+                                       "--memory-budget [default=the "
+                                       "temporary directory]") &
+           value("directory", spill_directory),
+       option("--output-queue").doc("The number of days whose summary may "
+                                    "wait to be written while the next are "
+                                    "ticked, 0 writes them after the last "
+                                    "day [default=2]") &
+           value("days", output_pipeline.max_pending),
+       option("--output-threads").doc("The number of threads that summarise "
+                                      "and encode the days [default=1]") &
+           value("threads", output_pipeline.n_threads),
+       option("--output-agents").doc("A file of the UUIDs of the agents "
+                                     "to summarise or fully serialize, one "
+                                     "per line [default=all]") &
+           value("file", output_agents_path),
+       option("--sample-agents").doc("Summarise or fully serialize a "
+                                     "uniform sample of this many agents "
+                                     "[default=all]") &
+           value("k", sample_size),
+       option("--sample-seed")
+               .set(has_sample_seed)
+               .doc("The seed of --sample-agents [default=the seed]") &
+           value("seed", sample_seed),
+       option("--output-beliefs").doc("The UUIDs of the beliefs to write, "
+                                      "separated by commas [default=all]") &
+           value("uuids", output_beliefs),
+       option("--output-behaviours").doc("The UUIDs of the behaviours to "
+                                         "write, separated by commas "
+                                         "[default=all]") &
+           value("uuids", output_behaviours),
+       option("--output-every").doc("Write every this many days from the "
+                                    "start time [default=1]") &
+           value("days", day_stride),
+       option("--compact-output")
+           .set(compact_output)
+           .doc("Write a dictionary of the beliefs, behaviours and agents "
+                "once, and refer to them by their position in it rather "
+                "than by UUID"),
+       option("--shm-output").doc("Publish every day to a ring buffer in "
+                                  "this shared memory object, such as "
+                                  "/contagent, for contagent-watch or "
+                                  "shm::Reader to read as it is ticked") &
+           value("name", output_pipeline.ring.name),
+       option("--shm-capacity").doc("The MiB of days that the ring holds "
+                                    "[default=64]") &
+           value("MiB", shm_capacity_mib),
+       option("--shm-state")
+           .set(output_pipeline.ring.state)
+           .doc("Publish the activations and actions of the selected agents "
+                "as well as the summary"),
+       option("--shm-wait")
+           .set(output_pipeline.ring.wait_for_readers)
+           .doc("Wait for the readers of the ring that fall behind, rather "
+                "than overwrite the days they have not read"),
+       option("--change-log")
+           .set(output_pipeline.change_log)
+           .doc("Write the initial state, the seed and the changes of action "
+                "as the output, from which contagent-replay recomputes the "
+                "activations of any agents"),
+       option("--seed").doc("The seed of the random number generator "
+                            "[default=random]") &
+           value("seed", seed),
+       option("--precision").doc("The precision of the dense engine, float32 "
+                                 "or float64 [default=float64]") &
+           value("precision", precision_name),
+       option("--validate-precision")
+           .set(validate_precision)
+           .doc("Run in both precisions and write the divergence of the "
+                "float32 summary statistics as the output"));
 
   if (!parse(argc, argv, cli)) {
     std::cout << make_man_page(cli, "contagentsim");
@@ -69,17 +228,165 @@ int main(int argc, char *argv[]) {
   if (end_time <= start_time) {
     throw std::invalid_argument("End time must be after start time");
   }
+  if (file_output.direct && !file_output.asynchronous) {
+    throw std::invalid_argument(
+        "O_DIRECT is only used with the asynchronous output");
+  }
+  file_output.buffer_size = write_buffer_mib << 20;
+
+  Precision precision;
+  if (precision_name == "float64") {
+    precision = Precision::FLOAT64;
+  } else if (precision_name == "float32") {
+    precision = Precision::FLOAT32;
+  } else {
+    throw std::invalid_argument("Precision must be float32 or float64");
+  }
+
+  const auto ordering = contagent::reorder::parse_ordering(ordering_name);
+
+  if (n_processes == 0) {
+    throw std::invalid_argument("There must be at least one process");
+  }
+  if (n_processes > 1 && !sweep_path.empty()) {
+    throw std::invalid_argument(
+        "A sweep cannot be divided between processes");
+  }
+  // Every scenario of a sweep shares the agents and ticks on one thread of
+  // the pool, so none has the full output, or threads to pin or schedule.
+  if (!sweep_path.empty() && (full_output || pin_threads || dataflow)) {
+    throw std::invalid_argument(
+        "A sweep writes only summaries, and ticks every scenario on one "
+        "thread, so it cannot have the full output, --pin or --dataflow");
+  }
+  if (day_stride == 0) {
+    throw std::invalid_argument("The output must be every 1 day or more");
+  }
+  if (!output_agents_path.empty() && sample_size != 0) {
+    throw std::invalid_argument(
+        "The agents to output are either listed or sampled");
+  }
+  if (output_pipeline.change_log && (n_processes > 1 || !sweep_path.empty())) {
+    throw std::invalid_argument(
+        "The change log is only written by a single process and scenario");
+  }
+  if (compact_output && (output_pipeline.change_log || !sweep_path.empty())) {
+    throw std::invalid_argument(
+        "The change log and sweeps are only written keyed by UUID");
+  }
+  if (compact_output) {
+    output_pipeline.schema = OutputSchema::COMPACT;
+  }
+  if (!output_pipeline.ring.name.empty() &&
+      (n_processes > 1 || !sweep_path.empty())) {
+    throw std::invalid_argument(
+        "The shared memory ring is only published by a single process and "
+        "scenario");
+  }
+  output_pipeline.ring.capacity = shm_capacity_mib << 20;
 
+  LOG(INFO) << "Using seed " << seed;
   LOG(INFO) << "Loading behaviours";
   auto behaviours = load_behaviours(behaviours_path);
   LOG(INFO) << "Loading beliefs";
   auto beliefs = load_beliefs(beliefs_path, behaviours);
-  LOG(INFO) << "Loading agents";
-  auto agents_file = contagent::json::create_zstd_istream(agents_path);
-  auto agents = load_agents(*agents_file, behaviours, beliefs, end_time);
-  auto output = contagent::json::create_zstd_ostream(output_path, compression_level);
+  // Under a budget, or divided between processes, the agents are streamed
+  // into every Population, unless they are needed as Agents.
+  std::vector<std::shared_ptr<Agent>> agents;
+  StreamedAgents streamed_agents;
+  if ((memory_budget_mib != 0 || n_processes > 1) && sweep_path.empty() &&
+      !validate_precision && !full_output && !output_pipeline.change_log) {
+    LOG(INFO) << "Indexing agents";
+    streamed_agents =
+        stream_agents(agents_path, behaviours, beliefs, end_time);
+  } else {
+    LOG(INFO) << "Loading agents";
+    auto agents_file = contagent::json::create_zstd_istream(agents_path);
+    agents = load_agents(*agents_file, behaviours, beliefs, end_time);
+  }
+  std::vector<boost::uuids::uuid> agent_uuids;
+  if (streamed_agents.index) {
+    agent_uuids = streamed_agents.index->uuids;
+  } else {
+    std::transform(agents.begin(), agents.end(),
+                   std::back_inserter(agent_uuids),
+                   [](const auto &agent) { return agent->get_uuid(); });
+  }
+
+  if (validate_precision) {
+    auto report = contagent::validation::compare_precision(
+        behaviours, beliefs, agents, start_time, end_time, seed);
+    nlohmann::json j = report;
+    LOG(INFO) << "Divergence of float32 from float64 " << j;
+    *contagent::json::create_zstd_ostream(output_path, compression_level,
+                                          file_output)
+        << j;
+    return 0;
+  }
+
+  OutputSelection output_selection;
+  output_selection.day_stride = day_stride;
+  output_selection.beliefs =
+      uuid_indices(split_uuids(output_beliefs), beliefs);
+  output_selection.behaviours =
+      uuid_indices(split_uuids(output_behaviours), behaviours);
+  if (!output_agents_path.empty()) {
+    output_selection.agents =
+        uuid_indices(load_uuids(output_agents_path), agent_uuids);
+  } else if (sample_size != 0) {
+    output_selection.agents = contagent::selection::sample(
+        agent_uuids.size(), sample_size, has_sample_seed ? sample_seed : seed);
+  }
+  if (!sweep_path.empty() &&
+      (!output_selection.agents.empty() || !output_selection.beliefs.empty() ||
+       !output_selection.behaviours.empty() || day_stride != 1)) {
+    throw std::invalid_argument("The output of a sweep cannot be selected");
+  }
+
+  if (!sweep_path.empty()) {
+    LOG(INFO) << "Loading sweep manifest";
+    auto scenarios = load_scenarios(sweep_path, behaviours, beliefs);
+    std::filesystem::create_directories(output_path);
+    contagent::sweep::Sweep sweep(
+        behaviours, beliefs, agents, start_time, end_time,
+        std::move(scenarios), seed, precision, ordering,
+        compress_graph ? GraphFormat::COMPRESSED : GraphFormat::CSR,
+        incremental ? Aggregation::INCREMENTAL : Aggregation::PULL,
+        Storage{memory_budget_mib << 20, spill_directory});
+    ThreadPool pool(n_threads);
+    sweep.run(pool, [&output_path, compression_level, &file_output](
+                        const contagent::sweep::Scenario &scenario) {
+      auto path = std::filesystem::path(output_path) / scenario.name;
+      path += ".json.zst";
+      return contagent::json::create_zstd_ostream(path, compression_level,
+                                                  file_output);
+    });
+    return 0;
+  }
+
+  auto output = contagent::json::create_zstd_ostream(
+      output_path, compression_level, file_output);
   auto config = make_configuration(start_time, end_time, behaviours, beliefs,
-                                   agents, full_output, std::move(output));
+                                   agents, full_output, std::move(output),
+                                   seed, precision,
+                                   Parallelism{n_threads, pin_threads,
+                                               dataflow
+                                                   ? Scheduling::DATAFLOW
+                                                   : Scheduling::BARRIER},
+                                   ordering,
+                                   compress_graph ? GraphFormat::COMPRESSED
+                                                  : GraphFormat::CSR,
+                                   incremental ? Aggregation::INCREMENTAL
+                                               : Aggregation::PULL,
+                                   Storage{memory_budget_mib << 20,
+                                           spill_directory},
+                                   output_pipeline,
+                                   std::move(output_selection),
+                                   std::move(streamed_agents));
+  if (n_processes > 1) {
+    contagent::cluster::run(*config, n_processes);
+    return 0;
+  }
   Runner runner(std::move(config));
   runner.run();
 }
@@ -90,12 +397,47 @@ make_configuration(const uint_fast32_t start_time, const uint_fast32_t end_time,
                    const std::vector<std::shared_ptr<Belief>> &beliefs,
                    const std::vector<std::shared_ptr<Agent>> &agents,
                    const bool full_output,
-                   std::unique_ptr<std::ostream> output) {
-  std::unique_ptr<Configuration> config =
-      std::make_unique<Configuration>(behaviours, beliefs, agents, start_time,
-                                      end_time, std::move(output), full_output);
+                   std::unique_ptr<std::ostream> output,
+                   const std::uint64_t seed, const Precision precision,
+                   const Parallelism &parallelism, const Ordering ordering,
+                   const GraphFormat graph_format,
+                   const Aggregation aggregation, const Storage &storage,
+                   const OutputPipeline &output_pipeline,
+                   OutputSelection output_selection,
+                   StreamedAgents streamed_agents) {
+  std::unique_ptr<Configuration> config = std::make_unique<Configuration>(
+      behaviours, beliefs, agents, start_time, end_time, std::move(output),
+      full_output, seed, precision, parallelism, ordering, graph_format,
+      aggregation, Ownership{}, storage, output_pipeline,
+      std::move(output_selection), SharedAgents{},
+      std::move(streamed_agents));
   return config;
 }
+std::vector<std::string> split_uuids(const std::string &uuids) {
+  std::vector<std::string> split;
+  std::stringstream stream(uuids);
+  std::string uuid;
+  while (std::getline(stream, uuid, ',')) {
+    if (!uuid.empty()) {
+      split.push_back(uuid);
+    }
+  }
+  return split;
+}
+std::vector<std::string> load_uuids(const std::string &file_path) {
+  std::ifstream file(file_path);
+  if (!file) {
+    throw std::invalid_argument("Unable to read " + file_path);
+  }
+  std::vector<std::string> uuids;
+  std::string uuid;
+  while (std::getline(file, uuid)) {
+    if (!uuid.empty()) {
+      uuids.push_back(uuid);
+    }
+  }
+  return uuids;
+}
 std::vector<std::shared_ptr<Behaviour>>
 load_behaviours(const std::string &file_path) {
   std::ifstream file(file_path);
@@ -150,39 +492,136 @@ load_agents(std::istream &is,
             const std::vector<std::shared_ptr<Belief>> &beliefs,
             const uint_fast32_t n_days) {
   try {
-    LOG(INFO) << "Parsing agents JSON";
-    nlohmann::json data = nlohmann::json::parse(is);
-    auto specs = data.template get<std::vector<contagent::json::AgentSpec>>();
-
     std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>> behaviour_map =
         vector_to_uuid_map(behaviours);
 
     std::map<boost::uuids::uuid, std::shared_ptr<Belief>> belief_map =
         vector_to_uuid_map(beliefs);
 
-    std::vector<std::shared_ptr<Agent>> agents;
+    LOG(INFO) << "Decompressing, parsing, constructing and linking agents";
+    contagent::json::AgentLoader loader(behaviour_map, belief_map, n_days);
+    auto agents = loader.load(is);
 
-    LOG(INFO) << "Transforming agents JSON to unlinked agents";
-    std::transform(specs.begin(), specs.end(), std::back_inserter(agents),
-                   [n_days, behaviour_map,
-                    belief_map](const contagent::json::AgentSpec &spec) {
-                     return spec.to_unlinked_agent(n_days, behaviour_map,
-                                                   belief_map);
-                   });
+    for (const auto &stage : loader.get_stages()) {
+      LOG(INFO) << stage.name << " processed " << stage.amount << " "
+                << stage.unit << " in " << stage.busy << "s ("
+                << stage.amount / std::max(stage.busy, 1e-9) << " "
+                << stage.unit << "/s), and waited " << stage.waiting << "s";
+    }
 
-    std::map<boost::uuids::uuid, std::shared_ptr<Agent>> agent_map =
-        vector_to_uuid_map(agents);
+    LOG(INFO) << "Interned the static parameters of " << agents.size()
+              << " agents into " << ArchetypeTable::global().size()
+              << " archetypes";
 
-    LOG(INFO) << "Link agents";
-    for (auto &agent : specs) {
-      agent.link_agents(agent_map);
+    return agents;
+  } catch (const std::exception &e) {
+    LOG(FATAL) << "Error reading agents JSON " << e.what();
+  }
+}
+StreamedAgents
+stream_agents(const std::string &file_path,
+              const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+              const std::vector<std::shared_ptr<Belief>> &beliefs,
+              const uint_fast32_t n_days) {
+  const auto log_stages = [](const contagent::json::AgentLoader &loader) {
+    for (const auto &stage : loader.get_stages()) {
+      LOG(INFO) << stage.name << " processed " << stage.amount << " "
+                << stage.unit << " in " << stage.busy << "s ("
+                << stage.amount / std::max(stage.busy, 1e-9) << " "
+                << stage.unit << "/s), and waited " << stage.waiting << "s";
     }
+  };
 
-    return agents;
+  try {
+    auto behaviour_map = std::make_shared<
+        const std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>>>(
+        vector_to_uuid_map(behaviours));
+    auto belief_map = std::make_shared<
+        const std::map<boost::uuids::uuid, std::shared_ptr<Belief>>>(
+        vector_to_uuid_map(beliefs));
+
+    LOG(INFO) << "Decompressing agents and reading their UUIDs";
+    contagent::json::AgentLoader loader(*behaviour_map, *belief_map, n_days);
+    auto agents_file = contagent::json::create_zstd_istream(file_path);
+    auto index = std::make_shared<const AgentIndex>(loader.index(*agents_file));
+    log_stages(loader);
+    LOG(INFO) << "Indexed " << index->uuids.size() << " agents";
+
+    // Every Population reads the file again for the agents it holds, as does
+    // cluster::plan for their friendships.
+    StreamedAgents streamed;
+    streamed.graph = [file_path, behaviour_map, belief_map, n_days, index,
+                      log_stages] {
+      LOG(INFO) << "Decompressing agents and reading their friendships";
+      contagent::json::AgentLoader loader(*behaviour_map, *belief_map,
+                                          n_days);
+      auto agents_file = contagent::json::create_zstd_istream(file_path);
+      auto graph = loader.graph(*agents_file, *index);
+      log_stages(loader);
+      return graph;
+    };
+    streamed.tabulate =
+        [file_path, behaviour_map, belief_map, n_days, index, log_stages](
+            const std::span<const std::uint32_t> rows,
+            const std::size_t n_owned,
+            const std::vector<std::shared_ptr<Belief>> &table_beliefs,
+            const std::vector<std::shared_ptr<Behaviour>> &table_behaviours,
+            const std::size_t day) {
+          LOG(INFO) << "Decompressing, parsing and tabulating agents";
+          contagent::json::AgentLoader loader(*behaviour_map, *belief_map,
+                                              n_days);
+          auto agents_file = contagent::json::create_zstd_istream(file_path);
+          auto table = loader.tabulate(*agents_file, *index, rows, n_owned,
+                                       table_beliefs, table_behaviours, day);
+          log_stages(loader);
+          return table;
+        };
+    streamed.index = std::move(index);
+    return streamed;
   } catch (const std::exception &e) {
     LOG(FATAL) << "Error reading agents JSON " << e.what();
   }
 }
+std::vector<contagent::sweep::Scenario>
+load_scenarios(const std::string &file_path,
+               const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+               const std::vector<std::shared_ptr<Belief>> &beliefs) {
+  std::ifstream file(file_path);
+  try {
+    nlohmann::json data = nlohmann::json::parse(file);
+    auto specs =
+        data.template get<std::vector<contagent::json::ScenarioSpec>>();
+
+    std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>> behaviour_map =
+        vector_to_uuid_map(behaviours);
+    std::map<boost::uuids::uuid, std::shared_ptr<Belief>> belief_map =
+        vector_to_uuid_map(beliefs);
+
+    std::set<std::string> names;
+    std::vector<contagent::sweep::Scenario> scenarios;
+
+    for (const auto &spec : specs) {
+      if (spec.name.empty() || !names.insert(spec.name).second) {
+        throw std::invalid_argument("Scenario names must be unique and "
+                                    "non-empty");
+      }
+      // The name is the file name of the output of the scenario, which must
+      // be in the output directory.
+      if (spec.name.front() == '.' ||
+          spec.name.find_first_of("/\\") != std::string::npos ||
+          spec.name.find("..") != std::string::npos) {
+        throw std::invalid_argument("Scenario name " + spec.name +
+                                    " is not a file name, as it starts with "
+                                    "'.' or has '/', '\\' or '..' in it");
+      }
+      scenarios.push_back(spec.to_scenario(behaviour_map, belief_map));
+    }
+
+    return scenarios;
+  } catch (const std::exception &e) {
+    LOG(FATAL) << "Error reading sweep manifest JSON " << e.what();
+  }
+}
 template <class T>
   requires CheckUUIDd<T>
 std::map<boost::uuids::uuid, std::shared_ptr<T>>
@@ -197,3 +636,36 @@ vector_to_uuid_map(const std::vector<std::shared_ptr<T>> &vec) {
 
   return m;
 }
+template <class T>
+  requires CheckUUIDd<T>
+std::vector<std::uint32_t>
+uuid_indices(const std::vector<std::string> &uuids,
+             const std::vector<std::shared_ptr<T>> &vec) {
+  std::vector<boost::uuids::uuid> vec_uuids;
+  std::transform(vec.begin(), vec.end(), std::back_inserter(vec_uuids),
+                 [](const std::shared_ptr<T> &elem) {
+                   return elem->get_uuid();
+                 });
+  return uuid_indices(uuids, vec_uuids);
+}
+std::vector<std::uint32_t>
+uuid_indices(const std::vector<std::string> &uuids,
+             const std::vector<boost::uuids::uuid> &vec) {
+  std::map<boost::uuids::uuid, std::uint32_t> index;
+  for (std::size_t i = 0; i < vec.size(); ++i) {
+    index.emplace(vec[i], i);
+  }
+
+  std::vector<std::uint32_t> indices;
+  for (const auto &uuid : uuids) {
+    const auto i = index.find(boost::lexical_cast<boost::uuids::uuid>(uuid));
+    if (i == index.end()) {
+      throw std::invalid_argument("Unknown UUID in the output selection " +
+                                  uuid);
+    }
+    indices.push_back(i->second);
+  }
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+  return indices;
+}
@@ -42,7 +42,18 @@ make_configuration(const uint_fast32_t start_time, const uint_fast32_t end_time,
                    const std::vector<std::shared_ptr<Belief>> &beliefs,
                    const std::vector<std::shared_ptr<Agent>> &agents,
                    const bool full_output,
-                   std::unique_ptr<std::ostream> output);
+                   std::unique_ptr<std::ostream> output,
+                   const std::uint64_t seed, const Precision precision,
+                   const Parallelism &parallelism, const Ordering ordering,
+                   const GraphFormat graph_format,
+                   const Aggregation aggregation, const Storage &storage,
+                   const OutputPipeline &output_pipeline,
+                   OutputSelection output_selection,
+                   StreamedAgents streamed_agents = {});
+
+std::vector<std::string> split_uuids(const std::string &uuids);
+
+std::vector<std::string> load_uuids(const std::string &file_path);
 
 std::vector<std::shared_ptr<Behaviour>>
 load_behaviours(const std::string &file_path);
@@ -57,9 +68,30 @@ load_agents(std::istream &is,
             const std::vector<std::shared_ptr<Belief>> &beliefs,
             const uint_fast32_t n_days);
 
+StreamedAgents
+stream_agents(const std::string &file_path,
+              const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+              const std::vector<std::shared_ptr<Belief>> &beliefs,
+              const uint_fast32_t n_days);
+
+std::vector<contagent::sweep::Scenario>
+load_scenarios(const std::string &file_path,
+               const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+               const std::vector<std::shared_ptr<Belief>> &beliefs);
+
 template <class T>
   requires CheckUUIDd<T>
 std::map<boost::uuids::uuid, std::shared_ptr<T>>
 vector_to_uuid_map(const std::vector<std::shared_ptr<T>> &vec);
 
+template <class T>
+  requires CheckUUIDd<T>
+std::vector<std::uint32_t>
+uuid_indices(const std::vector<std::string> &uuids,
+             const std::vector<std::shared_ptr<T>> &vec);
+
+std::vector<std::uint32_t>
+uuid_indices(const std::vector<std::string> &uuids,
+             const std::vector<boost::uuids::uuid> &vec);
+
 #endif // CONTAGENT_MAIN_H
@@ -29,15 +29,27 @@
 #ifndef CONTAGENT_AGENT_H
 #define CONTAGENT_AGENT_H
 
+#include "agent_history.h"
+#include "archetype.h"
 #include "belief.h"
 #include "uuidd.h"
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <optional>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace contagent {
 
+class Agent;
+
+/// The friends of an Agent, each with the weight of the friendship, sorted by
+/// std::owner_less with no friend twice. Every friendship is a pair in a
+/// vector rather than a node of a map, so that it takes 24 bytes.
+using Friends = std::vector<std::pair<std::weak_ptr<Agent>, double_t>>;
+
 /// An agent in the simulation.
 /// \author Robert Greener
 class Agent : public UUIDd {
@@ -46,7 +58,6 @@ public:
   /// \param n_days The number of days in the simulation.
   /// \param uuid The UUID of the agent.
   /// \param activations The activations of the agent.
-  /// \throws std::length_exception If n_days is greater than std::max_size().
   /// \author Robert Greener
   Agent(uint_fast32_t n_days, boost::uuids::uuid uuid,
         std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
@@ -60,32 +71,77 @@ public:
 
   explicit Agent(uint_fast32_t n_days);
 
-  [[maybe_unused]] [[nodiscard]] const std::unordered_map<
-      std::shared_ptr<Belief>, double_t> &
-  get_activations_for_day(std::size_t day);
+  /// Get the activations on a day, which are decompressed if the day is not
+  /// one of the last.
+  /// \param day The day.
+  /// \return The activations.
+  /// \throws std::out_of_range If the day has not been recorded.
+  [[maybe_unused]] [[nodiscard]] std::unordered_map<std::shared_ptr<Belief>,
+                                                    double_t>
+  get_activations_for_day(std::size_t day) const;
+
+  [[maybe_unused]] [[nodiscard]] const Friends &get_friends() const;
 
-  [[maybe_unused]] [[nodiscard]] const std::map<std::weak_ptr<Agent>, double_t,
-                                                std::owner_less<>> &
-  get_friends() const;
+  /// Get the activations on every day, decompressing them.
+  /// \return The activations.
+  [[nodiscard]] std::vector<
+      std::unordered_map<std::shared_ptr<Belief>, double_t>>
+  get_activations() const;
 
-  [[nodiscard]] const std::vector<
-      std::unordered_map<std::shared_ptr<Belief>, double_t>> &
-  get_activations() const noexcept;
+  /// Get the activations on every day, as they are stored.
+  /// \return The history.
+  [[nodiscard]] const ActivationHistory &
+  get_activation_history() const noexcept;
 
   void set_activations(
-      std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
-          activations);
-  [[maybe_unused]] void set_friends(
-      std::map<std::weak_ptr<Agent>, double_t, std::owner_less<>> friends);
+      const std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
+          &activations);
+
+  /// Set the activations for a single day, growing the history if needed.
+  /// \param day The day.
+  /// \param activations The activations.
+  void set_activations_for_day(
+      std::size_t day,
+      const std::unordered_map<std::shared_ptr<Belief>, double_t>
+          &activations);
+
+  /// Set the friends, sorting them, and keeping only the first weight of a
+  /// friend that is given more than once.
+  /// \param friends The friends.
+  [[maybe_unused]] void set_friends(Friends friends);
+
+  /// Get the action on every day, decompressing them.
+  /// \return The actions.
+  [[nodiscard]] std::vector<std::shared_ptr<Behaviour>> get_actions() const;
+
+  /// Get the actions on every day, as they are stored.
+  /// \return The history.
+  [[nodiscard]] const ActionHistory &get_action_history() const noexcept;
 
-  [[nodiscard]] const std::vector<std::shared_ptr<Behaviour>> &
-  get_actions() const;
   [[maybe_unused]] void
-  set_actions(std::vector<std::shared_ptr<Behaviour>> actions);
+  set_actions(const std::vector<std::shared_ptr<Behaviour>> &actions);
+
+  /// Record the Behaviour performed on a day, forgetting the actions of the
+  /// days after it.
+  /// \param day The day, which is at most the number of days recorded.
+  /// \param behaviour The behaviour.
+  /// \throws std::out_of_range If the day is after the days recorded.
+  void record_action(std::size_t day, std::shared_ptr<Behaviour> behaviour);
+
+  /// Get the id of the agent's Archetype in ArchetypeTable::global().
+  /// \return The id.
+  [[nodiscard]] std::uint32_t get_archetype() const noexcept;
+
+  /// Set the agent's Archetype in ArchetypeTable::global().
+  /// \param archetype A reference, as returned by ArchetypeTable::intern.
+  void set_archetype(ArchetypeTable::Reference archetype) noexcept;
 
   [[maybe_unused]] [[nodiscard]] const std::unordered_map<
       std::shared_ptr<Belief>, double_t> &
   get_deltas() const;
+
+  /// Set the deltas, interning a new Archetype with the existing performance
+  /// relationships. Prefer ::set_archetype when setting both.
   [[maybe_unused]] void
   set_deltas(std::unordered_map<std::shared_ptr<Belief>, double_t> deltas);
 
@@ -94,6 +150,8 @@ public:
       std::unordered_map<std::shared_ptr<Behaviour>, double_t>> &
   get_performance_relationships() const;
 
+  /// Set the performance relationships, interning a new Archetype with the
+  /// existing deltas. Prefer ::set_archetype when setting both.
   [[maybe_unused]] void set_performance_relationships(
       std::unordered_map<
           std::shared_ptr<Belief>,
@@ -139,24 +197,16 @@ public:
                       const std::vector<std::shared_ptr<Belief>> &beliefs);
 
 private:
-  std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
-      activations_;
-
-  std::map<std::weak_ptr<Agent>, double_t, std::owner_less<>> friends_;
-
-  std::vector<std::shared_ptr<Behaviour>> actions_;
+  ActivationHistory activations_;
 
-  std::unordered_map<std::shared_ptr<Belief>, double_t> deltas_;
+  Friends friends_;
 
-  std::unordered_map<std::shared_ptr<Belief>,
-                     std::unordered_map<std::shared_ptr<Behaviour>, double_t>>
-      performance_relationships_;
+  ActionHistory actions_;
 
-  /// Initialize the agent, reserving the space in the ::activations_ and
-  /// ::actions_ vectors.
-  /// \param n_days The number of days that the simulation will be run for.
-  /// \throws std::length_exception If n_days is greater than std::max_size().
-  void initialize(uint_fast32_t n_days);
+  /// The Archetype holding the deltas and performance relationships, which
+  /// are shared with every other Agent that has the same ones, and released
+  /// once none of them is left.
+  ArchetypeTable::Reference archetype_;
 };
 } // namespace contagent
 
@@ -0,0 +1,182 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_AGENT_HISTORY_H
+#define CONTAGENT_AGENT_HISTORY_H
+
+#include "behaviour.h"
+#include "belief.h"
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace contagent {
+
+/// The action of one Agent on every day, as runs of days on which it performed
+/// the same Behaviour. The behaviours are stored once, and the runs refer to
+/// them by a small index, so a day costs nothing until the action changes.
+class ActionHistory {
+public:
+  ActionHistory() = default;
+
+  /// Create a new ActionHistory.
+  /// \param actions The action on every day.
+  explicit ActionHistory(
+      const std::vector<std::shared_ptr<Behaviour>> &actions);
+
+  /// Get the number of days.
+  /// \return The number of days.
+  [[nodiscard]] std::size_t size() const noexcept;
+
+  /// Get the action on a day.
+  /// \param day The day.
+  /// \return The behaviour.
+  /// \throws std::out_of_range If the day has not been recorded.
+  [[nodiscard]] const std::shared_ptr<Behaviour> &at(std::size_t day) const;
+
+  /// Record the action on a day, forgetting the days after it.
+  /// \param day The day, which is at most ::size.
+  /// \param behaviour The behaviour.
+  /// \throws std::out_of_range If the day is after ::size.
+  void set(std::size_t day, std::shared_ptr<Behaviour> behaviour);
+
+  /// Get the action on every day.
+  /// \return The behaviours.
+  [[nodiscard]] std::vector<std::shared_ptr<Behaviour>> to_vector() const;
+
+private:
+  /// The days up to end, from the end of the run before, on which
+  /// behaviours_[behaviour] was performed.
+  struct Run {
+    std::uint32_t end;
+    std::uint32_t behaviour;
+  };
+
+  std::vector<std::shared_ptr<Behaviour>> behaviours_;
+  std::vector<Run> runs_;
+};
+
+/// The activations of one Agent on every day. Every BLOCK_DAYS days are
+/// compressed into a block once later days have been recorded: each
+/// activation is XORed with the one of the same belief the day before, which
+/// activations that change smoothly leave with leading zero bytes, and only
+/// the other bytes are kept, behind their number. The beliefs are stored once,
+/// and a day with the same beliefs as the day before does not repeat them.
+/// The last days stay uncompressed, so that ticking and reading the day
+/// before do not decompress.
+class ActivationHistory {
+public:
+  /// The activation of every belief on a day.
+  using Day = std::unordered_map<std::shared_ptr<Belief>, double_t>;
+
+  /// The number of days in a compressed block.
+  static constexpr std::size_t BLOCK_DAYS = 16;
+
+  ActivationHistory() = default;
+
+  /// Create a new ActivationHistory.
+  /// \param days The activations on every day.
+  explicit ActivationHistory(const std::vector<Day> &days);
+
+  /// Get the number of days.
+  /// \return The number of days.
+  [[nodiscard]] std::size_t size() const noexcept;
+
+  /// Get the activations on a day, decompressing them if need be.
+  /// \param day The day.
+  /// \return The activations.
+  /// \throws std::out_of_range If the day has not been recorded.
+  [[nodiscard]] Day at(std::size_t day) const;
+
+  /// Find the activation of a belief on a day.
+  /// \param day The day.
+  /// \param belief The belief.
+  /// \return The activation, or std::nullopt if the day has none for the
+  /// belief.
+  /// \throws std::out_of_range If the day has not been recorded.
+  [[nodiscard]] std::optional<double_t>
+  find(std::size_t day, const std::shared_ptr<Belief> &belief) const;
+
+  /// Set the activations on a day, adding days with none up to it.
+  /// \param day The day.
+  /// \param activations The activations.
+  void set(std::size_t day, const Day &activations);
+
+  /// Set the activation of a belief on a day, adding days with none up to it.
+  /// \param day The day.
+  /// \param belief The belief.
+  /// \param activation The activation.
+  void set(std::size_t day, const std::shared_ptr<Belief> &belief,
+           double_t activation);
+
+  /// Get the activations on every day.
+  /// \return The activations.
+  [[nodiscard]] std::vector<Day> to_vector() const;
+
+private:
+  /// The activation of beliefs_[belief].
+  struct Entry {
+    std::uint32_t belief;
+    double_t activation;
+  };
+  using OpenDay = std::vector<Entry>;
+
+  /// Get the index of a belief in beliefs_, adding it if it is new.
+  std::uint32_t intern(const std::shared_ptr<Belief> &belief);
+
+  /// Get a day, decompressing its block if it has been compressed.
+  /// \param day The day.
+  /// \param decoded Where a compressed day is decompressed to.
+  /// \return The day.
+  /// \throws std::out_of_range If the day has not been recorded.
+  [[nodiscard]] std::span<const Entry> get(std::size_t day,
+                                           OpenDay &decoded) const;
+
+  /// Make a day uncompressed, and add days with none up to it.
+  /// \return The day.
+  OpenDay &open(std::size_t day);
+
+  /// Compress the full blocks, keeping the last two days uncompressed.
+  void seal();
+
+  [[nodiscard]] std::vector<OpenDay> decode(std::size_t block) const;
+
+  std::vector<std::shared_ptr<Belief>> beliefs_;
+  /// The compressed blocks of the first days.
+  std::vector<std::vector<std::uint8_t>> blocks_;
+  /// The days after the compressed blocks.
+  std::vector<OpenDay> open_;
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_AGENT_HISTORY_H
@@ -0,0 +1,104 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_AGENT_TABLE_H
+#define CONTAGENT_AGENT_TABLE_H
+
+#include "archetype.h"
+#include "numa.h"
+#include <boost/uuid/uuid.hpp>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace contagent {
+
+/// The UUIDs of the agents of a JSON array, which is all that
+/// json::AgentLoader::index reads of them, so that they can be counted and
+/// selected without being loaded, see StreamedAgents.
+struct AgentIndex {
+  /// The UUID of every agent, in the order of the array.
+  std::vector<boost::uuids::uuid> uuids;
+};
+
+/// The friendships of the agents of an AgentIndex, numbered by their position
+/// in it, which is all that json::AgentLoader::graph reads of them, and all
+/// that a cluster::Plan needs.
+struct AgentGraph {
+  /// The friends of agent i are friends[offsets[i]] up to
+  /// friends[offsets[i + 1]], sorted by UUID.
+  std::vector<std::size_t> offsets;
+  std::vector<std::uint32_t> friends;
+  /// The least and greatest weight of every friendship, or empty if there are
+  /// none.
+  std::optional<std::pair<double_t, double_t>> weight_range;
+};
+
+/// The agents of a Configuration on one day, numbered by their index in it,
+/// with the beliefs and behaviours numbered by their position in it, which is
+/// all that a Population is built from. It is made from the Agents, or by
+/// json::AgentLoader::tabulate straight from their JSON, so that a population
+/// with StreamedAgents is never held as Agents. The arrays are numa::vectors,
+/// so that within a numa::FileBacking they are backed by files.
+struct AgentTable {
+  /// The ArchetypeTable id of every agent, N.
+  numa::vector<std::uint32_t> archetypes;
+  /// A Reference to every distinct Archetype of ::archetypes, which holds
+  /// them while the table exists, or empty if the Agents hold them.
+  std::vector<ArchetypeTable::Reference> references;
+
+  /// The behaviour that every agent performed on the day, or 0 if it
+  /// performed none of the Configuration, N.
+  numa::vector<std::uint32_t> actions;
+
+  /// The activations of agent i on the day are
+  /// activation_values[activation_offsets[i]] up to
+  /// activation_values[activation_offsets[i + 1]], of the beliefs in
+  /// activation_beliefs, in no particular order. The activations of beliefs
+  /// that are not in the Configuration are left out.
+  numa::vector<std::size_t> activation_offsets;
+  numa::vector<std::uint32_t> activation_beliefs;
+  numa::vector<double_t> activation_values;
+
+  /// The friends of agent i are friends[friend_offsets[i]] up to
+  /// friends[friend_offsets[i + 1]], sorted by UUID, with the weights that it
+  /// gives them in friend_weights. The ghosts of an Ownership have none.
+  numa::vector<std::size_t> friend_offsets;
+  numa::vector<std::uint32_t> friends;
+  numa::vector<double_t> friend_weights;
+
+  /// Get the number of agents.
+  /// \return N.
+  [[nodiscard]] std::size_t size() const noexcept { return actions.size(); }
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_AGENT_TABLE_H
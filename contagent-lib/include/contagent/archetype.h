@@ -0,0 +1,153 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_ARCHETYPE_H
+#define CONTAGENT_ARCHETYPE_H
+
+#include "behaviour.h"
+#include "belief.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace contagent {
+
+/// The static parameters of an Agent. Synthetic populations usually only have
+/// a few distinct sets of these, so they are interned in an ArchetypeTable and
+/// shared between all the agents that have them.
+struct Archetype {
+  /// The amount that an activation decays by every day, for each belief.
+  std::unordered_map<std::shared_ptr<Belief>, double_t> deltas;
+
+  /// How much holding a belief drives the performance of a behaviour.
+  std::unordered_map<std::shared_ptr<Belief>,
+                     std::unordered_map<std::shared_ptr<Behaviour>, double_t>>
+      performance_relationships;
+
+  bool operator==(const Archetype &other) const = default;
+};
+
+/// A hash-consed table of Archetypes, indexed by a 32-bit id. Every id is
+/// held by counted References, and once the last is destroyed the Archetype
+/// is released, with the Beliefs and Behaviours it holds, and its id is
+/// reused. Interning is thread-safe, and looking up an id that is held never
+/// takes a lock, as the storage never moves.
+class ArchetypeTable {
+public:
+  /// The id of the Archetype with no deltas and no performance relationships,
+  /// which is never released.
+  static constexpr std::uint32_t EMPTY = 0;
+
+  /// A counted reference to an Archetype of a table, which is copied with
+  /// the Agent that holds it.
+  class Reference {
+  public:
+    /// Refer to the EMPTY Archetype.
+    Reference() noexcept = default;
+    Reference(const Reference &other) noexcept;
+    Reference(Reference &&other) noexcept;
+    Reference &operator=(Reference other) noexcept;
+    ~Reference();
+
+    /// Get the id of the Archetype.
+    /// \return The id.
+    [[nodiscard]] std::uint32_t get() const noexcept;
+
+  private:
+    friend class ArchetypeTable;
+
+    Reference(ArchetypeTable *table, std::uint32_t id) noexcept;
+
+    ArchetypeTable *table_ = nullptr;
+    std::uint32_t id_ = EMPTY;
+  };
+
+  ArchetypeTable();
+  ~ArchetypeTable();
+
+  ArchetypeTable(const ArchetypeTable &) = delete;
+  ArchetypeTable &operator=(const ArchetypeTable &) = delete;
+
+  /// Get the table that is shared by every Agent in the process, which is
+  /// never destroyed, so that Agents that outlive it can still release their
+  /// Archetypes.
+  /// \return The table.
+  static ArchetypeTable &global();
+
+  /// Find the id of an Archetype, adding it to the table if it is new.
+  /// \param archetype The archetype.
+  /// \return A reference to the archetype.
+  /// \throws std::length_error If the table is full.
+  Reference intern(Archetype archetype);
+
+  /// Get an Archetype from its id.
+  /// \param id The id of a Reference that has not been destroyed.
+  /// \return The archetype.
+  [[nodiscard]] const Archetype &at(std::uint32_t id) const noexcept;
+
+  /// Get the number of distinct Archetypes in the table that are held.
+  /// \return The number of archetypes.
+  [[nodiscard]] std::size_t size() const noexcept;
+
+private:
+  /// Segment k holds FIRST_SEGMENT_SIZE << k entries.
+  static constexpr std::size_t FIRST_SEGMENT_SIZE = 64;
+  static constexpr std::size_t N_SEGMENTS = 26;
+
+  struct Entry {
+    Archetype archetype;
+    std::atomic<std::uint32_t> references = 0;
+  };
+
+  [[nodiscard]] static std::size_t hash(const Archetype &archetype) noexcept;
+
+  Entry &slot(std::uint32_t id) const noexcept;
+
+  /// Count another reference to an id that is held.
+  void acquire(std::uint32_t id) noexcept;
+
+  /// Stop counting a reference to an id, releasing it if it was the last.
+  void release(std::uint32_t id) noexcept;
+
+  std::array<std::atomic<Entry *>, N_SEGMENTS> segments_{};
+  std::atomic<std::uint32_t> size_ = 0;
+  /// The number of ids that have been used, guarded by ::mutex_.
+  std::uint32_t n_slots_ = 0;
+  /// The ids that have been released, guarded by ::mutex_.
+  std::vector<std::uint32_t> free_;
+  std::unordered_multimap<std::size_t, std::uint32_t> ids_;
+  std::mutex mutex_;
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_ARCHETYPE_H
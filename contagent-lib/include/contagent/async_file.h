@@ -0,0 +1,148 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef CONTAGENT_ASYNC_FILE_H
+#define CONTAGENT_ASYNC_FILE_H
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace contagent {
+
+/// How an output file is written, see AsyncFile.
+struct FileOutput {
+  /// Whether the writes are queued to an AsyncFile while the output is
+  /// encoded, rather than made as it is.
+  bool asynchronous = false;
+  /// Whether an AsyncFile bypasses the page cache with O_DIRECT, where the
+  /// file system supports it.
+  bool direct = false;
+  /// The number of bytes of every buffer, which is rounded up to
+  /// AsyncFile::ALIGNMENT.
+  std::size_t buffer_size = std::size_t{4} << 20;
+  /// The number of buffers, which is the number of writes that may be
+  /// queued, plus the one being filled.
+  std::size_t n_buffers = 4;
+  /// The number of threads that write with pwrite if io_uring is not
+  /// available.
+  std::size_t n_threads = 2;
+};
+
+/// A file that is written sequentially through large aligned buffers, each
+/// of which is written in the background once it is full, so that encoding
+/// only waits for the disk when every buffer is queued. The writes are
+/// submitted to an io_uring, through the system calls rather than liburing,
+/// and if the kernel or the build has none, they are made with pwrite on a
+/// ThreadPool.
+///
+/// With FileOutput::direct, the file is opened with O_DIRECT, and the last
+/// buffer is padded to ALIGNMENT and the file then truncated to its length.
+/// A write that the kernel cuts short is finished through the page cache,
+/// since it may stop at an offset that is not aligned.
+class AsyncFile {
+public:
+  /// The alignment of the buffers, and of the writes with O_DIRECT.
+  static constexpr std::size_t ALIGNMENT = 4096;
+
+  /// The time and bytes of the writes.
+  struct Metrics {
+    /// The number of bytes written.
+    std::size_t bytes = 0;
+    /// From opening the file until it was closed, in seconds.
+    double_t elapsed = 0.0;
+    /// Waiting for a buffer to be written so that it could be refilled,
+    /// or for the last to be written when closing, in seconds.
+    double_t stalled = 0.0;
+    /// Whether the writes were submitted to an io_uring.
+    bool io_uring = false;
+    /// Whether the file was opened with O_DIRECT.
+    bool direct = false;
+  };
+
+  /// Create or truncate a file.
+  /// \param path The path.
+  /// \param options How to write it, where FileOutput::asynchronous is
+  /// ignored.
+  /// \throws std::system_error If the file could not be opened.
+  AsyncFile(const std::filesystem::path &path, const FileOutput &options);
+
+  /// Close the file if ::close was not called, ignoring any error.
+  ~AsyncFile();
+
+  AsyncFile(const AsyncFile &) = delete;
+  AsyncFile &operator=(const AsyncFile &) = delete;
+
+  /// Append to the file, waiting for a buffer if all are being written.
+  /// \param data The bytes.
+  /// \param n The number of bytes.
+  /// \throws std::system_error If an earlier write failed.
+  void write(const char *data, std::size_t n);
+
+  /// Write the last buffer, wait for every write, and close the file.
+  /// \return The time and bytes of the writes.
+  /// \throws std::system_error If a write failed.
+  Metrics close();
+
+  /// Where the writes are sent, an io_uring or a ThreadPool.
+  class Backend;
+
+private:
+  /// Queue the buffer being filled, and take a free one, waiting for a
+  /// write to complete if there is none.
+  void submit();
+
+  const std::string path_;
+  int fd_ = -1;
+  /// The file opened again without O_DIRECT, with FileOutput::direct.
+  int buffered_fd_ = -1;
+  std::size_t buffer_size_ = 0;
+  /// Every buffer, aligned to ALIGNMENT.
+  std::vector<std::unique_ptr<char, void (*)(void *)>> buffers_;
+  /// Declared after the buffers, so that it waits for the writes from them
+  /// before they are freed.
+  std::unique_ptr<Backend> backend_;
+  /// The buffers that are not being filled or written.
+  std::vector<std::size_t> free_;
+  /// The buffer being filled, and the number of bytes in it.
+  std::size_t current_ = 0;
+  std::size_t filled_ = 0;
+  /// The offset in the file of the buffer being filled.
+  std::size_t offset_ = 0;
+  bool closed_ = false;
+  Metrics metrics_;
+  std::chrono::steady_clock::time_point opened_;
+};
+} // namespace contagent
+
+#endif // CONTAGENT_ASYNC_FILE_H
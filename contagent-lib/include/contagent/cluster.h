@@ -0,0 +1,171 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_CLUSTER_H
+#define CONTAGENT_CLUSTER_H
+
+#include "configuration.h"
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace contagent::cluster {
+/// A Unix stream socket to another process of a cluster, which sends and
+/// receives whole arrays of trivially copyable values.
+class Channel {
+public:
+  /// Create a new Channel.
+  /// \param fd The socket, which the Channel closes.
+  explicit Channel(int fd) noexcept;
+
+  ~Channel();
+
+  Channel(Channel &&other) noexcept;
+  Channel &operator=(Channel &&other) noexcept;
+  Channel(const Channel &) = delete;
+  Channel &operator=(const Channel &) = delete;
+
+  /// Make a pair of connected Channels.
+  /// \return The Channels.
+  /// \throws std::system_error If the sockets could not be made.
+  [[nodiscard]] static std::pair<Channel, Channel> make_pair();
+
+  /// Send an array, as its length and then its values.
+  /// \param values The values.
+  /// \throws std::system_error If the socket could not be written.
+  template <class T> void send(std::span<const T> values);
+
+  /// Receive an array sent by ::send.
+  /// \return The values.
+  /// \throws std::system_error If the socket could not be read.
+  /// \throws std::runtime_error If the other process closed its socket.
+  template <class T> [[nodiscard]] std::vector<T> receive();
+
+  /// Close the socket, which the other process sees as the end of the stream.
+  void close() noexcept;
+
+private:
+  void write_all(const void *data, std::size_t size);
+  void read_all(void *data, std::size_t size);
+
+  int fd_;
+};
+
+/// An agent that changed action, as the index of the agent in the
+/// Configuration and the index of the behaviour.
+struct Change {
+  std::uint32_t agent;
+  std::uint32_t action;
+};
+
+/// How the agents of a Configuration are divided between the processes of a
+/// cluster.
+struct Plan {
+  /// The agents in the order that they are divided, by their index in the
+  /// Configuration, N.
+  std::vector<std::uint32_t> order;
+  /// Process w owns order[boundaries[w]] up to order[boundaries[w + 1]].
+  std::vector<std::size_t> boundaries;
+  /// The ghosts of every process, which are the friends of its agents that
+  /// other processes own, in ascending order.
+  std::vector<std::vector<std::uint32_t>> ghosts;
+  /// The processes that have agent i as a ghost are
+  /// readers[reader_offsets[i]] up to readers[reader_offsets[i + 1]].
+  std::vector<std::size_t> reader_offsets;
+  std::vector<std::uint32_t> readers;
+  /// The least and greatest weight of every friendship, which every process
+  /// quantises a GraphFormat::COMPRESSED graph between, or empty if there are
+  /// no friendships.
+  std::optional<std::pair<double_t, double_t>> weight_range;
+};
+
+/// Divide the agents between processes, in the order of
+/// Configuration::get_ordering so that friends tend to be in the same
+/// process, into ranges of about the same number of agents plus friendships.
+/// The friendships of StreamedAgents are read by StreamedAgents::graph, and
+/// are not kept.
+/// \param configuration The configuration.
+/// \param n_processes The number of processes.
+/// \return The Plan.
+/// \throws std::out_of_range If an agent has a friend that is not in the
+/// Configuration.
+/// \throws Whatever StreamedAgents::graph threw.
+[[nodiscard]] Plan plan(const Configuration &configuration,
+                        std::size_t n_processes);
+
+/// Run a simulation with its agents divided between worker processes forked
+/// from this one, as a Plan, and write its summary as Runner does. Every
+/// worker ticks a Population of its own agents and its ghosts, whose actions
+/// it is sent each day: each worker sends the coordinator, this process, the
+/// actions that changed of the agents that others have as ghosts, and the
+/// coordinator sends each worker those of its ghosts. The workers then send
+/// their activations and actions, and the coordinator merges them into the
+/// summary of every day. The random numbers are drawn for the index of every
+/// agent in the Configuration, and a GraphFormat::COMPRESSED graph quantises
+/// the weights of every worker between the least and greatest of the Plan, so
+/// the result is the same as one process, except that
+/// Aggregation::INCREMENTAL sums the actions of friends in another order,
+/// which can round differently.
+/// With StreamedAgents this process holds only their index, the Plan and the
+/// summaries, and every worker loads only its own agents and ghosts. With
+/// Agents, they are loaded by this process, and the workers share their pages
+/// until they are written to. A worker keeps its days in a History rather
+/// than in the Agents, but the pages of its own agents and ghosts are still
+/// copied as their reference counts are written, so the workers together
+/// hold about one more copy of the Agents than this process does.
+/// \param configuration The configuration, with Parallelism::n_threads
+/// threads per worker, of which 0 divides the CPUs between the workers.
+/// \param n_processes The number of workers.
+/// \throws std::invalid_argument If the Configuration asks for the full
+/// output, which is not merged.
+/// \throws std::system_error If a worker or socket could not be made.
+/// \throws std::runtime_error If a worker failed.
+void run(const Configuration &configuration, std::size_t n_processes);
+
+template <class T> void Channel::send(const std::span<const T> values) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  const std::uint64_t size = values.size();
+  write_all(&size, sizeof(size));
+  write_all(values.data(), values.size_bytes());
+}
+
+template <class T> std::vector<T> Channel::receive() {
+  static_assert(std::is_trivially_copyable_v<T>);
+  std::uint64_t size;
+  read_all(&size, sizeof(size));
+  std::vector<T> values(size);
+  read_all(values.data(), size * sizeof(T));
+  return values;
+}
+} // namespace contagent::cluster
+
+#endif // CONTAGENT_CLUSTER_H
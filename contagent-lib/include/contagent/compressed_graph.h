@@ -0,0 +1,175 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_COMPRESSED_GRAPH_H
+#define CONTAGENT_COMPRESSED_GRAPH_H
+
+#include "numa.h"
+#include "partitions.h"
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <utility>
+
+namespace contagent {
+
+/// The friendships of a Population in a few bytes each, for networks that do
+/// not fit in memory as compressed sparse rows. The friends of every agent
+/// are sorted and delta-encoded, and the weights are dropped if they are all
+/// the same, or else quantised to 16 bits between the least and the greatest
+/// weight. Decoding is fused into ::count_actions, which replaces the CSR
+/// loop of a tick.
+///
+/// The quantised weights are multiples of a power of two, so their sums in
+/// double precision are exact while they are less than 2^53 steps, and do not
+/// depend on the order of the friends.
+/// The processes of a cluster number the agents differently, and so sort
+/// their friends into another order than one process does.
+///
+/// The row of an agent with friends is the number of friends and the zigzag
+/// difference between the first friend and the agent as varints, then the
+/// width in bits of the largest difference between consecutive friends as a
+/// byte, then those differences bit-packed at that width, and then the
+/// quantised weights. Fixed-width differences can be unpacked independently
+/// of each other, which is faster than a chain of varints.
+class CompressedGraph {
+public:
+  /// Compress a graph, with each partition placing the rows of its agents.
+  /// \param offsets The friends of agent i are from offsets[i] up to
+  /// offsets[i + 1], N + 1.
+  /// \param friends The friends, indexed by offsets.
+  /// \param weights The weight of every friendship.
+  /// \param partitions The partitions of the agents.
+  /// \param weight_range The least and greatest weight to quantise between,
+  /// which must contain the weights, or empty for those of the weights.
+  CompressedGraph(
+      std::span<const std::size_t> offsets,
+      std::span<const std::uint32_t> friends, std::span<const double_t> weights,
+      Partitions &partitions,
+      std::optional<std::pair<double_t, double_t>> weight_range = {});
+
+  /// Sum the weights of the friends of an agent by the behaviour they
+  /// performed most recently.
+  /// \param agent The index of the agent.
+  /// \param actions The action of every agent, N.
+  /// \param counts The sums, K, which are added to.
+  /// \return The number of friends.
+  std::size_t count_actions(std::size_t agent, const std::uint32_t *actions,
+                            double_t *counts) const noexcept;
+
+  /// Round a weight as it is stored.
+  /// \param weight A weight of one of the friendships.
+  /// \return The weight that ::count_actions adds for it.
+  [[nodiscard]] double_t quantise(double_t weight) const noexcept;
+
+  /// Get the number of bytes used, including the row offsets.
+  /// \return The number of bytes.
+  [[nodiscard]] std::size_t size_bytes() const noexcept;
+
+  /// Whether every friendship has the same weight, which is then not stored.
+  [[nodiscard]] bool has_uniform_weights() const noexcept;
+
+private:
+  static constexpr std::size_t PADDING = sizeof(std::uint64_t);
+
+  static std::uint64_t read_varint(const std::uint8_t *&p) noexcept;
+
+  [[nodiscard]] std::uint16_t quantum(double_t weight) const noexcept;
+
+  /// The row of agent i is bytes_[offsets_[i]] up to bytes_[offsets_[i + 1]],
+  /// and there are PADDING more bytes after the last row.
+  numa::vector<std::uint64_t> offsets_;
+  numa::vector<std::uint8_t> bytes_;
+
+  bool uniform_;
+  /// A weight is min_weight_ + q × weight_step_, for a quantised q, or
+  /// min_weight_ if the weights are uniform. The step is a power of two, and
+  /// the least weight a multiple of it.
+  double_t min_weight_;
+  double_t weight_step_;
+};
+
+inline std::uint64_t
+CompressedGraph::read_varint(const std::uint8_t *&p) noexcept {
+  std::uint64_t value = *p & 0x7f;
+  for (unsigned shift = 7; *p++ & 0x80; shift += 7) {
+    value |= static_cast<std::uint64_t>(*p & 0x7f) << shift;
+  }
+  return value;
+}
+
+inline std::size_t
+CompressedGraph::count_actions(const std::size_t agent,
+                               const std::uint32_t *actions,
+                               double_t *counts) const noexcept {
+  static_assert(std::endian::native == std::endian::little,
+                "The packed differences are read as little-endian words");
+
+  const std::uint8_t *p = bytes_.data() + offsets_[agent];
+  if (p == bytes_.data() + offsets_[agent + 1]) {
+    return 0;
+  }
+
+  const std::uint64_t n_friends = read_varint(p);
+  const std::uint64_t first = read_varint(p);
+  const unsigned width = *p++;
+  const std::uint8_t *const packed = p;
+  const std::uint8_t *const weights =
+      packed + ((n_friends - 1) * width + 7) / 8;
+  const std::uint64_t mask = (std::uint64_t{1} << width) - 1;
+
+  const auto weight = [&](const std::size_t j) {
+    if (uniform_) {
+      return min_weight_;
+    }
+    std::uint16_t q;
+    std::memcpy(&q, weights + 2 * j, sizeof(q));
+    return min_weight_ + weight_step_ * q;
+  };
+
+  std::uint64_t id = agent + ((first >> 1) ^ (~(first & 1) + 1));
+  counts[actions[id]] += weight(0);
+
+  for (std::size_t j = 1; j < n_friends; ++j) {
+    // The words may run past the row, into the padding at the end.
+    const std::size_t bit = (j - 1) * width;
+    std::uint64_t word;
+    std::memcpy(&word, packed + bit / 8, sizeof(word));
+    id += (word >> bit % 8) & mask;
+    counts[actions[id]] += weight(j);
+  }
+
+  return n_friends;
+}
+
+} // namespace contagent
+
+#endif // CONTAGENT_COMPRESSED_GRAPH_H
@@ -30,20 +30,227 @@
 #define CONTAGENT_CONFIGURATION_H
 
 #include "agent.h"
+#include "agent_table.h"
 #include "json/zstd.h"
 #include "behaviour.h"
 #include "belief.h"
+#include <boost/uuid/uuid.hpp>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
 #include <vector>
 namespace contagent {
 
+/// The floating-point type that the state and tables of a DensePopulation are
+/// stored and computed in.
+enum class Precision { FLOAT64, FLOAT32 };
+
+/// How the agents of a Population are numbered, see reorder::order.
+enum class Ordering {
+  /// The order of the Configuration.
+  INPUT,
+  /// Reverse Cuthill–McKee.
+  RCM,
+  /// Breadth-first search.
+  BFS,
+  /// Descending number of friendships.
+  DEGREE
+};
+
+/// How the friendships of a Population are stored.
+enum class GraphFormat {
+  /// Compressed sparse rows, with 12 bytes for every friendship.
+  CSR,
+  /// A CompressedGraph, with a few bytes for every friendship and the weights
+  /// quantised to 16 bits.
+  COMPRESSED
+};
+
+/// How a Population sums the actions of the friends of every agent.
+enum class Aggregation {
+  /// Every agent reads the actions of all its friends every day.
+  PULL,
+  /// Every agent keeps the sums, and an agent that changes behaviour updates
+  /// the sums of its followers.
+  INCREMENTAL
+};
+
+/// How the threads of a Population wait for each other, see Partitions.
+enum class Scheduling {
+  /// Every thread finishes a step of a tick before any starts the next.
+  BARRIER,
+  /// A thread starts perceiving a day once the threads whose agents its
+  /// agents are friends with have chosen their actions of the day before, so
+  /// threads can be on different days, see Population::flow.
+  DATAFLOW
+};
+
+/// How the steps of a tick are divided between threads, see Partitions.
+struct Parallelism {
+  /// The number of threads, 0 uses one per CPU.
+  std::size_t n_threads = 1;
+  /// Whether every thread is pinned to a CPU, so that the agents it owns stay
+  /// on the NUMA node they were placed on.
+  bool pin_threads = false;
+  /// How the threads wait for each other between steps.
+  Scheduling scheduling = Scheduling::BARRIER;
+};
+
+/// The agents of a Configuration that one process of a cluster owns, see
+/// cluster::run.
+struct Ownership {
+  /// The agents from this index on are ghosts, which are copies of the
+  /// friends of the owned agents that other processes own. Their friendships
+  /// are not loaded, they do not select actions, and their actions are set
+  /// with Population::set_actions.
+  std::size_t n_owned = std::numeric_limits<std::size_t>::max();
+  /// The index of every agent in the whole population, which its random
+  /// numbers are drawn for, or empty if that is its index in the
+  /// Configuration.
+  std::vector<std::uint32_t> ids;
+  /// The least and greatest weight of the friendships of the whole
+  /// population, which a GraphFormat::COMPRESSED graph quantises between so
+  /// that it rounds them as one process would, or empty for those of the
+  /// Configuration.
+  std::optional<std::pair<double_t, double_t>> weight_range;
+};
+
+/// Where the state and history of a Population are kept, see History.
+struct Storage {
+  /// The number of bytes of memory that the process may keep resident, or 0
+  /// for no limit. If this is not 0, the per-agent arrays of a Population and
+  /// the history are kept in memory-mapped files, and whenever the resident
+  /// memory of the process is over the budget after a day, or after a
+  /// partition of a day with Scheduling::DATAFLOW, the pages of the arrays
+  /// are dropped, so that the next day streams them back from the files. The
+  /// most recent actions and the tables of the archetypes always stay in RAM,
+  /// so with StreamedAgents this bounds the memory of the process to those
+  /// and a partition of the arrays. The Agents of a Configuration that has
+  /// them stay resident, so they are not within the budget.
+  std::size_t memory_budget = 0;
+  /// The directory that the files are made in, or empty for the temporary
+  /// directory.
+  std::filesystem::path directory;
+};
+
+/// How the output is encoded as JSON.
+enum class OutputSchema {
+  /// Every belief, behaviour and agent is keyed by its UUID, as
+  /// json::SummarySpec and json::AgentSpec.
+  KEYED,
+  /// A json::Dictionary of the beliefs, behaviours and agents is written
+  /// once, and the days are arrays in its order, as json::CompactSummarySpec.
+  COMPACT
+};
+
+/// A ring buffer in shared memory that the days are published to as well as
+/// written, for a process on the same machine to read as they are ticked, see
+/// shm::Publisher.
+struct RingOutput {
+  /// The name of the shared memory object, such as "/contagent", or empty
+  /// for none.
+  std::string name;
+  /// The number of bytes of records, which must hold the largest day.
+  std::size_t capacity = std::size_t{64} << 20;
+  /// Whether to publish the activations and actions of the selected agents
+  /// as well as the summary.
+  bool state = false;
+  /// Whether to wait for the readers that fall behind rather than overwrite
+  /// the days that they have not read.
+  bool wait_for_readers = false;
+};
+
+/// How the summary of every day is written while the next is ticked, see
+/// SummaryWriter.
+struct OutputPipeline {
+  /// The number of days that may be waiting to be written before ticking
+  /// waits for the writer, or 0 to write the summary after the last day.
+  std::size_t max_pending = 2;
+  /// The number of threads that summarise and encode the days.
+  std::size_t n_threads = 1;
+  /// Whether to write a replay::ChangeLog, the initial state, the seed and the
+  /// changes of action, in place of the summary.
+  bool change_log = false;
+  /// How the summary or the full output is encoded.
+  OutputSchema schema = OutputSchema::KEYED;
+  /// The ring that every day is published to as well, if it has a name.
+  RingOutput ring;
+};
+
+/// Which agents, beliefs, behaviours and days are written as the output, see
+/// selection. The summary is of the agents selected, and the full output has
+/// only them, with null in place of their actions on the days or of the
+/// behaviours that are not selected. Every list is of indices in the
+/// Configuration, in ascending order, and an empty list selects all of them.
+struct OutputSelection {
+  std::vector<std::uint32_t> agents;
+  std::vector<std::uint32_t> beliefs;
+  std::vector<std::uint32_t> behaviours;
+  /// Only every this many days from the start time are written.
+  std::size_t day_stride = 1;
+};
+
+/// The Agents of a Configuration that are shared with other Configurations,
+/// see sweep::Sweep. Shared Agents are never written to, so the days are kept
+/// in a History, and their activations and Archetypes stay keyed by the
+/// beliefs that they were loaded with.
+struct SharedAgents {
+  /// The beliefs that the Agents are keyed by, in the order of
+  /// Configuration::get_beliefs, or empty if the Agents are not shared.
+  std::vector<std::shared_ptr<Belief>> beliefs;
+  /// The factor that the delta of every belief is scaled by, in the same
+  /// order, or empty to scale none.
+  std::vector<double_t> delta_multipliers;
+};
+
+/// The agents of a Configuration that has no Agents, which a Population loads
+/// straight into its AgentTable, so that they are never all held in memory
+/// at once.
+struct StreamedAgents {
+  /// The UUIDs of the agents, or nullptr if the Configuration has Agents.
+  std::shared_ptr<const AgentIndex> index;
+  /// Load some of the agents of the index into an AgentTable, see
+  /// json::AgentLoader::tabulate, with the arguments:
+  /// - the position in the index of every agent of the table, in its order,
+  ///   or empty for all of them in the order of the index;
+  /// - the number of agents of the table that are not ghosts, see Ownership,
+  ///   as the friendships of the ghosts are not loaded;
+  /// - the beliefs and behaviours that they are numbered by;
+  /// - the day whose activations and actions are loaded.
+  std::function<AgentTable(std::span<const std::uint32_t>, std::size_t,
+                           const std::vector<std::shared_ptr<Belief>> &,
+                           const std::vector<std::shared_ptr<Behaviour>> &,
+                           std::size_t)>
+      tabulate;
+  /// Load the friendships of all of the agents of the index, see
+  /// json::AgentLoader::graph, which cluster::plan divides them by.
+  std::function<AgentGraph()> graph;
+};
+
 class Configuration {
 public:
   Configuration(const std::vector<std::shared_ptr<Behaviour>> &behaviours,
                 const std::vector<std::shared_ptr<Belief>> &beliefs,
                 const std::vector<std::shared_ptr<Agent>> &agents,
                 uint_fast32_t start_time, uint_fast32_t end_time,
-                std::unique_ptr<std::ostream> output_stream, bool full_output);
+                std::unique_ptr<std::ostream> output_stream, bool full_output,
+                std::uint64_t seed, Precision precision = Precision::FLOAT64,
+                Parallelism parallelism = {},
+                Ordering ordering = Ordering::INPUT,
+                GraphFormat graph_format = GraphFormat::CSR,
+                Aggregation aggregation = Aggregation::PULL,
+                Ownership ownership = {}, Storage storage = {},
+                OutputPipeline output_pipeline = {},
+                OutputSelection output_selection = {},
+                SharedAgents shared_agents = {},
+                StreamedAgents streamed_agents = {});
 
   [[nodiscard]] const std::vector<std::shared_ptr<Behaviour>> &
   get_behaviours() const;
@@ -53,6 +260,28 @@ public:
   [[nodiscard]] uint_fast32_t get_end_time() const;
   [[nodiscard]] const std::unique_ptr<std::ostream> &get_output_stream() const;
   [[nodiscard]] bool get_full_output() const;
+  [[nodiscard]] std::uint64_t get_seed() const;
+  [[nodiscard]] Precision get_precision() const;
+  [[nodiscard]] const Parallelism &get_parallelism() const;
+  [[nodiscard]] Ordering get_ordering() const;
+  [[nodiscard]] GraphFormat get_graph_format() const;
+  [[nodiscard]] Aggregation get_aggregation() const;
+  [[nodiscard]] const Ownership &get_ownership() const;
+  [[nodiscard]] const Storage &get_storage() const;
+  [[nodiscard]] const OutputPipeline &get_output_pipeline() const;
+  [[nodiscard]] const OutputSelection &get_output_selection() const;
+  [[nodiscard]] const SharedAgents &get_shared_agents() const;
+  [[nodiscard]] const StreamedAgents &get_streamed_agents() const;
+
+  /// Get the number of agents, which are the Agents, or else those of the
+  /// Ownership::ids, or else those of the StreamedAgents.
+  /// \return The number of agents.
+  [[nodiscard]] std::size_t get_n_agents() const;
+
+  /// Get the UUID of an agent, from its Agent or from the StreamedAgents.
+  /// \param agent The index of the agent.
+  /// \return The UUID.
+  [[nodiscard]] boost::uuids::uuid get_agent_uuid(std::size_t agent) const;
 
 private:
   const std::vector<std::shared_ptr<Behaviour>> behaviours_;
@@ -62,6 +291,18 @@ private:
   const uint_fast32_t end_time_;
   const std::unique_ptr<std::ostream> output_stream_;
   const bool full_output_;
+  const std::uint64_t seed_;
+  const Precision precision_;
+  const Parallelism parallelism_;
+  const Ordering ordering_;
+  const GraphFormat graph_format_;
+  const Aggregation aggregation_;
+  const Ownership ownership_;
+  const Storage storage_;
+  const OutputPipeline output_pipeline_;
+  const OutputSelection output_selection_;
+  const SharedAgents shared_agents_;
+  const StreamedAgents streamed_agents_;
 };
 
 } // namespace contagent
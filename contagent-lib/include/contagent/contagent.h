@@ -30,13 +30,38 @@
 #define CONTAGENT_CONTAGENT_H
 
 #include "agent.h"
+#include "agent_history.h"
+#include "agent_table.h"
+#include "archetype.h"
+#include "async_file.h"
 #include "behaviour.h"
 #include "belief.h"
+#include "cluster.h"
+#include "compressed_graph.h"
 #include "configuration.h"
+#include "dense_population.h"
+#include "history.h"
+#include "linalg.h"
 #include "named.h"
+#include "numa.h"
+#include "partitions.h"
+#include "population.h"
+#include "random.h"
+#include "reorder.h"
+#include "replay.h"
 #include "runner.h"
+#include "sampler.h"
+#include "selection.h"
+#include "shm_ring.h"
+#include "sparse_population.h"
+#include "spsc_queue.h"
 #include "summary.h"
+#include "summary_writer.h"
+#include "sweep.h"
+#include "thread_pool.h"
+#include "tick_kernel.h"
 #include "uuidd.h"
+#include "validation.h"
 #include "json/json.h"
 
 #endif // CONTAGENT_CONTAGENT_H
@@ -0,0 +1,188 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_DENSE_POPULATION_H
+#define CONTAGENT_DENSE_POPULATION_H
+
+#include "population.h"
+#include "tick_kernel.h"
+
+namespace contagent {
+
+/// A Population that stores every activation, N×B, and the perceptions and
+/// performance relationships as row-major matrices. When there is a TickKernel
+/// for the number of beliefs and behaviours, it is used to tick, and
+/// otherwise agents that share an Archetype are scored together as one matrix
+/// product. Every step is run on the Partitions in parallel.
+/// \tparam Real The floating-point type that the activations, the friend
+/// weights and the tables are stored and computed in, double_t or float. The
+/// scores are always double_t.
+template <class Real> class BasicDensePopulation final : public Population {
+public:
+  /// Create a new BasicDensePopulation. Activations and performance
+  /// relationships that an agent does not have are taken to be zero.
+  /// \param configuration The configuration, which must outlive this.
+  /// \param agents The table of the agents, see Population::tabulate, whose
+  /// activations are loaded as the current state.
+  /// \throws std::out_of_range If an agent is missing a delta.
+  BasicDensePopulation(const Configuration &configuration,
+                       const AgentTable &agents);
+
+  /// Get the current activations of an agent, ordered as
+  /// Configuration::get_beliefs.
+  /// \param agent The index of the agent.
+  /// \return The activations.
+  [[nodiscard]] std::span<const Real>
+  get_activations(std::size_t agent) const noexcept;
+
+  [[nodiscard]] double_t
+  get_activation(std::size_t agent, std::size_t belief) const noexcept final;
+
+  [[nodiscard]] Engine get_engine() const noexcept final;
+
+  /// Without a TickKernel, each partition computes the contexts of its agents
+  /// first, as ::contextualize does. If no action has changed since the last
+  /// call, the pressures of that call are reused rather than recomputed from
+  /// the friendships, and the agents whose activations did not change on the
+  /// last call keep them without being perceived or scored again.
+  void perceive(std::size_t day) final;
+
+  /// Compute Agent::contextualize for every agent and belief from the
+  /// previous activations, which scales every column of the N×B activation
+  /// matrix by the mean relationship of its belief.
+  void contextualize();
+
+  /// Without a TickKernel, agents that share an Archetype are scored together
+  /// as one matrix product, and the agents with a unique Archetype are scored
+  /// one at a time. If the performance relationships are sparse, each agent
+  /// is instead scored from the non-zero ones of its non-zero activations, so
+  /// only the behaviours that its beliefs touch are scored.
+  void score() final;
+
+  /// Get the TickKernel that is used to tick.
+  /// \return The TickKernel, or nullptr if the generic steps are used.
+  [[nodiscard]] const TickKernels<Real> *get_tick_kernels() const noexcept;
+
+  void store_activations(std::size_t day) const final;
+
+  /// With ::is_dataflow, each partition ticks its own agents, and the
+  /// current activations of a partition are copied into those of the day
+  /// before, rather than swapped, as the partitions can be on different days.
+  /// The pressures are always computed from the friendships, and the
+  /// Population does not settle.
+  void flow(std::size_t start, std::size_t end, std::uint64_t seed) final;
+
+  /// Without a TickKernel, the performance relationships are scored from
+  /// their non-zero entries when at most this fraction of them are non-zero.
+  static constexpr double_t MAX_SPARSE_PR_DENSITY = 0.25;
+
+private:
+  /// Groups of this size or smaller are scored one agent at a time.
+  static constexpr std::size_t MIN_GROUP_SIZE = 4;
+
+  /// The tables that are only read by a tick. Every NUMA node that has a
+  /// partition has its own copy, placed by the first partition on the node.
+  struct Tables {
+    /// Belief::perceptions_, B×K.
+    numa::vector<Real> perceptions;
+    /// Population::mean_relationships_, B.
+    numa::vector<Real> mean_relationships;
+    /// Population::deltas_, A×B.
+    numa::vector<Real> deltas;
+    /// The performance relationships of every archetype, A×B×K.
+    numa::vector<Real> performance_relationships;
+    /// If ::sparse_prs_, the non-zero performance relationships in
+    /// compressed sparse row form, with the row of belief b of archetype a at
+    /// a×B + b, and otherwise empty.
+    numa::vector<std::size_t> pr_offsets;
+    numa::vector<std::uint32_t> pr_behaviours;
+    numa::vector<Real> pr_values;
+  };
+
+  [[nodiscard]] TickState<Real> tick_state(std::size_t partition) noexcept;
+
+  [[nodiscard]] std::size_t state_bytes() const noexcept final;
+  void release_range(std::size_t begin, std::size_t end) const final;
+
+  /// The steps of a tick for a range of agents, on the calling thread, which
+  /// choose between the TickKernel and the generic steps.
+  void perceive_range(std::size_t partition, std::size_t begin,
+                      std::size_t end);
+  void score_range(std::size_t partition, std::size_t begin, std::size_t end);
+
+  /// ::store_activations for a range of agents.
+  void store_activations(std::size_t day, std::size_t begin,
+                         std::size_t end) const;
+
+  /// The steps of a tick without a TickKernel, for the agents of a
+  /// partition.
+  void contextualize_partition(std::size_t partition, std::size_t begin,
+                               std::size_t end);
+  void perceive_partition(std::size_t partition, std::size_t begin,
+                          std::size_t end);
+  void score_partition(std::size_t partition, std::size_t begin,
+                       std::size_t end);
+  void score_sparse_partition(std::size_t partition, std::size_t begin,
+                              std::size_t end);
+
+  /// The kernel for the number of beliefs and behaviours, or nullptr.
+  const TickKernels<Real> *tick_kernels_;
+
+  /// The tables of every node, indexed by Partitions::node.
+  std::vector<Tables> tables_;
+  /// Whether the performance relationships are scored from Tables::pr_values.
+  bool sparse_prs_;
+
+  /// Population::friend_weights_ as Real. When Real is double_t this points
+  /// into the Population, and otherwise into the converted copy.
+  numa::vector<Real> converted_friend_weights_;
+  const Real *real_friend_weights_;
+
+  /// The current activations, N×B.
+  numa::vector<Real> activations_;
+  /// The activations of the day before, N×B.
+  numa::vector<Real> previous_activations_;
+  /// The contexts computed from ::previous_activations_, N×B.
+  numa::vector<Real> contexts_;
+  /// The pressure of the friends of every agent on every belief, N×B, from
+  /// the last ::perceive.
+  numa::vector<Real> pressures_;
+};
+
+/// A BasicDensePopulation in double precision.
+using DensePopulation = BasicDensePopulation<double_t>;
+/// A BasicDensePopulation in single precision, which halves the memory that
+/// is read and written in a tick.
+using DensePopulation32 = BasicDensePopulation<float>;
+
+extern template class BasicDensePopulation<double_t>;
+extern template class BasicDensePopulation<float>;
+
+} // namespace contagent
+
+#endif // CONTAGENT_DENSE_POPULATION_H
@@ -0,0 +1,103 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_HISTORY_H
+#define CONTAGENT_HISTORY_H
+
+#include "numa.h"
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace contagent {
+
+/// The activations and actions of every agent on every day of a simulation,
+/// kept in memory-mapped files rather than in the Agents, which is where a
+/// Population with a Storage::memory_budget stores them. Every day is an
+/// N×B matrix of activations and a vector of N actions, with the rows in the
+/// order of the Population, so that each partition writes a contiguous range
+/// and then releases it. The files are sparse, so the days that are not
+/// written take no space.
+class History {
+public:
+  /// Create a new History, whose activations and actions are all zero.
+  /// \param agents The index in the Configuration of the agent of every row.
+  /// \param n_beliefs The number of beliefs.
+  /// \param n_days The number of days, the last is n_days - 1.
+  /// \param directory The directory to make the files in.
+  /// \throws std::system_error If the files could not be made.
+  History(std::vector<std::uint32_t> agents, std::size_t n_beliefs,
+          std::size_t n_days, const std::filesystem::path &directory);
+
+  [[nodiscard]] std::size_t n_agents() const noexcept;
+  [[nodiscard]] std::size_t n_beliefs() const noexcept;
+  [[nodiscard]] std::size_t n_days() const noexcept;
+
+  /// Get the index in the Configuration of the agent of every row.
+  /// \return The indices, N.
+  [[nodiscard]] std::span<const std::uint32_t> get_agents() const noexcept;
+
+  /// Get the activations of a day, ordered by row and then as
+  /// Configuration::get_beliefs.
+  /// \param day The day.
+  /// \return The activations, N×B.
+  [[nodiscard]] std::span<double_t> activations(std::size_t day) noexcept;
+  [[nodiscard]] std::span<const double_t>
+  activations(std::size_t day) const noexcept;
+
+  /// Get the actions of a day, as indices of Configuration::get_behaviours.
+  /// \param day The day.
+  /// \return The actions, N.
+  [[nodiscard]] std::span<std::uint32_t> actions(std::size_t day) noexcept;
+  [[nodiscard]] std::span<const std::uint32_t>
+  actions(std::size_t day) const noexcept;
+
+  /// Let the kernel drop the pages of a range of rows of a day, once they
+  /// have been written or read, see numa::release.
+  /// \param day The day.
+  /// \param begin The first row.
+  /// \param end One past the last row.
+  void release(std::size_t day, std::size_t begin,
+               std::size_t end) const noexcept;
+
+private:
+  const std::vector<std::uint32_t> agents_;
+  const std::size_t n_beliefs_;
+  const std::size_t n_days_;
+
+  /// The activations of every day, D×N×B.
+  numa::vector<double_t> activations_;
+  /// The actions of every day, D×N.
+  numa::vector<std::uint32_t> actions_;
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_HISTORY_H
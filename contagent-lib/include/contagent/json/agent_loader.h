@@ -0,0 +1,155 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_AGENT_LOADER_H
+#define CONTAGENT_AGENT_LOADER_H
+
+#include "contagent/agent.h"
+#include "contagent/agent_table.h"
+#include "contagent/behaviour.h"
+#include "contagent/belief.h"
+#include <boost/uuid/uuid.hpp>
+#include <cmath>
+#include <istream>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace contagent::json {
+/// Loads the agents of a JSON array of AgentSpecs, as
+/// AgentSpec::to_unlinked_agent and AgentSpec::link_agents do, in a pipeline
+/// of stages that run at the same time on their own threads and hand batches
+/// to each other through SpscQueues: decompression reads the stream, which
+/// is where it is decompressed, tokenisation cuts it into the agents and
+/// parses them, construction makes the unlinked Agents, and edge collection
+/// indexes them and collects their friendships, which are linked once the
+/// last agent has been collected. ::index, ::graph and ::tabulate run the
+/// same stages, but never make Agents, so that a population that does not fit
+/// in memory as Agents can be simulated from its StreamedAgents.
+class AgentLoader {
+public:
+  /// How much a stage did, and how long it took.
+  struct Stage {
+    /// The name of the stage.
+    std::string name;
+    /// What ::amount counts.
+    std::string unit;
+    /// The amount that the stage processed.
+    std::size_t amount = 0;
+    /// The time that the stage was working, in seconds.
+    double_t busy = 0.0;
+    /// The time that the stage waited for the stages either side of it, in
+    /// seconds.
+    double_t waiting = 0.0;
+  };
+
+  /// Create a new AgentLoader.
+  /// \param behaviours The behaviours, by UUID, which must outlive this.
+  /// \param beliefs The beliefs, by UUID, which must outlive this.
+  /// \param n_days The number of days of the simulation.
+  AgentLoader(
+      const std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>>
+          &behaviours,
+      const std::map<boost::uuids::uuid, std::shared_ptr<Belief>> &beliefs,
+      uint_fast32_t n_days);
+
+  /// Load the agents.
+  /// \param is The stream of the JSON array.
+  /// \return The agents, in the order of the array.
+  /// \throws std::runtime_error If the stream could not be read, or is not
+  /// an array of objects.
+  /// \throws std::out_of_range If an agent has a friend, behaviour or belief
+  /// that does not exist.
+  /// \throws Whatever parsing an AgentSpec threw.
+  [[nodiscard]] std::vector<std::shared_ptr<Agent>> load(std::istream &is);
+
+  /// Read the UUIDs of the agents, skipping the rest of them.
+  /// \param is The stream of the JSON array.
+  /// \return The index.
+  /// \throws std::runtime_error If the stream could not be read, or is not
+  /// an array of objects.
+  /// \throws Whatever parsing a UUID threw.
+  [[nodiscard]] AgentIndex index(std::istream &is);
+
+  /// Read the friendships of the agents of an index, skipping the rest of
+  /// them.
+  /// \param is The stream of the JSON array that was indexed.
+  /// \param index The index of the stream, see ::index.
+  /// \return The friendships.
+  /// \throws std::runtime_error If the stream could not be read, is not an
+  /// array of objects, or does not have the agents of the index.
+  /// \throws std::out_of_range If an agent has a friend that is not in the
+  /// index.
+  /// \throws Whatever parsing a UUID threw.
+  [[nodiscard]] AgentGraph graph(std::istream &is, const AgentIndex &index);
+
+  /// Load some of the agents straight into an AgentTable, as ::load and
+  /// Population::tabulate would, without making Agents. The agents that are
+  /// not in the table are cut out of the stream but not parsed, and only the
+  /// activations and actions of the day are read.
+  /// \param is The stream of the JSON array that was indexed.
+  /// \param index The index of the stream, see ::index.
+  /// \param rows The position in the index of every agent of the table, in
+  /// its order, or empty for all of them in the order of the index.
+  /// \param n_owned The number of agents of the table that are not ghosts,
+  /// see Ownership, whose friends must all be in the table. The friendships
+  /// of the ghosts are not loaded.
+  /// \param beliefs The beliefs that the activations are numbered by.
+  /// \param behaviours The behaviours that the actions are numbered by.
+  /// \param day The day whose activations and actions are loaded.
+  /// \return The table.
+  /// \throws std::runtime_error If the stream could not be read, is not an
+  /// array of objects, or does not have the agents of the index.
+  /// \throws std::out_of_range If an agent has no activations on the day, or
+  /// has a friend that is not in the table, or a behaviour or belief that
+  /// does not exist.
+  /// \throws Whatever parsing an AgentSpec threw.
+  [[nodiscard]] AgentTable
+  tabulate(std::istream &is, const AgentIndex &index,
+           std::span<const std::uint32_t> rows, std::size_t n_owned,
+           const std::vector<std::shared_ptr<Belief>> &beliefs,
+           const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+           std::size_t day);
+
+  /// Get what each stage of the last ::load, ::index, ::graph or ::tabulate
+  /// did, in the order of the pipeline. The stage that waited least is the
+  /// one that held the others back.
+  /// \return The stages.
+  [[nodiscard]] const std::vector<Stage> &get_stages() const noexcept;
+
+private:
+  const std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>> &behaviours_;
+  const std::map<boost::uuids::uuid, std::shared_ptr<Belief>> &beliefs_;
+  const uint_fast32_t n_days_;
+  std::vector<Stage> stages_;
+};
+} // namespace contagent::json
+
+#endif // CONTAGENT_AGENT_LOADER_H
@@ -55,6 +55,18 @@ public:
       const std::map<boost::uuids::uuid, std::shared_ptr<Belief>> &beliefs)
       const;
 
+  /// Intern the Archetype of the deltas and performance relationships, which
+  /// is the Archetype of the Agent that ::to_unlinked_agent makes.
+  /// \param behaviours The behaviours, by UUID.
+  /// \param beliefs The beliefs, by UUID.
+  /// \return A reference to the Archetype.
+  /// \throws std::out_of_range If a behaviour or belief does not exist.
+  [[nodiscard]] ArchetypeTable::Reference to_archetype(
+      const std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>>
+          &behaviours,
+      const std::map<boost::uuids::uuid, std::shared_ptr<Belief>> &beliefs)
+      const;
+
   void link_agents(
       const std::map<boost::uuids::uuid, std::shared_ptr<Agent>> &agents) const;
 };
@@ -0,0 +1,133 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef CONTAGENT_JSON_COMPACT_SPEC_H
+#define CONTAGENT_JSON_COMPACT_SPEC_H
+
+#include "contagent/configuration.h"
+#include "contagent/summary.h"
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace contagent::json {
+/// The beliefs, behaviours and agents of an OutputSchema::COMPACT output,
+/// which the rest of it refers to by their position in the dictionary rather
+/// than by UUID. Only those of the Configuration::get_output_selection are in
+/// it, and their UUIDs are formatted once, when it is made.
+///
+/// It is written as
+/// `{"version":1,"beliefs":[{"uuid":…,"name":…},…],"behaviours":[…],
+/// "agents":["uuid",…]}`, where the agents are only listed for the full
+/// output, as the summary does not refer to them.
+class Dictionary {
+public:
+  /// Make the dictionary of a Configuration.
+  /// \param configuration The configuration.
+  /// \param with_agents Whether to list the selected agents.
+  Dictionary(const Configuration &configuration, bool with_agents);
+
+  /// Get the beliefs, as indices of Configuration::get_beliefs.
+  /// \return The beliefs, in the order of the dictionary.
+  [[nodiscard]] const std::vector<std::uint32_t> &get_beliefs() const noexcept;
+
+  /// Get the behaviours, as indices of Configuration::get_behaviours.
+  /// \return The behaviours, in the order of the dictionary.
+  [[nodiscard]] const std::vector<std::uint32_t> &
+  get_behaviours() const noexcept;
+
+  /// Get the agents, as indices of Configuration::get_agents.
+  /// \return The agents, in the order of the dictionary, or empty if they are
+  /// not listed.
+  [[nodiscard]] const std::vector<std::uint32_t> &get_agents() const noexcept;
+
+  /// Find the position of a behaviour in the dictionary.
+  /// \param behaviour The behaviour.
+  /// \return The position, or nothing if it is not selected.
+  [[nodiscard]] std::optional<std::uint32_t>
+  find(const Behaviour *behaviour) const;
+
+  /// Get the dictionary encoded as a JSON object.
+  /// \return The JSON.
+  [[nodiscard]] const std::string &get_text() const noexcept;
+
+private:
+  std::vector<std::uint32_t> beliefs_;
+  std::vector<std::uint32_t> behaviours_;
+  std::vector<std::uint32_t> agents_;
+  std::unordered_map<const Behaviour *, std::uint32_t> behaviour_positions_;
+  std::string text_;
+};
+
+/// The summary statistics of a day in an OutputSchema::COMPACT output. The
+/// activations are in the order of the beliefs of the Dictionary and the
+/// performers in the order of its behaviours, with every statistic present.
+class CompactSummarySpec {
+public:
+  CompactSummarySpec() = default;
+  CompactSummarySpec(const Dictionary &dictionary,
+                     const Configuration &configuration,
+                     const contagent::summary::SummaryStats &stats,
+                     std::size_t time);
+
+  /// The day that the statistics are of.
+  std::size_t time = 0;
+  std::vector<double_t> mean_activations;
+  std::vector<double_t> sd_activations;
+  std::vector<double_t> median_activations;
+  std::vector<std::size_t> nonzero_activations;
+  std::vector<std::size_t> n_performers;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(CompactSummarySpec, time, mean_activations,
+                                   sd_activations, median_activations,
+                                   nonzero_activations, n_performers);
+
+/// Write the selected agents of a Configuration as an OutputSchema::COMPACT
+/// full output, which is
+/// `{"dictionary":{…},"times":[…],"actions":[…],"activations":[…]}`.
+/// The times are the selected days, the actions are the position in the
+/// Dictionary of the behaviour of every agent on every one of those days, or
+/// null if it is not selected, and the activations are those of every agent
+/// on every one of those days, in the order of the beliefs of the Dictionary.
+/// Unlike json::AgentSpec, the friends, deltas and performance relationships,
+/// which are inputs, are not written. Every agent is written as soon as its
+/// days are gathered, so the output is never held whole.
+/// \param configuration The configuration, whose Agents have their history.
+/// \param output The stream to write to.
+void write_compact_agents(const Configuration &configuration,
+                          std::ostream &output);
+} // namespace contagent::json
+
+#endif // CONTAGENT_JSON_COMPACT_SPEC_H
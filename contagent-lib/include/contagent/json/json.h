@@ -29,9 +29,12 @@
 #ifndef CONTAGENT_JSON_H
 #define CONTAGENT_JSON_H
 
+#include "agent_loader.h"
 #include "agent_spec.h"
 #include "behaviour_spec.h"
 #include "belief_spec.h"
+#include "compact_spec.h"
+#include "scenario_spec.h"
 #include "summary_spec.h"
 #include "zstd.h"
 
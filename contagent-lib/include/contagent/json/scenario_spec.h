@@ -0,0 +1,66 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_JSON_SCENARIO_SPEC_H
+#define CONTAGENT_JSON_SCENARIO_SPEC_H
+
+#include "contagent/sweep.h"
+#include "nlohmann/json.hpp"
+#include <boost/uuid/uuid.hpp>
+#include <string>
+
+namespace contagent::json {
+/// A Scenario of a sweep manifest, which is a JSON list of these. All keys are
+/// UUIDs of the beliefs and behaviours of the base model, and every field
+/// except name is optional.
+class ScenarioSpec {
+public:
+  ScenarioSpec() = default;
+
+  std::string name;
+  std::unordered_map<std::string, std::unordered_map<std::string, double_t>>
+      relationships;
+  std::unordered_map<std::string, std::unordered_map<std::string, double_t>>
+      perceptions;
+  double_t delta_multiplier = 1.0;
+  std::unordered_map<std::string, double_t> delta_multipliers;
+
+  [[nodiscard]] contagent::sweep::Scenario to_scenario(
+      const std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>>
+          &behaviours,
+      const std::map<boost::uuids::uuid, std::shared_ptr<Belief>> &beliefs)
+      const;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(ScenarioSpec, name,
+                                                relationships, perceptions,
+                                                delta_multiplier,
+                                                delta_multipliers)
+} // namespace contagent::json
+
+#endif // CONTAGENT_JSON_SCENARIO_SPEC_H
@@ -29,20 +29,25 @@
 #ifndef CONTAGENT_JSON_SUMMARY_SPEC_H
 #define CONTAGENT_JSON_SUMMARY_SPEC_H
 
+#include "contagent/configuration.h"
+#include "contagent/json/compact_spec.h"
 #include "contagent/summary.h"
 
 #include <boost/lexical_cast.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <string>
 
 namespace contagent::json {
 class SummarySpec {
 public:
   SummarySpec() = default;
-  explicit SummarySpec(const contagent::summary::SummaryStats &stats);
+  SummarySpec(const contagent::summary::SummaryStats &stats, std::size_t time);
 
+  /// The day that the statistics are of.
+  std::size_t time = 0;
   std::map<std::string, double_t> mean_activations;
   std::map<std::string, double_t> sd_activations;
   std::map<std::string, double_t> median_activations;
@@ -61,9 +66,42 @@ private:
   }
 };
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(SummarySpec, mean_activations,
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(SummarySpec, time, mean_activations,
                                    sd_activations, median_activations,
                                    nonzero_activations, n_performers);
+
+/// Encodes the summaries of the days of a Configuration in its OutputSchema,
+/// as a JSON array of SummarySpec, or as
+/// `{"dictionary":{…},"days":[…]}` of a Dictionary and CompactSummarySpec.
+/// The output is ::begin, then the days encoded by ::encode separated by
+/// commas, then ::end.
+class SummaryEncoder {
+public:
+  /// Make the encoder of a Configuration, and so its Dictionary.
+  /// \param configuration The configuration, which must outlive this.
+  explicit SummaryEncoder(const Configuration &configuration);
+
+  /// Get the text before the first day.
+  /// \return The text.
+  [[nodiscard]] std::string begin() const;
+
+  /// Encode the summary statistics of a day.
+  /// \param stats The statistics.
+  /// \param time The day.
+  /// \return The JSON.
+  [[nodiscard]] std::string
+  encode(const contagent::summary::SummaryStats &stats,
+         std::size_t time) const;
+
+  /// Get the text after the last day.
+  /// \return The text.
+  [[nodiscard]] std::string end() const;
+
+private:
+  const Configuration &configuration_;
+  /// The dictionary, if the schema is OutputSchema::COMPACT.
+  std::optional<Dictionary> dictionary_;
+};
 } // namespace contagent::json
 
 #endif // CONTAGENT_JSON_SUMMARY_SPEC_H
\ No newline at end of file
@@ -35,13 +35,22 @@
 
 #include <boost/iostreams/filter/zstd.hpp>
 
+#include "contagent/async_file.h"
+
 namespace contagent::json {
 
 std::unique_ptr<std::istream> create_zstd_istream(const std::string &filepath);
 
+/// Open a file to write zstd-compressed output to.
+/// \param filepath The path.
+/// \param compression_level The zstd level.
+/// \param file How the file is written. With FileOutput::asynchronous it is
+/// an AsyncFile, whose metrics are logged when the stream is closed.
+/// \return The stream, which finishes the file when it is destroyed.
 std::unique_ptr<std::ostream>
 create_zstd_ostream(const std::string &filepath,
-                    const uint32_t compression_level);
+                    const uint32_t compression_level,
+                    const FileOutput &file = {});
 
 inline std::unique_ptr<std::ostream>
 create_zstd_ostream(const std::string &filepath) {
@@ -0,0 +1,94 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_LINALG_H
+#define CONTAGENT_LINALG_H
+
+#include <cmath>
+#include <cstddef>
+
+namespace contagent::linalg {
+
+/// Compute C = A·B, where A is m×k, B is k×n and C is m×n. All matrices are
+/// row-major with the given leading dimensions. The product is cache-blocked,
+/// and the inner kernel computes a tile of C in vector registers.
+/// \param m The number of rows of A and C.
+/// \param n The number of columns of B and C.
+/// \param k The number of columns of A and rows of B.
+/// \param a The matrix A.
+/// \param lda The distance between the rows of A.
+/// \param b The matrix B.
+/// \param ldb The distance between the rows of B.
+/// \param c The matrix C, which is overwritten.
+/// \param ldc The distance between the rows of C.
+void gemm(std::size_t m, std::size_t n, std::size_t k, const double_t *a,
+          std::size_t lda, const double_t *b, std::size_t ldb, double_t *c,
+          std::size_t ldc) noexcept;
+
+/// ::gemm in single precision, with twice as many elements in each vector
+/// register.
+void gemm(std::size_t m, std::size_t n, std::size_t k, const float *a,
+          std::size_t lda, const float *b, std::size_t ldb, float *c,
+          std::size_t ldc) noexcept;
+
+/// Compute y = xᵀ·B, where x has k elements and B is k×n and row-major.
+/// This is used in place of ::gemm when there is only one row.
+/// \param n The number of columns of B and elements of y.
+/// \param k The number of elements of x and rows of B.
+/// \param x The vector x.
+/// \param b The matrix B.
+/// \param ldb The distance between the rows of B.
+/// \param y The vector y, which is overwritten.
+void gemv(std::size_t n, std::size_t k, const double_t *x, const double_t *b,
+          std::size_t ldb, double_t *y) noexcept;
+
+/// ::gemv in single precision.
+void gemv(std::size_t n, std::size_t k, const float *x, const float *b,
+          std::size_t ldb, float *y) noexcept;
+
+/// Compute C = A·diag(x), scaling every column of A by an element of x, where
+/// A and C are m×n and row-major.
+/// \param m The number of rows of A and C.
+/// \param n The number of columns of A and C, and elements of x.
+/// \param a The matrix A.
+/// \param lda The distance between the rows of A.
+/// \param x The vector x.
+/// \param c The matrix C, which is overwritten.
+/// \param ldc The distance between the rows of C.
+void scale_columns(std::size_t m, std::size_t n, const double_t *a,
+                   std::size_t lda, const double_t *x, double_t *c,
+                   std::size_t ldc) noexcept;
+
+/// ::scale_columns in single precision.
+void scale_columns(std::size_t m, std::size_t n, const float *a,
+                   std::size_t lda, const float *x, float *c,
+                   std::size_t ldc) noexcept;
+
+} // namespace contagent::linalg
+
+#endif // CONTAGENT_LINALG_H
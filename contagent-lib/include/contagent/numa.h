@@ -0,0 +1,165 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_NUMA_H
+#define CONTAGENT_NUMA_H
+
+#include <cstddef>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace contagent::numa {
+
+/// Allocations of at least this many bytes are aligned to, and advised to be
+/// backed by, transparent huge pages.
+constexpr std::size_t HUGE_PAGE_SIZE = std::size_t{2} << 20;
+
+/// The NUMA nodes of the machine and the CPUs of each that this process may
+/// run on.
+struct Topology {
+  /// The CPUs of every node, nodes without any are omitted.
+  std::vector<std::vector<unsigned>> cpus;
+
+  /// Read the topology from /sys/devices/system/node. If that is not
+  /// available, there is one node with std::thread::hardware_concurrency()
+  /// CPUs.
+  /// \return The topology.
+  [[nodiscard]] static Topology detect();
+
+  [[nodiscard]] std::size_t n_nodes() const noexcept;
+};
+
+/// Parse a Linux CPU list, such as "0-3,8,10-11".
+/// \param list The list.
+/// \return The CPUs, in the order they are listed.
+/// \throws std::invalid_argument If the list is malformed.
+[[nodiscard]] std::vector<unsigned> parse_cpu_list(const std::string &list);
+
+/// Pin the calling thread to one CPU, so that the memory it touches first is
+/// placed on the node of that CPU and stays local to it.
+/// \param cpu The CPU.
+/// \throws std::system_error If the thread could not be pinned.
+void pin_current_thread(unsigned cpu);
+
+/// While a FileBacking exists, the allocations of at least HUGE_PAGE_SIZE that
+/// the thread that made it makes with ::allocate are mappings of unlinked
+/// files in a directory rather than anonymous memory. The kernel can then
+/// write their pages back and drop them when memory is short, rather than
+/// swapping, and ::release can drop them explicitly. FileBackings nest, and
+/// the innermost applies.
+class FileBacking {
+public:
+  /// Start backing allocations with files.
+  /// \param directory The directory to make the files in, or empty to
+  /// allocate anonymous memory as usual.
+  explicit FileBacking(std::filesystem::path directory);
+
+  ~FileBacking();
+
+  FileBacking(const FileBacking &) = delete;
+  FileBacking &operator=(const FileBacking &) = delete;
+
+private:
+  std::filesystem::path directory_;
+  const std::filesystem::path *previous_;
+};
+
+/// Allocate memory without touching it, so that each page is placed on the
+/// node of the thread that writes it first. Allocations of at least
+/// HUGE_PAGE_SIZE are aligned to it and advised to use huge pages, or are
+/// backed by a file within a FileBacking.
+/// \param bytes The number of bytes.
+/// \return The memory.
+/// \throws std::bad_alloc If the memory could not be allocated.
+/// \throws std::system_error If the file of a FileBacking could not be made.
+[[nodiscard]] void *allocate(std::size_t bytes);
+
+/// Free memory returned by ::allocate.
+/// \param p The memory.
+/// \param bytes The number of bytes it was allocated with.
+void deallocate(void *p, std::size_t bytes) noexcept;
+
+/// Let the kernel drop the pages of part of an allocation that is backed by a
+/// file, which are read back from the file when they are next touched, so
+/// nothing is lost. The range is widened to whole pages. This does nothing
+/// for memory that is not backed by a file.
+/// \param p The first byte.
+/// \param bytes The number of bytes.
+void release(const void *p, std::size_t bytes) noexcept;
+
+/// Get the number of bytes that are allocated in files, see FileBacking.
+/// \return The number of bytes.
+[[nodiscard]] std::size_t file_backed_bytes() noexcept;
+
+/// Get the number of bytes of memory of the process that are resident, from
+/// /proc/self/statm, which counts the pages of file mappings until ::release
+/// drops them.
+/// \return The number of bytes, or 0 if they could not be read.
+[[nodiscard]] std::size_t resident_bytes() noexcept;
+
+/// An allocator that uses ::allocate, and that default-initialises rather
+/// than value-initialises, so that resizing a vector of a trivial type does
+/// not touch its pages. The elements must then be written by the threads
+/// that will use them.
+/// \tparam T The element type.
+template <class T> struct Allocator {
+  using value_type = T;
+
+  Allocator() noexcept = default;
+  template <class U> Allocator(const Allocator<U> &) noexcept {}
+
+  [[nodiscard]] T *allocate(std::size_t n) {
+    return static_cast<T *>(numa::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) noexcept {
+    numa::deallocate(p, n * sizeof(T));
+  }
+
+  template <class U> void construct(U *p) noexcept {
+    ::new (static_cast<void *>(p)) U;
+  }
+
+  template <class U, class... Args> void construct(U *p, Args &&...args) {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <class U> bool operator==(const Allocator<U> &) const noexcept {
+    return true;
+  }
+};
+
+/// A vector whose pages are placed by first touch.
+template <class T> using vector = std::vector<T, Allocator<T>>;
+
+} // namespace contagent::numa
+
+#endif // CONTAGENT_NUMA_H
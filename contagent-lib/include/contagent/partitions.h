@@ -0,0 +1,259 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_PARTITIONS_H
+#define CONTAGENT_PARTITIONS_H
+
+#include "configuration.h"
+#include "numa.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace contagent {
+
+/// Ranges of work for Partitions::steal. Chunk c is from bounds[c] up to
+/// bounds[c + 1], and the chunks that are queued to partition p are those
+/// from queues[p] up to queues[p + 1].
+struct Chunks {
+  std::vector<std::size_t> bounds;
+  std::vector<std::size_t> queues;
+
+  [[nodiscard]] std::size_t size() const noexcept;
+
+  /// Find the chunk that starts at a bound.
+  /// \param begin The first of the range of the chunk.
+  /// \return The index of the chunk.
+  [[nodiscard]] std::size_t find(std::size_t begin) const noexcept;
+};
+
+/// The agents of a Population divided into contiguous ranges, each of which is
+/// owned by one worker thread for the lifetime of the Population. The threads
+/// are spread evenly over the NUMA nodes, with consecutive partitions on the
+/// same node, so a step run by ::run reads and writes memory that was placed
+/// on its own node when the same thread first touched it.
+///
+/// The range of every partition is also divided into chunks of about the same
+/// number of friendships, which ::steal runs with work stealing, so that a
+/// thread whose agents have few friends helps the threads whose agents have
+/// many. Agents with at least HUB_DEGREE friends are hubs, whose friendships
+/// are too many for one chunk and are left out of its cost, for the
+/// Population to divide between chunks of their own.
+///
+/// ::flow runs a sequence of steps without a barrier between them, where each
+/// partition only waits for the partitions it depends on, so partitions with
+/// few friendships between them can be on different steps at once.
+class Partitions {
+public:
+  /// A step, called with the index of a partition and its range of agents.
+  using Task = std::function<void(std::size_t, std::size_t, std::size_t)>;
+
+  /// A step of ::flow, called with the index of a partition, its range of
+  /// agents, and the index of the step.
+  using FlowTask =
+      std::function<void(std::size_t, std::size_t, std::size_t, std::size_t)>;
+
+  /// For every partition, the other partitions that it waits for.
+  using Dependencies = std::vector<std::vector<std::uint32_t>>;
+
+  /// The time that a thread has spent in steps, since the Partitions were
+  /// made.
+  struct Utilisation {
+    /// Running its tasks, in seconds.
+    double_t busy = 0.0;
+    /// Waiting for the other threads to finish a step, in seconds, including
+    /// waiting on dependencies in ::flow.
+    double_t idle = 0.0;
+  };
+
+  /// An agent with at least this many friends is a hub.
+  static constexpr std::size_t HUB_DEGREE = std::size_t{1} << 14;
+
+  /// ::get_chunks has about this many chunks per partition, so there is
+  /// work left to steal once the threads with the least run out.
+  static constexpr std::size_t CHUNKS_PER_PARTITION = 16;
+
+  /// Chunks cost at least this much, in agents plus friendships, so that
+  /// taking one is cheap next to running it.
+  static constexpr std::size_t MIN_CHUNK_COST = std::size_t{1} << 12;
+
+  /// Divide the agents so that every partition has about the same number of
+  /// agents plus friendships, not counting the friendships of hubs. With one
+  /// thread and no pinning, steps are run by the caller and no thread is
+  /// started.
+  /// \param friend_offsets The friends of agent i are from friend_offsets[i]
+  /// up to friend_offsets[i + 1], N + 1.
+  /// \param parallelism The number of threads and whether they are pinned.
+  /// \param topology The NUMA topology.
+  /// \throws std::system_error If a thread could not be pinned.
+  Partitions(std::span<const std::size_t> friend_offsets,
+             const Parallelism &parallelism,
+             numa::Topology topology = numa::Topology::detect());
+
+  /// Stops and joins the threads.
+  ~Partitions();
+
+  Partitions(const Partitions &) = delete;
+  Partitions &operator=(const Partitions &) = delete;
+
+  [[nodiscard]] std::size_t size() const noexcept;
+
+  /// The first agent of a partition.
+  [[nodiscard]] std::size_t begin(std::size_t partition) const noexcept;
+  /// One past the last agent of a partition.
+  [[nodiscard]] std::size_t end(std::size_t partition) const noexcept;
+  /// The index, into numa::Topology::cpus, of the node of a partition.
+  [[nodiscard]] std::size_t node(std::size_t partition) const noexcept;
+  /// Whether a partition is the first on its node, which is the one that
+  /// places the copies of the tables that are replicated on every node.
+  [[nodiscard]] bool leads_node(std::size_t partition) const noexcept;
+  /// The number of nodes of the topology, some may have no partitions.
+  [[nodiscard]] std::size_t n_nodes() const noexcept;
+
+  /// Find the partition of an agent.
+  /// \param agent The index of the agent.
+  /// \return The index of the partition.
+  [[nodiscard]] std::size_t partition_of(std::size_t agent) const noexcept;
+
+  /// Get the chunks of the agents, which are queued to the partition that
+  /// owns them, and whose costs are counted as in the constructor.
+  /// \return The chunks.
+  [[nodiscard]] const Chunks &get_chunks() const noexcept;
+
+  /// Get how long each thread has been busy and idle in steps.
+  /// \return The Utilisation of every partition.
+  [[nodiscard]] std::vector<Utilisation> get_utilisation() const;
+
+  /// Run a step on every partition at once, each on its own thread, and wait
+  /// for them all to finish.
+  /// \param task The step.
+  /// \throws Whatever the first failing call of task throws.
+  void run(const Task &task);
+
+  /// Run a step on every chunk of the agents, as ::steal(chunks, task) does.
+  /// \param task The step, which is called with the partition of the thread
+  /// that runs it and the range of a chunk.
+  /// \throws Whatever the first failing call of task throws.
+  void steal(const Task &task);
+
+  /// Run a step on every chunk, and wait for them all to finish. Every thread
+  /// takes the chunks of its own queue from the front, and then takes from
+  /// the back of the queue with the most chunks left, until none are left.
+  /// \param chunks The chunks, with one queue per partition.
+  /// \param task The step, which is called with the partition of the thread
+  /// that runs it and the range of a chunk. It may be called more than once
+  /// per partition, or not at all.
+  /// \throws Whatever the first failing call of task throws.
+  void steal(const Chunks &chunks, const Task &task);
+
+  /// Run steps 0 up to n_steps on every partition, each on its own thread,
+  /// and wait for them all to finish. Step s on partition p starts once p has
+  /// finished step s - 1, and so has every partition in
+  /// dependencies[s % dependencies.size()][p], but not the others.
+  /// \param n_steps The number of steps.
+  /// \param dependencies The dependencies of the steps, in turn.
+  /// \param task The steps.
+  /// \throws Whatever the first failing call of task throws, after which no
+  /// partition starts another step.
+  void flow(std::size_t n_steps, std::span<const Dependencies> dependencies,
+            const FlowTask &task);
+
+  /// Find the partitions that the agents of every partition have friends in.
+  /// \param friend_offsets As passed to the constructor.
+  /// \param friends The friends, indexed by friend_offsets.
+  /// \return For every partition, the other partitions in ascending order.
+  [[nodiscard]] Dependencies
+  find_friend_partitions(std::span<const std::size_t> friend_offsets,
+                         std::span<const std::uint32_t> friends) const;
+
+  /// Measure the fraction of friendships between agents whose partitions are
+  /// on different nodes, as every one of those is a remote read of an action.
+  /// \param friend_offsets As passed to the constructor.
+  /// \param friends The friends, indexed by friend_offsets.
+  /// \return The fraction, 0 if there are no friendships.
+  [[nodiscard]] double_t
+  cross_node_fraction(std::span<const std::size_t> friend_offsets,
+                      std::span<const std::uint32_t> friends) const;
+
+private:
+  /// The chunks of a queue that are left, as the first in the high 32 bits and
+  /// one past the last in the low 32 bits, so that the owner and the thieves
+  /// can take from either end with one compare and swap. Each is on its own
+  /// cache line.
+  struct alignas(64) Queue {
+    std::atomic<std::uint64_t> range;
+  };
+
+  /// The number of steps of ::flow that a partition has finished, on its own
+  /// cache line.
+  struct alignas(64) Progress {
+    std::atomic<std::size_t> steps;
+  };
+
+  static bool take_front(Queue &queue, std::size_t &chunk) noexcept;
+  static bool take_back(Queue &queue, std::size_t &chunk) noexcept;
+
+  void work(std::size_t partition);
+  void stop() noexcept;
+
+  /// Partition p is the agents from boundaries_[p] up to boundaries_[p + 1].
+  std::vector<std::size_t> boundaries_;
+  Chunks chunks_;
+  std::vector<std::size_t> nodes_;
+  std::vector<unsigned> cpus_;
+  const std::size_t n_nodes_;
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const Task *task_ = nullptr;
+  std::uint64_t generation_ = 0;
+  std::size_t remaining_ = 0;
+  std::exception_ptr exception_;
+  bool stopping_ = false;
+
+  std::vector<Queue> queues_;
+  std::vector<Progress> progress_;
+  std::atomic<bool> flow_failed_ = false;
+  /// When the current step started, and when each thread finished it.
+  std::chrono::steady_clock::time_point started_;
+  std::vector<std::chrono::steady_clock::time_point> finished_;
+  std::vector<Utilisation> utilisation_;
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_PARTITIONS_H
@@ -0,0 +1,475 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_POPULATION_H
+#define CONTAGENT_POPULATION_H
+
+#include "agent_table.h"
+#include "compressed_graph.h"
+#include "configuration.h"
+#include "history.h"
+#include "numa.h"
+#include "partitions.h"
+#include "sampler.h"
+#include "summary.h"
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace contagent {
+
+/// An index-based copy of the agents of a Configuration, built from its
+/// AgentTable, which is what the Runner ticks. Beliefs and behaviours are
+/// numbered by their position in the Configuration, and agents by
+/// Configuration::get_ordering, which can put friends near each other. The
+/// static parameters are stored once per Archetype, and the friendships are
+/// stored in compressed sparse row form. How the activations are stored is
+/// left to the implementations, DensePopulation and SparsePopulation, and
+/// ::create chooses between them. Results are copied back into the Agents
+/// with ::store_activations and ::store_actions, or into a History if there
+/// is a Storage::memory_budget, or the Agents are SharedAgents, or there are
+/// StreamedAgents in their place.
+///
+/// The agents are divided into Partitions, and the per-agent arrays are
+/// placed by first touch from the thread that owns each range of agents, so
+/// that on a machine with several NUMA nodes each thread mostly reads local
+/// memory.
+///
+/// With a Storage::memory_budget, the AgentTable and the per-agent arrays are
+/// backed by files, apart from the most recent actions, which friends read
+/// and which always stay in RAM, and the results are stored in a History
+/// rather than in the Agents. Whenever the process is over the budget,
+/// ::release drops the pages of the arrays after a day, and the next tick
+/// streams them back partition by partition.
+class Population {
+public:
+  /// How the activations of a Population are stored.
+  enum class Engine { AUTO, DENSE, SPARSE };
+
+  /// Engine::AUTO chooses a SparsePopulation when ::measure_density is at most
+  /// this.
+  static constexpr double_t MAX_SPARSE_DENSITY = 0.25;
+
+  /// With Aggregation::INCREMENTAL, the sums of the actions of friends are
+  /// recounted from scratch rather than updated on a day when the agents that
+  /// changed behaviour have more than this fraction of all followers.
+  static constexpr double_t MAX_PUSH_FRACTION = 0.5;
+
+  /// The friendships of a hub, see Partitions::HUB_DEGREE, are summed in
+  /// pieces of this many, which are run in parallel.
+  static constexpr std::size_t HUB_PIECE = std::size_t{1} << 12;
+
+  /// Create a new Population. A dense Population is in the precision of
+  /// Configuration::get_precision, and a sparse one is always in double
+  /// precision.
+  /// \param configuration The configuration, which must outlive the
+  /// Population.
+  /// \param day The day whose activations are loaded as the current state.
+  /// \param engine The engine, Engine::AUTO chooses by ::measure_density.
+  /// \return The Population.
+  /// \throws std::out_of_range See ::tabulate, DensePopulation and
+  /// SparsePopulation.
+  [[nodiscard]] static std::unique_ptr<Population>
+  create(const Configuration &configuration, std::size_t day,
+         Engine engine = Engine::AUTO);
+
+  /// Make the AgentTable that a Population of a Configuration is built from,
+  /// from its Agents, or with StreamedAgents::tabulate if it has none.
+  /// \param configuration The configuration.
+  /// \param day The day whose activations and actions are loaded.
+  /// \return The table.
+  /// \throws std::out_of_range If an agent has no activations on the day, or
+  /// has a friend that is not in the Configuration.
+  [[nodiscard]] static AgentTable tabulate(const Configuration &configuration,
+                                           std::size_t day);
+
+  /// Estimate the fraction of the N×B activations that can be non-zero. An
+  /// activation is only non-zero if it was on the day loaded, or if its
+  /// belief perceives some behaviour, so this is the number of non-zero
+  /// activations on that day plus N for every belief with a non-zero
+  /// perception, over N×B.
+  /// \param configuration The configuration.
+  /// \param agents The table of the agents on the day.
+  /// \return The density, between 0 and 1.
+  [[nodiscard]] static double_t
+  measure_density(const Configuration &configuration,
+                  const AgentTable &agents);
+
+  virtual ~Population() = default;
+
+  Population(const Population &) = delete;
+  Population &operator=(const Population &) = delete;
+
+  [[nodiscard]] std::size_t n_agents() const noexcept;
+  [[nodiscard]] std::size_t n_beliefs() const noexcept;
+  [[nodiscard]] std::size_t n_behaviours() const noexcept;
+  [[nodiscard]] std::size_t n_archetypes() const noexcept;
+
+  /// Get the Agent of the Configuration that an index refers to, if it has
+  /// Agents.
+  /// \param agent The index of the agent.
+  /// \return The agent.
+  [[nodiscard]] const std::shared_ptr<Agent> &
+  get_agent(std::size_t agent) const noexcept;
+
+  /// Get the partitions of the agents between the threads that tick.
+  /// \return The partitions.
+  [[nodiscard]] const Partitions &get_partitions() const noexcept;
+
+  /// Get the current activation of an agent.
+  /// \param agent The index of the agent.
+  /// \param belief The index of the belief.
+  /// \return The activation.
+  [[nodiscard]] virtual double_t
+  get_activation(std::size_t agent, std::size_t belief) const noexcept = 0;
+
+  /// Get the index of the behaviour that an agent performed most recently.
+  /// \param agent The index of the agent.
+  /// \return The index of the behaviour.
+  [[nodiscard]] std::uint32_t get_action(std::size_t agent) const noexcept;
+
+  /// Get the scores computed by ::score for an agent, ordered as
+  /// Configuration::get_behaviours.
+  /// \param agent The index of the agent.
+  /// \return The scores.
+  [[nodiscard]] std::span<const double_t>
+  get_scores(std::size_t agent) const noexcept;
+
+  /// Get whether the Population has settled, which is when no action has
+  /// changed since ::perceive last ran, and it changed no activation at all.
+  /// The activations are then a fixed point, and ::perceive and ::score leave
+  /// the state as it is until ::select changes an action.
+  /// \return Whether the Population has settled.
+  [[nodiscard]] bool is_settled() const noexcept;
+
+  /// Set whether the Population has settled, see ::is_settled, which is how
+  /// replay::replay settles on the same days as the run that it replays.
+  /// \param settled Whether ::perceive and ::score leave the state as it is.
+  void set_settled(bool settled) noexcept;
+
+  /// Get the engine that the activations are stored in.
+  /// \return Engine::DENSE or Engine::SPARSE.
+  [[nodiscard]] virtual Engine get_engine() const noexcept = 0;
+
+  /// Update the activations of every agent for a day from the activations of
+  /// the day before and the actions of their friends. This is the equivalent
+  /// of Agent::update_activation_for_all_beliefs. This does nothing if
+  /// ::is_settled.
+  /// \param day The day, the current state must be of the day before.
+  virtual void perceive(std::size_t day) = 0;
+
+  /// Score every behaviour for every agent from the current activations, as
+  /// the performance relationships times the activations. This does nothing
+  /// if ::is_settled.
+  virtual void score() = 0;
+
+  /// Choose an action for every agent from the scores computed by ::score,
+  /// with a Sampler. This is the equivalent of Agent::perform_action. The
+  /// partitions choose in parallel, and the random numbers are drawn for the
+  /// index of each agent in the Configuration, so neither the partitions nor
+  /// the ordering change the result. With Aggregation::INCREMENTAL, this then
+  /// updates the sums of the actions of friends.
+  /// \param day The day.
+  /// \param seed The seed of the simulation.
+  void select(std::size_t day, std::uint64_t seed);
+
+  /// Set the actions of some agents, as though ::select had chosen them,
+  /// which is how the actions of the ghosts of an Ownership are updated.
+  /// \param actions The index of every agent, in ascending order, with its
+  /// action.
+  void set_actions(
+      std::span<const std::pair<std::uint32_t, std::uint32_t>> actions);
+
+  /// Copy the current activations into the Agents.
+  /// \param day The day to store them as.
+  virtual void store_activations(std::size_t day) const = 0;
+
+  /// Copy the current actions into the Agents.
+  /// \param day The day to store them as.
+  void store_actions(std::size_t day) const;
+
+  /// Get whether ::store_activations stores the activations that are zero,
+  /// which a SparsePopulation leaves out.
+  /// \return Whether the zeros are stored.
+  [[nodiscard]] virtual bool stores_zeros() const noexcept;
+
+  /// Copy the current activations and actions, which the partitions do in
+  /// parallel.
+  /// \param day The day to label them as.
+  /// \return The Snapshot, in the order of the Configuration.
+  [[nodiscard]] summary::Snapshot snapshot(std::size_t day) const;
+
+  /// Get the History that ::store_activations and ::store_actions copy into
+  /// in place of the Agents.
+  /// \return The History, or nullptr if there is no Storage::memory_budget,
+  /// and the Agents are neither SharedAgents nor StreamedAgents.
+  [[nodiscard]] const History *get_history() const noexcept;
+
+  /// Let the kernel drop the pages of the state of every partition if the
+  /// process is over the Storage::memory_budget, and otherwise do nothing.
+  void release() const;
+
+  /// Get whether ::flow ticks without barriers between the threads, which is
+  /// when Configuration::get_parallelism asks for Scheduling::DATAFLOW and
+  /// the Population supports it.
+  /// \return Whether the Population ticks by dataflow.
+  [[nodiscard]] bool is_dataflow() const noexcept;
+
+  /// Tick the days from start up to end, each as ::perceive,
+  /// ::store_activations, ::score, ::select and ::store_actions. A subclass
+  /// that supports ::is_dataflow runs every day as two steps of
+  /// Partitions::flow, perceiving and scoring, then selecting, with the
+  /// dependencies of ::flow_dependencies_, for the same result.
+  /// \param start The first day, the current state must be of the day before.
+  /// \param end One past the last day.
+  /// \param seed The seed of the simulation.
+  virtual void flow(std::size_t start, std::size_t end, std::uint64_t seed);
+
+protected:
+  /// Load everything but the activations.
+  /// \param configuration The configuration, which must outlive this.
+  /// \param agents The table of the agents, see ::tabulate, whose actions are
+  /// loaded as the current state.
+  /// \throws std::out_of_range If an agent is missing a delta.
+  Population(const Configuration &configuration, const AgentTable &agents);
+
+  template <class T>
+  static std::unordered_map<const T *, std::uint32_t>
+  index(const std::vector<std::shared_ptr<T>> &vec) {
+    std::unordered_map<const T *, std::uint32_t> m;
+    m.reserve(vec.size());
+    for (std::size_t i = 0; i < vec.size(); ++i) {
+      m.emplace(vec[i].get(), i);
+    }
+    return m;
+  }
+
+  /// Get the beliefs that the activations and Archetypes of the Agents are
+  /// keyed by, which are those of the Configuration unless the Agents are
+  /// SharedAgents.
+  /// \return The beliefs, B.
+  [[nodiscard]] const std::vector<std::shared_ptr<Belief>> &
+  get_agent_beliefs() const noexcept;
+
+  /// Sum the weights of the friends of an agent by the behaviour they
+  /// performed most recently. With Aggregation::INCREMENTAL these are the
+  /// sums kept in ::friend_counts_.
+  /// \param agent The index of the agent.
+  /// \param counts The sums, K, which are overwritten.
+  /// \return The number of friends.
+  std::size_t count_actions_of_friends(std::size_t agent,
+                                       double_t *counts) const noexcept;
+
+  /// Sum the actions of the friends of every hub into ::hub_counts_, from
+  /// the current actions. A subclass calls this in ::perceive before it
+  /// counts the actions of friends, unless they are kept incrementally.
+  void count_hub_actions();
+
+  /// Sum the actions of the friends of the hubs in a range of agents into
+  /// ::hub_counts_, on the calling thread, for the same sums as
+  /// ::count_hub_actions.
+  /// \param begin The first agent.
+  /// \param end One past the last agent.
+  void count_hub_actions(std::size_t begin, std::size_t end);
+
+  /// ::select for a range of agents.
+  /// \param p The partition of the calling thread, whose Sampler is used.
+  /// \param begin The first agent.
+  /// \param end One past the last agent.
+  /// \param day The day.
+  /// \param seed The seed of the simulation.
+  /// \param changes The agents whose action changed, with the action they had
+  /// before, which is overwritten.
+  void select_partition(
+      std::size_t p, std::size_t begin, std::size_t end, std::size_t day,
+      std::uint64_t seed,
+      std::vector<std::pair<std::uint32_t, std::uint32_t>> &changes);
+
+  /// ::store_actions for a range of agents.
+  /// \param day The day to store them as.
+  /// \param begin The first agent.
+  /// \param end One past the last agent.
+  void store_actions(std::size_t day, std::size_t begin,
+                     std::size_t end) const;
+
+  /// Back the allocations of the calling thread with files while the result
+  /// exists, if there is a Storage::memory_budget.
+  /// \return The FileBacking.
+  [[nodiscard]] numa::FileBacking back_with_files() const;
+
+  /// Get whether the resident memory of the process is over the
+  /// Storage::memory_budget, so that the state should be released.
+  /// \return Whether there is a budget and the process is over it.
+  [[nodiscard]] bool is_over_budget() const noexcept;
+
+  /// Get the number of bytes of the per-agent arrays that ::release drops.
+  /// \return The number of bytes.
+  [[nodiscard]] virtual std::size_t state_bytes() const noexcept;
+
+  /// ::release for a range of agents. A subclass adds its own arrays.
+  /// \param begin The first agent.
+  /// \param end One past the last agent.
+  virtual void release_range(std::size_t begin, std::size_t end) const;
+
+  const Configuration &configuration_;
+  const std::size_t n_agents_;
+  const std::size_t n_beliefs_;
+  const std::size_t n_behaviours_;
+  /// The number of agents that are not ghosts, see Ownership, which are the
+  /// first ones.
+  const std::size_t n_owned_;
+
+  /// The mean of Belief::relationships_ for every belief, B. As the
+  /// relationships are the same for every agent, Agent::contextualize is the
+  /// activation times this.
+  std::vector<double_t> mean_relationships_;
+  /// The deltas of every archetype, A×B.
+  std::vector<double_t> deltas_;
+
+  /// The index in the Configuration of every agent, see reorder::order.
+  numa::vector<std::uint32_t> original_;
+
+  /// The global ArchetypeTable id of every archetype.
+  std::vector<std::uint32_t> archetype_ids_;
+  /// The References of the AgentTable, which hold the archetypes if there
+  /// are no Agents to.
+  std::vector<ArchetypeTable::Reference> archetype_references_;
+  /// The archetype of every agent, indexing ::archetype_ids_.
+  numa::vector<std::uint32_t> archetypes_;
+  /// The agents of every archetype, in ascending order.
+  std::vector<std::vector<std::uint32_t>> members_;
+
+  /// The friends of agent i are friends_[friend_offsets_[i]] up to
+  /// friends_[friend_offsets_[i + 1]]. These are empty if ::graph_ is used.
+  numa::vector<std::size_t> friend_offsets_;
+  numa::vector<std::uint32_t> friends_;
+  numa::vector<double_t> friend_weights_;
+  /// The friendships, if Configuration::get_graph_format is
+  /// GraphFormat::COMPRESSED, and otherwise nullptr.
+  std::unique_ptr<CompressedGraph> graph_;
+
+  /// Whether Configuration::get_aggregation is Aggregation::INCREMENTAL.
+  const bool incremental_;
+  /// With Aggregation::INCREMENTAL, the sums of the weights of the friends of
+  /// every agent by their most recent action, N×K, and the number of friends
+  /// of every agent, N. Otherwise these are empty.
+  numa::vector<double_t> friend_counts_;
+  numa::vector<std::uint32_t> n_friends_;
+  /// With Aggregation::INCREMENTAL, the agents that have agent j as a friend
+  /// are followers_[follower_offsets_[j]] up to
+  /// followers_[follower_offsets_[j + 1]], in ascending order, with the
+  /// weights that they give j. Otherwise these are empty.
+  numa::vector<std::size_t> follower_offsets_;
+  numa::vector<std::uint32_t> followers_;
+  numa::vector<double_t> follower_weights_;
+  /// The agents with at least Partitions::HUB_DEGREE friends, in ascending
+  /// order. The friendships of hubs are summed by ::count_hub_actions, and
+  /// the sums are used in place of their friendships.
+  std::vector<std::uint32_t> hubs_;
+  /// The friendships of hub h are from hub_offsets_[h] up to
+  /// hub_offsets_[h + 1], in a numbering of the friendships of the hubs. With
+  /// ::graph_, whose rows cannot be read from the middle, they are copied
+  /// into hub_friends_ and hub_weights_, and otherwise they are the rows of
+  /// the hubs in ::friends_.
+  std::vector<std::size_t> hub_offsets_;
+  numa::vector<std::uint32_t> hub_friends_;
+  numa::vector<double_t> hub_weights_;
+  /// The friendships of the hubs divided into pieces of up to ::HUB_PIECE,
+  /// with the pieces of a hub queued to its partition.
+  Chunks hub_pieces_;
+  /// The sums of the actions of friends of every piece, P×K, and of every
+  /// hub, H×K, and the number of friends of every hub, H.
+  numa::vector<double_t> piece_counts_;
+  numa::vector<double_t> hub_counts_;
+  std::vector<std::uint32_t> hub_n_friends_;
+
+  /// The agents of every chunk of Partitions::get_chunks whose action was
+  /// changed by ::select, with the action they had before.
+  std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> changes_;
+  /// The Sampler of every partition, which keeps its workspace between days.
+  std::vector<Sampler> samplers_;
+  /// Whether ::select has changed an action since ::perceive last ran, which
+  /// is true before the first ::perceive. A subclass resets this in
+  /// ::perceive.
+  bool actions_changed_ = true;
+  /// See ::is_settled. A subclass sets this in ::perceive, and ::select
+  /// resets it.
+  bool settled_ = false;
+
+  /// The most recent actions, N.
+  numa::vector<std::uint32_t> actions_;
+  /// The scores of every behaviour, N×K.
+  numa::vector<double_t> scores_;
+  /// Whether the activations of each agent were exactly the same after the
+  /// last ::perceive as before it, N. Until an action changes, the pressures
+  /// stay the same, so such an agent is at a fixed point and a subclass
+  /// neither perceives nor scores it again.
+  numa::vector<std::uint8_t> fixed_;
+
+  /// The ranges of agents that are owned by each thread.
+  std::unique_ptr<Partitions> partitions_;
+
+  /// See ::get_history.
+  std::unique_ptr<History> history_;
+
+  /// See ::is_dataflow. A subclass that does not support it resets this.
+  bool dataflow_ = false;
+  /// With ::is_dataflow, the dependencies of the two steps of a day in
+  /// ::flow. Perceiving waits for the partitions that the agents of the
+  /// partition are friends with to select the day before, as it reads their
+  /// actions. Selecting waits for the partitions with friends in the
+  /// partition to perceive, as it overwrites the actions that they read.
+  std::vector<Partitions::Dependencies> flow_dependencies_;
+
+private:
+  /// Sum the actions of the friends in a piece of ::hub_pieces_.
+  void count_piece(std::size_t piece);
+
+  /// Sum the pieces of a hub into ::hub_counts_, in order.
+  void sum_pieces(std::size_t hub);
+
+  /// Sum the actions of the friends of an agent from its friendships.
+  std::size_t pull_actions_of_friends(std::size_t agent,
+                                      double_t *counts) const noexcept;
+
+  /// Update the state that depends on the actions after ::changes_ have been
+  /// made.
+  void apply_changes();
+
+  /// Recount ::friend_counts_ for every agent.
+  void pull_friend_counts();
+
+  /// Update ::friend_counts_ for the followers of the agents in ::changes_.
+  void push_friend_counts();
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_POPULATION_H
@@ -0,0 +1,66 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_RANDOM_H
+#define CONTAGENT_RANDOM_H
+
+#include <cmath>
+#include <cstdint>
+
+namespace contagent::random {
+
+/// The finalizer of splitmix64, a bijection that spreads the bits of x.
+/// \param x The input.
+/// \return The mixed bits.
+constexpr std::uint64_t mix(std::uint64_t x) noexcept {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+/// Draw a uniform random number in [0, 1) for an agent on a day. The draw is
+/// a pure function of its arguments, so the result of a simulation does not
+/// depend on the order in which agents are processed, and any single draw can
+/// be reproduced.
+/// \param seed The seed of the simulation.
+/// \param agent The index of the agent.
+/// \param day The day.
+/// \return The random number.
+constexpr double_t uniform(std::uint64_t seed, std::uint64_t agent,
+                           std::uint64_t day) noexcept {
+  const std::uint64_t bits =
+      mix(mix(seed ^ mix(agent + 0x9e3779b97f4a7c15ULL)) + day);
+  return static_cast<double_t>(bits >> 11) * 0x1.0p-53;
+}
+
+} // namespace contagent::random
+
+#endif // CONTAGENT_RANDOM_H
@@ -0,0 +1,74 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_REORDER_H
+#define CONTAGENT_REORDER_H
+
+#include "configuration.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace contagent::reorder {
+
+/// Renumber the agents so that friends have nearby indices, and so the
+/// actions that are read while perceiving are close together in memory. The
+/// friendships are treated as undirected.
+/// \param ordering The ordering, Ordering::INPUT is the identity.
+/// \param offsets The friends of agent i are from offsets[i] up to
+/// offsets[i + 1], N + 1.
+/// \param friends The friends, indexed by offsets.
+/// \return The index in the input of every agent in the new order, N.
+[[nodiscard]] std::vector<std::uint32_t>
+order(Ordering ordering, std::span<const std::size_t> offsets,
+      std::span<const std::uint32_t> friends);
+
+/// The mean of the absolute difference between the indices of an agent and
+/// each of its friends.
+/// \param offsets As passed to ::order.
+/// \param friends As passed to ::order.
+/// \return The mean distance, 0 if there are no friendships.
+[[nodiscard]] double_t
+mean_neighbour_distance(std::span<const std::size_t> offsets,
+                        std::span<const std::uint32_t> friends);
+
+/// Get the name of an ordering.
+/// \param ordering The ordering.
+/// \return The name, as accepted by ::parse_ordering.
+[[nodiscard]] std::string to_string(Ordering ordering);
+
+/// Parse the name of an ordering, input, rcm, bfs or degree.
+/// \param name The name.
+/// \return The ordering.
+/// \throws std::invalid_argument If the name is not an ordering.
+[[nodiscard]] Ordering parse_ordering(const std::string &name);
+
+} // namespace contagent::reorder
+
+#endif // CONTAGENT_REORDER_H
@@ -0,0 +1,143 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef CONTAGENT_REPLAY_H
+#define CONTAGENT_REPLAY_H
+
+#include "configuration.h"
+#include "population.h"
+#include "summary.h"
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace contagent::replay {
+/// An agent that changed action on a day, as the index of the agent in the
+/// Configuration and the index of the behaviour.
+struct Change {
+  std::uint32_t day;
+  std::uint32_t agent;
+  std::uint32_t action;
+};
+
+/// The record of a run from which ::replay recomputes the activations of any
+/// agents on any days: the initial state, the settings that the arithmetic
+/// depends on, the days on which the Population had settled, and every
+/// change of action. As the actions are read from the log rather than
+/// sampled again, only the agents asked for and their friends are ticked.
+///
+/// A ChangeLog is written by a Runner with OutputPipeline::change_log, as a
+/// JSON object of "version", "seed", "startTime", "endTime", "precision",
+/// "graphFormat", "aggregation" and "engine", then "behaviours", "beliefs"
+/// and "agents" in the form of the input, as they were before the first day,
+/// then "settled", the days, and "changes", each [day, agent, behaviour],
+/// with the agents and behaviours as indices of the arrays before.
+struct ChangeLog {
+  std::vector<std::shared_ptr<Behaviour>> behaviours;
+  std::vector<std::shared_ptr<Belief>> beliefs;
+  /// The agents, with their activations and actions before the first day.
+  std::vector<std::shared_ptr<Agent>> agents;
+  std::size_t start_time = 0;
+  std::size_t end_time = 0;
+  std::uint64_t seed = 0;
+  Precision precision = Precision::FLOAT64;
+  GraphFormat graph_format = GraphFormat::CSR;
+  Aggregation aggregation = Aggregation::PULL;
+  Population::Engine engine = Population::Engine::DENSE;
+  /// The days whose Population::perceive was skipped as the Population had
+  /// settled, in ascending order.
+  std::vector<std::uint32_t> settled;
+  /// The changes of action from the day before the start time, on which the
+  /// actions are relative to the actions of the input, ordered by day and
+  /// then by agent.
+  std::vector<Change> changes;
+};
+
+/// Writes the ChangeLog of a run to Configuration::get_output_stream. The
+/// settings and the initial state are written when it is made, and the
+/// changes are found at the end, from the actions stored in the Agents or
+/// the History, so that they are found the same way however the days were
+/// ticked.
+class ChangeLogWriter {
+public:
+  /// Start a new ChangeLogWriter, before any day is ticked.
+  /// \param configuration The configuration, which must outlive this.
+  /// \param population The Population, which has the initial state.
+  ChangeLogWriter(const Configuration &configuration,
+                  const Population &population);
+
+  /// Record that a day was not perceived as the Population had settled.
+  /// \param day The day.
+  void settled(std::size_t day);
+
+  /// Write the changes of every day and the end of the log.
+  /// \param population The Population, which has stored every day.
+  void finish(const Population &population);
+
+private:
+  const Configuration &configuration_;
+  /// The action of every agent, in the order of the Configuration, before
+  /// the day before the start time.
+  std::vector<std::uint32_t> initial_;
+  std::vector<std::uint32_t> settled_;
+};
+
+/// Read a ChangeLog written by ChangeLogWriter.
+/// \param is The stream.
+/// \return The ChangeLog.
+/// \throws std::runtime_error If the log is not a ChangeLog.
+/// \throws std::out_of_range If the log refers to an unknown entity.
+[[nodiscard]] ChangeLog read(std::istream &is);
+
+/// Recompute the activations of some agents on a range of days from a
+/// ChangeLog. The agents are ticked in a Population with their friends as
+/// the ghosts of an Ownership, whose actions, like their own, are set from
+/// the log each day, and the Population settles on the days that the run
+/// did. The friends of every agent are summed in the order of their UUIDs,
+/// and a GraphFormat::COMPRESSED graph quantises the weights in the range of
+/// every agent of the log, so the result is that of the run, except that
+/// Aggregation::INCREMENTAL may update the sums in a different order, which
+/// can differ by rounding.
+/// \param log The ChangeLog.
+/// \param agents The indices of the agents in ChangeLog::agents, without
+/// repeats.
+/// \param first The first day, at least ChangeLog::start_time.
+/// \param last One past the last day, at most ChangeLog::end_time.
+/// \param parallelism The threads that tick the Population.
+/// \return A summary::Snapshot of every day from first up to last, with the
+/// agents in the order asked for.
+/// \throws std::invalid_argument If the agents or days are not in the log.
+[[nodiscard]] std::vector<summary::Snapshot>
+replay(const ChangeLog &log, std::span<const std::uint32_t> agents,
+       std::size_t first, std::size_t last, const Parallelism &parallelism);
+} // namespace contagent::replay
+
+#endif // CONTAGENT_REPLAY_H
@@ -32,37 +32,62 @@
 #include <memory>
 
 #include "configuration.h"
+#include "population.h"
+#include "replay.h"
+#include "summary_writer.h"
 namespace contagent {
 /// Runner does as it suggests -- runs the simulation.
 /// \author Robert Greener
 class Runner {
 public:
   /// Create a new Runner with a supplied Configuration, which the Runner owns.
+  /// The activations on the day before Configuration::get_start_time are
+  /// loaded into a Population.
+  /// \throws std::invalid_argument If the Configuration asks for the full
+  /// output with a Storage::memory_budget, SharedAgents or StreamedAgents,
+  /// as the Agents have no history, or for both the full output and
+  /// OutputPipeline::change_log, or for the change log with StreamedAgents,
+  /// or for a RingOutput without a SummaryWriter to publish to it.
+  /// \param configuration The configuration.
+  /// \param engine The engine of the Population, see Population::create.
   /// \author Robert Greener
-  explicit Runner(std::unique_ptr<Configuration> configuration);
+  explicit Runner(std::unique_ptr<Configuration> configuration,
+                  Population::Engine engine = Population::Engine::AUTO);
 
-  /// For every Agent in the Configuration call
-  /// Agent::update_activation_for_all_beliefs.
+  /// Get the Population that is ticked, whose Population::get_history holds
+  /// the days if the Agents are not written to.
+  /// \return The population.
+  [[nodiscard]] const Population &get_population() const noexcept;
+
+  /// Update the activations of every agent with Population::perceive, and
+  /// store them in the Agents.
   /// \author Robert Greener
   void perceive_beliefs(uint_fast32_t time);
 
-  /// For every Agent in the Configuration call Agent::perform_action.
+  /// Choose the action of every agent with Population::score and
+  /// Population::select, and store them in the Agents.
   /// \author Robert Greener
   void perform_actions(uint_fast32_t time);
 
   /// Tick for a given time, calls ::perceive_beliefs followed by
-  /// ::perform_actions.
+  /// ::perform_actions, hands a Population::snapshot to the SummaryWriter if
+  /// there is one and selection::contains_day, then calls
+  /// Population::release.
   /// \author Robert Greener
   void tick(uint_fast32_t time);
 
   /// Tick between the start_time (inclusive) and end_time (exclusive), calling
-  /// ::tick.
+  /// ::tick, or Population::flow if the Population::is_dataflow.
   /// \author Robert Greener
   void tick_between(uint_fast32_t start_time, uint_fast32_t end_time);
 
   /// Tick between the Configuration::get_start_time (inclusive) and
   /// Configuration::get_end_time (exclusive), serializing the output at the
-  /// end. \author Robert Greener
+  /// end. The summary is written by a SummaryWriter as the days are ticked,
+  /// unless OutputPipeline::max_pending is 0, or the Population::is_dataflow,
+  /// whose days only all end together. With OutputPipeline::change_log, a
+  /// replay::ChangeLog is written in its place.
+  /// \author Robert Greener
   void run();
 
   void serialize_and_output_summary();
@@ -72,6 +97,16 @@ public:
 private:
   /// The Configuration of the simulation run.
   std::unique_ptr<Configuration> configuration_;
+
+  /// The state that is ticked, made by Population::create.
+  std::unique_ptr<Population> population_;
+
+  /// Writes the summary of every day while the next is ticked, or nullptr.
+  std::unique_ptr<SummaryWriter> writer_;
+
+  /// Writes the replay::ChangeLog with OutputPipeline::change_log, or
+  /// nullptr.
+  std::unique_ptr<replay::ChangeLogWriter> change_log_;
 };
 } // namespace contagent
 
@@ -0,0 +1,67 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_SAMPLER_H
+#define CONTAGENT_SAMPLER_H
+
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace contagent {
+
+/// Chooses a behaviour from the scores of every behaviour, as
+/// Agent::perform_action and Population::select do. If no score is positive,
+/// the behaviour with the greatest score is chosen, and otherwise each
+/// behaviour is chosen with the probability of its score over the sum of the
+/// positive scores. Ties for the greatest score go to the behaviour with the
+/// highest index, which is the last of them in a stable sort of the scores.
+///
+/// One pass finds the greatest score and the prefix sum of the positive
+/// scores, and the choice is then a binary search of the prefix sum, so
+/// nothing is sorted, and nothing is allocated once the Sampler has seen K
+/// behaviours.
+class Sampler {
+public:
+  /// Choose a behaviour.
+  /// \param scores The scores, K, which must not be empty.
+  /// \param rv A uniform random number in [0, 1), which is only used if some
+  /// score is positive.
+  /// \return The index of the behaviour.
+  [[nodiscard]] std::uint32_t sample(std::span<const double_t> scores,
+                                     double_t rv);
+
+private:
+  /// The sum of the positive scores up to and including each behaviour, K.
+  std::vector<double_t> cumulative_;
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_SAMPLER_H
@@ -0,0 +1,74 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef CONTAGENT_SELECTION_H
+#define CONTAGENT_SELECTION_H
+
+#include "configuration.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// Helpers for the OutputSelection of a Configuration.
+namespace contagent::selection {
+/// Draw a uniform sample of agents by reservoir sampling, with the random
+/// numbers of random::uniform, so that the same seed draws the same agents.
+/// The seed is salted and mixed first, so the draws are independent of those
+/// that a simulation with the same seed makes to select actions.
+/// \param n_agents The number of agents.
+/// \param k The size of the sample, all the agents if it is at least
+/// n_agents.
+/// \param seed The seed.
+/// \return The indices of the agents, in ascending order.
+[[nodiscard]] std::vector<std::uint32_t>
+sample(std::size_t n_agents, std::size_t k, std::uint64_t seed);
+
+/// Mark the elements of a list that are selected.
+/// \param selected The indices selected, or empty for all.
+/// \param n The number of elements.
+/// \return Whether every element is selected, n.
+/// \throws std::out_of_range If an index is not less than n.
+[[nodiscard]] std::vector<char> mask(std::span<const std::uint32_t> selected,
+                                     std::size_t n);
+
+/// Get the number of agents that are selected.
+/// \param configuration The configuration.
+/// \return The number of agents.
+[[nodiscard]] std::size_t count_agents(const Configuration &configuration);
+
+/// Get whether a day is written, which is every OutputSelection::day_stride
+/// days from the start time until the end time.
+/// \param configuration The configuration.
+/// \param day The day.
+/// \return Whether the day is written.
+[[nodiscard]] bool contains_day(const Configuration &configuration,
+                                std::size_t day) noexcept;
+} // namespace contagent::selection
+
+#endif // CONTAGENT_SELECTION_H
@@ -0,0 +1,277 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef CONTAGENT_SHM_RING_H
+#define CONTAGENT_SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+/// A ring buffer in POSIX shared memory, which a Publisher writes the days of
+/// a simulation to as they are ticked, and any number of Readers in other
+/// processes on the same machine read from without copying.
+///
+/// The shared memory object is laid out as a RingHeader, then the metadata,
+/// which is JSON, then the data, which is RingHeader::capacity bytes. Every
+/// record in the data is a RecordHeader followed by its payload, padded to
+/// RECORD_ALIGNMENT bytes. Records never wrap around the end of the data: if
+/// the next does not fit before the end, the rest is filled by a record of
+/// RecordKind::PADDING, and it starts at the beginning.
+///
+/// A position is the number of bytes ever written to the data, so the byte
+/// at a position is at `position % capacity`, and positions never repeat.
+/// The one producer
+/// 1. moves RingHeader::tail past the records it is about to overwrite,
+/// 2. issues a release fence,
+/// 3. writes the records, and
+/// 4. stores RingHeader::head after them with release ordering.
+/// A consumer
+/// 1. loads RingHeader::head with acquire ordering, and reads the records
+///    before it,
+/// 2. issues an acquire fence, and
+/// 3. loads RingHeader::tail: if it is after the position of a record, the
+///    record may have been overwritten while it was read, and must be
+///    discarded, which is Reader::valid.
+///
+/// By default the producer never waits, so a consumer that falls more than
+/// the capacity behind loses the oldest records. With
+/// RingHeader::wait_for_readers, the producer instead waits until every
+/// registered consumer's ReaderSlot::cursor has passed the records it is
+/// about to overwrite, so a slow consumer holds back the simulation. The
+/// slots of consumers whose processes have exited are freed.
+namespace contagent::shm {
+/// The RingHeader::magic of an initialised ring, "CTGNRING".
+constexpr std::uint64_t MAGIC = 0x474e49524e475443;
+constexpr std::uint32_t VERSION = 1;
+/// The number of consumers that can register at once.
+constexpr std::size_t MAX_READERS = 16;
+/// The alignment of every record and of the data.
+constexpr std::size_t RECORD_ALIGNMENT = 32;
+
+/// What the payload of a record is.
+enum class RecordKind : std::uint32_t {
+  /// Fills the end of the data, and is skipped.
+  PADDING = 0,
+  /// The summary of a day, as JSON in the OutputSchema of the output.
+  SUMMARY = 1,
+  /// The activations and actions of the agents at the end of a day, as a
+  /// StateHeader, then the activations of every agent in the metadata, as
+  /// `double[n_agents][n_beliefs]` in the order of its beliefs, then its
+  /// actions, as `uint32_t[n_agents]` positions of its behaviours, or
+  /// UINT32_MAX for a behaviour that is not in it.
+  STATE = 2
+};
+
+/// The header of every record.
+struct RecordHeader {
+  RecordKind kind;
+  std::uint32_t reserved;
+  /// The number of records before this one, not counting padding.
+  std::uint64_t sequence;
+  /// The day that the record is of.
+  std::uint64_t day;
+  /// The number of bytes of the payload, without the padding.
+  std::uint64_t size;
+};
+static_assert(sizeof(RecordHeader) == RECORD_ALIGNMENT);
+
+/// The start of the payload of a RecordKind::STATE record.
+struct StateHeader {
+  std::uint64_t n_agents;
+  std::uint64_t n_beliefs;
+};
+
+/// The registration of a consumer.
+struct alignas(64) ReaderSlot {
+  /// The process ID of the consumer, or 0 if the slot is free.
+  std::atomic<std::uint32_t> pid;
+  /// The position of the first record that the consumer has not finished
+  /// with.
+  std::atomic<std::uint64_t> cursor;
+};
+
+/// The start of the shared memory object.
+struct RingHeader {
+  /// MAGIC once the ring is initialised, stored with release ordering.
+  std::atomic<std::uint64_t> magic;
+  std::uint32_t version;
+  /// Whether the producer waits for the registered consumers, see
+  /// contagent::shm.
+  std::uint32_t wait_for_readers;
+  /// The number of bytes of the data, a multiple of RECORD_ALIGNMENT.
+  std::uint64_t capacity;
+  /// The offset of the metadata from the start of the object.
+  std::uint64_t metadata_offset;
+  /// The number of bytes of the metadata.
+  std::uint64_t metadata_size;
+  /// The offset of the data from the start of the object.
+  std::uint64_t data_offset;
+  /// The position after the last record that was published.
+  alignas(64) std::atomic<std::uint64_t> head;
+  /// The position of the oldest record that has not been overwritten.
+  alignas(64) std::atomic<std::uint64_t> tail;
+  /// Whether the producer has published its last record.
+  alignas(64) std::atomic<std::uint32_t> finished;
+  ReaderSlot readers[MAX_READERS];
+};
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free &&
+              std::atomic<std::uint32_t>::is_always_lock_free);
+
+/// Makes a ring and publishes records to it, from one thread.
+class Publisher {
+public:
+  /// Make a new ring, replacing any of the same name.
+  /// \param name The name of the shared memory object, such as "/contagent".
+  /// \param capacity The number of bytes of the data, which is rounded up to
+  /// RECORD_ALIGNMENT and must hold the largest record.
+  /// \param metadata The metadata.
+  /// \param wait_for_readers Whether to wait for the registered consumers.
+  /// \throws std::system_error If the object could not be made or mapped.
+  Publisher(const std::string &name, std::size_t capacity,
+            std::string_view metadata, bool wait_for_readers);
+
+  /// Mark the ring finished, and remove its name, so that the consumers that
+  /// have it mapped can still read it but no others can open it.
+  ~Publisher();
+
+  Publisher(const Publisher &) = delete;
+  Publisher &operator=(const Publisher &) = delete;
+
+  /// Publish a record, overwriting the oldest, or waiting for the consumers
+  /// to finish with them.
+  /// \param kind The kind.
+  /// \param day The day.
+  /// \param parts The payload, which is the concatenation of these.
+  /// \throws std::length_error If the record is larger than the capacity.
+  void publish(RecordKind kind, std::size_t day,
+               std::initializer_list<std::span<const std::byte>> parts);
+
+  /// Mark the ring finished, so that the consumers know that no more records
+  /// will be published.
+  void finish() noexcept;
+
+  /// Get the time that ::publish has waited for the consumers.
+  /// \return The time, in seconds.
+  [[nodiscard]] double get_stalled() const noexcept;
+
+  /// Get the number of records that were overwritten before a registered
+  /// consumer had read them.
+  /// \return The number of records.
+  [[nodiscard]] std::size_t get_overtaken() const noexcept;
+
+private:
+  /// Move the tail past every record that a new record overwrites, first
+  /// waiting for the consumers if RingHeader::wait_for_readers.
+  /// \param start The position of the new record.
+  /// \param end The position after it.
+  void reclaim(std::uint64_t start, std::uint64_t end);
+
+  std::string name_;
+  std::size_t size_ = 0;
+  RingHeader *header_ = nullptr;
+  std::byte *data_ = nullptr;
+  std::uint64_t head_ = 0;
+  std::uint64_t tail_ = 0;
+  std::uint64_t sequence_ = 0;
+  double stalled_ = 0.0;
+  std::size_t overtaken_ = 0;
+};
+
+/// A record that a Reader has read, which points into the shared memory.
+struct Record {
+  RecordKind kind;
+  std::uint64_t sequence;
+  std::uint64_t day;
+  std::span<const std::byte> payload;
+  /// The position of the record.
+  std::uint64_t position;
+};
+
+/// Registers as a consumer of a ring, and reads its records in order.
+class Reader {
+public:
+  /// Open a ring and register as a consumer.
+  /// \param name The name of the shared memory object.
+  /// \param from_oldest Whether to start at the oldest record that has not
+  /// been overwritten, rather than at the next to be published.
+  /// \throws std::system_error If the object could not be opened or mapped.
+  /// \throws std::runtime_error If it is not an initialised ring of this
+  /// version, or every ReaderSlot is taken.
+  explicit Reader(const std::string &name, bool from_oldest = true);
+
+  /// Unregister, and unmap the ring.
+  ~Reader();
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  /// Get the metadata, which is JSON.
+  /// \return The metadata.
+  [[nodiscard]] std::string_view get_metadata() const noexcept;
+
+  /// Read the next record, finishing with the one before it, which may then
+  /// be overwritten.
+  /// \return The record, or nothing if none has been published since.
+  [[nodiscard]] std::optional<Record> next();
+
+  /// Get whether a record has not been overwritten, which must be checked
+  /// after reading its payload unless RingHeader::wait_for_readers, as the
+  /// producer does not wait.
+  /// \param record The record.
+  /// \return Whether everything that was read of it is intact.
+  [[nodiscard]] bool valid(const Record &record) const noexcept;
+
+  /// Get whether every record has been read and no more will be published.
+  /// \return Whether the ring is finished.
+  [[nodiscard]] bool finished() const noexcept;
+
+  /// Get the number of records that were overwritten before they were read.
+  /// \return The number of records.
+  [[nodiscard]] std::size_t get_lost() const noexcept;
+
+private:
+  std::size_t size_ = 0;
+  RingHeader *header_ = nullptr;
+  const std::byte *data_ = nullptr;
+  ReaderSlot *slot_ = nullptr;
+  /// The position of the next record.
+  std::uint64_t position_ = 0;
+  /// The sequence of the next record.
+  std::optional<std::uint64_t> sequence_;
+  std::size_t lost_ = 0;
+};
+} // namespace contagent::shm
+
+#endif // CONTAGENT_SHM_RING_H
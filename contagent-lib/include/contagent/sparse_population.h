@@ -0,0 +1,106 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_SPARSE_POPULATION_H
+#define CONTAGENT_SPARSE_POPULATION_H
+
+#include "population.h"
+
+namespace contagent {
+
+/// A Population for models with many beliefs of which each agent holds only a
+/// few. The activations of every agent are a list of (belief, activation)
+/// sorted by belief, holding only the non-zero activations, and the
+/// perceptions and performance relationships hold only their non-zero
+/// entries, so that ticking scales with the non-zero activations rather than
+/// with N×B.
+class SparsePopulation final : public Population {
+public:
+  /// Create a new SparsePopulation. Activations and performance relationships
+  /// that an agent does not have are taken to be zero.
+  /// \param configuration The configuration, which must outlive this.
+  /// \param agents The table of the agents, see Population::tabulate, whose
+  /// activations are loaded as the current state.
+  /// \throws std::out_of_range If an agent is missing a delta.
+  SparsePopulation(const Configuration &configuration,
+                   const AgentTable &agents);
+
+  [[nodiscard]] double_t
+  get_activation(std::size_t agent, std::size_t belief) const noexcept final;
+
+  [[nodiscard]] Engine get_engine() const noexcept final;
+
+  /// Get the number of non-zero activations.
+  /// \return The number of non-zero activations.
+  [[nodiscard]] std::size_t n_non_zero() const noexcept;
+
+  /// The beliefs that can change for an agent are those that were non-zero on
+  /// the day before and those that perceive a behaviour that a friend
+  /// performed, and the rest stay zero.
+  void perceive(std::size_t day) final;
+
+  void score() final;
+
+  /// Only the non-zero activations are stored.
+  void store_activations(std::size_t day) const final;
+
+  [[nodiscard]] bool stores_zeros() const noexcept final;
+
+private:
+  /// Belief::perceptions_ in compressed sparse column form, the beliefs that
+  /// perceive behaviour k are perception_beliefs_[perception_offsets_[k]] up
+  /// to perception_beliefs_[perception_offsets_[k + 1]], in ascending order.
+  std::vector<std::size_t> perception_offsets_;
+  std::vector<std::uint32_t> perception_beliefs_;
+  std::vector<double_t> perception_values_;
+
+  /// The performance relationships of every archetype in compressed sparse
+  /// row form, with the row of belief b of archetype a at a×B + b.
+  std::vector<std::size_t> pr_offsets_;
+  std::vector<std::uint32_t> pr_behaviours_;
+  std::vector<double_t> pr_values_;
+
+  /// The current activations of agent i are values_[offsets_[i]] up to
+  /// values_[offsets_[i + 1]], of the beliefs in beliefs_, in ascending order.
+  std::vector<std::size_t> offsets_;
+  std::vector<std::uint32_t> beliefs_;
+  std::vector<double_t> values_;
+  /// The activations of the day before, in the same form.
+  std::vector<std::size_t> previous_offsets_;
+  std::vector<std::uint32_t> previous_beliefs_;
+  std::vector<double_t> previous_values_;
+
+  /// Workspaces of ::perceive, the unnormalized pressure on every belief and
+  /// whether it is in the list of beliefs that can change, B.
+  std::vector<double_t> pressures_;
+  std::vector<std::uint8_t> touched_;
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_SPARSE_POPULATION_H
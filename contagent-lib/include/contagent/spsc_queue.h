@@ -0,0 +1,131 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_SPSC_QUEUE_H
+#define CONTAGENT_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace contagent {
+
+/// A bounded lock-free queue between one producer thread and one consumer
+/// thread. Each side only writes its own index of a ring of slots, and waits
+/// on the index of the other with std::atomic::wait when the ring is full or
+/// empty, so neither takes a lock.
+/// \tparam T The type of the values, which must be default constructible.
+template <class T> class SpscQueue {
+public:
+  /// Create a new SpscQueue.
+  /// \param capacity The number of values that it holds at most.
+  explicit SpscQueue(std::size_t capacity) : slots_(capacity) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  /// Add a value, waiting while the queue is full. Only the producer may call
+  /// this.
+  /// \param value The value.
+  /// \return Whether it was added, which it is not once the consumer has
+  /// called ::cancel.
+  bool push(T value);
+
+  /// Take the oldest value, waiting while the queue is empty. Only the
+  /// consumer may call this.
+  /// \return The value, or std::nullopt once the queue is empty and the
+  /// producer has called ::close.
+  std::optional<T> pop();
+
+  /// Mark the end of the values. Only the producer may call this.
+  void close() noexcept;
+
+  /// Stop taking values, so that ::push stops waiting and fails. Only the
+  /// consumer may call this.
+  void cancel() noexcept;
+
+private:
+  /// The bit of head_ that ::cancel sets, and of tail_ that ::close sets.
+  static constexpr std::uint64_t CLOSED = std::uint64_t{1} << 63;
+
+  std::vector<T> slots_;
+  /// The number of values that the consumer has taken.
+  alignas(64) std::atomic<std::uint64_t> head_ = 0;
+  /// The number of values that the producer has added.
+  alignas(64) std::atomic<std::uint64_t> tail_ = 0;
+};
+
+template <class T> bool SpscQueue<T>::push(T value) {
+  const std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+  std::uint64_t head = head_.load(std::memory_order_acquire);
+  while ((head & CLOSED) == 0 && tail - head == slots_.size()) {
+    head_.wait(head, std::memory_order_acquire);
+    head = head_.load(std::memory_order_acquire);
+  }
+  if ((head & CLOSED) != 0) {
+    return false;
+  }
+
+  slots_[tail % slots_.size()] = std::move(value);
+  tail_.store(tail + 1, std::memory_order_release);
+  tail_.notify_one();
+  return true;
+}
+
+template <class T> std::optional<T> SpscQueue<T>::pop() {
+  const std::uint64_t head = head_.load(std::memory_order_relaxed) & ~CLOSED;
+  std::uint64_t tail = tail_.load(std::memory_order_acquire);
+  while ((tail & ~CLOSED) == head) {
+    if ((tail & CLOSED) != 0) {
+      return std::nullopt;
+    }
+    tail_.wait(tail, std::memory_order_acquire);
+    tail = tail_.load(std::memory_order_acquire);
+  }
+
+  std::optional<T> value = std::move(slots_[head % slots_.size()]);
+  head_.store(head + 1, std::memory_order_release);
+  head_.notify_one();
+  return value;
+}
+
+template <class T> void SpscQueue<T>::close() noexcept {
+  tail_.fetch_or(CLOSED, std::memory_order_release);
+  tail_.notify_one();
+}
+
+template <class T> void SpscQueue<T>::cancel() noexcept {
+  head_.fetch_or(CLOSED, std::memory_order_release);
+  head_.notify_one();
+}
+
+} // namespace contagent
+
+#endif // CONTAGENT_SPSC_QUEUE_H
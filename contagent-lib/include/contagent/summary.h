@@ -28,12 +28,16 @@
 #ifndef CONTAGENT_SUMMARY_H
 #define CONTAGENT_SUMMARY_H
 
+#include <cstdint>
 #include <memory>
+#include <span>
 #include <unordered_map>
+#include <vector>
 
 #include "behaviour.h"
 #include "belief.h"
 #include "configuration.h"
+#include "history.h"
 
 namespace contagent::summary {
 [[nodiscard]] std::unordered_map<std::shared_ptr<Belief>, double_t>
@@ -61,8 +65,62 @@ struct SummaryStats {
   std::unordered_map<std::shared_ptr<Behaviour>, std::size_t> n_performers;
 };
 
+/// Calculate the SummaryStats of a day from the Agents. Every overload
+/// summarises only the agents, beliefs and behaviours of the
+/// Configuration::get_output_selection.
+/// \param c The configuration.
+/// \param time The day.
+/// \return The summary statistics.
 [[nodiscard]] std::unique_ptr<SummaryStats>
 calculate_summary_stats(const Configuration &c, std::size_t time);
+
+/// Calculate the SummaryStats of a day from the activations and actions of
+/// the agents rather than from the Agents, as when they are spread between
+/// the processes of a cluster.
+/// \param c The configuration.
+/// \param activations The activations of every belief of the selected
+/// agents, B, which may leave out zeros, in any order.
+/// \param n_performers The number of selected agents that performed every
+/// behaviour, K.
+/// \return The summary statistics.
+[[nodiscard]] std::unique_ptr<SummaryStats>
+calculate_summary_stats(const Configuration &c,
+                        std::vector<std::vector<double_t>> activations,
+                        std::span<const std::size_t> n_performers);
+
+/// A copy of the activations and actions of every agent at the end of a day,
+/// made by Population::snapshot, which can be summarised while the next day
+/// is ticked.
+struct Snapshot {
+  std::size_t day = 0;
+  /// The activations of every agent, in the order of the Configuration and
+  /// then as Configuration::get_beliefs, N×B.
+  std::vector<double_t> activations;
+  /// The action of every agent, as an index of Configuration::get_behaviours,
+  /// N.
+  std::vector<std::uint32_t> actions;
+  /// Whether the zero activations are left out of the sums, as they are left
+  /// out of the Agents of a SparsePopulation, so that the sums are in the
+  /// same order as from the Agents.
+  bool omit_zeros = false;
+};
+
+/// Calculate the SummaryStats of a Snapshot.
+/// \param c The configuration, whose agents must all be in the Snapshot.
+/// \param snapshot The snapshot.
+/// \return The summary statistics.
+[[nodiscard]] std::unique_ptr<SummaryStats>
+calculate_summary_stats(const Configuration &c, const Snapshot &snapshot);
+
+/// Calculate the SummaryStats of a day from a History, as when the Population
+/// kept it in files rather than in the Agents.
+/// \param c The configuration, whose agents must all be in the History.
+/// \param history The history.
+/// \param time The day.
+/// \return The summary statistics.
+[[nodiscard]] std::unique_ptr<SummaryStats>
+calculate_summary_stats(const Configuration &c, const History &history,
+                        std::size_t time);
 } // namespace contagent::summary
 
 #endif // CONTAGENT_SUMMARY_H
\ No newline at end of file
@@ -0,0 +1,143 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_SUMMARY_WRITER_H
+#define CONTAGENT_SUMMARY_WRITER_H
+
+#include "configuration.h"
+#include "json/compact_spec.h"
+#include "json/summary_spec.h"
+#include "shm_ring.h"
+#include "summary.h"
+#include "thread_pool.h"
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+
+namespace contagent {
+
+/// Writes the summary of every day to Configuration::get_output_stream, in
+/// the same form as Runner::serialize_and_output_summary, while the days
+/// after it are ticked, in its OutputSchema. Every day is handed over as a
+/// summary::Snapshot, which a ThreadPool summarises and encodes as JSON, and
+/// a writer thread then writes the days in order, which is where the output
+/// is compressed. At most OutputPipeline::max_pending days are held at once,
+/// and ::push waits for the writer when they are, so that a slow output
+/// holds back the ticks rather than filling memory. With a RingOutput, the
+/// writer thread also publishes every day to a shm::Publisher, whose
+/// metadata is `{"dictionary":…,"startTime":…,"endTime":…,
+/// "dayStride":…,"schema":…,"state":…}` with the json::Dictionary of the
+/// selected beliefs, behaviours and, with RingOutput::state, agents.
+class SummaryWriter {
+public:
+  /// The time that was spent on each part of the output.
+  struct Metrics {
+    /// Waiting in ::push for the writer to make room, in seconds.
+    double_t blocked = 0.0;
+    /// Summarising and encoding on the ThreadPool, in seconds.
+    double_t encoding = 0.0;
+    /// Writing, and so compressing, on the writer thread, in seconds.
+    double_t writing = 0.0;
+    /// Publishing to the RingOutput, in seconds.
+    double_t publishing = 0.0;
+    /// Of the publishing, waiting for the readers of the ring, in seconds.
+    double_t stalled = 0.0;
+    /// The number of days that were overwritten in the ring before a reader
+    /// had read them.
+    std::size_t overtaken = 0;
+  };
+
+  /// Start a new SummaryWriter.
+  /// \param configuration The configuration, which must outlive this.
+  /// \throws std::system_error If the RingOutput could not be made.
+  explicit SummaryWriter(const Configuration &configuration);
+
+  /// Stop the threads, without writing the end of the output if ::finish was
+  /// not called.
+  ~SummaryWriter();
+
+  SummaryWriter(const SummaryWriter &) = delete;
+  SummaryWriter &operator=(const SummaryWriter &) = delete;
+
+  /// Hand over the next day, waiting while OutputPipeline::max_pending days
+  /// are being summarised or written.
+  /// \param snapshot The day, which must follow the last one pushed.
+  /// \throws Whatever summarising or writing an earlier day threw.
+  void push(summary::Snapshot snapshot);
+
+  /// Wait for every day to be written, and end the output.
+  /// \return The time that was spent on the output.
+  /// \throws Whatever summarising or writing a day threw.
+  Metrics finish();
+
+private:
+  /// A day that is being summarised and encoded.
+  struct Pending {
+    std::size_t day = 0;
+    std::future<void> encoded;
+    std::shared_ptr<std::string> text;
+    /// The shm::RecordKind::STATE payload, if RingOutput::state.
+    std::shared_ptr<std::vector<std::byte>> state;
+  };
+
+  /// Write the days as they are encoded, until ::finish.
+  void write();
+
+  const Configuration &configuration_;
+  const json::SummaryEncoder encoder_;
+  const std::size_t max_pending_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  /// The days that have been pushed but not yet written, in order.
+  std::queue<Pending> queue_;
+  /// The number of days that have been pushed but not yet written.
+  std::size_t n_pending_ = 0;
+  bool finishing_ = false;
+  /// The first exception of summarising or writing a day.
+  std::exception_ptr error_;
+  Metrics metrics_;
+
+  /// The dictionary of the RingOutput, if there is one.
+  std::optional<json::Dictionary> ring_dictionary_;
+  std::unique_ptr<shm::Publisher> publisher_;
+
+  ThreadPool encoders_;
+  std::thread writer_;
+};
+
+} // namespace contagent
+
+#endif // CONTAGENT_SUMMARY_WRITER_H
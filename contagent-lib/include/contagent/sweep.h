@@ -0,0 +1,147 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_SWEEP_H
+#define CONTAGENT_SWEEP_H
+
+#include "agent.h"
+#include "behaviour.h"
+#include "belief.h"
+#include "configuration.h"
+#include "thread_pool.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace contagent::sweep {
+
+/// A single point in a parameter sweep. Every override is keyed by the
+/// Belief and Behaviour objects of the base model, so that a Scenario can be
+/// applied to a model that has already been loaded.
+struct Scenario {
+  /// The name of the scenario, used to name its output.
+  std::string name;
+
+  /// Entries of Belief::relationships_ that override the base model.
+  std::unordered_map<std::shared_ptr<Belief>,
+                     std::unordered_map<std::shared_ptr<Belief>, double_t>>
+      relationships;
+
+  /// Entries of Belief::perceptions_ that override the base model.
+  std::unordered_map<std::shared_ptr<Belief>,
+                     std::unordered_map<std::shared_ptr<Behaviour>, double_t>>
+      perceptions;
+
+  /// A multiplier applied to every Agent's delta for all beliefs.
+  double_t delta_multiplier = 1.0;
+
+  /// Per-belief multipliers applied to every Agent's delta, on top of
+  /// ::delta_multiplier.
+  std::unordered_map<std::shared_ptr<Belief>, double_t> delta_multipliers;
+};
+
+/// Copy the beliefs, applying the relationship and perception overrides of a
+/// Scenario.
+/// \param beliefs The beliefs of the base model.
+/// \param scenario The scenario.
+/// \param remap Filled with a mapping from the base beliefs to the copies.
+/// \return The copied beliefs, in the same order as beliefs.
+[[nodiscard]] std::vector<std::shared_ptr<Belief>>
+copy_beliefs(const std::vector<std::shared_ptr<Belief>> &beliefs,
+             const Scenario &scenario,
+             std::unordered_map<std::shared_ptr<Belief>,
+                                std::shared_ptr<Belief>> &remap);
+
+/// Share the agents of the base model with a Scenario, whose beliefs are
+/// copies made by ::copy_beliefs, scaling their deltas as described by the
+/// Scenario.
+/// \param beliefs The beliefs of the base model.
+/// \param scenario The scenario.
+/// \return The SharedAgents of the Configuration of the scenario.
+[[nodiscard]] SharedAgents
+share_agents(const std::vector<std::shared_ptr<Belief>> &beliefs,
+             const Scenario &scenario);
+
+/// A parameter sweep runs a number of Scenarios over a single loaded
+/// population, so that the agents file only has to be parsed once.
+class Sweep {
+public:
+  /// Create a new Sweep. The base model is never mutated; every Scenario runs
+  /// on its own copy of the beliefs, and shares the agents, whose days it
+  /// keeps in a History. Every Scenario uses the same seed, so that
+  /// differences between them are not down to chance, and the same
+  /// precision, ordering, graph format, aggregation and storage. Each ticks
+  /// on a single thread of the pool that ::run is given.
+  Sweep(std::vector<std::shared_ptr<Behaviour>> behaviours,
+        std::vector<std::shared_ptr<Belief>> beliefs,
+        std::vector<std::shared_ptr<Agent>> agents, uint_fast32_t start_time,
+        uint_fast32_t end_time, std::vector<Scenario> scenarios,
+        std::uint64_t seed, Precision precision = Precision::FLOAT64,
+        Ordering ordering = Ordering::INPUT,
+        GraphFormat graph_format = GraphFormat::CSR,
+        Aggregation aggregation = Aggregation::PULL, Storage storage = {});
+
+  /// Build the Configuration for a single Scenario.
+  /// \param scenario The scenario.
+  /// \param output_stream Where the summary of the scenario is written.
+  /// \return The configuration.
+  [[nodiscard]] std::unique_ptr<Configuration>
+  make_configuration(const Scenario &scenario,
+                     std::unique_ptr<std::ostream> output_stream) const;
+
+  /// Run every Scenario on the pool, writing one summary per Scenario.
+  /// \param pool The pool that the scenarios run on.
+  /// \param make_output Creates the output stream of a Scenario.
+  /// \throws std::exception The first exception thrown by a Scenario, after
+  /// all the others have finished.
+  void run(ThreadPool &pool,
+           const std::function<std::unique_ptr<std::ostream>(
+               const Scenario &)> &make_output) const;
+
+  [[nodiscard]] const std::vector<Scenario> &get_scenarios() const;
+
+private:
+  const std::vector<std::shared_ptr<Behaviour>> behaviours_;
+  const std::vector<std::shared_ptr<Belief>> beliefs_;
+  const std::vector<std::shared_ptr<Agent>> agents_;
+  const uint_fast32_t start_time_;
+  const uint_fast32_t end_time_;
+  const std::vector<Scenario> scenarios_;
+  const std::uint64_t seed_;
+  const Precision precision_;
+  const Ordering ordering_;
+  const GraphFormat graph_format_;
+  const Aggregation aggregation_;
+  const Storage storage_;
+};
+
+} // namespace contagent::sweep
+
+#endif // CONTAGENT_SWEEP_H
@@ -0,0 +1,264 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_TICK_KERNEL_H
+#define CONTAGENT_TICK_KERNEL_H
+
+#include "compressed_graph.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace contagent {
+
+/// The arrays of a BasicDensePopulation that are read and written by a tick,
+/// laid out as documented there.
+/// \tparam Real The floating-point type of the state and tables.
+template <class Real> struct TickState {
+  const std::size_t *friend_offsets;
+  const std::uint32_t *friends;
+  const Real *friend_weights;
+  /// The friendships if they are compressed, and then the three above are
+  /// not used, otherwise nullptr.
+  const CompressedGraph *graph;
+  /// N×K, the weighted actions of the friends of each agent if they are kept
+  /// incrementally, and then none of the friendships are read, otherwise
+  /// nullptr.
+  const double_t *friend_counts;
+  /// N, the number of friends of each agent if friend_counts is not nullptr.
+  const std::uint32_t *n_friends;
+  /// The hubs, in ascending order, whose friendships are not read, as the
+  /// weighted actions of their friends are in hub_counts, H×K, and their
+  /// numbers of friends are in hub_n_friends, H.
+  const std::uint32_t *hubs;
+  std::size_t n_hubs;
+  const double_t *hub_counts;
+  const std::uint32_t *hub_n_friends;
+  const std::uint32_t *actions;
+  const std::uint32_t *archetypes;
+  /// B×K.
+  const Real *perceptions;
+  /// B.
+  const Real *mean_relationships;
+  /// A×B.
+  const Real *deltas;
+  /// A×B×K.
+  const Real *performance_relationships;
+  /// The pressure on every agent and belief, N×B, which is written by
+  /// TickKernel::perceive unless frozen.
+  Real *pressures;
+  /// Whether no action has changed since ::pressures were written, so they
+  /// are read rather than computed from the friendships.
+  bool frozen;
+  /// N, Population::fixed_, which is read while frozen and written by
+  /// TickKernel::perceive. Agents at a fixed point are not scored.
+  std::uint8_t *fixed;
+  /// N×B.
+  const Real *previous_activations;
+  /// N×B.
+  Real *activations;
+  /// N×K, which are always double_t as Population::select reads them.
+  double_t *scores;
+};
+
+/// Call f(0) up to f(N - 1), with each index as a std::integral_constant, so
+/// that the loop is always fully unrolled.
+template <std::size_t N, class F> inline void unroll(F &&f) {
+  [&f]<std::size_t... I>(std::index_sequence<I...>) {
+    (f(std::integral_constant<std::size_t, I>{}), ...);
+  }(std::make_index_sequence<N>{});
+}
+
+/// The steps of a tick of a BasicDensePopulation, for a number of beliefs and
+/// behaviours that is known at compile time. Every loop over beliefs and
+/// behaviours is unrolled, and the perceptions, the actions of friends and
+/// the activations of an agent are held in local arrays rather than read
+/// through a stride. The results are the same as the generic steps of
+/// BasicDensePopulation.
+/// \tparam Real The floating-point type of the state and tables.
+/// \tparam NB The number of beliefs.
+/// \tparam NK The number of behaviours.
+template <class Real, std::size_t NB, std::size_t NK> struct TickKernel {
+  /// BasicDensePopulation::perceive for the agents in [begin, end).
+  static void perceive(const TickState<Real> &state, std::size_t begin,
+                       std::size_t end) noexcept;
+
+  /// BasicDensePopulation::score for the agents in [begin, end).
+  static void score(const TickState<Real> &state, std::size_t begin,
+                    std::size_t end) noexcept;
+};
+
+/// A TickKernel, for choosing one at runtime.
+template <class Real> struct TickKernels {
+  std::size_t n_beliefs;
+  std::size_t n_behaviours;
+  void (*perceive)(const TickState<Real> &, std::size_t, std::size_t) noexcept;
+  void (*score)(const TickState<Real> &, std::size_t, std::size_t) noexcept;
+};
+
+/// TickKernel is instantiated for up to this many beliefs.
+constexpr std::size_t MAX_KERNEL_BELIEFS = 8;
+/// TickKernel is instantiated for up to this many behaviours.
+constexpr std::size_t MAX_KERNEL_BEHAVIOURS = 4;
+
+/// Find the TickKernel for a number of beliefs and behaviours. This is
+/// instantiated for double_t and float.
+/// \tparam Real The floating-point type of the state and tables.
+/// \param n_beliefs The number of beliefs.
+/// \param n_behaviours The number of behaviours.
+/// \return The TickKernel, or nullptr if there is not one for these sizes.
+template <class Real>
+[[nodiscard]] const TickKernels<Real> *
+find_tick_kernels(std::size_t n_beliefs, std::size_t n_behaviours) noexcept;
+
+template <class Real, std::size_t NB, std::size_t NK>
+void TickKernel<Real, NB, NK>::perceive(const TickState<Real> &state,
+                                        const std::size_t begin,
+                                        const std::size_t end) noexcept {
+  constexpr Real zero = 0;
+  constexpr Real one = 1;
+  constexpr Real two = 2;
+
+  std::array<Real, NB * NK> perceptions;
+  std::array<Real, NB> mean_relationships;
+  unroll<NB * NK>([&](auto e) { perceptions[e] = state.perceptions[e]; });
+  unroll<NB>([&](auto b) {
+    mean_relationships[b] = state.mean_relationships[b];
+  });
+
+  // The next hub at or after i.
+  std::size_t h =
+      std::lower_bound(state.hubs, state.hubs + state.n_hubs, begin) -
+      state.hubs;
+
+  for (std::size_t i = begin; i < end; ++i) {
+    Real *pressures = state.pressures + i * NB;
+    const bool hub = h < state.n_hubs && state.hubs[h] == i;
+    const Real *previous = state.previous_activations + i * NB;
+    Real *current = state.activations + i * NB;
+
+    if (state.frozen && state.fixed[i]) {
+      unroll<NB>([&](auto b) { current[b] = previous[b]; });
+      h += hub;
+      continue;
+    }
+
+    if (!state.frozen) {
+      std::array<Real, NK> actions_of_friends{};
+      std::size_t n_friends;
+      if (state.friend_counts) {
+        const double_t *counts = state.friend_counts + i * NK;
+        unroll<NK>([&](auto k) {
+          actions_of_friends[k] = static_cast<Real>(counts[k]);
+        });
+        n_friends = state.n_friends[i];
+      } else if (hub) {
+        const double_t *counts = state.hub_counts + h * NK;
+        unroll<NK>([&](auto k) {
+          actions_of_friends[k] = static_cast<Real>(counts[k]);
+        });
+        n_friends = state.hub_n_friends[h];
+      } else if (state.graph) {
+        // Summed in double precision, where the sums are exact.
+        std::array<double_t, NK> counts{};
+        n_friends = state.graph->count_actions(i, state.actions, counts.data());
+        unroll<NK>([&](auto k) {
+          actions_of_friends[k] = static_cast<Real>(counts[k]);
+        });
+      } else {
+        const std::size_t first = state.friend_offsets[i];
+        const std::size_t last = state.friend_offsets[i + 1];
+        for (std::size_t e = first; e < last; ++e) {
+          actions_of_friends[state.actions[state.friends[e]]] +=
+              state.friend_weights[e];
+        }
+        n_friends = last - first;
+      }
+
+      unroll<NB>([&](auto b) {
+        Real pressure = zero;
+        if (n_friends != 0) {
+          unroll<NK>([&](auto k) {
+            pressure += perceptions[b * NK + k] * actions_of_friends[k];
+          });
+          pressure /= n_friends; // NOLINT(*-narrowing-conversions)
+        }
+        pressures[b] = pressure;
+      });
+    }
+    h += hub;
+
+    const Real *deltas = state.deltas + state.archetypes[i] * NB;
+
+    unroll<NB>([&](auto b) {
+      const Real pressure = pressures[b];
+      const Real context = previous[b] * mean_relationships[b];
+      const Real activation_change = pressure > zero
+                                         ? (one + context) / two * pressure
+                                         : (one - context) / two * pressure;
+
+      current[b] = std::max(
+          -one, std::min(one, deltas[b] * previous[b] + activation_change));
+    });
+    state.fixed[i] = std::equal(current, current + NB, previous);
+  }
+}
+
+template <class Real, std::size_t NB, std::size_t NK>
+void TickKernel<Real, NB, NK>::score(const TickState<Real> &state,
+                                     const std::size_t begin,
+                                     const std::size_t end) noexcept {
+  for (std::size_t i = begin; i < end; ++i) {
+    if (state.fixed[i]) {
+      continue;
+    }
+
+    const Real *prs =
+        state.performance_relationships + state.archetypes[i] * NB * NK;
+
+    std::array<Real, NB> activations;
+    unroll<NB>([&](auto b) {
+      activations[b] = state.activations[i * NB + b];
+    });
+
+    std::array<Real, NK> scores{};
+    unroll<NB>([&](auto b) {
+      unroll<NK>(
+          [&](auto k) { scores[k] += activations[b] * prs[b * NK + k]; });
+    });
+
+    unroll<NK>([&](auto k) { state.scores[i * NK + k] = scores[k]; });
+  }
+}
+
+} // namespace contagent
+
+#endif // CONTAGENT_TICK_KERNEL_H
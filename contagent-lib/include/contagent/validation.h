@@ -0,0 +1,85 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTAGENT_VALIDATION_H
+#define CONTAGENT_VALIDATION_H
+
+#include "agent.h"
+#include "behaviour.h"
+#include "belief.h"
+#include "configuration.h"
+#include "nlohmann/json.hpp"
+#include <memory>
+#include <vector>
+
+namespace contagent::validation {
+
+/// The absolute difference of a summary statistic between two runs, over
+/// every day and every belief or behaviour.
+struct Divergence {
+  double_t max = 0.0;
+  double_t mean = 0.0;
+};
+
+/// How far the summary statistics of a run in Precision::FLOAT32 are from
+/// those of the same run in Precision::FLOAT64.
+struct PrecisionReport {
+  Divergence mean_activation;
+  Divergence sd_activation;
+  Divergence median_activation;
+  /// As a fraction of the number of agents.
+  Divergence nonzero_activation;
+  /// As a fraction of the number of agents.
+  Divergence n_performers;
+};
+
+/// Run a model in both precisions from the same seed and compare their
+/// summary statistics. Both runs use the dense engine, whatever the density
+/// of the activations. Each run shares the agents, which are not mutated,
+/// and keeps its days in a History.
+/// \param behaviours The behaviours.
+/// \param beliefs The beliefs.
+/// \param agents The agents.
+/// \param start_time The start time of the simulation.
+/// \param end_time The end time of the simulation.
+/// \param seed The seed of both runs.
+/// \return The divergence of the single-precision run.
+[[nodiscard]] PrecisionReport
+compare_precision(const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+                  const std::vector<std::shared_ptr<Belief>> &beliefs,
+                  const std::vector<std::shared_ptr<Agent>> &agents,
+                  uint_fast32_t start_time, uint_fast32_t end_time,
+                  std::uint64_t seed);
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Divergence, max, mean)
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(PrecisionReport, mean_activation,
+                                   sd_activation, median_activation,
+                                   nonzero_activation, n_performers)
+} // namespace contagent::validation
+
+#endif // CONTAGENT_VALIDATION_H
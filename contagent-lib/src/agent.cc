@@ -26,78 +26,107 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <random>
 #include <ranges>
+#include <stdexcept>
 #include <utility>
 
 #include "contagent/agent.h"
 #include "contagent/belief.h"
+#include "contagent/sampler.h"
 
 namespace contagent {
-Agent::Agent(const uint_fast32_t n_days, boost::uuids::uuid uuid)
-    : UUIDd(uuid) {
-  initialize(n_days);
-}
+// The histories grow as days are recorded, so the number of days is not
+// needed to reserve them.
 
-Agent::Agent(const uint_fast32_t n_days) { initialize(n_days); }
+Agent::Agent([[maybe_unused]] const uint_fast32_t n_days,
+             boost::uuids::uuid uuid)
+    : UUIDd(uuid) {}
 
-[[maybe_unused]] const std::unordered_map<std::shared_ptr<Belief>, double_t> &
-Agent::get_activations_for_day(const std::size_t day) {
+Agent::Agent([[maybe_unused]] const uint_fast32_t n_days) {}
+
+[[maybe_unused]] std::unordered_map<std::shared_ptr<Belief>, double_t>
+Agent::get_activations_for_day(const std::size_t day) const {
   return activations_.at(day);
 }
 
-Agent::Agent(uint_fast32_t n_days, boost::uuids::uuid uuid,
+Agent::Agent([[maybe_unused]] uint_fast32_t n_days, boost::uuids::uuid uuid,
              std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
                  activations)
-    : UUIDd(uuid), activations_(std::move(activations)) {
-  initialize(n_days);
-}
+    : UUIDd(uuid), activations_(activations) {}
 
 Agent::Agent(std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
                  activations,
-             uint_fast32_t n_days)
-    : activations_(std::move(activations)) {
-  initialize(n_days);
-}
+             [[maybe_unused]] uint_fast32_t n_days)
+    : activations_(activations) {}
 
-[[maybe_unused]] const std::map<std::weak_ptr<Agent>, double_t,
-                                std::owner_less<>> &
-Agent::get_friends() const {
+[[maybe_unused]] const Friends &Agent::get_friends() const {
   return friends_;
 }
 
-[[maybe_unused]] void Agent::set_friends(
-    std::map<std::weak_ptr<Agent>, double_t, std::owner_less<>> friends) {
+[[maybe_unused]] void Agent::set_friends(Friends friends) {
+  const std::owner_less<> less;
+  std::stable_sort(friends.begin(), friends.end(),
+                   [&less](const auto &a, const auto &b) {
+                     return less(a.first, b.first);
+                   });
+  friends.erase(std::unique(friends.begin(), friends.end(),
+                            [&less](const auto &a, const auto &b) {
+                              return !less(a.first, b.first) &&
+                                     !less(b.first, a.first);
+                            }),
+                friends.end());
+  friends.shrink_to_fit();
   friends_ = std::move(friends);
 }
 
-const std::vector<std::shared_ptr<Behaviour>> &Agent::get_actions() const {
+std::vector<std::shared_ptr<Behaviour>> Agent::get_actions() const {
+  return actions_.to_vector();
+}
+
+const ActionHistory &Agent::get_action_history() const noexcept {
   return actions_;
 }
 
 [[maybe_unused]] void
-Agent::set_actions(std::vector<std::shared_ptr<Behaviour>> actions) {
-  actions_ = std::move(actions);
+Agent::set_actions(const std::vector<std::shared_ptr<Behaviour>> &actions) {
+  actions_ = ActionHistory(actions);
+}
+
+void Agent::record_action(const std::size_t day,
+                          std::shared_ptr<Behaviour> behaviour) {
+  actions_.set(day, std::move(behaviour));
+}
+
+std::uint32_t Agent::get_archetype() const noexcept {
+  return archetype_.get();
+}
+
+void Agent::set_archetype(ArchetypeTable::Reference archetype) noexcept {
+  archetype_ = std::move(archetype);
 }
 
 [[maybe_unused]] const std::unordered_map<std::shared_ptr<Belief>, double_t> &
 Agent::get_deltas() const {
-  return deltas_;
+  return ArchetypeTable::global().at(archetype_.get()).deltas;
 }
 
 [[maybe_unused]] void Agent::set_deltas(
     std::unordered_map<std::shared_ptr<Belief>, double_t> deltas) {
-  deltas_ = std::move(deltas);
+  auto &table = ArchetypeTable::global();
+  Archetype archetype = table.at(archetype_.get());
+  archetype.deltas = std::move(deltas);
+  archetype_ = table.intern(std::move(archetype));
 }
 
 double_t Agent::weighted_relationship(const uint_fast32_t sim_time,
                                       const std::shared_ptr<Belief> &b1,
                                       const std::shared_ptr<Belief> &b2) const {
-  auto &acts = activations_[sim_time];
-  if (acts.contains(b1)) {
+  if (const auto activation = activations_.find(sim_time, b1)) {
     auto &relationships = b1->get_relationships();
     if (relationships.contains(b2)) {
-      return acts.at(b1) * relationships.at(b2);
+      return *activation * relationships.at(b2);
     }
   } else {
     return 0.0;
@@ -128,11 +157,8 @@ Agent::get_actions_of_friends(uint_fast32_t sim_time) const {
 
   for (auto const &[weak_friend, w] : friends_) {
     if (auto shared_friend = weak_friend.lock()) {
-      auto &action = shared_friend->get_actions().at(sim_time);
-      if (!map->contains(action)) {
-        map->insert(std::pair<std::shared_ptr<Behaviour>, double_t>(action, 0.0));
-      }
-      map->insert(std::pair<std::shared_ptr<Behaviour>, double_t>(action, map->at(action) + w));
+      auto &action = shared_friend->get_action_history().at(sim_time);
+      (*map)[action] += w;
     }
   }
 
@@ -177,21 +203,20 @@ void Agent::update_activation(
     const std::vector<std::shared_ptr<Belief>> &beliefs,
     const std::unordered_map<std::shared_ptr<Behaviour>, double_t>
         &actions_of_friends) {
-  const double_t delta = deltas_.at(belief);
-  const auto &activations = activations_.at(sim_time - 1);
-  const double_t activation = activations.at(belief);
+  const double_t delta =
+      ArchetypeTable::global().at(archetype_.get()).deltas.at(belief);
+  const auto activation = activations_.find(sim_time - 1, belief);
+  if (!activation) {
+    throw std::out_of_range("The agent has no activation of the belief");
+  }
 
   const double_t activation_change_v =
       activation_change(sim_time - 1, belief, beliefs, actions_of_friends);
 
   const double_t new_activation =
-      std::max(-1.0, std::min(1.0, delta * activation + activation_change_v));
-
-  if (activations_.size() < sim_time + 1) {
-    activations_.resize(sim_time + 1);
-  }
+      std::max(-1.0, std::min(1.0, delta * *activation + activation_change_v));
 
-  activations_.at(sim_time)[belief] = new_activation;
+  activations_.set(sim_time, belief, new_activation);
 }
 void Agent::update_activation_for_all_beliefs(
     const uint_fast32_t sim_time,
@@ -205,99 +230,65 @@ void Agent::update_activation_for_all_beliefs(
     std::shared_ptr<Belief>,
     std::unordered_map<std::shared_ptr<Behaviour>, double_t>> &
 Agent::get_performance_relationships() const {
-  return performance_relationships_;
+  return ArchetypeTable::global()
+      .at(archetype_.get())
+      .performance_relationships;
 }
 [[maybe_unused]] void Agent::set_performance_relationships(
     std::unordered_map<std::shared_ptr<Belief>,
                        std::unordered_map<std::shared_ptr<Behaviour>, double_t>>
         performanceRelationships) {
-  performance_relationships_ = std::move(performanceRelationships);
+  auto &table = ArchetypeTable::global();
+  Archetype archetype = table.at(archetype_.get());
+  archetype.performance_relationships = std::move(performanceRelationships);
+  archetype_ = table.intern(std::move(archetype));
 }
 
 void Agent::perform_action(
     const uint_fast32_t sim_time,
     const std::vector<std::shared_ptr<Behaviour>> &behaviours,
     const std::vector<std::shared_ptr<Belief>> &beliefs) {
-  std::vector<std::pair<std::shared_ptr<Behaviour>, double_t>>
-      unnormalized_probabilities;
-  unnormalized_probabilities.reserve(behaviours.size());
+  // Reused between calls, so that choosing allocates nothing.
+  thread_local std::vector<double_t> scores;
+  thread_local Sampler sampler;
+  scores.assign(behaviours.size(), 0.0);
 
-  for (const auto &behaviour : behaviours) {
-    double_t value = 0.0;
+  const auto &performance_relationships =
+      ArchetypeTable::global().at(archetype_.get()).performance_relationships;
+  const auto activations = activations_.at(sim_time);
 
-    for (const auto &belief : beliefs) {
-      double_t prs = performance_relationships_.at(belief).at(behaviour);
-      double_t activation = activations_.at(sim_time).at(belief);
-      value += prs * activation;
+  for (const auto &belief : beliefs) {
+    const auto &prs = performance_relationships.at(belief);
+    const double_t activation = activations.at(belief);
+    for (std::size_t k = 0; k < behaviours.size(); ++k) {
+      scores[k] += prs.at(behaviours[k]) * activation;
     }
-
-    unnormalized_probabilities.emplace_back(behaviour, value);
   }
 
-  std::sort(
-      unnormalized_probabilities.begin(), unnormalized_probabilities.end(),
-      [](const auto &p1, const auto &p2) { return p1.second < p2.second; });
-
-  const auto &last_elem = unnormalized_probabilities.back();
+  std::random_device random_device;
+  std::mt19937 rng{random_device()};
+  std::uniform_real_distribution<> distribution(0.0, 1.0);
 
-  if (last_elem.second < 0.0) {
-    actions_.insert(actions_.begin() + sim_time, last_elem.first);
-  } else {
-    std::vector<std::pair<std::shared_ptr<Behaviour>, double_t>>
-        filtered_probabilities;
-    std::copy_if(unnormalized_probabilities.begin(),
-                 unnormalized_probabilities.end(),
-                 std::back_inserter(filtered_probabilities),
-                 [](const auto &pair) { return pair.second >= 0.0; });
-    if (filtered_probabilities.size() == 1) {
-      actions_.insert(actions_.begin() + sim_time,
-                      filtered_probabilities[0].first);
-    } else {
-      double_t normalizing_factor = 0.0;
-
-      for (const auto &[_, v] : filtered_probabilities) {
-        normalizing_factor += v;
-      }
-
-      for (auto &[_, v] : filtered_probabilities) {
-        v /= normalizing_factor;
-      }
-
-      std::shared_ptr<Behaviour> &chosenBehaviour =
-          filtered_probabilities.back().first;
-
-      std::random_device random_device;
-      std::mt19937 rng{random_device()};
-      std::uniform_real_distribution<> distribution(
-          0, std::nextafter(1.0, std::numeric_limits<double_t>::max()));
-
-      double_t rv = distribution(rng);
-
-      for (auto &[behaviour, v] : filtered_probabilities) {
-        rv -= v;
-
-        if (rv <= 0.0) {
-          chosenBehaviour = behaviour;
-          break;
-        }
-      }
-
-      actions_.insert(actions_.begin() + sim_time, chosenBehaviour);
-    }
-  }
+  const std::uint32_t chosen = sampler.sample(scores, distribution(rng));
+  record_action(sim_time, behaviours[chosen]);
 }
 
-void Agent::initialize(uint_fast32_t n_days) {
-  actions_.reserve(n_days);
-  activations_.reserve(n_days);
-}
 void Agent::set_activations(
-    std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
-        activations) {
-  activations_ = std::move(activations);
+    const std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
+        &activations) {
+  activations_ = ActivationHistory(activations);
+}
+void Agent::set_activations_for_day(
+    const std::size_t day,
+    const std::unordered_map<std::shared_ptr<Belief>, double_t>
+        &activations) {
+  activations_.set(day, activations);
+}
+std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>>
+Agent::get_activations() const {
+  return activations_.to_vector();
 }
-const std::vector<std::unordered_map<std::shared_ptr<Belief>, double_t>> &
-Agent::get_activations() const noexcept {
+const ActivationHistory &Agent::get_activation_history() const noexcept {
   return activations_;
 }
 } // namespace contagent
@@ -0,0 +1,326 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/agent_history.h"
+
+#include <algorithm>
+#include <bit>
+#include <span>
+#include <stdexcept>
+
+namespace contagent {
+namespace {
+void put_varint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<std::uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<std::uint8_t>(value));
+}
+
+std::uint64_t get_varint(const std::uint8_t *&in) {
+  std::uint64_t value = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    const std::uint8_t byte = *in++;
+    value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+}
+} // namespace
+
+ActionHistory::ActionHistory(
+    const std::vector<std::shared_ptr<Behaviour>> &actions) {
+  for (std::size_t day = 0; day < actions.size(); ++day) {
+    set(day, actions[day]);
+  }
+}
+
+std::size_t ActionHistory::size() const noexcept {
+  return runs_.empty() ? 0 : runs_.back().end;
+}
+
+const std::shared_ptr<Behaviour> &
+ActionHistory::at(const std::size_t day) const {
+  const auto run = std::upper_bound(
+      runs_.begin(), runs_.end(), day,
+      [](const std::size_t d, const Run &r) { return d < r.end; });
+  if (run == runs_.end()) {
+    throw std::out_of_range("No action has been recorded for the day");
+  }
+  return behaviours_[run->behaviour];
+}
+
+void ActionHistory::set(const std::size_t day,
+                        std::shared_ptr<Behaviour> behaviour) {
+  if (day > size()) {
+    throw std::out_of_range("Actions must be recorded without gaps");
+  }
+
+  while (!runs_.empty() && runs_.back().end > day) {
+    const std::size_t start =
+        runs_.size() > 1 ? runs_[runs_.size() - 2].end : 0;
+    if (start < day) {
+      runs_.back().end = day;
+    } else {
+      runs_.pop_back();
+    }
+  }
+
+  if (!runs_.empty() && behaviours_[runs_.back().behaviour] == behaviour) {
+    ++runs_.back().end;
+    return;
+  }
+
+  auto known = std::find(behaviours_.begin(), behaviours_.end(), behaviour);
+  if (known == behaviours_.end()) {
+    behaviours_.push_back(std::move(behaviour));
+    known = behaviours_.end() - 1;
+  }
+  runs_.push_back({static_cast<std::uint32_t>(day + 1),
+                   static_cast<std::uint32_t>(known - behaviours_.begin())});
+}
+
+std::vector<std::shared_ptr<Behaviour>> ActionHistory::to_vector() const {
+  std::vector<std::shared_ptr<Behaviour>> actions;
+  actions.reserve(size());
+  for (const auto &run : runs_) {
+    actions.resize(run.end, behaviours_[run.behaviour]);
+  }
+  return actions;
+}
+
+ActivationHistory::ActivationHistory(const std::vector<Day> &days) {
+  for (std::size_t day = 0; day < days.size(); ++day) {
+    set(day, days[day]);
+  }
+}
+
+std::size_t ActivationHistory::size() const noexcept {
+  return blocks_.size() * BLOCK_DAYS + open_.size();
+}
+
+ActivationHistory::Day ActivationHistory::at(const std::size_t day) const {
+  OpenDay decoded;
+  Day activations;
+  for (const auto &[belief, activation] : get(day, decoded)) {
+    activations.emplace(beliefs_[belief], activation);
+  }
+  return activations;
+}
+
+std::optional<double_t>
+ActivationHistory::find(const std::size_t day,
+                        const std::shared_ptr<Belief> &belief) const {
+  OpenDay decoded;
+  const auto entries = get(day, decoded);
+  const auto known = std::find(beliefs_.begin(), beliefs_.end(), belief);
+  if (known == beliefs_.end()) {
+    return std::nullopt;
+  }
+
+  const auto index = static_cast<std::uint32_t>(known - beliefs_.begin());
+  for (const auto &entry : entries) {
+    if (entry.belief == index) {
+      return entry.activation;
+    }
+  }
+  return std::nullopt;
+}
+
+void ActivationHistory::set(const std::size_t day, const Day &activations) {
+  OpenDay entries;
+  entries.reserve(activations.size());
+  for (const auto &[belief, activation] : activations) {
+    entries.push_back({intern(belief), activation});
+  }
+  open(day) = std::move(entries);
+  seal();
+}
+
+void ActivationHistory::set(const std::size_t day,
+                            const std::shared_ptr<Belief> &belief,
+                            const double_t activation) {
+  const std::uint32_t index = intern(belief);
+  auto &entries = open(day);
+  const auto entry =
+      std::find_if(entries.begin(), entries.end(),
+                   [index](const Entry &e) { return e.belief == index; });
+  if (entry == entries.end()) {
+    entries.push_back({index, activation});
+  } else {
+    entry->activation = activation;
+  }
+  seal();
+}
+
+std::vector<ActivationHistory::Day> ActivationHistory::to_vector() const {
+  std::vector<Day> days;
+  days.reserve(size());
+  const auto add = [this, &days](const OpenDay &entries) {
+    auto &day = days.emplace_back();
+    for (const auto &[belief, activation] : entries) {
+      day.emplace(beliefs_[belief], activation);
+    }
+  };
+
+  for (std::size_t block = 0; block < blocks_.size(); ++block) {
+    for (const auto &entries : decode(block)) {
+      add(entries);
+    }
+  }
+  for (const auto &entries : open_) {
+    add(entries);
+  }
+  return days;
+}
+
+std::uint32_t ActivationHistory::intern(const std::shared_ptr<Belief> &belief) {
+  const auto known = std::find(beliefs_.begin(), beliefs_.end(), belief);
+  if (known != beliefs_.end()) {
+    return known - beliefs_.begin();
+  }
+  beliefs_.push_back(belief);
+  return beliefs_.size() - 1;
+}
+
+std::span<const ActivationHistory::Entry>
+ActivationHistory::get(const std::size_t day, OpenDay &decoded) const {
+  if (day >= size()) {
+    throw std::out_of_range("No activations have been recorded for the day");
+  }
+  const std::size_t sealed = blocks_.size() * BLOCK_DAYS;
+  if (day >= sealed) {
+    return open_[day - sealed];
+  }
+  decoded = std::move(decode(day / BLOCK_DAYS)[day % BLOCK_DAYS]);
+  return decoded;
+}
+
+ActivationHistory::OpenDay &ActivationHistory::open(const std::size_t day) {
+  // Changing a compressed day is rare, so the blocks from it on are
+  // decompressed, and compressed again by ::seal.
+  if (const std::size_t block = day / BLOCK_DAYS; block < blocks_.size()) {
+    std::vector<OpenDay> days;
+    for (std::size_t b = block; b < blocks_.size(); ++b) {
+      auto decoded = decode(b);
+      std::move(decoded.begin(), decoded.end(), std::back_inserter(days));
+    }
+    std::move(open_.begin(), open_.end(), std::back_inserter(days));
+    blocks_.resize(block);
+    open_ = std::move(days);
+  }
+
+  const std::size_t sealed = blocks_.size() * BLOCK_DAYS;
+  if (day >= size()) {
+    open_.resize(day + 1 - sealed);
+  }
+  return open_[day - sealed];
+}
+
+void ActivationHistory::seal() {
+  std::size_t n_sealed = 0;
+  while (open_.size() - n_sealed >= BLOCK_DAYS + 2) {
+    std::vector<std::uint8_t> block;
+    std::vector<std::uint64_t> previous(beliefs_.size(), 0);
+    const OpenDay *previous_day = nullptr;
+
+    for (std::size_t d = n_sealed; d < n_sealed + BLOCK_DAYS; ++d) {
+      const auto &day = open_[d];
+      const bool same_beliefs =
+          previous_day != nullptr && previous_day->size() == day.size() &&
+          std::equal(day.begin(), day.end(), previous_day->begin(),
+                     [](const Entry &a, const Entry &b) {
+                       return a.belief == b.belief;
+                     });
+      put_varint(block, day.size() << 1 | (same_beliefs ? 1 : 0));
+      if (!same_beliefs) {
+        for (const auto &entry : day) {
+          put_varint(block, entry.belief);
+        }
+      }
+
+      for (const auto &entry : day) {
+        const auto bits = std::bit_cast<std::uint64_t>(entry.activation);
+        std::uint64_t x = bits ^ previous[entry.belief];
+        previous[entry.belief] = bits;
+        const auto n_bytes =
+            static_cast<std::uint8_t>(8 - std::countl_zero(x) / 8);
+        block.push_back(n_bytes);
+        for (std::uint8_t i = 0; i < n_bytes; ++i, x >>= 8) {
+          block.push_back(static_cast<std::uint8_t>(x));
+        }
+      }
+      previous_day = &day;
+    }
+
+    block.shrink_to_fit();
+    blocks_.push_back(std::move(block));
+    n_sealed += BLOCK_DAYS;
+  }
+
+  if (n_sealed != 0) {
+    open_.erase(open_.begin(), open_.begin() + n_sealed);
+  }
+}
+
+std::vector<ActivationHistory::OpenDay>
+ActivationHistory::decode(const std::size_t block) const {
+  std::vector<OpenDay> days(BLOCK_DAYS);
+  std::vector<std::uint64_t> previous(beliefs_.size(), 0);
+  const std::uint8_t *in = blocks_[block].data();
+
+  for (std::size_t d = 0; d < BLOCK_DAYS; ++d) {
+    auto &day = days[d];
+    const std::uint64_t header = get_varint(in);
+    day.resize(header >> 1);
+    if ((header & 1) != 0) {
+      for (std::size_t e = 0; e < day.size(); ++e) {
+        day[e].belief = days[d - 1][e].belief;
+      }
+    } else {
+      for (auto &entry : day) {
+        entry.belief = static_cast<std::uint32_t>(get_varint(in));
+      }
+    }
+
+    for (auto &entry : day) {
+      const std::uint8_t n_bytes = *in++;
+      std::uint64_t x = 0;
+      for (std::uint8_t i = 0; i < n_bytes; ++i) {
+        x |= static_cast<std::uint64_t>(*in++) << (8 * i);
+      }
+      previous[entry.belief] ^= x;
+      entry.activation = std::bit_cast<double_t>(previous[entry.belief]);
+    }
+  }
+
+  return days;
+}
+} // namespace contagent
@@ -0,0 +1,203 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/archetype.h"
+#include "contagent/random.h"
+
+#include <bit>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace contagent {
+namespace {
+using random::mix;
+
+template <class K>
+std::size_t hash_entry(const std::shared_ptr<K> &key, double_t value) noexcept {
+  return mix(std::hash<std::shared_ptr<K>>()(key) ^
+             mix(std::bit_cast<std::uint64_t>(value)));
+}
+} // namespace
+
+ArchetypeTable::Reference::Reference(ArchetypeTable *table,
+                                     const std::uint32_t id) noexcept
+    : table_(table), id_(id) {}
+
+ArchetypeTable::Reference::Reference(const Reference &other) noexcept
+    : table_(other.table_), id_(other.id_) {
+  if (table_ != nullptr) {
+    table_->acquire(id_);
+  }
+}
+
+ArchetypeTable::Reference::Reference(Reference &&other) noexcept
+    : table_(std::exchange(other.table_, nullptr)),
+      id_(std::exchange(other.id_, EMPTY)) {}
+
+ArchetypeTable::Reference &
+ArchetypeTable::Reference::operator=(Reference other) noexcept {
+  std::swap(table_, other.table_);
+  std::swap(id_, other.id_);
+  return *this;
+}
+
+ArchetypeTable::Reference::~Reference() {
+  if (table_ != nullptr) {
+    table_->release(id_);
+  }
+}
+
+std::uint32_t ArchetypeTable::Reference::get() const noexcept { return id_; }
+
+ArchetypeTable::ArchetypeTable() {
+  // The reference to the empty archetype is never destroyed, so that it is
+  // never released.
+  auto empty = intern(Archetype());
+  empty.table_ = nullptr;
+}
+
+ArchetypeTable::~ArchetypeTable() {
+  for (auto &segment : segments_) {
+    delete[] segment.load();
+  }
+}
+
+ArchetypeTable &ArchetypeTable::global() {
+  static auto *table = new ArchetypeTable();
+  return *table;
+}
+
+ArchetypeTable::Reference ArchetypeTable::intern(Archetype archetype) {
+  const std::size_t h = hash(archetype);
+
+  std::lock_guard lock(mutex_);
+
+  auto [begin, end] = ids_.equal_range(h);
+  for (auto it = begin; it != end; ++it) {
+    if (auto &entry = slot(it->second); entry.archetype == archetype) {
+      entry.references.fetch_add(1, std::memory_order_relaxed);
+      return {this, it->second};
+    }
+  }
+
+  std::uint32_t id;
+  if (!free_.empty()) {
+    id = free_.back();
+    free_.pop_back();
+  } else {
+    if (n_slots_ == std::numeric_limits<std::uint32_t>::max()) {
+      throw std::length_error("Too many archetypes");
+    }
+    id = n_slots_;
+    const std::size_t k = std::bit_width(id / FIRST_SEGMENT_SIZE + 1) - 1;
+    if (segments_[k].load(std::memory_order_relaxed) == nullptr) {
+      segments_[k].store(new Entry[FIRST_SEGMENT_SIZE << k],
+                         std::memory_order_release);
+    }
+    ++n_slots_;
+  }
+
+  auto &entry = slot(id);
+  entry.archetype = std::move(archetype);
+  entry.references.store(1, std::memory_order_relaxed);
+  ids_.emplace(h, id);
+  size_.fetch_add(1, std::memory_order_release);
+
+  return {this, id};
+}
+
+const Archetype &ArchetypeTable::at(const std::uint32_t id) const noexcept {
+  return slot(id).archetype;
+}
+
+std::size_t ArchetypeTable::size() const noexcept {
+  return size_.load(std::memory_order_acquire);
+}
+
+void ArchetypeTable::acquire(const std::uint32_t id) noexcept {
+  slot(id).references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ArchetypeTable::release(const std::uint32_t id) noexcept {
+  auto &entry = slot(id);
+
+  // Only the last reference takes the lock, as ::intern is the only way to
+  // count a reference to an id that is not held.
+  std::uint32_t n = entry.references.load(std::memory_order_relaxed);
+  while (n > 1) {
+    if (entry.references.compare_exchange_weak(n, n - 1,
+                                               std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+
+  std::lock_guard lock(mutex_);
+  if (entry.references.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  auto [begin, end] = ids_.equal_range(hash(entry.archetype));
+  for (auto it = begin; it != end; ++it) {
+    if (it->second == id) {
+      ids_.erase(it);
+      break;
+    }
+  }
+  entry.archetype = Archetype();
+  free_.push_back(id);
+  size_.fetch_sub(1, std::memory_order_release);
+}
+
+std::size_t ArchetypeTable::hash(const Archetype &archetype) noexcept {
+  // Entries are combined with a sum so that the hash does not depend on the
+  // iteration order of the maps.
+  std::size_t h = 0;
+
+  for (const auto &[belief, delta] : archetype.deltas) {
+    h += hash_entry(belief, delta);
+  }
+
+  for (const auto &[belief, prs] : archetype.performance_relationships) {
+    std::size_t inner = 0;
+    for (const auto &[behaviour, pr] : prs) {
+      inner += hash_entry(behaviour, pr);
+    }
+    h += mix(std::hash<std::shared_ptr<Belief>>()(belief) + mix(inner));
+  }
+
+  return h;
+}
+
+ArchetypeTable::Entry &
+ArchetypeTable::slot(const std::uint32_t id) const noexcept {
+  const std::size_t k = std::bit_width(id / FIRST_SEGMENT_SIZE + 1) - 1;
+  const std::size_t offset = id - FIRST_SEGMENT_SIZE * ((1ULL << k) - 1);
+  return segments_[k].load(std::memory_order_acquire)[offset];
+}
+} // namespace contagent
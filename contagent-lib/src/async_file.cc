@@ -0,0 +1,469 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "contagent/async_file.h"
+#include "contagent/thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <future>
+#include <glog/logging.h>
+#include <system_error>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define CONTAGENT_HAS_IO_URING 1
+#endif
+
+namespace contagent {
+/// Where the writes of an AsyncFile are sent.
+class AsyncFile::Backend {
+public:
+  virtual ~Backend() = default;
+
+  /// Queue a write of a buffer.
+  /// \param buffer The index of the buffer, which is returned by ::wait.
+  /// \param data The bytes.
+  /// \param size The number of bytes.
+  /// \param offset The offset in the file.
+  virtual void submit(std::size_t buffer, const char *data, std::size_t size,
+                      std::size_t offset) = 0;
+
+  /// Wait for a queued write to complete.
+  /// \return The index of its buffer.
+  /// \throws std::system_error If it failed.
+  virtual std::size_t wait() = 0;
+
+  /// Get the number of writes that are queued.
+  [[nodiscard]] virtual std::size_t n_pending() const noexcept = 0;
+};
+
+namespace {
+/// Make a std::system_error of an errno.
+std::system_error error(const int code, const std::string &what) {
+  return {code, std::generic_category(), what};
+}
+
+/// Write all of a range of bytes with pwrite, retrying short writes. With
+/// O_DIRECT a short write may stop off the alignment, from where the file
+/// cannot be written directly, so the rest goes through the page cache.
+/// \param fd The file.
+/// \param buffered The file without O_DIRECT, or -1 if fd is not direct.
+void write_fully(int fd, const int buffered, const char *data,
+                 std::size_t size, std::size_t offset) {
+  while (size != 0) {
+    const ssize_t n = pwrite(fd, data, size, static_cast<off_t>(offset));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw error(errno, "Unable to write the output");
+    }
+    data += n;
+    size -= static_cast<std::size_t>(n);
+    offset += static_cast<std::size_t>(n);
+    if (size != 0 && buffered >= 0) {
+      fd = buffered;
+    }
+  }
+}
+
+/// Writes with pwrite on a ThreadPool, completing in order.
+class PwriteBackend final : public AsyncFile::Backend {
+public:
+  PwriteBackend(const int fd, const int buffered, const std::size_t n_threads)
+      : fd_(fd), buffered_(buffered),
+        pool_(std::max<std::size_t>(1, n_threads)) {}
+
+  void submit(const std::size_t buffer, const char *data,
+              const std::size_t size, const std::size_t offset) override {
+    pending_.emplace_back(
+        buffer, pool_.submit([fd = fd_, buffered = buffered_, data, size,
+                              offset] {
+          write_fully(fd, buffered, data, size, offset);
+        }));
+  }
+
+  std::size_t wait() override {
+    auto [buffer, written] = std::move(pending_.front());
+    pending_.pop_front();
+    written.get();
+    return buffer;
+  }
+
+  [[nodiscard]] std::size_t n_pending() const noexcept override {
+    return pending_.size();
+  }
+
+private:
+  const int fd_;
+  const int buffered_;
+  ThreadPool pool_;
+  std::deque<std::pair<std::size_t, std::future<void>>> pending_;
+};
+
+#ifdef CONTAGENT_HAS_IO_URING
+/// Writes through an io_uring, whose rings are mapped and driven with the
+/// io_uring_setup and io_uring_enter system calls.
+class IoUringBackend final : public AsyncFile::Backend {
+public:
+  /// \throws std::system_error If the kernel has no io_uring, or does not
+  /// allow it.
+  IoUringBackend(const int fd, const int buffered, const std::size_t n_buffers)
+      : fd_(fd), buffered_(buffered), requests_(n_buffers) {
+    io_uring_params params{};
+    ring_fd_ = static_cast<int>(syscall(
+        __NR_io_uring_setup, static_cast<unsigned>(n_buffers), &params));
+    if (ring_fd_ < 0) {
+      throw error(errno, "Unable to set up an io_uring");
+    }
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sq_ = map(sq_size_, IORING_OFF_SQ_RING);
+    cq_ = map(cq_size_, IORING_OFF_CQ_RING);
+    sqes_ = static_cast<io_uring_sqe *>(map(sqes_size_, IORING_OFF_SQES));
+    if (!sq_ || !cq_ || !sqes_) {
+      const int code = errno;
+      unmap();
+      throw error(code, "Unable to map an io_uring");
+    }
+
+    auto *sq = static_cast<char *>(sq_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto *cq = static_cast<char *>(cq_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  ~IoUringBackend() override {
+    // The kernel may still be writing from the buffers, which are freed
+    // after this, so every write is waited for.
+    while (n_pending_ != 0) {
+      try {
+        wait();
+      } catch (const std::system_error &) {
+      }
+    }
+    unmap();
+  }
+
+  void submit(const std::size_t buffer, const char *data,
+              const std::size_t size, const std::size_t offset) override {
+    requests_[buffer] = {{const_cast<char *>(data), size}, offset};
+    ++n_pending_;
+    enqueue(buffer);
+  }
+
+  std::size_t wait() override {
+    while (true) {
+      const unsigned head = *cq_head_;
+      if (head == std::atomic_ref(*cq_tail_).load(std::memory_order_acquire)) {
+        if (syscall(__NR_io_uring_enter, ring_fd_, 0, 1,
+                    IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+            errno != EINTR) {
+          throw error(errno, "Unable to wait for the io_uring");
+        }
+        continue;
+      }
+      const io_uring_cqe cqe = cqes_[head & cq_mask_];
+      std::atomic_ref(*cq_head_).store(head + 1, std::memory_order_release);
+
+      const auto buffer = static_cast<std::size_t>(cqe.user_data);
+      auto &request = requests_[buffer];
+      if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+        enqueue(buffer);
+        continue;
+      }
+      if (cqe.res < 0) {
+        --n_pending_;
+        throw error(-cqe.res, "Unable to write the output");
+      }
+      // A short write is continued from where it stopped. With O_DIRECT
+      // that may be off the alignment, so the rest is written through the
+      // page cache instead.
+      const auto written = static_cast<std::size_t>(cqe.res);
+      if (written < request.iov.iov_len) {
+        request.iov.iov_base = static_cast<char *>(request.iov.iov_base) +
+                               written;
+        request.iov.iov_len -= written;
+        request.offset += written;
+        if (buffered_ < 0) {
+          enqueue(buffer);
+          continue;
+        }
+        --n_pending_;
+        write_fully(buffered_, -1,
+                    static_cast<const char *>(request.iov.iov_base),
+                    request.iov.iov_len, request.offset);
+        return buffer;
+      }
+      --n_pending_;
+      return buffer;
+    }
+  }
+
+  [[nodiscard]] std::size_t n_pending() const noexcept override {
+    return n_pending_;
+  }
+
+private:
+  /// A write of a buffer, which stays put while the kernel reads it.
+  struct Request {
+    iovec iov;
+    std::size_t offset;
+  };
+
+  void *map(const std::size_t size, const unsigned long long offset) const {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_,
+                   static_cast<off_t>(offset));
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  void unmap() noexcept {
+    if (sq_) {
+      munmap(sq_, sq_size_);
+    }
+    if (cq_) {
+      munmap(cq_, cq_size_);
+    }
+    if (sqes_) {
+      munmap(sqes_, sqes_size_);
+    }
+    close(ring_fd_);
+  }
+
+  /// Submit the write of a Request, as one IORING_OP_WRITEV.
+  void enqueue(const std::size_t buffer) {
+    const unsigned tail = *sq_tail_;
+    const unsigned index = tail & sq_mask_;
+    io_uring_sqe &sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITEV;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<std::uint64_t>(&requests_[buffer].iov);
+    sqe.len = 1;
+    sqe.off = requests_[buffer].offset;
+    sqe.user_data = buffer;
+    sq_array_[index] = index;
+    std::atomic_ref(*sq_tail_).store(tail + 1, std::memory_order_release);
+
+    while (syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0) < 0) {
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        throw error(errno, "Unable to submit to the io_uring");
+      }
+    }
+  }
+
+  const int fd_;
+  const int buffered_;
+  int ring_fd_ = -1;
+  std::vector<Request> requests_;
+  std::size_t n_pending_ = 0;
+
+  void *sq_ = nullptr;
+  void *cq_ = nullptr;
+  io_uring_sqe *sqes_ = nullptr;
+  std::size_t sq_size_ = 0;
+  std::size_t cq_size_ = 0;
+  std::size_t sqes_size_ = 0;
+  unsigned *sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+};
+#endif
+} // namespace
+
+AsyncFile::AsyncFile(const std::filesystem::path &path,
+                     const FileOutput &options)
+    : path_(path.string()),
+      buffer_size_((std::max<std::size_t>(options.buffer_size, 1) +
+                    ALIGNMENT - 1) /
+                   ALIGNMENT * ALIGNMENT),
+      opened_(std::chrono::steady_clock::now()) {
+  constexpr int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+  if (options.direct) {
+    fd_ = open(path_.c_str(), flags | O_DIRECT, 0644);
+    if (fd_ >= 0) {
+      metrics_.direct = true;
+    } else {
+      LOG(WARNING) << "Unable to open " << path_
+                   << " with O_DIRECT, writing through the page cache";
+    }
+  }
+#endif
+  if (fd_ < 0) {
+    fd_ = open(path_.c_str(), flags, 0644);
+  }
+  if (fd_ < 0) {
+    throw error(errno, "Unable to open " + path_);
+  }
+  if (metrics_.direct) {
+    buffered_fd_ = open(path_.c_str(), O_WRONLY | O_CLOEXEC);
+    if (buffered_fd_ < 0) {
+      const int code = errno;
+      ::close(fd_);
+      throw error(code, "Unable to open " + path_);
+    }
+  }
+
+  const std::size_t n_buffers = std::max<std::size_t>(options.n_buffers, 2);
+  for (std::size_t b = 0; b < n_buffers; ++b) {
+    auto *buffer =
+        static_cast<char *>(std::aligned_alloc(ALIGNMENT, buffer_size_));
+    if (!buffer) {
+      ::close(fd_);
+      if (buffered_fd_ >= 0) {
+        ::close(buffered_fd_);
+      }
+      throw std::bad_alloc();
+    }
+    buffers_.emplace_back(buffer, std::free);
+    free_.push_back(n_buffers - 1 - b);
+  }
+  current_ = free_.back();
+  free_.pop_back();
+
+#ifdef CONTAGENT_HAS_IO_URING
+  try {
+    backend_ = std::make_unique<IoUringBackend>(fd_, buffered_fd_, n_buffers);
+    metrics_.io_uring = true;
+  } catch (const std::system_error &e) {
+    LOG(INFO) << e.what() << ", writing " << path_ << " with pwrite";
+  }
+#endif
+  if (!backend_) {
+    backend_ = std::make_unique<PwriteBackend>(fd_, buffered_fd_,
+                                               options.n_threads);
+  }
+}
+
+AsyncFile::~AsyncFile() {
+  if (!closed_) {
+    try {
+      close();
+    } catch (const std::exception &e) {
+      LOG(ERROR) << "Unable to close " << path_ << ": " << e.what();
+    }
+  }
+}
+
+void AsyncFile::write(const char *data, std::size_t n) {
+  while (n != 0) {
+    const std::size_t copied = std::min(n, buffer_size_ - filled_);
+    std::memcpy(buffers_[current_].get() + filled_, data, copied);
+    filled_ += copied;
+    data += copied;
+    n -= copied;
+    if (filled_ == buffer_size_) {
+      submit();
+    }
+  }
+}
+
+void AsyncFile::submit() {
+  // With O_DIRECT every write must be a multiple of the alignment, so the
+  // last buffer is padded with zeros, which ::close then truncates.
+  std::size_t size = filled_;
+  if (metrics_.direct) {
+    size = (filled_ + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    std::memset(buffers_[current_].get() + filled_, 0, size - filled_);
+  }
+  backend_->submit(current_, buffers_[current_].get(), size, offset_);
+  offset_ += filled_;
+  metrics_.bytes += filled_;
+  filled_ = 0;
+
+  if (free_.empty()) {
+    const auto started = std::chrono::steady_clock::now();
+    free_.push_back(backend_->wait());
+    metrics_.stalled += std::chrono::duration<double_t>(
+                            std::chrono::steady_clock::now() - started)
+                            .count();
+  }
+  current_ = free_.back();
+  free_.pop_back();
+}
+
+AsyncFile::Metrics AsyncFile::close() {
+  closed_ = true;
+  std::exception_ptr failure;
+  try {
+    if (filled_ != 0) {
+      submit();
+    }
+    const auto started = std::chrono::steady_clock::now();
+    while (backend_->n_pending() != 0) {
+      free_.push_back(backend_->wait());
+    }
+    metrics_.stalled += std::chrono::duration<double_t>(
+                            std::chrono::steady_clock::now() - started)
+                            .count();
+    if (metrics_.direct && ftruncate(fd_, static_cast<off_t>(offset_)) != 0) {
+      throw error(errno, "Unable to truncate " + path_);
+    }
+  } catch (...) {
+    failure = std::current_exception();
+  }
+  backend_.reset();
+  if (buffered_fd_ >= 0 && ::close(buffered_fd_) != 0 && !failure) {
+    failure = std::make_exception_ptr(error(errno, "Unable to close " + path_));
+  }
+  if (::close(fd_) != 0 && !failure) {
+    failure = std::make_exception_ptr(error(errno, "Unable to close " + path_));
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  metrics_.elapsed = std::chrono::duration<double_t>(
+                         std::chrono::steady_clock::now() - opened_)
+                         .count();
+  return metrics_;
+}
+} // namespace contagent
@@ -0,0 +1,520 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/cluster.h"
+#include "contagent/json/summary_spec.h"
+#include "contagent/population.h"
+#include "contagent/reorder.h"
+#include "contagent/selection.h"
+#include "contagent/summary.h"
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace contagent::cluster {
+namespace {
+/// Tick the agents of one process of a Plan, and send its activations and
+/// actions to the coordinator.
+/// \param configuration The configuration of the whole simulation.
+/// \param plan The plan.
+/// \param w The index of the process.
+/// \param n_threads The number of threads to tick with.
+/// \param channel The channel to the coordinator.
+void work(const Configuration &configuration, const Plan &plan,
+          const std::size_t w, const std::size_t n_threads,
+          Channel &channel) {
+  const auto &behaviours = configuration.get_behaviours();
+  const auto &beliefs = configuration.get_beliefs();
+  const auto &ghosts = plan.ghosts[w];
+  const std::size_t start = configuration.get_start_time();
+  const std::size_t end = configuration.get_end_time();
+  const std::uint64_t seed = configuration.get_seed();
+
+  // The agents of the process are its own, in the order of the Plan, and
+  // then its ghosts.
+  Ownership ownership;
+  ownership.ids.assign(plan.order.begin() + plan.boundaries[w],
+                       plan.order.begin() + plan.boundaries[w + 1]);
+  ownership.n_owned = ownership.ids.size();
+  ownership.ids.insert(ownership.ids.end(), ghosts.begin(), ghosts.end());
+  ownership.weight_range = plan.weight_range;
+
+  // With StreamedAgents the worker loads only its own agents and ghosts from
+  // their JSON. Otherwise the Agents are the coordinator's, forked with it,
+  // and a page of them is only copied when it is written to. The worker
+  // holds them without taking a reference, and keeps the days in a History
+  // rather than writing them to the Agents, so that it does not write to
+  // them. Building the Population still locks the friends of its agents,
+  // which writes to their reference counts, so the pages of its own agents
+  // and ghosts are copied, but not those of the rest.
+  const auto &streamed = configuration.get_streamed_agents();
+  std::vector<std::shared_ptr<Agent>> local;
+  if (!streamed.index) {
+    const auto &agents = configuration.get_agents();
+    for (const auto i : ownership.ids) {
+      local.push_back(
+          std::shared_ptr<Agent>(std::shared_ptr<Agent>(), agents[i].get()));
+    }
+  }
+  const std::size_t n_owned = ownership.n_owned;
+  const std::vector<std::uint32_t> ids = ownership.ids;
+
+  // The ghosts are last, so the agents are not reordered, and the exchange
+  // comes between selecting and storing, so there are barriers.
+  Parallelism parallelism = configuration.get_parallelism();
+  parallelism.n_threads = n_threads;
+  parallelism.scheduling = Scheduling::BARRIER;
+  const Configuration local_configuration(
+      behaviours, beliefs, local, start, end, nullptr, false, seed,
+      configuration.get_precision(), parallelism, Ordering::INPUT,
+      configuration.get_graph_format(), configuration.get_aggregation(),
+      std::move(ownership), configuration.get_storage(), {}, {},
+      SharedAgents{beliefs, {}}, streamed);
+  auto population = Population::create(local_configuration, start - 1);
+
+  // The actions that the other processes have of every owned agent that is a
+  // ghost of theirs, as only the changes are sent.
+  std::vector<std::uint32_t> exported;
+  std::vector<std::uint32_t> sent;
+  for (std::size_t i = 0; i < n_owned; ++i) {
+    if (plan.reader_offsets[ids[i]] != plan.reader_offsets[ids[i] + 1]) {
+      exported.push_back(i);
+      sent.push_back(population->get_action(i));
+    }
+  }
+
+  const auto exchange = [&] {
+    std::vector<Change> changes;
+    for (std::size_t e = 0; e < exported.size(); ++e) {
+      const std::uint32_t action = population->get_action(exported[e]);
+      if (action != sent[e]) {
+        changes.push_back({ids[exported[e]], action});
+        sent[e] = action;
+      }
+    }
+    channel.send<Change>(changes);
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> actions;
+    for (const auto &change : channel.receive<Change>()) {
+      const std::size_t g =
+          std::lower_bound(ghosts.begin(), ghosts.end(), change.agent) -
+          ghosts.begin();
+      actions.emplace_back(n_owned + g, change.action);
+    }
+    std::sort(actions.begin(), actions.end());
+    population->set_actions(actions);
+  };
+
+  population->score();
+  population->select(start - 1, seed);
+  exchange();
+  population->store_actions(start - 1);
+
+  for (std::size_t day = start; day < end; ++day) {
+    population->perceive(day);
+    population->store_activations(day);
+    population->score();
+    population->select(day, seed);
+    exchange();
+    population->store_actions(day);
+    population->release();
+  }
+
+  // The rows of the History are in the order of the agents, as the ghosts
+  // keep them from being reordered, and a Population that does not store
+  // zeros leaves them out of the summary as it would from the Agents.
+  // Only the selected agents and days are sent, and the coordinator
+  // leaves out the beliefs and behaviours that are not selected.
+  const History &history = *population->get_history();
+  const bool omit_zeros = !population->stores_zeros();
+  const auto agent_mask = selection::mask(
+      configuration.get_output_selection().agents,
+      configuration.get_n_agents());
+  for (std::size_t day = start; day < end; ++day) {
+    if (!selection::contains_day(configuration, day)) {
+      continue;
+    }
+    for (std::size_t b = 0; b < beliefs.size(); ++b) {
+      std::vector<double_t> activations;
+      activations.reserve(n_owned);
+      for (std::size_t i = 0; i < n_owned; ++i) {
+        const double_t activation =
+            history.activations(day)[i * beliefs.size() + b];
+        if (agent_mask[ids[i]] && (!omit_zeros || activation != 0.0)) {
+          activations.push_back(activation);
+        }
+      }
+      channel.send<double_t>(activations);
+    }
+
+    std::vector<std::uint64_t> n_performers(behaviours.size(), 0);
+    for (std::size_t i = 0; i < n_owned; ++i) {
+      if (agent_mask[ids[i]]) {
+        ++n_performers[history.actions(day)[i]];
+      }
+    }
+    channel.send<std::uint64_t>(n_performers);
+    history.release(day, 0, n_owned);
+  }
+}
+
+/// Route the changed actions between the workers every day, then merge their
+/// activations and actions into summaries, and write them.
+/// \param configuration The configuration of the whole simulation.
+/// \param plan The plan.
+/// \param channels The channel to every worker.
+void coordinate(const Configuration &configuration, const Plan &plan,
+                std::vector<Channel> &channels) {
+  const std::size_t start = configuration.get_start_time();
+  const std::size_t end = configuration.get_end_time();
+  const std::size_t n_beliefs = configuration.get_beliefs().size();
+  const std::size_t n_behaviours = configuration.get_behaviours().size();
+
+  // The day before the start is selected as Runner::run does.
+  for (std::size_t day = start - 1; day < end; ++day) {
+    std::vector<std::vector<Change>> outgoing(channels.size());
+    std::size_t n_changes = 0;
+    for (auto &channel : channels) {
+      for (const auto &change : channel.receive<Change>()) {
+        for (std::size_t r = plan.reader_offsets[change.agent];
+             r < plan.reader_offsets[change.agent + 1]; ++r) {
+          outgoing[plan.readers[r]].push_back(change);
+        }
+        ++n_changes;
+      }
+    }
+    for (std::size_t w = 0; w < channels.size(); ++w) {
+      channels[w].send<Change>(outgoing[w]);
+    }
+    LOG(INFO) << "[time=" << day << "] Exchanged " << n_changes
+              << " changed actions between the processes";
+  }
+
+  const contagent::json::SummaryEncoder encoder(configuration);
+  auto &output = *configuration.get_output_stream();
+  output << encoder.begin();
+  bool first = true;
+  for (std::size_t day = start; day < end; ++day) {
+    if (!selection::contains_day(configuration, day)) {
+      continue;
+    }
+    std::vector<std::vector<double_t>> activations(n_beliefs);
+    std::vector<std::size_t> n_performers(n_behaviours, 0);
+
+    for (auto &channel : channels) {
+      for (auto &belief_activations : activations) {
+        const auto received = channel.receive<double_t>();
+        belief_activations.insert(belief_activations.end(), received.begin(),
+                                  received.end());
+      }
+      const auto received = channel.receive<std::uint64_t>();
+      for (std::size_t k = 0; k < n_behaviours; ++k) {
+        n_performers[k] += received[k];
+      }
+    }
+
+    const auto stats = summary::calculate_summary_stats(
+        configuration, std::move(activations), n_performers);
+    output << (first ? "" : ",") << encoder.encode(*stats, day);
+    first = false;
+  }
+  output << encoder.end();
+}
+
+/// Wait for every worker to exit.
+/// \param pids The process IDs of the workers.
+/// \return The number of workers that failed.
+std::size_t wait_for(const std::vector<pid_t> &pids) {
+  std::size_t failed = 0;
+  for (const auto pid : pids) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      ++failed;
+    }
+  }
+  return failed;
+}
+} // namespace
+
+Channel::Channel(const int fd) noexcept : fd_(fd) {}
+
+Channel::~Channel() { close(); }
+
+Channel::Channel(Channel &&other) noexcept
+    : fd_(std::exchange(other.fd_, -1)) {}
+
+Channel &Channel::operator=(Channel &&other) noexcept {
+  if (this != &other) {
+    close();
+    fd_ = std::exchange(other.fd_, -1);
+  }
+  return *this;
+}
+
+std::pair<Channel, Channel> Channel::make_pair() {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Unable to make a socket pair");
+  }
+  return {Channel(fds[0]), Channel(fds[1])};
+}
+
+void Channel::close() noexcept {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+void Channel::write_all(const void *data, std::size_t size) {
+  const auto *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    // Without MSG_NOSIGNAL, writing to a worker that has died would kill the
+    // coordinator rather than throw.
+    const ssize_t n = ::send(fd_, bytes, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "Unable to write to a socket");
+    }
+    bytes += n;
+    size -= n;
+  }
+}
+
+void Channel::read_all(void *data, std::size_t size) {
+  auto *bytes = static_cast<char *>(data);
+  while (size > 0) {
+    const ssize_t n = ::recv(fd_, bytes, size, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "Unable to read from a socket");
+    }
+    if (n == 0) {
+      throw std::runtime_error("The other process closed its socket");
+    }
+    bytes += n;
+    size -= n;
+  }
+}
+
+Plan plan(const Configuration &configuration, const std::size_t n_processes) {
+  const std::size_t n_agents = configuration.get_n_agents();
+
+  // The friendships of StreamedAgents are read from their JSON, and are only
+  // held while the agents are divided.
+  Plan plan;
+  AgentGraph graph;
+  if (const auto &streamed = configuration.get_streamed_agents();
+      streamed.index) {
+    graph = streamed.graph();
+  } else {
+    const auto &agents = configuration.get_agents();
+    std::unordered_map<const Agent *, std::uint32_t> agent_index;
+    agent_index.reserve(n_agents);
+    for (std::size_t i = 0; i < n_agents; ++i) {
+      agent_index.emplace(agents[i].get(), i);
+    }
+
+    // The friends are sorted by UUID, as they are read from the JSON.
+    std::vector<std::pair<const Agent *, double_t>> agent_friends;
+    graph.offsets.reserve(n_agents + 1);
+    graph.offsets.push_back(0);
+    for (const auto &agent : agents) {
+      agent_friends.clear();
+      for (const auto &[weak_friend, weight] : agent->get_friends()) {
+        if (auto shared_friend = weak_friend.lock()) {
+          agent_friends.emplace_back(shared_friend.get(), weight);
+        } else {
+          throw std::runtime_error("Unable to lock weak pointer");
+        }
+        auto &[min, max] = graph.weight_range.emplace(
+            graph.weight_range.value_or(std::pair{weight, weight}));
+        min = std::min(min, weight);
+        max = std::max(max, weight);
+      }
+      std::sort(agent_friends.begin(), agent_friends.end(),
+                [](const auto &a, const auto &b) {
+                  return a.first->get_uuid() < b.first->get_uuid();
+                });
+      for (const auto &[shared_friend, _weight] : agent_friends) {
+        graph.friends.push_back(agent_index.at(shared_friend));
+      }
+      graph.offsets.push_back(graph.friends.size());
+    }
+  }
+  const auto &offsets = graph.offsets;
+  const auto &friends = graph.friends;
+  plan.weight_range = graph.weight_range;
+
+  plan.order = reorder::order(configuration.get_ordering(), offsets, friends);
+
+  // The cost of the agents before each, in the order.
+  std::vector<std::size_t> costs(n_agents + 1, 0);
+  for (std::size_t k = 0; k < n_agents; ++k) {
+    const std::uint32_t i = plan.order[k];
+    costs[k + 1] = costs[k] + 1 + offsets[i + 1] - offsets[i];
+  }
+  plan.boundaries.push_back(0);
+  for (std::size_t w = 1; w < n_processes; ++w) {
+    plan.boundaries.push_back(
+        std::lower_bound(costs.begin() + plan.boundaries.back(), costs.end(),
+                         costs.back() * w / n_processes) -
+        costs.begin());
+  }
+  plan.boundaries.push_back(n_agents);
+
+  std::vector<std::uint32_t> owner(n_agents);
+  for (std::size_t w = 0; w < n_processes; ++w) {
+    for (std::size_t k = plan.boundaries[w]; k < plan.boundaries[w + 1];
+         ++k) {
+      owner[plan.order[k]] = w;
+    }
+  }
+
+  plan.ghosts.resize(n_processes);
+  for (std::size_t w = 0; w < n_processes; ++w) {
+    auto &ghosts = plan.ghosts[w];
+    for (std::size_t k = plan.boundaries[w]; k < plan.boundaries[w + 1];
+         ++k) {
+      const std::uint32_t i = plan.order[k];
+      for (std::size_t e = offsets[i]; e < offsets[i + 1]; ++e) {
+        if (owner[friends[e]] != w) {
+          ghosts.push_back(friends[e]);
+        }
+      }
+    }
+    std::sort(ghosts.begin(), ghosts.end());
+    ghosts.erase(std::unique(ghosts.begin(), ghosts.end()), ghosts.end());
+  }
+
+  plan.reader_offsets.assign(n_agents + 1, 0);
+  for (const auto &ghosts : plan.ghosts) {
+    for (const auto g : ghosts) {
+      ++plan.reader_offsets[g + 1];
+    }
+  }
+  for (std::size_t i = 0; i < n_agents; ++i) {
+    plan.reader_offsets[i + 1] += plan.reader_offsets[i];
+  }
+  plan.readers.resize(plan.reader_offsets.back());
+  std::vector<std::size_t> next(plan.reader_offsets.begin(),
+                                plan.reader_offsets.end() - 1);
+  for (std::size_t w = 0; w < n_processes; ++w) {
+    for (const auto g : plan.ghosts[w]) {
+      plan.readers[next[g]++] = w;
+    }
+  }
+
+  return plan;
+}
+
+void run(const Configuration &configuration, const std::size_t n_processes) {
+  if (configuration.get_full_output()) {
+    throw std::invalid_argument(
+        "The full output cannot be merged between processes");
+  }
+
+  const auto cluster_plan = plan(configuration, n_processes);
+  LOG(INFO) << "Divided " << configuration.get_n_agents()
+            << " agents between " << n_processes << " processes, with "
+            << cluster_plan.readers.size() << " ghosts";
+
+  std::size_t n_threads = configuration.get_parallelism().n_threads;
+  if (n_threads == 0) {
+    n_threads = std::max<std::size_t>(
+        1, std::thread::hardware_concurrency() / n_processes);
+  }
+
+  std::vector<Channel> channels;
+  std::vector<pid_t> pids;
+  for (std::size_t w = 0; w < n_processes; ++w) {
+    auto [coordinator_end, worker_end] = Channel::make_pair();
+    const pid_t pid = fork();
+    if (pid < 0) {
+      const int error = errno;
+      channels.clear();
+      wait_for(pids);
+      throw std::system_error(error, std::generic_category(),
+                              "Unable to fork a worker");
+    }
+
+    if (pid == 0) {
+      // The worker must not hold the sockets of the other workers, or they
+      // would not see the coordinator close them. It leaves with _exit, so
+      // that it does not flush or close the output of the coordinator.
+      for (auto &channel : channels) {
+        channel.close();
+      }
+      coordinator_end.close();
+      int status = 0;
+      try {
+        work(configuration, cluster_plan, w, n_threads, worker_end);
+      } catch (const std::exception &e) {
+        LOG(ERROR) << "[process=" << w << "] " << e.what();
+        status = 1;
+      }
+      google::FlushLogFiles(google::GLOG_INFO);
+      _exit(status);
+    }
+
+    channels.push_back(std::move(coordinator_end));
+    pids.push_back(pid);
+  }
+
+  try {
+    coordinate(configuration, cluster_plan, channels);
+  } catch (...) {
+    channels.clear();
+    wait_for(pids);
+    throw;
+  }
+
+  channels.clear();
+  if (const std::size_t failed = wait_for(pids); failed != 0) {
+    throw std::runtime_error(std::to_string(failed) + " workers failed");
+  }
+}
+} // namespace contagent::cluster
@@ -0,0 +1,169 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/compressed_graph.h"
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace contagent {
+namespace {
+void write_varint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<std::uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<std::uint8_t>(value));
+}
+} // namespace
+
+CompressedGraph::CompressedGraph(const std::span<const std::size_t> offsets,
+                                 const std::span<const std::uint32_t> friends,
+                                 const std::span<const double_t> weights,
+                                 Partitions &partitions,
+                                 std::optional<std::pair<double_t, double_t>>
+                                     weight_range) {
+  const std::size_t n_agents = offsets.size() - 1;
+
+  if (!weight_range && !weights.empty()) {
+    const auto [min, max] =
+        std::minmax_element(weights.begin(), weights.end());
+    weight_range.emplace(*min, *max);
+  }
+  const auto [min, max] = weight_range.value_or(std::pair{0.0, 0.0});
+  uniform_ = min == max;
+  min_weight_ = min;
+  weight_step_ = 0.0;
+  if (!uniform_) {
+    // The least power of two that spans the weights in 0xfffe steps, which
+    // leaves a step for rounding the least weight down to a multiple of it.
+    const double_t step = (max - min) / 0xfffe;
+    weight_step_ = std::ldexp(1.0, std::ilogb(step));
+    if (weight_step_ < step) {
+      weight_step_ *= 2;
+    }
+    min_weight_ = std::floor(min / weight_step_) * weight_step_;
+  }
+
+  // Encode the row of an agent, with its friends in ascending order.
+  const auto encode = [&](const std::size_t agent,
+                          std::vector<std::pair<std::uint32_t, double_t>> &row,
+                          std::vector<std::uint8_t> &out) {
+    row.clear();
+    for (std::size_t e = offsets[agent]; e < offsets[agent + 1]; ++e) {
+      row.emplace_back(friends[e], weights[e]);
+    }
+    std::sort(row.begin(), row.end());
+
+    out.clear();
+    if (row.empty()) {
+      return;
+    }
+
+    std::uint32_t max_delta = 0;
+    for (std::size_t r = 1; r < row.size(); ++r) {
+      max_delta = std::max(max_delta, row[r].first - row[r - 1].first);
+    }
+    const unsigned width = std::bit_width(max_delta);
+
+    const auto delta = static_cast<std::int64_t>(row.front().first) -
+                       static_cast<std::int64_t>(agent);
+    write_varint(out, row.size());
+    write_varint(out, static_cast<std::uint64_t>(delta) << 1 ^
+                          static_cast<std::uint64_t>(delta >> 63));
+    out.push_back(width);
+
+    const std::size_t packed = out.size();
+    out.resize(packed + ((row.size() - 1) * width + 7) / 8, 0);
+    for (std::size_t r = 1; r < row.size(); ++r) {
+      const std::size_t bit = (r - 1) * width;
+      std::uint64_t value = std::uint64_t{row[r].first - row[r - 1].first}
+                            << bit % 8;
+      for (std::size_t i = packed + bit / 8; value != 0; ++i, value >>= 8) {
+        out[i] |= static_cast<std::uint8_t>(value);
+      }
+    }
+
+    if (!uniform_) {
+      for (const auto &[_id, weight] : row) {
+        const auto q = quantum(weight);
+        out.push_back(static_cast<std::uint8_t>(q));
+        out.push_back(static_cast<std::uint8_t>(q >> 8));
+      }
+    }
+  };
+
+  std::vector<std::uint64_t> sizes(n_agents + 1, 0);
+  partitions.run([&](std::size_t, const std::size_t begin,
+                     const std::size_t end) {
+    std::vector<std::pair<std::uint32_t, double_t>> row;
+    std::vector<std::uint8_t> out;
+    for (std::size_t i = begin; i < end; ++i) {
+      encode(i, row, out);
+      sizes[i + 1] = out.size();
+    }
+  });
+  std::partial_sum(sizes.begin(), sizes.end(), sizes.begin());
+
+  // Resizing does not touch the pages, so each is placed on the node of the
+  // partition that encodes into it.
+  offsets_.resize(n_agents + 1);
+  bytes_.resize(sizes.back() + PADDING);
+  partitions.run([&](std::size_t, const std::size_t begin,
+                     const std::size_t end) {
+    std::vector<std::pair<std::uint32_t, double_t>> row;
+    std::vector<std::uint8_t> out;
+    for (std::size_t i = begin; i < end; ++i) {
+      offsets_[i] = sizes[i];
+      encode(i, row, out);
+      std::copy(out.begin(), out.end(), bytes_.begin() + sizes[i]);
+    }
+  });
+  offsets_[n_agents] = sizes[n_agents];
+  std::fill(bytes_.end() - PADDING, bytes_.end(), 0);
+}
+
+std::uint16_t CompressedGraph::quantum(const double_t weight) const noexcept {
+  return static_cast<std::uint16_t>(
+      std::lround((weight - min_weight_) / weight_step_));
+}
+
+double_t CompressedGraph::quantise(const double_t weight) const noexcept {
+  return uniform_ ? min_weight_ : min_weight_ + weight_step_ * quantum(weight);
+}
+
+std::size_t CompressedGraph::size_bytes() const noexcept {
+  return offsets_.size() * sizeof(std::uint64_t) + bytes_.size();
+}
+
+bool CompressedGraph::has_uniform_weights() const noexcept {
+  return uniform_;
+}
+} // namespace contagent
@@ -34,10 +34,23 @@ Configuration::Configuration(
     const std::vector<std::shared_ptr<Belief>> &beliefs,
     const std::vector<std::shared_ptr<Agent>> &agents,
     const uint_fast32_t start_time, const uint_fast32_t end_time,
-    std::unique_ptr<std::ostream> output_stream, const bool full_output)
+    std::unique_ptr<std::ostream> output_stream, const bool full_output,
+    const std::uint64_t seed, const Precision precision,
+    const Parallelism parallelism, const Ordering ordering,
+    const GraphFormat graph_format, const Aggregation aggregation,
+    Ownership ownership, Storage storage,
+    const OutputPipeline output_pipeline, OutputSelection output_selection,
+    SharedAgents shared_agents, StreamedAgents streamed_agents)
     : behaviours_(behaviours), beliefs_(beliefs), agents_(agents),
       start_time_(start_time), end_time_(end_time),
-      output_stream_(std::move(output_stream)), full_output_(full_output) {}
+      output_stream_(std::move(output_stream)), full_output_(full_output),
+      seed_(seed), precision_(precision), parallelism_(parallelism),
+      ordering_(ordering), graph_format_(graph_format),
+      aggregation_(aggregation), ownership_(std::move(ownership)),
+      storage_(std::move(storage)), output_pipeline_(output_pipeline),
+      output_selection_(std::move(output_selection)),
+      shared_agents_(std::move(shared_agents)),
+      streamed_agents_(std::move(streamed_agents)) {}
 const std::vector<std::shared_ptr<Behaviour>> &
 Configuration::get_behaviours() const {
   return behaviours_;
@@ -54,4 +67,41 @@ const std::unique_ptr<std::ostream> &Configuration::get_output_stream() const {
   return output_stream_;
 }
 bool Configuration::get_full_output() const { return full_output_; }
+std::uint64_t Configuration::get_seed() const { return seed_; }
+Precision Configuration::get_precision() const { return precision_; }
+const Parallelism &Configuration::get_parallelism() const {
+  return parallelism_;
+}
+Ordering Configuration::get_ordering() const { return ordering_; }
+GraphFormat Configuration::get_graph_format() const { return graph_format_; }
+Aggregation Configuration::get_aggregation() const { return aggregation_; }
+const Ownership &Configuration::get_ownership() const { return ownership_; }
+const Storage &Configuration::get_storage() const { return storage_; }
+const OutputPipeline &Configuration::get_output_pipeline() const {
+  return output_pipeline_;
+}
+const OutputSelection &Configuration::get_output_selection() const {
+  return output_selection_;
+}
+const SharedAgents &Configuration::get_shared_agents() const {
+  return shared_agents_;
+}
+const StreamedAgents &Configuration::get_streamed_agents() const {
+  return streamed_agents_;
+}
+std::size_t Configuration::get_n_agents() const {
+  if (!streamed_agents_.index) {
+    return agents_.size();
+  }
+  return ownership_.ids.empty() ? streamed_agents_.index->uuids.size()
+                                : ownership_.ids.size();
+}
+boost::uuids::uuid
+Configuration::get_agent_uuid(const std::size_t agent) const {
+  if (!streamed_agents_.index) {
+    return agents_[agent]->get_uuid();
+  }
+  return streamed_agents_.index
+      ->uuids[ownership_.ids.empty() ? agent : ownership_.ids[agent]];
+}
 } // namespace contagent
\ No newline at end of file
@@ -0,0 +1,596 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/dense_population.h"
+#include "contagent/linalg.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace contagent {
+namespace {
+/// The number of agents of an Archetype that are scored by one matrix
+/// product, so that the gathered activations and scores stay in cache.
+constexpr std::size_t SCORE_BLOCK = 4096;
+} // namespace
+
+template <class Real>
+BasicDensePopulation<Real>::BasicDensePopulation(
+    const Configuration &configuration, const AgentTable &agents)
+    : Population(configuration, agents),
+      tick_kernels_(find_tick_kernels<Real>(n_beliefs_, n_behaviours_)) {
+  const auto &beliefs = configuration.get_beliefs();
+  const auto &behaviours = configuration.get_behaviours();
+
+  const auto behaviour_index = index(behaviours);
+
+  std::vector<Real> perceptions(n_beliefs_ * n_behaviours_, 0.0);
+
+  for (std::size_t b = 0; b < n_beliefs_; ++b) {
+    for (const auto &[weak_behaviour, perception] :
+         beliefs[b]->get_perceptions()) {
+      if (auto behaviour = weak_behaviour.lock();
+          behaviour && behaviour_index.contains(behaviour.get())) {
+        perceptions[b * n_behaviours_ + behaviour_index.at(behaviour.get())] =
+            perception;
+      }
+    }
+  }
+
+  const auto &table = ArchetypeTable::global();
+  const auto &agent_beliefs = get_agent_beliefs();
+  std::vector<Real> performance_relationships(
+      archetype_ids_.size() * n_beliefs_ * n_behaviours_, 0.0);
+  Real *prs = performance_relationships.data();
+
+  for (const auto id : archetype_ids_) {
+    const auto &archetype = table.at(id);
+    for (const auto &belief : agent_beliefs) {
+      if (auto belief_prs = archetype.performance_relationships.find(belief);
+          belief_prs != archetype.performance_relationships.end()) {
+        for (std::size_t k = 0; k < n_behaviours_; ++k) {
+          if (auto pr = belief_prs->second.find(behaviours[k]);
+              pr != belief_prs->second.end()) {
+            prs[k] = pr->second;
+          }
+        }
+      }
+      prs += n_behaviours_;
+    }
+  }
+
+  std::vector<std::size_t> pr_offsets{0};
+  std::vector<std::uint32_t> pr_behaviours;
+  std::vector<Real> pr_values;
+  for (std::size_t row = 0; row < archetype_ids_.size() * n_beliefs_; ++row) {
+    for (std::size_t k = 0; k < n_behaviours_; ++k) {
+      if (const Real pr = performance_relationships[row * n_behaviours_ + k];
+          pr != 0.0) {
+        pr_behaviours.push_back(k);
+        pr_values.push_back(pr);
+      }
+    }
+    pr_offsets.push_back(pr_behaviours.size());
+  }
+  sparse_prs_ = !tick_kernels_ &&
+                static_cast<double_t>(pr_values.size()) <=
+                    MAX_SPARSE_PR_DENSITY * performance_relationships.size();
+
+  tables_.resize(partitions_->n_nodes());
+
+  {
+    const auto backing = back_with_files();
+    if constexpr (std::is_same_v<Real, double_t>) {
+      real_friend_weights_ = friend_weights_.data();
+    } else {
+      converted_friend_weights_.resize(friend_weights_.size());
+      real_friend_weights_ = converted_friend_weights_.data();
+    }
+
+    activations_.resize(n_agents_ * n_beliefs_);
+    previous_activations_.resize(n_agents_ * n_beliefs_);
+    contexts_.resize(n_agents_ * n_beliefs_);
+    pressures_.resize(n_agents_ * n_beliefs_);
+  }
+
+  partitions_->run([&](const std::size_t p, const std::size_t begin,
+                       const std::size_t end) {
+    if (partitions_->leads_node(p)) {
+      auto &tables = tables_[partitions_->node(p)];
+      tables.perceptions.assign(perceptions.begin(), perceptions.end());
+      tables.mean_relationships.assign(mean_relationships_.begin(),
+                                       mean_relationships_.end());
+      tables.deltas.assign(deltas_.begin(), deltas_.end());
+      tables.performance_relationships.assign(
+          performance_relationships.begin(), performance_relationships.end());
+      if (sparse_prs_) {
+        tables.pr_offsets.assign(pr_offsets.begin(), pr_offsets.end());
+        tables.pr_behaviours.assign(pr_behaviours.begin(), pr_behaviours.end());
+        tables.pr_values.assign(pr_values.begin(), pr_values.end());
+      }
+    }
+
+    if constexpr (!std::is_same_v<Real, double_t>) {
+      if (!graph_) {
+        std::copy(friend_weights_.begin() + friend_offsets_[begin],
+                  friend_weights_.begin() + friend_offsets_[end],
+                  converted_friend_weights_.begin() + friend_offsets_[begin]);
+      }
+    }
+
+    std::fill(activations_.begin() + begin * n_beliefs_,
+              activations_.begin() + end * n_beliefs_, 0.0);
+    std::fill(previous_activations_.begin() + begin * n_beliefs_,
+              previous_activations_.begin() + end * n_beliefs_, 0.0);
+    std::fill(contexts_.begin() + begin * n_beliefs_,
+              contexts_.begin() + end * n_beliefs_, 0.0);
+    std::fill(pressures_.begin() + begin * n_beliefs_,
+              pressures_.begin() + end * n_beliefs_, 0.0);
+
+    for (std::size_t i = begin; i < end; ++i) {
+      const std::size_t row = original_[i];
+      for (std::size_t a = agents.activation_offsets[row];
+           a < agents.activation_offsets[row + 1]; ++a) {
+        activations_[i * n_beliefs_ + agents.activation_beliefs[a]] =
+            agents.activation_values[a];
+      }
+    }
+  });
+}
+
+template <class Real>
+std::span<const Real> BasicDensePopulation<Real>::get_activations(
+    const std::size_t agent) const noexcept {
+  return {activations_.data() + agent * n_beliefs_, n_beliefs_};
+}
+
+template <class Real>
+double_t BasicDensePopulation<Real>::get_activation(
+    const std::size_t agent, const std::size_t belief) const noexcept {
+  return activations_[agent * n_beliefs_ + belief];
+}
+
+template <class Real>
+Population::Engine BasicDensePopulation<Real>::get_engine() const noexcept {
+  return Engine::DENSE;
+}
+
+template <class Real>
+const TickKernels<Real> *
+BasicDensePopulation<Real>::get_tick_kernels() const noexcept {
+  return tick_kernels_;
+}
+
+template <class Real>
+TickState<Real>
+BasicDensePopulation<Real>::tick_state(const std::size_t partition) noexcept {
+  auto &tables = tables_[partitions_->node(partition)];
+  return {friend_offsets_.data(),
+          friends_.data(),
+          real_friend_weights_,
+          graph_.get(),
+          incremental_ ? friend_counts_.data() : nullptr,
+          n_friends_.data(),
+          hubs_.data(),
+          hubs_.size(),
+          hub_counts_.data(),
+          hub_n_friends_.data(),
+          actions_.data(),
+          archetypes_.data(),
+          tables.perceptions.data(),
+          tables.mean_relationships.data(),
+          tables.deltas.data(),
+          tables.performance_relationships.data(),
+          pressures_.data(),
+          !actions_changed_,
+          fixed_.data(),
+          previous_activations_.data(),
+          activations_.data(),
+          scores_.data()};
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::perceive(std::size_t) {
+  if (settled_) {
+    return;
+  }
+
+  if (actions_changed_ && !incremental_) {
+    count_hub_actions();
+  }
+
+  std::swap(activations_, previous_activations_);
+  const bool frozen = !actions_changed_;
+  std::vector<char> moved(partitions_->size(), 0);
+
+  partitions_->steal([this, frozen, &moved](const std::size_t p,
+                                          const std::size_t begin,
+                                          const std::size_t end) {
+    perceive_range(p, begin, end);
+
+    // With the same pressures, the partition has reached a fixed point once
+    // no activation of any of its agents has changed.
+    if (frozen) {
+      moved[p] |= std::find(fixed_.begin() + begin, fixed_.begin() + end, 0) !=
+                  fixed_.begin() + end;
+    }
+  });
+
+  actions_changed_ = false;
+  settled_ = frozen && std::find(moved.begin(), moved.end(), 1) == moved.end();
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::perceive_range(const std::size_t p,
+                                                const std::size_t begin,
+                                                const std::size_t end) {
+  if (tick_kernels_) {
+    tick_kernels_->perceive(tick_state(p), begin, end);
+  } else {
+    contextualize_partition(p, begin, end);
+    perceive_partition(p, begin, end);
+  }
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::perceive_partition(const std::size_t p,
+                                                    const std::size_t begin,
+                                                    const std::size_t end) {
+  constexpr Real zero = 0;
+  constexpr Real one = 1;
+  constexpr Real two = 2;
+
+  const std::size_t n_beliefs = n_beliefs_;
+  const std::size_t n_behaviours = n_behaviours_;
+  const auto &tables = tables_[partitions_->node(p)];
+  const Real *perceptions = tables.perceptions.data();
+  std::vector<Real> actions_of_friends(n_behaviours);
+  std::vector<double_t> counts(graph_ ? n_behaviours : 0);
+  // The next hub at or after i.
+  auto hub = std::lower_bound(hubs_.begin(), hubs_.end(), begin);
+
+  for (std::size_t i = begin; i < end; ++i) {
+    Real *pressures = pressures_.data() + i * n_beliefs;
+    const bool is_hub = hub != hubs_.end() && *hub == i;
+    const Real *previous = previous_activations_.data() + i * n_beliefs;
+    Real *current = activations_.data() + i * n_beliefs;
+
+    if (!actions_changed_ && fixed_[i]) {
+      std::copy_n(previous, n_beliefs, current);
+      hub += is_hub;
+      continue;
+    }
+
+    if (actions_changed_) {
+      std::fill(actions_of_friends.begin(), actions_of_friends.end(), zero);
+      std::size_t n_friends;
+      if (incremental_) {
+        const double_t *counts = friend_counts_.data() + i * n_behaviours;
+        for (std::size_t k = 0; k < n_behaviours; ++k) {
+          actions_of_friends[k] = static_cast<Real>(counts[k]);
+        }
+        n_friends = n_friends_[i];
+      } else if (is_hub) {
+        const std::size_t h = hub - hubs_.begin();
+        const double_t *counts = hub_counts_.data() + h * n_behaviours;
+        for (std::size_t k = 0; k < n_behaviours; ++k) {
+          actions_of_friends[k] = static_cast<Real>(counts[k]);
+        }
+        n_friends = hub_n_friends_[h];
+      } else if (graph_) {
+        // Summed in double precision, where the sums are exact.
+        std::fill(counts.begin(), counts.end(), 0.0);
+        n_friends = graph_->count_actions(i, actions_.data(), counts.data());
+        for (std::size_t k = 0; k < n_behaviours; ++k) {
+          actions_of_friends[k] = static_cast<Real>(counts[k]);
+        }
+      } else {
+        for (std::size_t e = friend_offsets_[i]; e < friend_offsets_[i + 1];
+             ++e) {
+          actions_of_friends[actions_[friends_[e]]] +=
+              real_friend_weights_[e];
+        }
+        n_friends = friend_offsets_[i + 1] - friend_offsets_[i];
+      }
+
+      for (std::size_t b = 0; b < n_beliefs; ++b) {
+        Real pressure = zero;
+        if (n_friends != 0) {
+          for (std::size_t k = 0; k < n_behaviours; ++k) {
+            pressure +=
+                perceptions[b * n_behaviours + k] * actions_of_friends[k];
+          }
+          pressure /= n_friends; // NOLINT(*-narrowing-conversions)
+        }
+        pressures[b] = pressure;
+      }
+    }
+    hub += is_hub;
+
+    const Real *contexts = contexts_.data() + i * n_beliefs;
+    const Real *deltas = tables.deltas.data() + archetypes_[i] * n_beliefs;
+
+    for (std::size_t b = 0; b < n_beliefs; ++b) {
+      const Real pressure = pressures[b];
+      const Real context = contexts[b];
+      const Real activation_change = pressure > zero
+                                         ? (one + context) / two * pressure
+                                         : (one - context) / two * pressure;
+
+      current[b] = std::max(
+          -one, std::min(one, deltas[b] * previous[b] + activation_change));
+    }
+    fixed_[i] = std::equal(current, current + n_beliefs, previous);
+  }
+}
+
+template <class Real> void BasicDensePopulation<Real>::contextualize() {
+  partitions_->run([this](const std::size_t p, const std::size_t begin,
+                          const std::size_t end) {
+    contextualize_partition(p, begin, end);
+  });
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::contextualize_partition(
+    const std::size_t p, const std::size_t begin, const std::size_t end) {
+  linalg::scale_columns(end - begin, n_beliefs_,
+                        previous_activations_.data() + begin * n_beliefs_,
+                        n_beliefs_,
+                        tables_[partitions_->node(p)].mean_relationships.data(),
+                        contexts_.data() + begin * n_beliefs_, n_beliefs_);
+}
+
+template <class Real> void BasicDensePopulation<Real>::score() {
+  if (settled_) {
+    return;
+  }
+
+  // The dense scores are one product of matrices per partition, rather than
+  // one per chunk, so they are not stolen.
+  if (!tick_kernels_ && !sparse_prs_) {
+    partitions_->run([this](const std::size_t p, const std::size_t begin,
+                            const std::size_t end) {
+      score_range(p, begin, end);
+    });
+    return;
+  }
+
+  partitions_->steal([this](const std::size_t p, const std::size_t begin,
+                            const std::size_t end) {
+    score_range(p, begin, end);
+  });
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::score_range(const std::size_t p,
+                                             const std::size_t begin,
+                                             const std::size_t end) {
+  if (tick_kernels_) {
+    tick_kernels_->score(tick_state(p), begin, end);
+  } else if (sparse_prs_) {
+    score_sparse_partition(p, begin, end);
+  } else {
+    score_partition(p, begin, end);
+  }
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::score_partition(const std::size_t p,
+                                                 const std::size_t begin,
+                                                 const std::size_t end) {
+  const std::size_t n_beliefs = n_beliefs_;
+  const std::size_t n_behaviours = n_behaviours_;
+  const auto &tables = tables_[partitions_->node(p)];
+  std::vector<Real> a;
+  std::vector<Real> c;
+
+  for (std::size_t g = 0; g < members_.size(); ++g) {
+    // The members are in ascending order, so those in the partition are
+    // contiguous.
+    const auto first =
+        std::lower_bound(members_[g].begin(), members_[g].end(), begin);
+    const auto last = std::lower_bound(first, members_[g].end(), end);
+    const std::span<const std::uint32_t> members(first, last);
+    const Real *prs =
+        tables.performance_relationships.data() + g * n_beliefs * n_behaviours;
+
+    if (members.size() <= MIN_GROUP_SIZE) {
+      c.resize(n_behaviours);
+      for (const auto i : members) {
+        if (fixed_[i]) {
+          continue;
+        }
+        linalg::gemv(n_behaviours, n_beliefs,
+                     activations_.data() + i * n_beliefs, prs, n_behaviours,
+                     c.data());
+        std::copy_n(c.data(), n_behaviours, scores_.data() + i * n_behaviours);
+      }
+      continue;
+    }
+
+    for (std::size_t block = 0; block < members.size();
+         block += SCORE_BLOCK) {
+      const std::size_t m = std::min(SCORE_BLOCK, members.size() - block);
+      a.resize(m * n_beliefs);
+      c.resize(m * n_behaviours);
+
+      for (std::size_t r = 0; r < m; ++r) {
+        std::copy_n(activations_.data() + members[block + r] * n_beliefs,
+                    n_beliefs, a.data() + r * n_beliefs);
+      }
+
+      linalg::gemm(m, n_behaviours, n_beliefs, a.data(), n_beliefs, prs,
+                   n_behaviours, c.data(), n_behaviours);
+
+      for (std::size_t r = 0; r < m; ++r) {
+        std::copy_n(c.data() + r * n_behaviours, n_behaviours,
+                    scores_.data() + members[block + r] * n_behaviours);
+      }
+    }
+  }
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::score_sparse_partition(
+    const std::size_t p, const std::size_t begin, const std::size_t end) {
+  const std::size_t n_beliefs = n_beliefs_;
+  const std::size_t n_behaviours = n_behaviours_;
+  const auto &tables = tables_[partitions_->node(p)];
+  std::vector<Real> c(n_behaviours);
+
+  for (std::size_t i = begin; i < end; ++i) {
+    if (fixed_[i]) {
+      continue;
+    }
+
+    std::fill(c.begin(), c.end(), Real{0});
+    const Real *activations = activations_.data() + i * n_beliefs;
+    const std::size_t row = archetypes_[i] * n_beliefs;
+
+    for (std::size_t b = 0; b < n_beliefs; ++b) {
+      if (activations[b] == 0.0) {
+        continue;
+      }
+      for (std::size_t f = tables.pr_offsets[row + b];
+           f < tables.pr_offsets[row + b + 1]; ++f) {
+        c[tables.pr_behaviours[f]] += activations[b] * tables.pr_values[f];
+      }
+    }
+
+    std::copy(c.begin(), c.end(), scores_.data() + i * n_behaviours);
+  }
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::store_activations(
+    const std::size_t day) const {
+  if (!history_) {
+    store_activations(day, 0, n_agents_);
+    return;
+  }
+
+  partitions_->run([this, day](std::size_t, const std::size_t begin,
+                               const std::size_t end) {
+    store_activations(day, begin, end);
+  });
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::store_activations(
+    const std::size_t day, const std::size_t begin,
+    const std::size_t end) const {
+  if (history_) {
+    std::copy(activations_.begin() + begin * n_beliefs_,
+              activations_.begin() + end * n_beliefs_,
+              history_->activations(day).begin() + begin * n_beliefs_);
+    history_->release(day, begin, end);
+    return;
+  }
+
+  const auto &beliefs = configuration_.get_beliefs();
+
+  for (std::size_t i = begin; i < end; ++i) {
+    std::unordered_map<std::shared_ptr<Belief>, double_t> activations;
+    activations.reserve(n_beliefs_);
+    for (std::size_t b = 0; b < n_beliefs_; ++b) {
+      activations.emplace(beliefs[b], activations_[i * n_beliefs_ + b]);
+    }
+    get_agent(i)->set_activations_for_day(day, activations);
+  }
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::flow(const std::size_t start,
+                                      const std::size_t end,
+                                      const std::uint64_t seed) {
+  if (!dataflow_) {
+    Population::flow(start, end, seed);
+    return;
+  }
+
+  actions_changed_ = true;
+  settled_ = false;
+  std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> changes(
+      partitions_->size());
+
+  partitions_->flow(
+      2 * (end - start), flow_dependencies_,
+      [this, start, seed, &changes](const std::size_t p,
+                                    const std::size_t begin,
+                                    const std::size_t end,
+                                    const std::size_t step) {
+        const std::size_t day = start + step / 2;
+        if (step % 2 == 0) {
+          count_hub_actions(begin, end);
+          std::copy(activations_.begin() + begin * n_beliefs_,
+                    activations_.begin() + end * n_beliefs_,
+                    previous_activations_.begin() + begin * n_beliefs_);
+          perceive_range(p, begin, end);
+          store_activations(day, begin, end);
+          score_range(p, begin, end);
+        } else {
+          select_partition(p, begin, end, day, seed, changes[p]);
+          store_actions(day, begin, end);
+          if (is_over_budget()) {
+            release_range(begin, end);
+          }
+        }
+      });
+}
+
+template <class Real>
+std::size_t BasicDensePopulation<Real>::state_bytes() const noexcept {
+  return Population::state_bytes() +
+         converted_friend_weights_.size() * sizeof(Real) +
+         (activations_.size() + previous_activations_.size() +
+          contexts_.size() + pressures_.size()) *
+             sizeof(Real);
+}
+
+template <class Real>
+void BasicDensePopulation<Real>::release_range(const std::size_t begin,
+                                               const std::size_t end) const {
+  Population::release_range(begin, end);
+
+  const std::size_t first = begin * n_beliefs_;
+  const std::size_t bytes = (end - begin) * n_beliefs_ * sizeof(Real);
+  numa::release(activations_.data() + first, bytes);
+  numa::release(previous_activations_.data() + first, bytes);
+  numa::release(contexts_.data() + first, bytes);
+  numa::release(pressures_.data() + first, bytes);
+  if (!converted_friend_weights_.empty()) {
+    numa::release(converted_friend_weights_.data() + friend_offsets_[begin],
+                  (friend_offsets_[end] - friend_offsets_[begin]) *
+                      sizeof(Real));
+  }
+}
+
+template class BasicDensePopulation<double_t>;
+template class BasicDensePopulation<float>;
+} // namespace contagent
@@ -0,0 +1,81 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/history.h"
+
+namespace contagent {
+History::History(std::vector<std::uint32_t> agents, const std::size_t n_beliefs,
+                 const std::size_t n_days,
+                 const std::filesystem::path &directory)
+    : agents_(std::move(agents)), n_beliefs_(n_beliefs), n_days_(n_days) {
+  // Resizing does not touch the pages, so they only take space in the files
+  // once they are written.
+  const numa::FileBacking backing(directory);
+  activations_.resize(n_days_ * agents_.size() * n_beliefs_);
+  actions_.resize(n_days_ * agents_.size());
+}
+
+std::size_t History::n_agents() const noexcept { return agents_.size(); }
+
+std::size_t History::n_beliefs() const noexcept { return n_beliefs_; }
+
+std::size_t History::n_days() const noexcept { return n_days_; }
+
+std::span<const std::uint32_t> History::get_agents() const noexcept {
+  return agents_;
+}
+
+std::span<double_t> History::activations(const std::size_t day) noexcept {
+  const std::size_t size = agents_.size() * n_beliefs_;
+  return {activations_.data() + day * size, size};
+}
+
+std::span<const double_t>
+History::activations(const std::size_t day) const noexcept {
+  const std::size_t size = agents_.size() * n_beliefs_;
+  return {activations_.data() + day * size, size};
+}
+
+std::span<std::uint32_t> History::actions(const std::size_t day) noexcept {
+  return {actions_.data() + day * agents_.size(), agents_.size()};
+}
+
+std::span<const std::uint32_t>
+History::actions(const std::size_t day) const noexcept {
+  return {actions_.data() + day * agents_.size(), agents_.size()};
+}
+
+void History::release(const std::size_t day, const std::size_t begin,
+                      const std::size_t end) const noexcept {
+  const std::size_t n_agents = agents_.size();
+  numa::release(activations_.data() + (day * n_agents + begin) * n_beliefs_,
+                (end - begin) * n_beliefs_ * sizeof(double_t));
+  numa::release(actions_.data() + day * n_agents + begin,
+                (end - begin) * sizeof(std::uint32_t));
+}
+} // namespace contagent
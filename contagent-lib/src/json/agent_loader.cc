@@ -0,0 +1,721 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/json/agent_loader.h"
+
+#include "contagent/json/agent_spec.h"
+#include "contagent/spsc_queue.h"
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/string_generator.hpp>
+#include <boost/uuid/uuid_hash.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace contagent::json {
+namespace {
+/// The number of bytes that are read from the stream at once.
+constexpr std::size_t CHUNK_SIZE = 1 << 20;
+/// The number of agents that are handed between stages at once.
+constexpr std::size_t BATCH_SIZE = 256;
+/// The number of chunks or batches that a queue between stages holds.
+constexpr std::size_t QUEUE_CAPACITY = 16;
+
+/// An Agent that has been made but not linked to its friends.
+struct Unlinked {
+  std::shared_ptr<Agent> agent;
+  std::unordered_map<std::string, double_t> friends;
+};
+
+/// A friendship, from the index of an agent to the UUID of its friend.
+struct Edge {
+  std::size_t agent;
+  boost::uuids::uuid friend_uuid;
+  double_t weight;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double_t seconds_since(const Clock::time_point started) {
+  return std::chrono::duration<double_t>(Clock::now() - started).count();
+}
+
+/// Add a value to a queue, counting the time that it waits.
+/// \return Whether it was added.
+template <class T>
+bool push(SpscQueue<T> &queue, T value, AgentLoader::Stage &stage) {
+  const auto started = Clock::now();
+  const bool pushed = queue.push(std::move(value));
+  stage.waiting += seconds_since(started);
+  return pushed;
+}
+
+/// Take a value from a queue, counting the time that it waits.
+/// \return The value, or std::nullopt at the end of the queue.
+template <class T>
+std::optional<T> pop(SpscQueue<T> &queue, AgentLoader::Stage &stage) {
+  const auto started = Clock::now();
+  auto value = queue.pop();
+  stage.waiting += seconds_since(started);
+  return value;
+}
+
+/// Run a stage, counting the time that it did not wait as busy.
+template <class F> void run_stage(AgentLoader::Stage &stage, F &&body) {
+  const auto started = Clock::now();
+  body();
+  stage.busy = seconds_since(started) - stage.waiting;
+}
+
+/// Cuts the text of a JSON array of objects into the text of the objects, as
+/// it arrives in chunks.
+class Splitter {
+public:
+  /// Cut the next chunk.
+  /// \param chunk The chunk.
+  /// \param emit Called with the text of every object that ends in the
+  /// chunk, which is only valid during the call.
+  /// \throws std::runtime_error If the text is not an array of objects.
+  template <class F> void feed(std::string_view chunk, F &&emit);
+
+  /// Check that the array has ended.
+  /// \throws std::runtime_error If it has not.
+  void finish() const;
+
+private:
+  /// The start of the object that has not ended yet.
+  std::string element_;
+  /// The number of arrays and objects that the text is inside.
+  std::size_t depth_ = 0;
+  bool in_string_ = false;
+  bool escaped_ = false;
+  bool ended_ = false;
+};
+
+template <class F> void Splitter::feed(const std::string_view chunk, F &&emit) {
+  const auto malformed = [] {
+    return std::runtime_error("The agents must be a JSON array of objects");
+  };
+  std::size_t start = depth_ >= 2 ? 0 : std::string_view::npos;
+
+  for (std::size_t i = 0; i < chunk.size(); ++i) {
+    if (in_string_) {
+      if (escaped_) {
+        escaped_ = false;
+        continue;
+      }
+      i = chunk.find_first_of(R"("\)", i);
+      if (i == std::string_view::npos) {
+        break;
+      }
+      if (chunk[i] == '\\') {
+        escaped_ = true;
+      } else {
+        in_string_ = false;
+      }
+      continue;
+    }
+
+    const char c = chunk[i];
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+      break;
+    case '{':
+    case '[':
+      if (ended_ || (depth_ == 0 && c != '[') || (depth_ == 1 && c != '{')) {
+        throw malformed();
+      }
+      if (depth_ == 1) {
+        start = i;
+      }
+      ++depth_;
+      break;
+    case '}':
+    case ']':
+      if (depth_ == 0 || (depth_ == 1 && c != ']')) {
+        throw malformed();
+      }
+      --depth_;
+      if (depth_ == 1) {
+        const auto text = chunk.substr(start, i + 1 - start);
+        if (element_.empty()) {
+          emit(text);
+        } else {
+          element_.append(text);
+          emit(std::string_view(element_));
+          element_.clear();
+        }
+        start = std::string_view::npos;
+      } else if (depth_ == 0) {
+        ended_ = true;
+      }
+      break;
+    default:
+      if (depth_ < 2 && !(depth_ == 1 && c == ',')) {
+        throw malformed();
+      }
+      if (c == '"') {
+        in_string_ = true;
+      }
+    }
+  }
+
+  if (start != std::string_view::npos) {
+    element_.append(chunk.substr(start));
+  }
+}
+
+void Splitter::finish() const {
+  if (!ended_) {
+    throw std::runtime_error("The agents JSON ended before its array");
+  }
+}
+
+/// An agent that tokenisation has parsed, with its position in the array.
+struct Parsed {
+  std::size_t position;
+  AgentSpec spec;
+};
+
+/// Run the stages of an AgentLoader over a stream: decompression reads it,
+/// tokenisation cuts it into agents and parses those that are wanted,
+/// construction makes a product of each, and the calling thread collects the
+/// products in the order of the array.
+/// \tparam Product What construction makes of an agent.
+/// \param is The stream of the JSON array.
+/// \param stages The stages, which are reset.
+/// \param collection The last stage, whose amount collect counts.
+/// \param parse Called with the text of every agent and its position in the
+/// array, returns its AgentSpec, or std::nullopt to skip it.
+/// \param construct Called with every agent that was parsed, returns its
+/// Product.
+/// \param collect Called with every Product, in the order of the array.
+/// \throws Whatever a stage threw.
+template <class Product, class Parse, class Construct, class Collect>
+void run_pipeline(std::istream &is, std::vector<AgentLoader::Stage> &stages,
+                  AgentLoader::Stage collection, Parse &&parse,
+                  Construct &&construct, Collect &&collect) {
+  stages = {{"Decompression", "bytes"},
+            {"Tokenisation", "agents"},
+            {"Construction", "agents"},
+            std::move(collection)};
+  auto &decompression = stages[0];
+  auto &tokenisation = stages[1];
+  auto &construction = stages[2];
+  auto &collecting = stages[3];
+
+  SpscQueue<std::string> chunks(QUEUE_CAPACITY);
+  SpscQueue<std::vector<Parsed>> specs(QUEUE_CAPACITY);
+  SpscQueue<std::vector<Product>> products(QUEUE_CAPACITY);
+
+  // A stage that fails cancels its input, so that the stages before it stop,
+  // and closes its output, so that the stages after it finish.
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  const auto fail = [&error_mutex, &error] {
+    std::lock_guard lock(error_mutex);
+    if (!error) {
+      error = std::current_exception();
+    }
+  };
+
+  std::thread decompressor([&] {
+    try {
+      run_stage(decompression, [&] {
+        while (is) {
+          std::string chunk(CHUNK_SIZE, '\0');
+          is.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+          chunk.resize(is.gcount());
+          if (chunk.empty()) {
+            break;
+          }
+          decompression.amount += chunk.size();
+          if (!push(chunks, std::move(chunk), decompression)) {
+            return;
+          }
+        }
+        if (is.bad()) {
+          throw std::runtime_error("Unable to read the agents");
+        }
+      });
+    } catch (...) {
+      fail();
+    }
+    chunks.close();
+  });
+
+  std::thread tokeniser([&] {
+    try {
+      run_stage(tokenisation, [&] {
+        Splitter splitter;
+        std::vector<Parsed> batch;
+        std::size_t position = 0;
+        bool stopped = false;
+        while (auto chunk = pop(chunks, tokenisation)) {
+          splitter.feed(*chunk, [&](const std::string_view text) {
+            if (auto spec = parse(text, position)) {
+              batch.push_back({position, std::move(*spec)});
+            }
+            ++position;
+            if (batch.size() == BATCH_SIZE) {
+              tokenisation.amount += batch.size();
+              stopped = !push(specs, std::move(batch), tokenisation);
+              batch = {};
+            }
+          });
+          if (stopped) {
+            return;
+          }
+        }
+        splitter.finish();
+        tokenisation.amount += batch.size();
+        push(specs, std::move(batch), tokenisation);
+      });
+    } catch (...) {
+      fail();
+    }
+    chunks.cancel();
+    specs.close();
+  });
+
+  std::thread constructor([&] {
+    try {
+      run_stage(construction, [&] {
+        while (auto batch = pop(specs, construction)) {
+          std::vector<Product> made;
+          made.reserve(batch->size());
+          for (auto &parsed : *batch) {
+            made.push_back(construct(parsed));
+          }
+          construction.amount += made.size();
+          if (!push(products, std::move(made), construction)) {
+            return;
+          }
+        }
+      });
+    } catch (...) {
+      fail();
+    }
+    specs.cancel();
+    products.close();
+  });
+
+  try {
+    run_stage(collecting, [&] {
+      while (auto batch = pop(products, collecting)) {
+        for (auto &product : *batch) {
+          collect(product);
+        }
+      }
+    });
+  } catch (...) {
+    fail();
+  }
+  products.cancel();
+
+  decompressor.join();
+  tokeniser.join();
+  constructor.join();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+/// Index a map of pointers by their position in a vector.
+template <class T>
+std::unordered_map<const T *, std::uint32_t>
+index_of(const std::vector<std::shared_ptr<T>> &vec) {
+  std::unordered_map<const T *, std::uint32_t> m;
+  m.reserve(vec.size());
+  for (std::size_t i = 0; i < vec.size(); ++i) {
+    m.emplace(vec[i].get(), i);
+  }
+  return m;
+}
+
+/// Make a callback that drops every key of an agent but some as it is parsed,
+/// so that the rest of it is never held.
+/// \param keys The keys to keep.
+/// \return The callback.
+nlohmann::json::parser_callback_t only_keys(std::vector<std::string> keys) {
+  return [keys = std::move(keys)](const int depth,
+                                  const nlohmann::json::parse_event_t event,
+                                  const nlohmann::json &parsed) {
+    return event != nlohmann::json::parse_event_t::key || depth != 1 ||
+           std::find(keys.begin(), keys.end(), parsed) != keys.end();
+  };
+}
+
+/// Find the friends of an agent among some agents.
+/// \param spec The agent.
+/// \param by_uuid The UUID and number of every agent, sorted.
+/// \return The number of every friend and the weight that the agent gives
+/// it, sorted by the UUID of the friend.
+/// \throws std::out_of_range If a friend is not among the agents.
+std::vector<std::pair<std::uint32_t, double_t>> find_friends(
+    const AgentSpec &spec,
+    const std::vector<std::pair<boost::uuids::uuid, std::uint32_t>> &by_uuid) {
+  const boost::uuids::string_generator parse_uuid;
+  std::vector<std::tuple<boost::uuids::uuid, std::uint32_t, double_t>> found;
+  found.reserve(spec.friends.size());
+  for (const auto &[text, weight] : spec.friends) {
+    const auto uuid = parse_uuid(text);
+    const auto it = std::lower_bound(by_uuid.begin(), by_uuid.end(),
+                                     std::pair(uuid, std::uint32_t{0}));
+    if (it == by_uuid.end() || it->first != uuid) {
+      throw std::out_of_range("Agent " + spec.uuid +
+                              " has a friend that is not loaded, " + text);
+    }
+    found.emplace_back(uuid, it->second, weight);
+  }
+  std::sort(found.begin(), found.end());
+
+  std::vector<std::pair<std::uint32_t, double_t>> friends;
+  friends.reserve(found.size());
+  for (const auto &[_uuid, i, weight] : found) {
+    friends.emplace_back(i, weight);
+  }
+  return friends;
+}
+
+/// Check that an agent is the one that was indexed at its position.
+/// \param parsed The agent.
+/// \param index The index.
+/// \throws std::runtime_error If it is not.
+void check_indexed(const Parsed &parsed, const AgentIndex &index) {
+  if (parsed.position >= index.uuids.size() ||
+      boost::uuids::string_generator()(parsed.spec.uuid) !=
+          index.uuids[parsed.position]) {
+    throw std::runtime_error("The agents are not those that were indexed");
+  }
+}
+
+/// An agent of an AgentTable that has been made but not collected.
+struct Row {
+  /// The row of the table.
+  std::uint32_t row;
+  ArchetypeTable::Reference archetype;
+  std::uint32_t action;
+  std::vector<std::pair<std::uint32_t, double_t>> activations;
+  /// The rows of the friends, sorted by UUID, with their weights.
+  std::vector<std::pair<std::uint32_t, double_t>> friends;
+};
+} // namespace
+
+AgentLoader::AgentLoader(
+    const std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>> &behaviours,
+    const std::map<boost::uuids::uuid, std::shared_ptr<Belief>> &beliefs,
+    const uint_fast32_t n_days)
+    : behaviours_(behaviours), beliefs_(beliefs), n_days_(n_days) {}
+
+std::vector<std::shared_ptr<Agent>> AgentLoader::load(std::istream &is) {
+  std::vector<std::shared_ptr<Agent>> agents;
+  std::unordered_map<boost::uuids::uuid, std::size_t> index;
+  std::vector<Edge> edges;
+  const boost::uuids::string_generator parse_uuid;
+  run_pipeline<Unlinked>(
+      is, stages_, {"Edge collection", "friendships"},
+      [](const std::string_view text, std::size_t) {
+        return std::optional(
+            nlohmann::json::parse(text.begin(), text.end())
+                .template get<AgentSpec>());
+      },
+      [this](Parsed &parsed) {
+        return Unlinked{
+            parsed.spec.to_unlinked_agent(n_days_, behaviours_, beliefs_),
+            std::move(parsed.spec.friends)};
+      },
+      [&](Unlinked &unlinked) {
+        index.emplace(unlinked.agent->get_uuid(), agents.size());
+        for (const auto &[uuid, weight] : unlinked.friends) {
+          edges.push_back({agents.size(), parse_uuid(uuid), weight});
+        }
+        agents.push_back(std::move(unlinked.agent));
+      });
+  stages_[3].amount = edges.size();
+
+  auto edge = edges.begin();
+  for (std::size_t i = 0; i < agents.size(); ++i) {
+    const auto last = std::find_if(
+        edge, edges.end(), [i](const Edge &e) { return e.agent != i; });
+    Friends friends;
+    friends.reserve(last - edge);
+    for (; edge != last; ++edge) {
+      friends.emplace_back(agents[index.at(edge->friend_uuid)], edge->weight);
+    }
+    agents[i]->set_friends(std::move(friends));
+  }
+
+  return agents;
+}
+
+AgentIndex AgentLoader::index(std::istream &is) {
+  const auto uuid_only = only_keys({"uuid"});
+  AgentIndex index;
+  const boost::uuids::string_generator parse_uuid;
+  run_pipeline<boost::uuids::uuid>(
+      is, stages_, {"Indexing", "agents"},
+      [&uuid_only](const std::string_view text, std::size_t) {
+        AgentSpec spec;
+        spec.uuid = nlohmann::json::parse(text.begin(), text.end(), uuid_only)
+                        .at("uuid")
+                        .template get<std::string>();
+        return std::optional(std::move(spec));
+      },
+      [&parse_uuid](const Parsed &parsed) {
+        return parse_uuid(parsed.spec.uuid);
+      },
+      [this, &index](const boost::uuids::uuid &uuid) {
+        index.uuids.push_back(uuid);
+        ++stages_[3].amount;
+      });
+  return index;
+}
+
+AgentGraph AgentLoader::graph(std::istream &is, const AgentIndex &index) {
+  std::vector<std::pair<boost::uuids::uuid, std::uint32_t>> by_uuid(
+      index.uuids.size());
+  for (std::size_t i = 0; i < index.uuids.size(); ++i) {
+    by_uuid[i] = {index.uuids[i], i};
+  }
+  std::sort(by_uuid.begin(), by_uuid.end());
+
+  const auto uuid_and_friends = only_keys({"uuid", "friends"});
+  AgentGraph graph;
+  graph.offsets.reserve(index.uuids.size() + 1);
+  graph.offsets.push_back(0);
+  run_pipeline<std::vector<std::pair<std::uint32_t, double_t>>>(
+      is, stages_, {"Friendship collection", "friendships"},
+      [&uuid_and_friends](const std::string_view text, std::size_t) {
+        const auto parsed =
+            nlohmann::json::parse(text.begin(), text.end(), uuid_and_friends);
+        AgentSpec spec;
+        parsed.at("uuid").get_to(spec.uuid);
+        parsed.at("friends").get_to(spec.friends);
+        return std::optional(std::move(spec));
+      },
+      [&index, &by_uuid](const Parsed &parsed) {
+        check_indexed(parsed, index);
+        return find_friends(parsed.spec, by_uuid);
+      },
+      [this, &graph](const std::vector<std::pair<std::uint32_t, double_t>>
+                         &friends) {
+        for (const auto &[i, weight] : friends) {
+          graph.friends.push_back(i);
+          auto &[min, max] = graph.weight_range.emplace(
+              graph.weight_range.value_or(std::pair{weight, weight}));
+          min = std::min(min, weight);
+          max = std::max(max, weight);
+        }
+        graph.offsets.push_back(graph.friends.size());
+        stages_[3].amount += friends.size();
+      });
+
+  if (graph.offsets.size() != index.uuids.size() + 1) {
+    throw std::runtime_error("The agents are not those that were indexed");
+  }
+  return graph;
+}
+
+AgentTable AgentLoader::tabulate(
+    std::istream &is, const AgentIndex &index,
+    const std::span<const std::uint32_t> rows, const std::size_t n_owned,
+    const std::vector<std::shared_ptr<Belief>> &beliefs,
+    const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+    const std::size_t day) {
+  const std::size_t n_rows = rows.empty() ? index.uuids.size() : rows.size();
+  const auto position_of = [&rows](const std::size_t row) -> std::uint32_t {
+    return rows.empty() ? row : rows[row];
+  };
+
+  // The rows are collected in the order of the array, and the tokeniser
+  // parses only the positions of the rows, which it finds in order.
+  std::vector<std::uint32_t> arrival(n_rows);
+  std::iota(arrival.begin(), arrival.end(), 0);
+  std::sort(arrival.begin(), arrival.end(),
+            [&position_of](const std::uint32_t a, const std::uint32_t b) {
+              return position_of(a) < position_of(b);
+            });
+  std::vector<std::uint32_t> positions(n_rows);
+  for (std::size_t j = 0; j < n_rows; ++j) {
+    positions[j] = position_of(arrival[j]);
+    if (positions[j] >= index.uuids.size() ||
+        (j > 0 && positions[j] == positions[j - 1])) {
+      throw std::invalid_argument(
+          "The rows of a table must be distinct agents of the index");
+    }
+  }
+
+  // The friends of the agents are found by UUID among the rows.
+  std::vector<std::pair<boost::uuids::uuid, std::uint32_t>> by_uuid(n_rows);
+  for (std::size_t row = 0; row < n_rows; ++row) {
+    by_uuid[row] = {index.uuids[position_of(row)], row};
+  }
+  std::sort(by_uuid.begin(), by_uuid.end());
+
+  const auto belief_index = index_of(beliefs);
+  const auto behaviour_index = index_of(behaviours);
+
+  AgentTable table;
+  table.archetypes.reserve(n_rows);
+  table.actions.reserve(n_rows);
+  table.activation_offsets.reserve(n_rows + 1);
+  table.activation_offsets.push_back(0);
+  table.friend_offsets.reserve(n_rows + 1);
+  table.friend_offsets.push_back(0);
+  std::unordered_set<std::uint32_t> held;
+
+  std::size_t next = 0;
+  std::size_t n_made = 0;
+  run_pipeline<Row>(
+      is, stages_, {"Tabulation", "friendships"},
+      [&positions, &next](const std::string_view text,
+                          const std::size_t position) {
+        if (next == positions.size() || positions[next] != position) {
+          return std::optional<AgentSpec>();
+        }
+        ++next;
+        return std::optional(nlohmann::json::parse(text.begin(), text.end())
+                                 .template get<AgentSpec>());
+      },
+      [&](const Parsed &parsed) {
+        const auto &spec = parsed.spec;
+        Row row{arrival[n_made++], spec.to_archetype(behaviours_, beliefs_), 0,
+                {}, {}};
+        check_indexed(parsed, index);
+
+        if (day < spec.actions.size()) {
+          const auto &behaviour = behaviours_.at(
+              boost::lexical_cast<boost::uuids::uuid>(spec.actions[day]));
+          if (const auto k = behaviour_index.find(behaviour.get());
+              k != behaviour_index.end()) {
+            row.action = k->second;
+          }
+        }
+
+        if (day >= spec.activations.size()) {
+          throw std::out_of_range(
+              "No activations have been recorded for the day");
+        }
+        for (const auto &[uuid, activation] : spec.activations[day]) {
+          const auto &belief =
+              beliefs_.at(boost::lexical_cast<boost::uuids::uuid>(uuid));
+          if (const auto b = belief_index.find(belief.get());
+              b != belief_index.end()) {
+            row.activations.emplace_back(b->second, activation);
+          }
+        }
+
+        if (row.row < n_owned) {
+          row.friends = find_friends(spec, by_uuid);
+        }
+        return row;
+      },
+      [this, &table, &held](Row &row) {
+        const std::uint32_t id = row.archetype.get();
+        table.archetypes.push_back(id);
+        if (held.insert(id).second) {
+          table.references.push_back(std::move(row.archetype));
+        }
+        table.actions.push_back(row.action);
+        for (const auto &[b, activation] : row.activations) {
+          table.activation_beliefs.push_back(b);
+          table.activation_values.push_back(activation);
+        }
+        table.activation_offsets.push_back(table.activation_beliefs.size());
+        for (const auto &[friend_row, weight] : row.friends) {
+          table.friends.push_back(friend_row);
+          table.friend_weights.push_back(weight);
+        }
+        table.friend_offsets.push_back(table.friends.size());
+        stages_[3].amount += row.friends.size();
+      });
+
+  if (table.size() != n_rows) {
+    throw std::runtime_error("The agents are not those that were indexed");
+  }
+
+  if (std::is_sorted(rows.begin(), rows.end())) {
+    return table;
+  }
+
+  // The rows were collected in the order of the array, and are copied into
+  // the order of the table.
+  std::vector<std::uint32_t> collected(n_rows);
+  for (std::size_t j = 0; j < n_rows; ++j) {
+    collected[arrival[j]] = j;
+  }
+  AgentTable ordered;
+  ordered.references = std::move(table.references);
+  ordered.archetypes.reserve(n_rows);
+  ordered.actions.reserve(n_rows);
+  ordered.activation_offsets.reserve(n_rows + 1);
+  ordered.activation_offsets.push_back(0);
+  ordered.activation_beliefs.reserve(table.activation_beliefs.size());
+  ordered.activation_values.reserve(table.activation_values.size());
+  ordered.friend_offsets.reserve(n_rows + 1);
+  ordered.friend_offsets.push_back(0);
+  ordered.friends.reserve(table.friends.size());
+  ordered.friend_weights.reserve(table.friend_weights.size());
+  for (const auto j : collected) {
+    ordered.archetypes.push_back(table.archetypes[j]);
+    ordered.actions.push_back(table.actions[j]);
+    for (std::size_t a = table.activation_offsets[j];
+         a < table.activation_offsets[j + 1]; ++a) {
+      ordered.activation_beliefs.push_back(table.activation_beliefs[a]);
+      ordered.activation_values.push_back(table.activation_values[a]);
+    }
+    ordered.activation_offsets.push_back(ordered.activation_beliefs.size());
+    for (std::size_t e = table.friend_offsets[j];
+         e < table.friend_offsets[j + 1]; ++e) {
+      ordered.friends.push_back(table.friends[e]);
+      ordered.friend_weights.push_back(table.friend_weights[e]);
+    }
+    ordered.friend_offsets.push_back(ordered.friends.size());
+  }
+  return ordered;
+}
+
+const std::vector<AgentLoader::Stage> &
+AgentLoader::get_stages() const noexcept {
+  return stages_;
+}
+} // namespace contagent::json
@@ -33,12 +33,14 @@
 [[maybe_unused]] contagent::json::AgentSpec::AgentSpec(
     const contagent::Agent &agent)
     : uuid(boost::lexical_cast<std::string>(agent.get_uuid())) {
-  std::transform(agent.get_actions().begin(), agent.get_actions().end(),
+  const auto agent_actions = agent.get_actions();
+  std::transform(agent_actions.begin(), agent_actions.end(),
                  std::back_inserter(actions), [](const auto &action) {
                    return boost::lexical_cast<std::string>(action->get_uuid());
                  });
 
-  std::transform(agent.get_activations().begin(), agent.get_activations().end(),
+  const auto agent_activations = agent.get_activations();
+  std::transform(agent_activations.begin(), agent_activations.end(),
                  std::back_inserter(activations), [](const auto &m) {
                    std::unordered_map<std::string, double_t> new_m;
 
@@ -46,8 +48,8 @@
                        m.begin(), m.end(), std::inserter(new_m, new_m.end()),
                        [](const auto &pair) {
                          std::pair<std::string, double_t> new_pair;
-                         new_pair.first =
-                             boost::lexical_cast<std::string>(pair.first);
+                         new_pair.first = boost::lexical_cast<std::string>(
+                             pair.first->get_uuid());
                          new_pair.second = pair.second;
                          return new_pair;
                        });
@@ -58,7 +60,8 @@
   std::transform(agent.get_deltas().begin(), agent.get_deltas().end(),
                  std::inserter(deltas, deltas.end()), [](const auto &pair) {
                    std::pair<std::string, double_t> new_pair(
-                       boost::lexical_cast<std::string>(pair.first),
+                       boost::lexical_cast<std::string>(
+                           pair.first->get_uuid()),
                        pair.second);
                    return new_pair;
                  });
@@ -86,13 +89,15 @@
                        std::inserter(new_inner_map, new_inner_map.end()),
                        [](const auto &inner_pair) {
                          return std::pair<std::string, double_t>(
-                             boost::lexical_cast<std::string>(inner_pair.first),
+                             boost::lexical_cast<std::string>(
+                                 inner_pair.first->get_uuid()),
                              inner_pair.second);
                        });
 
         return std::pair<std::string,
                          std::unordered_map<std::string, double_t>>(
-            boost::lexical_cast<std::string>(outer_pair.first), new_inner_map);
+            boost::lexical_cast<std::string>(outer_pair.first->get_uuid()),
+            new_inner_map);
       });
 }
 
@@ -108,7 +113,7 @@ std::shared_ptr<contagent::Agent> contagent::json::AgentSpec::to_unlinked_agent(
 
   std::transform(actions.begin(), actions.end(),
                  std::back_inserter(actions_proper),
-                 [behaviours](const std::string &action) {
+                 [&behaviours](const std::string &action) {
                    auto u = boost::lexical_cast<boost::uuids::uuid>(action);
                    return behaviours.at(u);
                  });
@@ -121,7 +126,7 @@ std::shared_ptr<contagent::Agent> contagent::json::AgentSpec::to_unlinked_agent(
   std::transform(
       activations.begin(), activations.end(),
       std::back_inserter(activations_proper),
-      [beliefs](const std::unordered_map<std::string, double_t>
+      [&beliefs](const std::unordered_map<std::string, double_t>
                     &activations_at_time) {
         std::unordered_map<std::shared_ptr<contagent::Belief>, double_t>
             activations_at_time_proper;
@@ -130,7 +135,7 @@ std::shared_ptr<contagent::Agent> contagent::json::AgentSpec::to_unlinked_agent(
             activations_at_time.begin(), activations_at_time.end(),
             std::inserter(activations_at_time_proper,
                           activations_at_time_proper.end()),
-            [beliefs](const auto &p) {
+            [&beliefs](const auto &p) {
               std::pair<std::shared_ptr<contagent::Belief>, double_t> new_pair;
               new_pair.first =
                   beliefs.at(boost::lexical_cast<boost::uuids::uuid>(p.first));
@@ -142,14 +147,23 @@ std::shared_ptr<contagent::Agent> contagent::json::AgentSpec::to_unlinked_agent(
       });
 
   agent->set_activations(activations_proper);
+  agent->set_archetype(to_archetype(behaviours, beliefs));
 
+  return agent;
+}
+
+contagent::ArchetypeTable::Reference
+contagent::json::AgentSpec::to_archetype(
+    const std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>> &behaviours,
+    const std::map<boost::uuids::uuid, std::shared_ptr<Belief>> &beliefs)
+    const {
   std::unordered_map<std::shared_ptr<contagent::Belief>, double_t>
       deltas_proper;
 
   std::transform(
       deltas.begin(), deltas.end(),
       std::inserter(deltas_proper, deltas_proper.end()),
-      [beliefs](const auto &p) {
+      [&beliefs](const auto &p) {
         std::pair<std::shared_ptr<contagent::Belief>, double_t> new_pair;
         new_pair.first =
             beliefs.at(boost::lexical_cast<boost::uuids::uuid>(p.first));
@@ -157,8 +171,6 @@ std::shared_ptr<contagent::Agent> contagent::json::AgentSpec::to_unlinked_agent(
         return new_pair;
       });
 
-  agent->set_deltas(deltas_proper);
-
   std::unordered_map<
       std::shared_ptr<contagent::Belief>,
       std::unordered_map<std::shared_ptr<contagent::Behaviour>, double_t>>
@@ -168,7 +180,7 @@ std::shared_ptr<contagent::Agent> contagent::json::AgentSpec::to_unlinked_agent(
       performance_relationships.begin(), performance_relationships.end(),
       std::inserter(performance_relationships_proper,
                     performance_relationships_proper.end()),
-      [beliefs, behaviours](const auto &p) {
+      [&beliefs, &behaviours](const auto &p) {
         std::pair<
             std::shared_ptr<contagent::Belief>,
             std::unordered_map<std::shared_ptr<contagent::Behaviour>, double_t>>
@@ -183,7 +195,7 @@ std::shared_ptr<contagent::Agent> contagent::json::AgentSpec::to_unlinked_agent(
         std::transform(
             p.second.begin(), p.second.end(),
             std::inserter(inner_map, inner_map.end()),
-            [behaviours](const auto &inner_pair) {
+            [&behaviours](const auto &inner_pair) {
               std::pair<std::shared_ptr<contagent::Behaviour>, double_t>
                   new_inner_pair;
               new_inner_pair.first = behaviours.at(
@@ -197,22 +209,21 @@ std::shared_ptr<contagent::Agent> contagent::json::AgentSpec::to_unlinked_agent(
         return new_outer_pair;
       });
 
-  agent->set_performance_relationships(performance_relationships_proper);
-
-  return agent;
+  return ArchetypeTable::global().intern(
+      Archetype{std::move(deltas_proper),
+                std::move(performance_relationships_proper)});
 }
 
 void contagent::json::AgentSpec::link_agents(
     const std::map<boost::uuids::uuid, std::shared_ptr<Agent>> &agents) const {
   auto &agent = agents.at(boost::lexical_cast<boost::uuids::uuid>(uuid));
 
-  std::map<std::weak_ptr<contagent::Agent>, double_t, std::owner_less<>>
-      friends_proper;
+  contagent::Friends friends_proper;
+  friends_proper.reserve(friends.size());
 
   std::transform(
-      friends.begin(), friends.end(),
-      std::inserter(friends_proper, friends_proper.end()),
-      [agents](const auto &p) {
+      friends.begin(), friends.end(), std::back_inserter(friends_proper),
+      [&agents](const auto &p) {
         const auto &f =
             agents.at(boost::lexical_cast<boost::uuids::uuid>(p.first));
         std::weak_ptr<contagent::Agent> weak_friend = f;
@@ -221,5 +232,5 @@ void contagent::json::AgentSpec::link_agents(
         return new_pair;
       });
 
-  agent->set_friends(friends_proper);
+  agent->set_friends(std::move(friends_proper));
 }
@@ -0,0 +1,204 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "contagent/json/compact_spec.h"
+#include "contagent/selection.h"
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+namespace contagent::json {
+namespace {
+/// Get the indices that a selection selects.
+/// \param selected The indices selected, or empty for all.
+/// \param n The number of elements.
+/// \return The indices, in ascending order.
+std::vector<std::uint32_t> selected_indices(
+    const std::vector<std::uint32_t> &selected, const std::size_t n) {
+  std::vector<std::uint32_t> indices;
+  const auto mask = selection::mask(selected, n);
+  for (std::uint32_t i = 0; i < n; ++i) {
+    if (mask[i]) {
+      indices.push_back(i);
+    }
+  }
+  return indices;
+}
+
+/// Look up a statistic of a belief or behaviour, which is left out of a
+/// summary::SummaryStats when it is 0.
+template <typename K, typename V>
+V find_or_zero(const std::unordered_map<std::shared_ptr<K>, V> &values,
+               const std::shared_ptr<K> &key) {
+  const auto it = values.find(key);
+  return it == values.end() ? V{} : it->second;
+}
+} // namespace
+
+Dictionary::Dictionary(const Configuration &configuration,
+                       const bool with_agents) {
+  const auto &beliefs = configuration.get_beliefs();
+  const auto &behaviours = configuration.get_behaviours();
+  const auto &selection = configuration.get_output_selection();
+  beliefs_ = selected_indices(selection.beliefs, beliefs.size());
+  behaviours_ = selected_indices(selection.behaviours, behaviours.size());
+  if (with_agents) {
+    agents_ =
+        selected_indices(selection.agents, configuration.get_n_agents());
+  }
+
+  nlohmann::json j = {{"version", 1}};
+  auto &belief_entries = j["beliefs"] = nlohmann::json::array();
+  for (const auto b : beliefs_) {
+    belief_entries.push_back(
+        {{"uuid", boost::lexical_cast<std::string>(beliefs[b]->get_uuid())},
+         {"name", beliefs[b]->get_name()}});
+  }
+  auto &behaviour_entries = j["behaviours"] = nlohmann::json::array();
+  for (std::uint32_t k = 0; k < behaviours_.size(); ++k) {
+    const auto &behaviour = behaviours[behaviours_[k]];
+    behaviour_positions_.emplace(behaviour.get(), k);
+    behaviour_entries.push_back(
+        {{"uuid", boost::lexical_cast<std::string>(behaviour->get_uuid())},
+         {"name", behaviour->get_name()}});
+  }
+  if (with_agents) {
+    auto &agent_entries = j["agents"] = nlohmann::json::array();
+    for (const auto i : agents_) {
+      agent_entries.push_back(
+          boost::lexical_cast<std::string>(configuration.get_agent_uuid(i)));
+    }
+  }
+  text_ = j.dump();
+}
+
+const std::vector<std::uint32_t> &Dictionary::get_beliefs() const noexcept {
+  return beliefs_;
+}
+
+const std::vector<std::uint32_t> &
+Dictionary::get_behaviours() const noexcept {
+  return behaviours_;
+}
+
+const std::vector<std::uint32_t> &Dictionary::get_agents() const noexcept {
+  return agents_;
+}
+
+std::optional<std::uint32_t>
+Dictionary::find(const Behaviour *behaviour) const {
+  const auto it = behaviour_positions_.find(behaviour);
+  if (it == behaviour_positions_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+const std::string &Dictionary::get_text() const noexcept { return text_; }
+
+CompactSummarySpec::CompactSummarySpec(
+    const Dictionary &dictionary, const Configuration &configuration,
+    const contagent::summary::SummaryStats &stats, const std::size_t time)
+    : time(time) {
+  const auto &beliefs = configuration.get_beliefs();
+  for (const auto b : dictionary.get_beliefs()) {
+    mean_activations.push_back(
+        find_or_zero(stats.mean_activations, beliefs[b]));
+    sd_activations.push_back(find_or_zero(stats.sd_activations, beliefs[b]));
+    median_activations.push_back(
+        find_or_zero(stats.median_activations, beliefs[b]));
+    nonzero_activations.push_back(
+        find_or_zero(stats.nonzero_activations, beliefs[b]));
+  }
+  const auto &behaviours = configuration.get_behaviours();
+  for (const auto k : dictionary.get_behaviours()) {
+    n_performers.push_back(find_or_zero(stats.n_performers, behaviours[k]));
+  }
+}
+
+void write_compact_agents(const Configuration &configuration,
+                          std::ostream &output) {
+  const Dictionary dictionary(configuration, true);
+  const auto &agents = configuration.get_agents();
+  const auto &beliefs = configuration.get_beliefs();
+
+  std::vector<std::size_t> times;
+  for (std::size_t day = configuration.get_start_time();
+       day < configuration.get_end_time(); ++day) {
+    if (selection::contains_day(configuration, day)) {
+      times.push_back(day);
+    }
+  }
+
+  // Every agent is written as soon as its days are gathered, rather than
+  // building the whole output, so only one agent is held at a time.
+  output << "{\"dictionary\":" << dictionary.get_text()
+         << ",\"times\":" << nlohmann::json(times) << ",\"actions\":[";
+  bool first = true;
+  for (const auto i : dictionary.get_agents()) {
+    const auto agent_actions = agents[i]->get_actions();
+
+    auto days_actions = nlohmann::json::array();
+    for (const auto day : times) {
+      const auto position =
+          day < agent_actions.size()
+              ? dictionary.find(agent_actions[day].get())
+              : std::nullopt;
+      if (position) {
+        days_actions.push_back(*position);
+      } else {
+        days_actions.push_back(nullptr);
+      }
+    }
+    output << (first ? "" : ",") << days_actions;
+    first = false;
+  }
+
+  output << "],\"activations\":[";
+  first = true;
+  for (const auto i : dictionary.get_agents()) {
+    const auto agent_activations = agents[i]->get_activations();
+
+    auto days_activations = nlohmann::json::array();
+    for (const auto day : times) {
+      std::vector<double_t> day_activations;
+      day_activations.reserve(dictionary.get_beliefs().size());
+      for (const auto b : dictionary.get_beliefs()) {
+        day_activations.push_back(
+            day < agent_activations.size()
+                ? find_or_zero(agent_activations[day], beliefs[b])
+                : 0.0);
+      }
+      days_activations.push_back(std::move(day_activations));
+    }
+    output << (first ? "" : ",") << days_activations;
+    first = false;
+  }
+  output << "]}";
+}
+} // namespace contagent::json
@@ -0,0 +1,67 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/json/scenario_spec.h"
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+namespace contagent::json {
+contagent::sweep::Scenario ScenarioSpec::to_scenario(
+    const std::map<boost::uuids::uuid, std::shared_ptr<Behaviour>> &behaviours,
+    const std::map<boost::uuids::uuid, std::shared_ptr<Belief>> &beliefs)
+    const {
+  contagent::sweep::Scenario scenario;
+  scenario.name = name;
+  scenario.delta_multiplier = delta_multiplier;
+
+  for (const auto &[b1, inner] : relationships) {
+    auto &out = scenario.relationships[beliefs.at(
+        boost::lexical_cast<boost::uuids::uuid>(b1))];
+    for (const auto &[b2, relationship] : inner) {
+      out[beliefs.at(boost::lexical_cast<boost::uuids::uuid>(b2))] =
+          relationship;
+    }
+  }
+
+  for (const auto &[belief, inner] : perceptions) {
+    auto &out = scenario.perceptions[beliefs.at(
+        boost::lexical_cast<boost::uuids::uuid>(belief))];
+    for (const auto &[behaviour, perception] : inner) {
+      out[behaviours.at(boost::lexical_cast<boost::uuids::uuid>(behaviour))] =
+          perception;
+    }
+  }
+
+  for (const auto &[belief, multiplier] : delta_multipliers) {
+    scenario.delta_multipliers[beliefs.at(
+        boost::lexical_cast<boost::uuids::uuid>(belief))] = multiplier;
+  }
+
+  return scenario;
+}
+} // namespace contagent::json
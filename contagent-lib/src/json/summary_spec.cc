@@ -31,11 +31,39 @@
 #include <boost/uuid/uuid_io.hpp>
 
 namespace contagent::json {
-SummarySpec::SummarySpec(const contagent::summary::SummaryStats &stats) {
+SummarySpec::SummarySpec(const contagent::summary::SummaryStats &stats,
+                         const std::size_t time)
+    : time(time) {
   fill_map(mean_activations, stats.mean_activations);
   fill_map(sd_activations, stats.sd_activations);
   fill_map(median_activations, stats.median_activations);
   fill_map(nonzero_activations, stats.nonzero_activations);
   fill_map(n_performers, stats.n_performers);
 }
+
+SummaryEncoder::SummaryEncoder(const Configuration &configuration)
+    : configuration_(configuration) {
+  if (configuration.get_output_pipeline().schema == OutputSchema::COMPACT) {
+    dictionary_.emplace(configuration, false);
+  }
+}
+
+std::string SummaryEncoder::begin() const {
+  return dictionary_ ? "{\"dictionary\":" + dictionary_->get_text() +
+                           ",\"days\":["
+                     : "[";
+}
+
+std::string
+SummaryEncoder::encode(const contagent::summary::SummaryStats &stats,
+                       const std::size_t time) const {
+  if (dictionary_) {
+    return nlohmann::json(
+               CompactSummarySpec(*dictionary_, configuration_, stats, time))
+        .dump();
+  }
+  return nlohmann::json(SummarySpec(stats, time)).dump();
+}
+
+std::string SummaryEncoder::end() const { return dictionary_ ? "]}" : "]"; }
 } // namespace contagent::json
\ No newline at end of file
@@ -31,8 +31,46 @@
 #include <boost/iostreams/device/file.hpp>
 #include <boost/iostreams/filter/zstd.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
+#include <glog/logging.h>
 
 namespace contagent::json {
+namespace {
+/// A Boost.Iostreams sink that appends to an AsyncFile, which it shares
+/// between its copies, and logs its metrics when it is closed.
+class AsyncFileSink {
+public:
+  typedef char char_type;
+  struct category : boost::iostreams::sink_tag,
+                    boost::iostreams::closable_tag {};
+
+  AsyncFileSink(const std::string &filepath, const FileOutput &options)
+      : path_(filepath),
+        file_(std::make_shared<AsyncFile>(filepath, options)) {}
+
+  std::streamsize write(const char *s, const std::streamsize n) {
+    file_->write(s, static_cast<std::size_t>(n));
+    return n;
+  }
+
+  void close() {
+    const auto metrics = file_->close();
+    const double_t mib = static_cast<double_t>(metrics.bytes) / (1 << 20);
+    LOG(INFO) << "Wrote " << mib << " MiB to " << path_ << " in "
+              << metrics.elapsed << "s, at "
+              << (metrics.elapsed > 0 ? mib / metrics.elapsed : 0.0)
+              << " MiB/s, "
+              << (metrics.io_uring ? "through io_uring" : "with pwrite")
+              << (metrics.direct ? " and O_DIRECT" : "")
+              << ", and encoding waited " << metrics.stalled
+              << "s for the writes";
+  }
+
+private:
+  std::string path_;
+  std::shared_ptr<AsyncFile> file_;
+};
+} // namespace
+
 std::unique_ptr<std::istream> create_zstd_istream(const std::string &filepath) {
   auto istream = std::make_unique<boost::iostreams::filtering_istream>();
   istream->push(boost::iostreams::zstd_decompressor());
@@ -42,10 +80,15 @@ std::unique_ptr<std::istream> create_zstd_istream(const std::string &filepath) {
 
 std::unique_ptr<std::ostream>
 create_zstd_ostream(const std::string &filepath,
-                    const uint32_t compression_level) {
+                    const uint32_t compression_level,
+                    const FileOutput &file) {
   auto ostream = std::make_unique<boost::iostreams::filtering_ostream>();
   ostream->push(boost::iostreams::zstd_compressor(compression_level));
-  ostream->push(boost::iostreams::file_sink(filepath));
+  if (file.asynchronous) {
+    ostream->push(AsyncFileSink(filepath, file));
+  } else {
+    ostream->push(boost::iostreams::file_sink(filepath));
+  }
   return ostream;
 }
 } // namespace contagent::json
\ No newline at end of file
@@ -0,0 +1,288 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/linalg.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace contagent::linalg {
+namespace {
+/// The number of bytes in a vector register, 32 with AVX, or else the 16 of
+/// SSE2, as wider vectors would be split by the compiler and passed to the
+/// helpers in memory.
+#ifdef __AVX__
+constexpr std::size_t VECTOR_BYTES = 32;
+#else
+constexpr std::size_t VECTOR_BYTES = 16;
+#endif
+
+template <class T> struct Vector;
+
+template <> struct Vector<double_t> {
+  using type = double_t __attribute__((vector_size(VECTOR_BYTES)));
+};
+
+template <> struct Vector<float> {
+  using type = float __attribute__((vector_size(VECTOR_BYTES)));
+};
+
+template <class T> using vec = typename Vector<T>::type;
+
+/// The number of elements in a vector register.
+template <class T> constexpr std::size_t W = VECTOR_BYTES / sizeof(T);
+
+/// The size of the tile of C that is held in registers.
+constexpr std::size_t MR = 4;
+template <class T> constexpr std::size_t NR = 2 * W<T>;
+
+/// The size of the blocks of A and B that are packed, chosen so that a packed
+/// block of B stays in L1 and a packed block of A stays in L2.
+constexpr std::size_t KC = 256;
+constexpr std::size_t MC = 128;
+
+template <class T> inline vec<T> load(const T *p) noexcept {
+  vec<T> v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+template <class T> inline void store(T *p, vec<T> v) noexcept {
+  std::memcpy(p, &v, sizeof(v));
+}
+
+/// Pack a kb×n block of B into panels of NR columns, padded with zeros.
+template <class T>
+void pack_b(std::size_t kb, std::size_t n, const T *b, std::size_t ldb,
+            T *packed) noexcept {
+  for (std::size_t j = 0; j < n; j += NR<T>) {
+    const std::size_t nr = std::min(NR<T>, n - j);
+    for (std::size_t p = 0; p < kb; ++p) {
+      const T *row = b + p * ldb + j;
+      std::size_t jj = 0;
+      for (; jj < nr; ++jj) {
+        packed[jj] = row[jj];
+      }
+      for (; jj < NR<T>; ++jj) {
+        packed[jj] = 0.0;
+      }
+      packed += NR<T>;
+    }
+  }
+}
+
+/// Pack an mb×kb block of A into panels of MR rows, stored column by column
+/// and padded with zeros.
+template <class T>
+void pack_a(std::size_t mb, std::size_t kb, const T *a, std::size_t lda,
+            T *packed) noexcept {
+  for (std::size_t i = 0; i < mb; i += MR) {
+    const std::size_t mr = std::min(MR, mb - i);
+    for (std::size_t p = 0; p < kb; ++p) {
+      std::size_t ii = 0;
+      for (; ii < mr; ++ii) {
+        packed[ii] = a[(i + ii) * lda + p];
+      }
+      for (; ii < MR; ++ii) {
+        packed[ii] = 0.0;
+      }
+      packed += MR;
+    }
+  }
+}
+
+/// Compute an MR×NR tile of C from packed panels of A and B, either
+/// overwriting or accumulating into C. Only the top-left mr×nr of the tile
+/// is written.
+template <class T>
+void micro_kernel(std::size_t kb, const T *a, const T *b, T *c,
+                  std::size_t ldc, std::size_t mr, std::size_t nr,
+                  bool accumulate) noexcept {
+  constexpr std::size_t w = W<T>;
+  vec<T> acc[MR][2] = {};
+
+  for (std::size_t p = 0; p < kb; ++p) {
+    const vec<T> b0 = load(b);
+    const vec<T> b1 = load(b + w);
+    for (std::size_t i = 0; i < MR; ++i) {
+      const vec<T> ai = vec<T>{} + a[i];
+      acc[i][0] += ai * b0;
+      acc[i][1] += ai * b1;
+    }
+    a += MR;
+    b += NR<T>;
+  }
+
+  if (mr == MR && nr == NR<T>) {
+    for (std::size_t i = 0; i < MR; ++i) {
+      T *row = c + i * ldc;
+      if (accumulate) {
+        store(row, load(row) + acc[i][0]);
+        store(row + w, load(row + w) + acc[i][1]);
+      } else {
+        store(row, acc[i][0]);
+        store(row + w, acc[i][1]);
+      }
+    }
+  } else {
+    T tile[MR][NR<T>];
+    for (std::size_t i = 0; i < MR; ++i) {
+      store(tile[i], acc[i][0]);
+      store(tile[i] + w, acc[i][1]);
+    }
+    for (std::size_t i = 0; i < mr; ++i) {
+      for (std::size_t j = 0; j < nr; ++j) {
+        c[i * ldc + j] = accumulate ? c[i * ldc + j] + tile[i][j] : tile[i][j];
+      }
+    }
+  }
+}
+
+template <class T>
+void gemm_impl(const std::size_t m, const std::size_t n, const std::size_t k,
+               const T *a, const std::size_t lda, const T *b,
+               const std::size_t ldb, T *c, const std::size_t ldc) noexcept {
+  if (k == 0) {
+    for (std::size_t i = 0; i < m; ++i) {
+      std::fill_n(c + i * ldc, n, T(0));
+    }
+    return;
+  }
+
+  thread_local std::vector<T> packed_a;
+  thread_local std::vector<T> packed_b;
+
+  constexpr std::size_t nr = NR<T>;
+  const std::size_t n_panels = (n + nr - 1) / nr;
+  packed_b.resize(std::min(KC, k) * n_panels * nr);
+  packed_a.resize((std::min(MC, m) + MR - 1) / MR * MR * std::min(KC, k));
+
+  for (std::size_t pc = 0; pc < k; pc += KC) {
+    const std::size_t kb = std::min(KC, k - pc);
+    pack_b(kb, n, b + pc * ldb, ldb, packed_b.data());
+
+    for (std::size_t ic = 0; ic < m; ic += MC) {
+      const std::size_t mb = std::min(MC, m - ic);
+      pack_a(mb, kb, a + ic * lda + pc, lda, packed_a.data());
+
+      for (std::size_t jr = 0; jr < n; jr += nr) {
+        const T *pb = packed_b.data() + jr / nr * kb * nr;
+        for (std::size_t ir = 0; ir < mb; ir += MR) {
+          micro_kernel(kb, packed_a.data() + ir / MR * kb * MR, pb,
+                       c + (ic + ir) * ldc + jr, ldc, std::min(MR, mb - ir),
+                       std::min(nr, n - jr), pc != 0);
+        }
+      }
+    }
+  }
+}
+
+template <class T>
+void gemv_impl(const std::size_t n, const std::size_t k, const T *x,
+               const T *b, const std::size_t ldb, T *y) noexcept {
+  std::fill_n(y, n, T(0));
+  for (std::size_t p = 0; p < k; ++p) {
+    const T xp = x[p];
+    const T *row = b + p * ldb;
+    for (std::size_t j = 0; j < n; ++j) {
+      y[j] += xp * row[j];
+    }
+  }
+}
+
+template <class T>
+void scale_columns_impl(const std::size_t m, const std::size_t n,
+                        const T *__restrict a, const std::size_t lda,
+                        const T *__restrict x, T *__restrict c,
+                        const std::size_t ldc) noexcept {
+  if (lda == n && ldc == n && n != 0) {
+    // The matrices are contiguous, so x is repeated to cover a block of rows
+    // and each block is scaled as one long loop that the compiler vectorizes,
+    // rather than as many loops of length n.
+    thread_local std::vector<T> repeated;
+    const std::size_t rows_per_block = std::max<std::size_t>(1, 512 / n);
+    repeated.resize(rows_per_block * n);
+    for (std::size_t r = 0; r < rows_per_block; ++r) {
+      std::copy_n(x, n, repeated.data() + r * n);
+    }
+    const T *__restrict xs = repeated.data();
+
+    for (std::size_t i = 0; i < m; i += rows_per_block) {
+      const std::size_t len = std::min(rows_per_block, m - i) * n;
+      const T *__restrict ai = a + i * n;
+      T *__restrict ci = c + i * n;
+      for (std::size_t j = 0; j < len; ++j) {
+        ci[j] = ai[j] * xs[j];
+      }
+    }
+    return;
+  }
+
+  for (std::size_t i = 0; i < m; ++i) {
+    for (std::size_t j = 0; j < n; ++j) {
+      c[i * ldc + j] = a[i * lda + j] * x[j];
+    }
+  }
+}
+} // namespace
+
+void gemm(const std::size_t m, const std::size_t n, const std::size_t k,
+          const double_t *a, const std::size_t lda, const double_t *b,
+          const std::size_t ldb, double_t *c, const std::size_t ldc) noexcept {
+  gemm_impl(m, n, k, a, lda, b, ldb, c, ldc);
+}
+
+void gemm(const std::size_t m, const std::size_t n, const std::size_t k,
+          const float *a, const std::size_t lda, const float *b,
+          const std::size_t ldb, float *c, const std::size_t ldc) noexcept {
+  gemm_impl(m, n, k, a, lda, b, ldb, c, ldc);
+}
+
+void gemv(const std::size_t n, const std::size_t k, const double_t *x,
+          const double_t *b, const std::size_t ldb, double_t *y) noexcept {
+  gemv_impl(n, k, x, b, ldb, y);
+}
+
+void gemv(const std::size_t n, const std::size_t k, const float *x,
+          const float *b, const std::size_t ldb, float *y) noexcept {
+  gemv_impl(n, k, x, b, ldb, y);
+}
+
+void scale_columns(const std::size_t m, const std::size_t n, const double_t *a,
+                   const std::size_t lda, const double_t *x, double_t *c,
+                   const std::size_t ldc) noexcept {
+  scale_columns_impl(m, n, a, lda, x, c, ldc);
+}
+
+void scale_columns(const std::size_t m, const std::size_t n, const float *a,
+                   const std::size_t lda, const float *x, float *c,
+                   const std::size_t ldc) noexcept {
+  scale_columns_impl(m, n, a, lda, x, c, ldc);
+}
+} // namespace contagent::linalg
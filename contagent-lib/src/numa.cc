@@ -0,0 +1,332 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/numa.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace contagent::numa {
+namespace {
+/// Read the first line of a file.
+/// \param path The path.
+/// \return The line, or empty if the file could not be read.
+std::string read_line(const std::filesystem::path &path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+/// Whether this process may run on a CPU.
+/// \param cpu The CPU.
+/// \return Whether it is in the affinity mask of the process.
+bool is_allowed(const unsigned cpu) {
+#ifdef __linux__
+  static const cpu_set_t allowed = [] {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+      for (unsigned c = 0; c < CPU_SETSIZE; ++c) {
+        CPU_SET(c, &set);
+      }
+    }
+    return set;
+  }();
+  return cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed);
+#else
+  return true;
+#endif
+}
+
+/// The directory of the innermost FileBacking of this thread, or nullptr.
+thread_local const std::filesystem::path *backing_directory = nullptr;
+
+/// The allocations that are backed by files, by their address, with their
+/// length.
+std::mutex mappings_mutex;
+std::map<std::uintptr_t, std::size_t> mappings;
+std::atomic<std::size_t> mapped_bytes = 0;
+
+/// Map a new unlinked file, which is removed when it is unmapped.
+/// \param directory The directory to make it in.
+/// \param bytes The size of the file.
+/// \return The mapping.
+/// \throws std::system_error If the file could not be made or mapped.
+void *map_file(const std::filesystem::path &directory,
+               const std::size_t bytes) {
+#ifdef __linux__
+  int fd = open(directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    // Not every file system supports O_TMPFILE.
+    std::string path = (directory / "contagent-XXXXXX").string();
+    fd = mkostemp(path.data(), O_CLOEXEC);
+    if (fd >= 0) {
+      unlink(path.c_str());
+    }
+  }
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Unable to make a file in " + directory.string());
+  }
+
+  // The file is sparse, so only the pages that are written take space.
+  if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to size a file in " + directory.string());
+  }
+  void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int error = errno;
+  close(fd);
+  if (p == MAP_FAILED) {
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to map a file in " + directory.string());
+  }
+
+  std::lock_guard lock(mappings_mutex);
+  mappings.emplace(reinterpret_cast<std::uintptr_t>(p), bytes);
+  mapped_bytes += bytes;
+  return p;
+#else
+  throw std::system_error(std::make_error_code(std::errc::not_supported),
+                          "Files can only back memory on Linux");
+#endif
+}
+
+/// Unmap an allocation if it is backed by a file.
+/// \param p The allocation.
+/// \return Whether it was.
+bool unmap_file(void *p) noexcept {
+#ifdef __linux__
+  std::size_t bytes;
+  {
+    std::lock_guard lock(mappings_mutex);
+    const auto mapping = mappings.find(reinterpret_cast<std::uintptr_t>(p));
+    if (mapping == mappings.end()) {
+      return false;
+    }
+    bytes = mapping->second;
+    mappings.erase(mapping);
+  }
+  munmap(p, bytes);
+  mapped_bytes -= bytes;
+  return true;
+#else
+  return false;
+#endif
+}
+} // namespace
+
+FileBacking::FileBacking(std::filesystem::path directory)
+    : directory_(std::move(directory)), previous_(backing_directory) {
+  backing_directory = directory_.empty() ? nullptr : &directory_;
+}
+
+FileBacking::~FileBacking() { backing_directory = previous_; }
+
+Topology Topology::detect() {
+  Topology topology;
+  const std::filesystem::path root = "/sys/devices/system/node";
+
+  try {
+    for (const auto node : parse_cpu_list(read_line(root / "online"))) {
+      auto cpus = parse_cpu_list(
+          read_line(root / ("node" + std::to_string(node)) / "cpulist"));
+      std::erase_if(cpus, [](const auto cpu) { return !is_allowed(cpu); });
+      if (!cpus.empty()) {
+        topology.cpus.push_back(std::move(cpus));
+      }
+    }
+  } catch (const std::invalid_argument &) {
+    topology.cpus.clear();
+  }
+
+  if (topology.cpus.empty()) {
+    auto &cpus = topology.cpus.emplace_back();
+    for (unsigned cpu = 0;
+         cpu < std::max(1U, std::thread::hardware_concurrency()); ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+
+  return topology;
+}
+
+std::size_t Topology::n_nodes() const noexcept { return cpus.size(); }
+
+std::vector<unsigned> parse_cpu_list(const std::string &list) {
+  std::vector<unsigned> cpus;
+  std::size_t pos = 0;
+
+  while (pos < list.size()) {
+    std::size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    const std::string range = list.substr(pos, end - pos);
+    pos = end + 1;
+
+    try {
+      const std::size_t dash = range.find('-');
+      const unsigned first = std::stoul(range.substr(0, dash));
+      const unsigned last = dash == std::string::npos
+                                ? first
+                                : std::stoul(range.substr(dash + 1));
+      for (unsigned cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::logic_error &) {
+      throw std::invalid_argument("Malformed CPU list " + list);
+    }
+  }
+
+  return cpus;
+}
+
+void pin_current_thread(const unsigned cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (const int error =
+          pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      error != 0) {
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to pin thread to CPU " +
+                                std::to_string(cpu));
+  }
+#endif
+}
+
+void *allocate(const std::size_t bytes) {
+  if (bytes < HUGE_PAGE_SIZE) {
+    return ::operator new(bytes);
+  }
+
+  const std::size_t rounded =
+      (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  if (backing_directory) {
+    return map_file(*backing_directory, rounded);
+  }
+  void *p = ::operator new(rounded, std::align_val_t{HUGE_PAGE_SIZE});
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  // This is only advice, if transparent huge pages are disabled it fails and
+  // normal pages are used.
+  madvise(p, rounded, MADV_HUGEPAGE);
+#endif
+  return p;
+}
+
+void deallocate(void *p, const std::size_t bytes) noexcept {
+  if (bytes < HUGE_PAGE_SIZE) {
+    ::operator delete(p);
+  } else if (!unmap_file(p)) {
+    ::operator delete(p, std::align_val_t{HUGE_PAGE_SIZE});
+  }
+}
+
+void release(const void *p, const std::size_t bytes) noexcept {
+#ifdef __linux__
+  if (bytes == 0 || mapped_bytes == 0) {
+    return;
+  }
+
+  const auto address = reinterpret_cast<std::uintptr_t>(p);
+  std::uintptr_t first;
+  std::uintptr_t last;
+  {
+    std::lock_guard lock(mappings_mutex);
+    auto mapping = mappings.upper_bound(address);
+    if (mapping == mappings.begin()) {
+      return;
+    }
+    --mapping;
+    if (address >= mapping->first + mapping->second) {
+      return;
+    }
+    first = mapping->first;
+    last = mapping->first + mapping->second;
+  }
+
+  // Widening to whole pages cannot lose anything, as the pages of a shared
+  // mapping of a file are read back from the page cache or the file.
+  static const std::uintptr_t page = sysconf(_SC_PAGESIZE);
+  const std::uintptr_t begin = std::max(first, address / page * page);
+  const std::uintptr_t end =
+      std::min(last, (address + bytes + page - 1) / page * page);
+  madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+std::size_t file_backed_bytes() noexcept { return mapped_bytes; }
+
+std::size_t resident_bytes() noexcept {
+#ifdef __linux__
+  // This is read after every day, so it avoids the allocations of a stream.
+  const int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  char text[128];
+  const ssize_t n = read(fd, text, sizeof(text) - 1);
+  close(fd);
+  if (n <= 0) {
+    return 0;
+  }
+  text[n] = '\0';
+
+  // The second field is the number of resident pages.
+  unsigned long long pages = 0;
+  if (std::sscanf(text, "%*s %llu", &pages) != 1) {
+    return 0;
+  }
+  static const std::size_t page = sysconf(_SC_PAGESIZE);
+  return pages * page;
+#else
+  return 0;
+#endif
+}
+} // namespace contagent::numa
@@ -0,0 +1,424 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/partitions.h"
+#include <algorithm>
+#include <utility>
+
+namespace contagent {
+std::size_t Chunks::size() const noexcept { return bounds.size() - 1; }
+
+std::size_t Chunks::find(const std::size_t begin) const noexcept {
+  return std::lower_bound(bounds.begin(), bounds.end() - 1, begin) -
+         bounds.begin();
+}
+
+Partitions::Partitions(const std::span<const std::size_t> friend_offsets,
+                       const Parallelism &parallelism,
+                       numa::Topology topology)
+    : n_nodes_(topology.n_nodes()) {
+  std::size_t n_cpus = 0;
+  for (const auto &cpus : topology.cpus) {
+    n_cpus += cpus.size();
+  }
+
+  const std::size_t n_partitions =
+      parallelism.n_threads == 0 ? n_cpus : parallelism.n_threads;
+  const std::size_t n_agents = friend_offsets.size() - 1;
+
+  // The cost of the agents before each agent.
+  std::vector<std::size_t> costs(n_agents + 1, 0);
+  for (std::size_t i = 0; i < n_agents; ++i) {
+    const std::size_t degree = friend_offsets[i + 1] - friend_offsets[i];
+    costs[i + 1] = costs[i] + 1 + (degree < HUB_DEGREE ? degree : 0);
+  }
+  const auto at_cost = [&costs](const std::size_t first,
+                                const std::size_t last,
+                                const std::size_t target) {
+    return static_cast<std::size_t>(
+        std::lower_bound(costs.begin() + first, costs.begin() + last,
+                         target) -
+        costs.begin());
+  };
+
+  boundaries_.reserve(n_partitions + 1);
+  boundaries_.push_back(0);
+  for (std::size_t p = 1; p < n_partitions; ++p) {
+    boundaries_.push_back(
+        at_cost(boundaries_.back(), n_agents, costs.back() * p / n_partitions));
+  }
+  boundaries_.push_back(n_agents);
+
+  const std::size_t grain =
+      std::max(MIN_CHUNK_COST,
+               costs.back() / (n_partitions * CHUNKS_PER_PARTITION));
+  chunks_.bounds.push_back(0);
+  chunks_.queues.push_back(0);
+  for (std::size_t p = 0; p < n_partitions; ++p) {
+    const std::size_t first = boundaries_[p];
+    const std::size_t last = boundaries_[p + 1];
+    const std::size_t cost = costs[last] - costs[first];
+    const std::size_t n_chunks = (cost + grain - 1) / grain;
+    for (std::size_t c = 1; c < n_chunks; ++c) {
+      const std::size_t bound =
+          at_cost(first, last, costs[first] + cost * c / n_chunks);
+      if (bound > chunks_.bounds.back()) {
+        chunks_.bounds.push_back(bound);
+      }
+    }
+    if (last > chunks_.bounds.back()) {
+      chunks_.bounds.push_back(last);
+    }
+    chunks_.queues.push_back(chunks_.size());
+  }
+
+  // Each node gets a contiguous block of partitions, and the threads of a
+  // node take its CPUs in turn.
+  nodes_.reserve(n_partitions);
+  cpus_.reserve(n_partitions);
+  for (std::size_t p = 0; p < n_partitions; ++p) {
+    const std::size_t node = p * n_nodes_ / n_partitions;
+    const std::size_t first = (node * n_partitions + n_nodes_ - 1) / n_nodes_;
+    const auto &cpus = topology.cpus[node];
+    nodes_.push_back(node);
+    cpus_.push_back(cpus[(p - first) % cpus.size()]);
+  }
+
+  queues_ = std::vector<Queue>(n_partitions);
+  progress_ = std::vector<Progress>(n_partitions);
+  finished_.resize(n_partitions);
+  utilisation_.resize(n_partitions);
+
+  if (n_partitions == 1 && !parallelism.pin_threads) {
+    return;
+  }
+
+  workers_.reserve(n_partitions);
+  for (std::size_t p = 0; p < n_partitions; ++p) {
+    workers_.emplace_back([this, p] { work(p); });
+  }
+
+  if (parallelism.pin_threads) {
+    try {
+      run([this](const std::size_t p, std::size_t, std::size_t) {
+        numa::pin_current_thread(cpus_[p]);
+      });
+    } catch (...) {
+      stop();
+      throw;
+    }
+  }
+}
+
+Partitions::~Partitions() { stop(); }
+
+std::size_t Partitions::size() const noexcept {
+  return boundaries_.size() - 1;
+}
+
+std::size_t Partitions::begin(const std::size_t partition) const noexcept {
+  return boundaries_[partition];
+}
+
+std::size_t Partitions::end(const std::size_t partition) const noexcept {
+  return boundaries_[partition + 1];
+}
+
+std::size_t Partitions::node(const std::size_t partition) const noexcept {
+  return nodes_[partition];
+}
+
+bool Partitions::leads_node(const std::size_t partition) const noexcept {
+  return partition == 0 || nodes_[partition - 1] != nodes_[partition];
+}
+
+std::size_t Partitions::n_nodes() const noexcept { return n_nodes_; }
+
+std::size_t
+Partitions::partition_of(const std::size_t agent) const noexcept {
+  return std::upper_bound(boundaries_.begin() + 1, boundaries_.end() - 1,
+                          agent) -
+         boundaries_.begin() - 1;
+}
+
+const Chunks &Partitions::get_chunks() const noexcept { return chunks_; }
+
+std::vector<Partitions::Utilisation> Partitions::get_utilisation() const {
+  return utilisation_;
+}
+
+void Partitions::run(const Task &task) {
+  if (workers_.empty()) {
+    const auto started = std::chrono::steady_clock::now();
+    task(0, begin(0), end(0));
+    utilisation_[0].busy += std::chrono::duration<double_t>(
+                                std::chrono::steady_clock::now() - started)
+                                .count();
+    return;
+  }
+
+  std::unique_lock lock(mutex_);
+  task_ = &task;
+  remaining_ = workers_.size();
+  started_ = std::chrono::steady_clock::now();
+  ++generation_;
+  start_.notify_all();
+  done_.wait(lock, [this] { return remaining_ == 0; });
+  task_ = nullptr;
+
+  const auto finished = *std::max_element(finished_.begin(), finished_.end());
+  for (std::size_t p = 0; p < size(); ++p) {
+    utilisation_[p].busy +=
+        std::chrono::duration<double_t>(finished_[p] - started_).count();
+    utilisation_[p].idle +=
+        std::chrono::duration<double_t>(finished - finished_[p]).count();
+  }
+
+  if (exception_) {
+    std::rethrow_exception(std::exchange(exception_, nullptr));
+  }
+}
+
+void Partitions::steal(const Task &task) { steal(chunks_, task); }
+
+void Partitions::steal(const Chunks &chunks, const Task &task) {
+  for (std::size_t p = 0; p < size(); ++p) {
+    queues_[p].range.store(chunks.queues[p] << 32 | chunks.queues[p + 1],
+                           std::memory_order_relaxed);
+  }
+
+  run([this, &chunks, &task](const std::size_t p, std::size_t, std::size_t) {
+    std::size_t chunk;
+    while (take_front(queues_[p], chunk)) {
+      task(p, chunks.bounds[chunk], chunks.bounds[chunk + 1]);
+    }
+
+    while (true) {
+      // The victim is the queue with the most chunks left.
+      std::size_t victim = size();
+      std::uint64_t most = 0;
+      for (std::size_t q = 0; q < size(); ++q) {
+        const std::uint64_t range =
+            queues_[q].range.load(std::memory_order_relaxed);
+        const std::uint64_t first = range >> 32;
+        const std::uint64_t last = range & 0xffffffff;
+        const std::uint64_t left = first < last ? last - first : 0;
+        if (left > most) {
+          victim = q;
+          most = left;
+        }
+      }
+      if (victim == size()) {
+        return;
+      }
+
+      if (take_back(queues_[victim], chunk)) {
+        task(p, chunks.bounds[chunk], chunks.bounds[chunk + 1]);
+      }
+    }
+  });
+}
+
+bool Partitions::take_front(Queue &queue, std::size_t &chunk) noexcept {
+  std::uint64_t range = queue.range.load(std::memory_order_relaxed);
+  while (true) {
+    const std::uint64_t first = range >> 32;
+    const std::uint64_t last = range & 0xffffffff;
+    if (first >= last) {
+      return false;
+    }
+    if (queue.range.compare_exchange_weak(range, (first + 1) << 32 | last,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+      chunk = first;
+      return true;
+    }
+  }
+}
+
+bool Partitions::take_back(Queue &queue, std::size_t &chunk) noexcept {
+  std::uint64_t range = queue.range.load(std::memory_order_relaxed);
+  while (true) {
+    const std::uint64_t first = range >> 32;
+    const std::uint64_t last = range & 0xffffffff;
+    if (first >= last) {
+      return false;
+    }
+    if (queue.range.compare_exchange_weak(range, first << 32 | (last - 1),
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+      chunk = last - 1;
+      return true;
+    }
+  }
+}
+
+void Partitions::flow(const std::size_t n_steps,
+                      const std::span<const Dependencies> dependencies,
+                      const FlowTask &task) {
+  for (auto &progress : progress_) {
+    progress.steps.store(0, std::memory_order_relaxed);
+  }
+  flow_failed_.store(false, std::memory_order_relaxed);
+  std::vector<double_t> waited(size(), 0.0);
+
+  run([this, n_steps, dependencies, &task, &waited](const std::size_t p,
+                                                    const std::size_t begin,
+                                                    const std::size_t end) {
+    auto &steps = progress_[p].steps;
+    // A partition that stops early marks every step finished, so that the
+    // partitions waiting on it wake up and stop too.
+    const auto abandon = [&steps, n_steps] {
+      steps.store(n_steps, std::memory_order_release);
+      steps.notify_all();
+    };
+
+    try {
+      for (std::size_t s = 0; s < n_steps; ++s) {
+        const auto started = std::chrono::steady_clock::now();
+        for (const auto q : dependencies[s % dependencies.size()][p]) {
+          auto &other = progress_[q].steps;
+          std::size_t finished;
+          while ((finished = other.load(std::memory_order_acquire)) < s) {
+            other.wait(finished, std::memory_order_acquire);
+          }
+        }
+        waited[p] += std::chrono::duration<double_t>(
+                         std::chrono::steady_clock::now() - started)
+                         .count();
+
+        if (flow_failed_.load(std::memory_order_relaxed)) {
+          abandon();
+          return;
+        }
+        task(p, begin, end, s);
+        steps.store(s + 1, std::memory_order_release);
+        steps.notify_all();
+      }
+    } catch (...) {
+      flow_failed_.store(true, std::memory_order_relaxed);
+      abandon();
+      throw;
+    }
+  });
+
+  for (std::size_t p = 0; p < size(); ++p) {
+    utilisation_[p].busy -= waited[p];
+    utilisation_[p].idle += waited[p];
+  }
+}
+
+Partitions::Dependencies Partitions::find_friend_partitions(
+    const std::span<const std::size_t> friend_offsets,
+    const std::span<const std::uint32_t> friends) const {
+  Dependencies partitions(size());
+  std::vector<char> seen(size());
+
+  for (std::size_t p = 0; p < size(); ++p) {
+    std::fill(seen.begin(), seen.end(), 0);
+    for (std::size_t e = friend_offsets[begin(p)];
+         e < friend_offsets[end(p)]; ++e) {
+      seen[partition_of(friends[e])] = 1;
+    }
+    for (std::size_t q = 0; q < size(); ++q) {
+      if (q != p && seen[q]) {
+        partitions[p].push_back(q);
+      }
+    }
+  }
+
+  return partitions;
+}
+
+double_t Partitions::cross_node_fraction(
+    const std::span<const std::size_t> friend_offsets,
+    const std::span<const std::uint32_t> friends) const {
+  if (friends.empty()) {
+    return 0.0;
+  }
+
+  std::size_t cross = 0;
+  for (std::size_t p = 0; p < size(); ++p) {
+    for (std::size_t e = friend_offsets[begin(p)];
+         e < friend_offsets[end(p)]; ++e) {
+      if (nodes_[partition_of(friends[e])] != nodes_[p]) {
+        ++cross;
+      }
+    }
+  }
+
+  // NOLINTNEXTLINE(*-narrowing-conversions)
+  return static_cast<double_t>(cross) / friends.size();
+}
+
+void Partitions::work(const std::size_t partition) {
+  std::uint64_t seen = 0;
+
+  while (true) {
+    const Task *task;
+    {
+      std::unique_lock lock(mutex_);
+      start_.wait(lock,
+                  [this, seen] { return stopping_ || generation_ != seen; });
+      if (stopping_) {
+        return;
+      }
+      seen = generation_;
+      task = task_;
+    }
+
+    try {
+      (*task)(partition, begin(partition), end(partition));
+    } catch (...) {
+      std::lock_guard lock(mutex_);
+      if (!exception_) {
+        exception_ = std::current_exception();
+      }
+    }
+
+    finished_[partition] = std::chrono::steady_clock::now();
+    std::lock_guard lock(mutex_);
+    if (--remaining_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+void Partitions::stop() noexcept {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  start_.notify_all();
+
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+} // namespace contagent
@@ -0,0 +1,903 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/population.h"
+#include "contagent/dense_population.h"
+#include "contagent/random.h"
+#include "contagent/reorder.h"
+#include "contagent/sparse_population.h"
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <span>
+
+namespace contagent {
+namespace {
+/// Back the allocations of the calling thread with files while the result
+/// exists, if there is a Storage::memory_budget.
+numa::FileBacking file_backing(const Storage &storage) {
+  if (storage.memory_budget == 0) {
+    return numa::FileBacking({});
+  }
+  return numa::FileBacking(storage.directory.empty()
+                               ? std::filesystem::temp_directory_path()
+                               : storage.directory);
+}
+} // namespace
+
+std::unique_ptr<Population>
+Population::create(const Configuration &configuration, const std::size_t day,
+                   Engine engine) {
+  const auto &storage = configuration.get_storage();
+
+  // The table is only needed while the Population is built, and is backed by
+  // files as its arrays are.
+  std::optional<AgentTable> agents;
+  {
+    const auto backing = file_backing(storage);
+    agents = tabulate(configuration, day);
+  }
+
+  if (engine == Engine::AUTO) {
+    const double_t density = measure_density(configuration, *agents);
+    engine = density <= MAX_SPARSE_DENSITY ? Engine::SPARSE : Engine::DENSE;
+    LOG(INFO) << "Measured an activation density of " << density
+              << ", using the "
+              << (engine == Engine::SPARSE ? "sparse" : "dense") << " engine";
+  }
+
+  std::unique_ptr<Population> population;
+  if (engine == Engine::SPARSE) {
+    if (configuration.get_precision() != Precision::FLOAT64) {
+      LOG(WARNING) << "The sparse engine only computes in double precision";
+    }
+    population = std::make_unique<SparsePopulation>(configuration, *agents);
+  } else if (configuration.get_precision() == Precision::FLOAT32) {
+    population = std::make_unique<DensePopulation32>(configuration, *agents);
+  } else {
+    population = std::make_unique<DensePopulation>(configuration, *agents);
+  }
+  agents.reset();
+
+  if (storage.memory_budget != 0) {
+    LOG(INFO) << "Keeping " << population->state_bytes()
+              << " bytes of state and the history in "
+              << numa::file_backed_bytes() << " bytes of files, with "
+              << numa::resident_bytes() << " bytes resident of a budget of "
+              << storage.memory_budget << " bytes";
+  }
+
+  return population;
+}
+
+AgentTable Population::tabulate(const Configuration &configuration,
+                                const std::size_t day) {
+  const auto &shared = configuration.get_shared_agents();
+  const auto &beliefs =
+      shared.beliefs.empty() ? configuration.get_beliefs() : shared.beliefs;
+  const auto &behaviours = configuration.get_behaviours();
+  const auto &ownership = configuration.get_ownership();
+  const std::size_t n_agents = configuration.get_n_agents();
+  const std::size_t n_owned = std::min(ownership.n_owned, n_agents);
+
+  if (const auto &streamed = configuration.get_streamed_agents();
+      streamed.index) {
+    return streamed.tabulate(ownership.ids, n_owned, beliefs, behaviours,
+                             day);
+  }
+
+  const auto &agents = configuration.get_agents();
+  const auto belief_index = index(beliefs);
+  const auto behaviour_index = index(behaviours);
+  const auto agent_index = index(agents);
+
+  AgentTable table;
+  table.archetypes.reserve(n_agents);
+  table.actions.reserve(n_agents);
+  table.activation_offsets.reserve(n_agents + 1);
+  table.activation_offsets.push_back(0);
+  table.friend_offsets.reserve(n_agents + 1);
+  table.friend_offsets.push_back(0);
+
+  // The friends of every agent are sorted by UUID, as the Agents keep them by
+  // address, so that their weights are summed in the same order whatever the
+  // Configuration, which is what lets a replay::ChangeLog recompute any
+  // subset of the agents exactly.
+  std::vector<std::pair<const Agent *, double_t>> agent_friends;
+  for (std::size_t i = 0; i < n_agents; ++i) {
+    const auto &agent = agents[i];
+    table.archetypes.push_back(agent->get_archetype());
+
+    const auto &agent_actions = agent->get_action_history();
+    table.actions.push_back(
+        day < agent_actions.size() &&
+                behaviour_index.contains(agent_actions.at(day).get())
+            ? behaviour_index.at(agent_actions.at(day).get())
+            : 0);
+
+    for (const auto &[belief, activation] :
+         agent->get_activations_for_day(day)) {
+      if (const auto b = belief_index.find(belief.get());
+          b != belief_index.end()) {
+        table.activation_beliefs.push_back(b->second);
+        table.activation_values.push_back(activation);
+      }
+    }
+    table.activation_offsets.push_back(table.activation_beliefs.size());
+
+    if (i < n_owned) {
+      agent_friends.clear();
+      for (const auto &[weak_friend, weight] : agent->get_friends()) {
+        if (auto shared_friend = weak_friend.lock()) {
+          agent_friends.emplace_back(shared_friend.get(), weight);
+        } else {
+          throw std::runtime_error("Unable to lock weak pointer");
+        }
+      }
+      std::sort(agent_friends.begin(), agent_friends.end(),
+                [](const auto &a, const auto &b) {
+                  return a.first->get_uuid() < b.first->get_uuid();
+                });
+      for (const auto &[shared_friend, weight] : agent_friends) {
+        table.friends.push_back(agent_index.at(shared_friend));
+        table.friend_weights.push_back(weight);
+      }
+    }
+    table.friend_offsets.push_back(table.friends.size());
+  }
+
+  return table;
+}
+
+double_t Population::measure_density(const Configuration &configuration,
+                                     const AgentTable &agents) {
+  const auto &beliefs = configuration.get_beliefs();
+  const std::size_t size = agents.size() * beliefs.size();
+
+  if (size == 0) {
+    return 1.0;
+  }
+
+  std::size_t non_zero = std::count_if(
+      agents.activation_values.begin(), agents.activation_values.end(),
+      [](const double_t activation) { return activation != 0.0; });
+
+  for (const auto &belief : beliefs) {
+    if (std::any_of(belief->get_perceptions().begin(),
+                    belief->get_perceptions().end(),
+                    [](const auto &p) { return p.second != 0.0; })) {
+      non_zero += agents.size();
+    }
+  }
+
+  // NOLINTNEXTLINE(*-narrowing-conversions)
+  return std::min(1.0, static_cast<double_t>(non_zero) / size);
+}
+
+Population::Population(const Configuration &configuration,
+                       const AgentTable &agents)
+    : configuration_(configuration), n_agents_(agents.size()),
+      n_beliefs_(configuration.get_beliefs().size()),
+      n_behaviours_(configuration.get_behaviours().size()),
+      n_owned_(std::min(configuration.get_ownership().n_owned, n_agents_)),
+      incremental_(configuration.get_aggregation() ==
+                   Aggregation::INCREMENTAL) {
+  const auto &beliefs = configuration.get_beliefs();
+
+  mean_relationships_.assign(n_beliefs_, 0.0);
+
+  // The relationships are summed in the order of the Configuration, as the
+  // Beliefs keep them by address.
+  for (std::size_t b = 0; b < n_beliefs_; ++b) {
+    const auto &relationships = beliefs[b]->get_relationships();
+    for (const auto &b2 : beliefs) {
+      if (const auto relationship = relationships.find(b2);
+          relationship != relationships.end()) {
+        mean_relationships_[b] += relationship->second;
+      }
+    }
+    mean_relationships_[b] /= n_beliefs_; // NOLINT(*-narrowing-conversions)
+  }
+
+  if (n_owned_ < n_agents_ && configuration.get_ordering() != Ordering::INPUT) {
+    throw std::invalid_argument("The ghosts of an Ownership must stay last, so "
+                                "its agents cannot be reordered");
+  }
+
+  const std::span<const std::size_t> input_offsets = agents.friend_offsets;
+  const std::span<const std::uint32_t> input_friends = agents.friends;
+  const auto ordering = configuration.get_ordering();
+  const auto original = reorder::order(ordering, input_offsets, input_friends);
+  std::vector<std::uint32_t> position(n_agents_);
+  for (std::size_t i = 0; i < n_agents_; ++i) {
+    position[original[i]] = i;
+  }
+
+  const auto &table = ArchetypeTable::global();
+  const auto &agent_beliefs = get_agent_beliefs();
+  const auto &multipliers = configuration.get_shared_agents().delta_multipliers;
+  std::unordered_map<std::uint32_t, std::uint32_t> local_archetypes;
+  std::vector<std::uint32_t> archetypes;
+  std::vector<std::uint32_t> actions;
+  archetypes.reserve(n_agents_);
+  actions.reserve(n_agents_);
+  archetype_references_ = agents.references;
+
+  // With Ordering::INPUT the friendships of the table are already in order,
+  // and they are only renumbered into a copy otherwise.
+  std::vector<std::size_t> reordered_offsets;
+  std::vector<std::uint32_t> reordered_friends;
+  std::vector<double_t> reordered_weights;
+  if (ordering != Ordering::INPUT) {
+    reordered_offsets.reserve(n_agents_ + 1);
+    reordered_offsets.push_back(0);
+    reordered_friends.reserve(input_friends.size());
+    reordered_weights.reserve(input_friends.size());
+  }
+
+  for (std::size_t i = 0; i < n_agents_; ++i) {
+    const std::uint32_t id = agents.archetypes[original[i]];
+
+    auto [it, inserted] = local_archetypes.emplace(id, local_archetypes.size());
+    if (inserted) {
+      const auto &archetype = table.at(id);
+      for (std::size_t b = 0; b < n_beliefs_; ++b) {
+        const double_t delta = archetype.deltas.at(agent_beliefs[b]);
+        deltas_.push_back(multipliers.empty() ? delta
+                                              : delta * multipliers[b]);
+      }
+      archetype_ids_.push_back(id);
+      members_.emplace_back();
+    }
+    archetypes.push_back(it->second);
+    members_[it->second].push_back(i);
+
+    // The friends keep their order, so that the weights are summed in the
+    // same order whatever the ordering.
+    if (ordering != Ordering::INPUT) {
+      for (std::size_t e = input_offsets[original[i]];
+           e < input_offsets[original[i] + 1]; ++e) {
+        reordered_friends.push_back(position[input_friends[e]]);
+        reordered_weights.push_back(agents.friend_weights[e]);
+      }
+      reordered_offsets.push_back(reordered_friends.size());
+    }
+
+    actions.push_back(agents.actions[original[i]]);
+  }
+
+  const std::span<const std::size_t> friend_offsets =
+      ordering == Ordering::INPUT ? input_offsets : reordered_offsets;
+  const std::span<const std::uint32_t> friends =
+      ordering == Ordering::INPUT ? input_friends : reordered_friends;
+  const std::span<const double_t> friend_weights =
+      ordering == Ordering::INPUT
+          ? std::span<const double_t>(agents.friend_weights)
+          : reordered_weights;
+
+  if (ordering != Ordering::INPUT) {
+    LOG(INFO) << "Ordered the agents by " << reorder::to_string(ordering)
+              << ", the mean distance between friends went from "
+              << reorder::mean_neighbour_distance(input_offsets,
+                                                  input_friends)
+              << " to "
+              << reorder::mean_neighbour_distance(friend_offsets, friends);
+  }
+
+  partitions_ = std::make_unique<Partitions>(friend_offsets,
+                                             configuration.get_parallelism());
+
+  // Resizing does not touch the pages, so each is placed on the node of the
+  // partition that copies into it.
+  const bool compressed =
+      configuration.get_graph_format() == GraphFormat::COMPRESSED;
+  actions_.resize(n_agents_);
+  {
+    const auto backing = back_with_files();
+    original_.resize(n_agents_);
+    archetypes_.resize(n_agents_);
+    if (!compressed) {
+      friend_offsets_.resize(n_agents_ + 1);
+      friends_.resize(friends.size());
+      friend_weights_.resize(friend_weights.size());
+    }
+    scores_.resize(n_agents_ * n_behaviours_);
+    fixed_.resize(n_agents_);
+  }
+
+  partitions_->run([&](std::size_t, const std::size_t begin,
+                       const std::size_t end) {
+    std::copy(original.begin() + begin, original.begin() + end,
+              original_.begin() + begin);
+    std::copy(archetypes.begin() + begin, archetypes.begin() + end,
+              archetypes_.begin() + begin);
+    if (!compressed) {
+      std::copy(friend_offsets.begin() + begin, friend_offsets.begin() + end,
+                friend_offsets_.begin() + begin);
+      std::copy(friends.begin() + friend_offsets[begin],
+                friends.begin() + friend_offsets[end],
+                friends_.begin() + friend_offsets[begin]);
+      std::copy(friend_weights.begin() + friend_offsets[begin],
+                friend_weights.begin() + friend_offsets[end],
+                friend_weights_.begin() + friend_offsets[begin]);
+    }
+    std::copy(actions.begin() + begin, actions.begin() + end,
+              actions_.begin() + begin);
+    std::fill(scores_.begin() + begin * n_behaviours_,
+              scores_.begin() + end * n_behaviours_, 0.0);
+    std::fill(fixed_.begin() + begin, fixed_.begin() + end, 0);
+  });
+
+  if (compressed) {
+    graph_ = std::make_unique<CompressedGraph>(
+        friend_offsets, friends, friend_weights, *partitions_,
+        configuration.get_ownership().weight_range);
+    LOG(INFO) << "Compressed " << friends.size() << " friendships into "
+              << graph_->size_bytes() << " bytes"
+              << (graph_->has_uniform_weights() ? ", with uniform weights"
+                                                : "");
+  } else {
+    friend_offsets_[n_agents_] = friend_offsets[n_agents_];
+  }
+
+  for (std::size_t i = 0; i < n_agents_; ++i) {
+    if (friend_offsets[i + 1] - friend_offsets[i] >=
+        Partitions::HUB_DEGREE) {
+      hubs_.push_back(i);
+    }
+  }
+
+  if (!hubs_.empty()) {
+    // The pieces of the hubs of each partition follow one another, as the
+    // hubs are in ascending order, so each partition queues a range.
+    const std::size_t n_partitions = partitions_->size();
+    hub_offsets_.push_back(0);
+    hub_pieces_.bounds.push_back(0);
+    hub_pieces_.queues.push_back(0);
+    for (const auto hub : hubs_) {
+      const std::size_t degree = friend_offsets[hub + 1] - friend_offsets[hub];
+      while (hub_pieces_.queues.size() <= partitions_->partition_of(hub)) {
+        hub_pieces_.queues.push_back(hub_pieces_.size());
+      }
+      for (std::size_t e = HUB_PIECE; e < degree; e += HUB_PIECE) {
+        hub_pieces_.bounds.push_back(hub_offsets_.back() + e);
+      }
+      hub_offsets_.push_back(hub_offsets_.back() + degree);
+      hub_pieces_.bounds.push_back(hub_offsets_.back());
+      hub_n_friends_.push_back(degree);
+
+      if (graph_) {
+        for (std::size_t e = friend_offsets[hub]; e < friend_offsets[hub + 1];
+             ++e) {
+          hub_friends_.push_back(friends[e]);
+          hub_weights_.push_back(graph_->quantise(friend_weights[e]));
+        }
+      }
+    }
+    while (hub_pieces_.queues.size() <= n_partitions) {
+      hub_pieces_.queues.push_back(hub_pieces_.size());
+    }
+
+    piece_counts_.resize(hub_pieces_.size() * n_behaviours_);
+    hub_counts_.resize(hubs_.size() * n_behaviours_);
+
+    LOG(INFO) << hubs_.size() << " agents have at least "
+              << Partitions::HUB_DEGREE << " friends, whose "
+              << hub_offsets_.back() << " friendships are summed in "
+              << hub_pieces_.size() << " pieces";
+  }
+
+  if (incremental_) {
+    // The followers of every agent, found by a counting sort of the
+    // friendships, which leaves them in ascending order.
+    std::vector<std::size_t> follower_offsets(n_agents_ + 1, 0);
+    for (const auto f : friends) {
+      ++follower_offsets[f + 1];
+    }
+    std::partial_sum(follower_offsets.begin(), follower_offsets.end(),
+                     follower_offsets.begin());
+
+    std::vector<std::uint32_t> followers(friends.size());
+    std::vector<double_t> follower_weights(friends.size());
+    std::vector<std::size_t> next(follower_offsets.begin(),
+                                  follower_offsets.end() - 1);
+    for (std::size_t i = 0; i < n_agents_; ++i) {
+      for (std::size_t e = friend_offsets[i]; e < friend_offsets[i + 1];
+           ++e) {
+        const std::size_t slot = next[friends[e]]++;
+        followers[slot] = i;
+        // The same weight as is pulled, so that pushes and pulls agree.
+        follower_weights[slot] =
+            graph_ ? graph_->quantise(friend_weights[e]) : friend_weights[e];
+      }
+    }
+
+    {
+      const auto backing = back_with_files();
+      friend_counts_.resize(n_agents_ * n_behaviours_);
+      n_friends_.resize(n_agents_);
+      follower_offsets_.resize(n_agents_ + 1);
+      followers_.resize(followers.size());
+      follower_weights_.resize(follower_weights.size());
+    }
+
+    partitions_->run([&](std::size_t, const std::size_t begin,
+                         const std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        n_friends_[i] = friend_offsets[i + 1] - friend_offsets[i];
+      }
+      std::copy(follower_offsets.begin() + begin,
+                follower_offsets.begin() + end,
+                follower_offsets_.begin() + begin);
+      std::copy(followers.begin() + follower_offsets[begin],
+                followers.begin() + follower_offsets[end],
+                followers_.begin() + follower_offsets[begin]);
+      std::copy(follower_weights.begin() + follower_offsets[begin],
+                follower_weights.begin() + follower_offsets[end],
+                follower_weights_.begin() + follower_offsets[begin]);
+    });
+    follower_offsets_[n_agents_] = follower_offsets[n_agents_];
+
+    pull_friend_counts();
+  }
+
+  if (configuration.get_parallelism().scheduling == Scheduling::DATAFLOW) {
+    if (incremental_) {
+      LOG(WARNING) << "Incremental aggregation updates the followers in every "
+                      "partition, so the threads tick with barriers";
+    } else {
+      // Selecting waits on the transpose of what perceiving waits on.
+      const auto friend_partitions =
+          partitions_->find_friend_partitions(friend_offsets, friends);
+      Partitions::Dependencies follower_partitions(partitions_->size());
+      for (std::size_t p = 0; p < partitions_->size(); ++p) {
+        for (const auto q : friend_partitions[p]) {
+          follower_partitions[q].push_back(p);
+        }
+      }
+      std::size_t n_dependencies = 0;
+      for (const auto &partitions : friend_partitions) {
+        n_dependencies += partitions.size();
+      }
+      LOG(INFO) << "Ticking by dataflow, with " << n_dependencies
+                << " dependencies between " << partitions_->size()
+                << " partitions";
+
+      dataflow_ = true;
+      flow_dependencies_ = {friend_partitions, follower_partitions};
+    }
+  }
+
+  changes_.resize(partitions_->get_chunks().size());
+  samplers_.resize(partitions_->size());
+
+  // Shared Agents are read by other Populations, so the days are kept apart,
+  // as they are when there are no Agents to keep them in.
+  if (const auto &storage = configuration.get_storage();
+      storage.memory_budget != 0 ||
+      !configuration.get_shared_agents().beliefs.empty() ||
+      configuration.get_streamed_agents().index) {
+    history_ = std::make_unique<History>(
+        std::vector<std::uint32_t>(original.begin(), original.end()),
+        n_beliefs_, configuration.get_end_time(),
+        storage.directory.empty() ? std::filesystem::temp_directory_path()
+                                  : storage.directory);
+  }
+
+  LOG(INFO) << "Partitioned " << n_agents_ << " agents between "
+            << partitions_->size() << " threads on " << partitions_->n_nodes()
+            << " NUMA nodes, "
+            << partitions_->cross_node_fraction(friend_offsets, friends)
+            << " of friendships cross nodes";
+}
+
+std::size_t Population::n_agents() const noexcept { return n_agents_; }
+
+std::size_t Population::n_beliefs() const noexcept { return n_beliefs_; }
+
+std::size_t Population::n_behaviours() const noexcept {
+  return n_behaviours_;
+}
+
+std::size_t Population::n_archetypes() const noexcept {
+  return members_.size();
+}
+
+const Partitions &Population::get_partitions() const noexcept {
+  return *partitions_;
+}
+
+const std::shared_ptr<Agent> &
+Population::get_agent(const std::size_t agent) const noexcept {
+  return configuration_.get_agents()[original_[agent]];
+}
+
+const std::vector<std::shared_ptr<Belief>> &
+Population::get_agent_beliefs() const noexcept {
+  const auto &shared = configuration_.get_shared_agents();
+  return shared.beliefs.empty() ? configuration_.get_beliefs()
+                                : shared.beliefs;
+}
+
+bool Population::is_settled() const noexcept { return settled_; }
+
+std::uint32_t Population::get_action(const std::size_t agent) const noexcept {
+  return actions_[agent];
+}
+
+std::span<const double_t>
+Population::get_scores(const std::size_t agent) const noexcept {
+  return {scores_.data() + agent * n_behaviours_, n_behaviours_};
+}
+
+std::size_t
+Population::count_actions_of_friends(const std::size_t agent,
+                                     double_t *counts) const noexcept {
+  if (incremental_) {
+    std::copy_n(friend_counts_.data() + agent * n_behaviours_, n_behaviours_,
+                counts);
+    return n_friends_[agent];
+  }
+  return pull_actions_of_friends(agent, counts);
+}
+
+std::size_t
+Population::pull_actions_of_friends(const std::size_t agent,
+                                    double_t *counts) const noexcept {
+  if (!hubs_.empty()) {
+    const auto hub = std::lower_bound(hubs_.begin(), hubs_.end(), agent);
+    if (hub != hubs_.end() && *hub == agent) {
+      const std::size_t h = hub - hubs_.begin();
+      std::copy_n(hub_counts_.data() + h * n_behaviours_, n_behaviours_,
+                  counts);
+      return hub_n_friends_[h];
+    }
+  }
+
+  std::fill_n(counts, n_behaviours_, 0.0);
+  if (graph_) {
+    return graph_->count_actions(agent, actions_.data(), counts);
+  }
+  for (std::size_t e = friend_offsets_[agent]; e < friend_offsets_[agent + 1];
+       ++e) {
+    counts[actions_[friends_[e]]] += friend_weights_[e];
+  }
+  return friend_offsets_[agent + 1] - friend_offsets_[agent];
+}
+
+void Population::count_hub_actions() {
+  if (hubs_.empty()) {
+    return;
+  }
+
+  partitions_->steal(hub_pieces_, [this](std::size_t, const std::size_t begin,
+                                         std::size_t) {
+    count_piece(hub_pieces_.find(begin));
+  });
+
+  for (std::size_t h = 0; h < hubs_.size(); ++h) {
+    sum_pieces(h);
+  }
+}
+
+void Population::count_hub_actions(const std::size_t begin,
+                                   const std::size_t end) {
+  const std::size_t first =
+      std::lower_bound(hubs_.begin(), hubs_.end(), begin) - hubs_.begin();
+  const std::size_t last =
+      std::lower_bound(hubs_.begin(), hubs_.end(), end) - hubs_.begin();
+
+  for (std::size_t h = first; h < last; ++h) {
+    for (std::size_t piece = hub_pieces_.find(hub_offsets_[h]);
+         piece < hub_pieces_.find(hub_offsets_[h + 1]); ++piece) {
+      count_piece(piece);
+    }
+    sum_pieces(h);
+  }
+}
+
+void Population::count_piece(const std::size_t piece) {
+  const std::size_t begin = hub_pieces_.bounds[piece];
+  const std::size_t end = hub_pieces_.bounds[piece + 1];
+  const std::size_t h =
+      std::upper_bound(hub_offsets_.begin(), hub_offsets_.end(), begin) -
+      hub_offsets_.begin() - 1;
+  double_t *counts = piece_counts_.data() + piece * n_behaviours_;
+  std::fill_n(counts, n_behaviours_, 0.0);
+
+  if (graph_) {
+    for (std::size_t e = begin; e < end; ++e) {
+      counts[actions_[hub_friends_[e]]] += hub_weights_[e];
+    }
+  } else {
+    const std::size_t base = friend_offsets_[hubs_[h]] - hub_offsets_[h];
+    for (std::size_t e = base + begin; e < base + end; ++e) {
+      counts[actions_[friends_[e]]] += friend_weights_[e];
+    }
+  }
+}
+
+void Population::sum_pieces(const std::size_t hub) {
+  // The pieces are summed in order, so that the sums of a hub do not depend
+  // on which threads counted them.
+  double_t *counts = hub_counts_.data() + hub * n_behaviours_;
+  std::fill_n(counts, n_behaviours_, 0.0);
+  for (std::size_t piece = hub_pieces_.find(hub_offsets_[hub]);
+       piece < hub_pieces_.find(hub_offsets_[hub + 1]); ++piece) {
+    const double_t *partial = piece_counts_.data() + piece * n_behaviours_;
+    for (std::size_t k = 0; k < n_behaviours_; ++k) {
+      counts[k] += partial[k];
+    }
+  }
+}
+
+void Population::pull_friend_counts() {
+  count_hub_actions();
+  partitions_->steal([this](std::size_t, const std::size_t begin,
+                          const std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      pull_actions_of_friends(i, friend_counts_.data() + i * n_behaviours_);
+    }
+  });
+}
+
+void Population::push_friend_counts() {
+  // Every partition updates only its own agents, so it finds the range of
+  // each list of followers that is in the partition.
+  partitions_->run([this](std::size_t, const std::size_t begin,
+                          const std::size_t end) {
+    for (const auto &changes : changes_) {
+      for (const auto &[j, previous] : changes) {
+        const auto first = followers_.begin() + follower_offsets_[j];
+        const auto last = followers_.begin() + follower_offsets_[j + 1];
+        const std::uint32_t action = actions_[j];
+
+        for (auto it = std::lower_bound(first, last, begin);
+             it != last && *it < end; ++it) {
+          const double_t weight =
+              follower_weights_[it - followers_.begin()];
+          double_t *counts = friend_counts_.data() + *it * n_behaviours_;
+          counts[previous] -= weight;
+          counts[action] += weight;
+        }
+      }
+    }
+  });
+}
+
+void Population::select(const std::size_t day, const std::uint64_t seed) {
+  if (n_behaviours_ == 0) {
+    return;
+  }
+
+  // The changes are kept by chunk, rather than by thread, so that they are
+  // in the same order whichever thread takes a chunk.
+  partitions_->steal([this, day, seed](const std::size_t p,
+                                       const std::size_t begin,
+                                       const std::size_t end) {
+    select_partition(p, begin, end, day, seed,
+                     changes_[partitions_->get_chunks().find(begin)]);
+  });
+
+  apply_changes();
+}
+
+void Population::set_settled(const bool settled) noexcept {
+  settled_ = settled;
+}
+
+void Population::set_actions(
+    const std::span<const std::pair<std::uint32_t, std::uint32_t>> actions) {
+  for (auto &changes : changes_) {
+    changes.clear();
+  }
+
+  for (const auto &[i, action] : actions) {
+    if (actions_[i] != action) {
+      changes_.front().emplace_back(i, actions_[i]);
+      actions_[i] = action;
+    }
+  }
+
+  apply_changes();
+}
+
+void Population::apply_changes() {
+  const bool changed =
+      std::any_of(changes_.begin(), changes_.end(),
+                  [](const auto &changes) { return !changes.empty(); });
+  if (changed) {
+    actions_changed_ = true;
+    settled_ = false;
+  }
+
+  if (incremental_ && changed) {
+    std::size_t pushes = 0;
+    for (const auto &changes : changes_) {
+      for (const auto &[j, _previous] : changes) {
+        pushes += follower_offsets_[j + 1] - follower_offsets_[j];
+      }
+    }
+
+    // NOLINTNEXTLINE(*-narrowing-conversions)
+    if (pushes > MAX_PUSH_FRACTION * followers_.size()) {
+      pull_friend_counts();
+    } else {
+      push_friend_counts();
+    }
+  }
+}
+
+void Population::select_partition(
+    const std::size_t p, const std::size_t begin, const std::size_t end,
+    const std::size_t day, const std::uint64_t seed,
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> &changes) {
+  auto &sampler = samplers_[p];
+  const auto &ids = configuration_.get_ownership().ids;
+  changes.clear();
+
+  for (std::size_t i = begin; i < std::min(end, n_owned_); ++i) {
+    const std::uint32_t id = ids.empty() ? original_[i] : ids[original_[i]];
+    const std::uint32_t action =
+        sampler.sample({scores_.data() + i * n_behaviours_, n_behaviours_},
+                       random::uniform(seed, id, day));
+    if (actions_[i] != action) {
+      changes.emplace_back(i, actions_[i]);
+      actions_[i] = action;
+    }
+  }
+}
+
+void Population::store_actions(const std::size_t day) const {
+  if (!history_) {
+    store_actions(day, 0, n_agents_);
+    return;
+  }
+
+  partitions_->run(
+      [this, day](std::size_t, const std::size_t begin,
+                  const std::size_t end) { store_actions(day, begin, end); });
+}
+
+void Population::store_actions(const std::size_t day, const std::size_t begin,
+                               const std::size_t end) const {
+  if (history_) {
+    std::copy(actions_.begin() + begin, actions_.begin() + end,
+              history_->actions(day).begin() + begin);
+    history_->release(day, begin, end);
+    return;
+  }
+
+  const auto &behaviours = configuration_.get_behaviours();
+  const auto &agents = configuration_.get_agents();
+
+  for (std::size_t i = begin; i < end; ++i) {
+    agents[original_[i]]->record_action(day, behaviours[actions_[i]]);
+  }
+}
+
+bool Population::stores_zeros() const noexcept { return true; }
+
+summary::Snapshot Population::snapshot(const std::size_t day) const {
+  summary::Snapshot snapshot;
+  snapshot.day = day;
+  snapshot.activations.resize(n_agents_ * n_beliefs_);
+  snapshot.actions.resize(n_agents_);
+  snapshot.omit_zeros = !stores_zeros();
+
+  partitions_->run([this, &snapshot](std::size_t, const std::size_t begin,
+                                     const std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      const std::size_t row = original_[i];
+      for (std::size_t b = 0; b < n_beliefs_; ++b) {
+        snapshot.activations[row * n_beliefs_ + b] = get_activation(i, b);
+      }
+      snapshot.actions[row] = actions_[i];
+    }
+  });
+
+  return snapshot;
+}
+
+const History *Population::get_history() const noexcept {
+  return history_.get();
+}
+
+void Population::release() const {
+  if (!is_over_budget()) {
+    return;
+  }
+
+  partitions_->run([this](std::size_t, const std::size_t begin,
+                          const std::size_t end) {
+    release_range(begin, end);
+  });
+}
+
+numa::FileBacking Population::back_with_files() const {
+  return file_backing(configuration_.get_storage());
+}
+
+bool Population::is_over_budget() const noexcept {
+  const std::size_t budget = configuration_.get_storage().memory_budget;
+  return budget != 0 && numa::resident_bytes() > budget;
+}
+
+std::size_t Population::state_bytes() const noexcept {
+  return original_.size() * sizeof(std::uint32_t) +
+         archetypes_.size() * sizeof(std::uint32_t) +
+         friend_offsets_.size() * sizeof(std::size_t) +
+         friends_.size() * sizeof(std::uint32_t) +
+         friend_weights_.size() * sizeof(double_t) +
+         scores_.size() * sizeof(double_t) + fixed_.size() +
+         friend_counts_.size() * sizeof(double_t) +
+         n_friends_.size() * sizeof(std::uint32_t);
+}
+
+void Population::release_range(const std::size_t begin,
+                               const std::size_t end) const {
+  numa::release(original_.data() + begin,
+                (end - begin) * sizeof(std::uint32_t));
+  numa::release(archetypes_.data() + begin,
+                (end - begin) * sizeof(std::uint32_t));
+  numa::release(scores_.data() + begin * n_behaviours_,
+                (end - begin) * n_behaviours_ * sizeof(double_t));
+  numa::release(fixed_.data() + begin, end - begin);
+  if (!graph_) {
+    const std::size_t first = friend_offsets_[begin];
+    const std::size_t last = friend_offsets_[end];
+    numa::release(friend_offsets_.data() + begin,
+                  (end - begin) * sizeof(std::size_t));
+    numa::release(friends_.data() + first,
+                  (last - first) * sizeof(std::uint32_t));
+    numa::release(friend_weights_.data() + first,
+                  (last - first) * sizeof(double_t));
+  }
+  if (incremental_) {
+    numa::release(friend_counts_.data() + begin * n_behaviours_,
+                  (end - begin) * n_behaviours_ * sizeof(double_t));
+    numa::release(n_friends_.data() + begin,
+                  (end - begin) * sizeof(std::uint32_t));
+  }
+}
+
+bool Population::is_dataflow() const noexcept { return dataflow_; }
+
+void Population::flow(const std::size_t start, const std::size_t end,
+                      const std::uint64_t seed) {
+  for (std::size_t day = start; day < end; ++day) {
+    perceive(day);
+    store_activations(day);
+    score();
+    select(day, seed);
+    store_actions(day);
+  }
+}
+} // namespace contagent
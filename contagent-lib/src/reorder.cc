@@ -0,0 +1,196 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/reorder.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace contagent::reorder {
+namespace {
+/// The friendships in both directions, in compressed sparse row form.
+struct Undirected {
+  std::vector<std::size_t> offsets;
+  std::vector<std::uint32_t> neighbours;
+
+  [[nodiscard]] std::size_t degree(const std::uint32_t i) const noexcept {
+    return offsets[i + 1] - offsets[i];
+  }
+};
+
+Undirected make_undirected(const std::span<const std::size_t> offsets,
+                           const std::span<const std::uint32_t> friends) {
+  const std::size_t n = offsets.size() - 1;
+  Undirected graph;
+  graph.offsets.assign(n + 1, 0);
+
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t e = offsets[i]; e < offsets[i + 1]; ++e) {
+      ++graph.offsets[i + 1];
+      ++graph.offsets[friends[e] + 1];
+    }
+  }
+  std::partial_sum(graph.offsets.begin(), graph.offsets.end(),
+                   graph.offsets.begin());
+
+  std::vector<std::size_t> next(graph.offsets.begin(),
+                                graph.offsets.end() - 1);
+  graph.neighbours.resize(graph.offsets.back());
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t e = offsets[i]; e < offsets[i + 1]; ++e) {
+      graph.neighbours[next[i]++] = friends[e];
+      graph.neighbours[next[friends[e]]++] = i;
+    }
+  }
+
+  return graph;
+}
+
+/// Number the agents in breadth-first order, starting each connected
+/// component from its first agent in roots.
+/// \param graph The graph.
+/// \param roots Every agent, in the order to try them as roots.
+/// \param by_degree Whether to visit the unvisited neighbours of an agent in
+/// ascending order of degree, which is Cuthill–McKee.
+/// \return The order.
+std::vector<std::uint32_t>
+breadth_first(const Undirected &graph, const std::vector<std::uint32_t> &roots,
+              const bool by_degree) {
+  const std::size_t n = roots.size();
+  std::vector<std::uint32_t> order;
+  order.reserve(n);
+  std::vector<bool> visited(n, false);
+
+  for (const auto root : roots) {
+    if (visited[root]) {
+      continue;
+    }
+    visited[root] = true;
+    order.push_back(root);
+
+    for (std::size_t head = order.size() - 1; head < order.size(); ++head) {
+      const std::uint32_t i = order[head];
+      const std::size_t first = order.size();
+      for (std::size_t e = graph.offsets[i]; e < graph.offsets[i + 1]; ++e) {
+        if (const auto j = graph.neighbours[e]; !visited[j]) {
+          visited[j] = true;
+          order.push_back(j);
+        }
+      }
+      if (by_degree) {
+        std::sort(order.begin() + first, order.end(),
+                  [&graph](const auto a, const auto b) {
+                    return std::pair(graph.degree(a), a) <
+                           std::pair(graph.degree(b), b);
+                  });
+      }
+    }
+  }
+
+  return order;
+}
+} // namespace
+
+std::vector<std::uint32_t> order(const Ordering ordering,
+                                 const std::span<const std::size_t> offsets,
+                                 const std::span<const std::uint32_t> friends) {
+  const std::size_t n = offsets.size() - 1;
+  std::vector<std::uint32_t> identity(n);
+  std::iota(identity.begin(), identity.end(), 0);
+
+  if (ordering == Ordering::INPUT) {
+    return identity;
+  }
+
+  const auto graph = make_undirected(offsets, friends);
+  const auto by_degree = [&graph](const auto a, const auto b) {
+    return graph.degree(a) < graph.degree(b);
+  };
+
+  switch (ordering) {
+  case Ordering::RCM: {
+    // Starting from an agent of least degree keeps the bandwidth low.
+    std::stable_sort(identity.begin(), identity.end(), by_degree);
+    auto order = breadth_first(graph, identity, true);
+    std::reverse(order.begin(), order.end());
+    return order;
+  }
+  case Ordering::BFS:
+    return breadth_first(graph, identity, false);
+  case Ordering::DEGREE:
+    std::stable_sort(identity.begin(), identity.end(),
+                     [&by_degree](const auto a, const auto b) {
+                       return by_degree(b, a);
+                     });
+    return identity;
+  default:
+    return identity;
+  }
+}
+
+double_t mean_neighbour_distance(const std::span<const std::size_t> offsets,
+                                 const std::span<const std::uint32_t> friends) {
+  if (friends.empty()) {
+    return 0.0;
+  }
+
+  double_t total = 0.0;
+  for (std::size_t i = 0; i + 1 < offsets.size(); ++i) {
+    for (std::size_t e = offsets[i]; e < offsets[i + 1]; ++e) {
+      // NOLINTNEXTLINE(*-narrowing-conversions)
+      total += i > friends[e] ? i - friends[e] : friends[e] - i;
+    }
+  }
+
+  // NOLINTNEXTLINE(*-narrowing-conversions)
+  return total / friends.size();
+}
+
+std::string to_string(const Ordering ordering) {
+  switch (ordering) {
+  case Ordering::RCM:
+    return "rcm";
+  case Ordering::BFS:
+    return "bfs";
+  case Ordering::DEGREE:
+    return "degree";
+  default:
+    return "input";
+  }
+}
+
+Ordering parse_ordering(const std::string &name) {
+  for (const auto ordering :
+       {Ordering::INPUT, Ordering::RCM, Ordering::BFS, Ordering::DEGREE}) {
+    if (name == to_string(ordering)) {
+      return ordering;
+    }
+  }
+  throw std::invalid_argument("Ordering must be input, rcm, bfs or degree");
+}
+} // namespace contagent::reorder
@@ -0,0 +1,338 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "contagent/replay.h"
+#include "contagent/json/agent_spec.h"
+#include "contagent/json/behaviour_spec.h"
+#include "contagent/json/belief_spec.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace contagent::replay {
+namespace {
+/// The version of the ChangeLog format, which ::read checks.
+constexpr int VERSION = 1;
+
+/// An agent of the log that is not in the Population of ::replay.
+constexpr std::uint32_t ABSENT = std::numeric_limits<std::uint32_t>::max();
+
+std::string to_string(const Precision precision) {
+  return precision == Precision::FLOAT32 ? "float32" : "float64";
+}
+
+std::string to_string(const GraphFormat graph_format) {
+  return graph_format == GraphFormat::COMPRESSED ? "compressed" : "csr";
+}
+
+std::string to_string(const Aggregation aggregation) {
+  return aggregation == Aggregation::INCREMENTAL ? "incremental" : "pull";
+}
+
+std::string to_string(const Population::Engine engine) {
+  return engine == Population::Engine::SPARSE ? "sparse" : "dense";
+}
+
+/// Parse a setting that was written by one of the ::to_string.
+/// \param name The name.
+/// \param values Every value of the setting.
+/// \return The value whose name it is.
+/// \throws std::runtime_error If the name is of no value.
+template <class T>
+T parse(const std::string &name, const std::initializer_list<T> values) {
+  for (const auto value : values) {
+    if (to_string(value) == name) {
+      return value;
+    }
+  }
+  throw std::runtime_error("Unknown setting in the change log " + name);
+}
+
+template <class T>
+std::map<boost::uuids::uuid, std::shared_ptr<T>>
+uuid_map(const std::vector<std::shared_ptr<T>> &vec) {
+  std::map<boost::uuids::uuid, std::shared_ptr<T>> m;
+  for (const auto &elem : vec) {
+    m.emplace(elem->get_uuid(), elem);
+  }
+  return m;
+}
+} // namespace
+
+ChangeLogWriter::ChangeLogWriter(const Configuration &configuration,
+                                 const Population &population)
+    : configuration_(configuration),
+      initial_(
+          population.snapshot(configuration.get_start_time() - 1).actions) {
+  const nlohmann::json header = {
+      {"version", VERSION},
+      {"seed", configuration_.get_seed()},
+      {"startTime", configuration_.get_start_time()},
+      {"endTime", configuration_.get_end_time()},
+      {"precision", to_string(configuration_.get_precision())},
+      {"graphFormat", to_string(configuration_.get_graph_format())},
+      {"aggregation", to_string(configuration_.get_aggregation())},
+      {"engine", to_string(population.get_engine())}};
+
+  std::vector<json::BehaviourSpec> behaviours;
+  for (const auto &behaviour : configuration_.get_behaviours()) {
+    behaviours.emplace_back(*behaviour);
+  }
+  std::vector<json::BeliefSpec> beliefs;
+  for (const auto &belief : configuration_.get_beliefs()) {
+    beliefs.emplace_back(*belief);
+  }
+
+  // The object is left open, and the agents are written one at a time so
+  // that they are never all held as JSON.
+  auto &output = *configuration_.get_output_stream();
+  std::string text = header.dump();
+  text.pop_back();
+  output << text << ",\"behaviours\":" << nlohmann::json(behaviours)
+         << ",\"beliefs\":" << nlohmann::json(beliefs) << ",\"agents\":[";
+  bool first = true;
+  for (const auto &agent : configuration_.get_agents()) {
+    output << (first ? "" : ",") << nlohmann::json(json::AgentSpec(*agent));
+    first = false;
+  }
+  output << ']';
+}
+
+void ChangeLogWriter::settled(const std::size_t day) {
+  settled_.push_back(day);
+}
+
+void ChangeLogWriter::finish(const Population &population) {
+  const auto &agents = configuration_.get_agents();
+  const auto &behaviours = configuration_.get_behaviours();
+  const History *history = population.get_history();
+  std::unordered_map<const Behaviour *, std::uint32_t> behaviour_index;
+  for (std::size_t k = 0; k < behaviours.size(); ++k) {
+    behaviour_index.emplace(behaviours[k].get(), k);
+  }
+
+  auto &output = *configuration_.get_output_stream();
+  output << ",\"settled\":" << nlohmann::json(settled_) << ",\"changes\":[";
+
+  std::vector<std::uint32_t> previous = initial_;
+  std::vector<std::uint32_t> actions(agents.size());
+  bool first = true;
+  for (std::size_t day = configuration_.get_start_time() - 1;
+       day < configuration_.get_end_time(); ++day) {
+    if (history) {
+      const auto rows = history->get_agents();
+      const auto day_actions = history->actions(day);
+      for (std::size_t r = 0; r < rows.size(); ++r) {
+        actions[rows[r]] = day_actions[r];
+      }
+      history->release(day, 0, rows.size());
+    } else {
+      for (std::size_t a = 0; a < agents.size(); ++a) {
+        actions[a] =
+            behaviour_index.at(agents[a]->get_action_history().at(day).get());
+      }
+    }
+
+    for (std::size_t a = 0; a < agents.size(); ++a) {
+      if (actions[a] != previous[a]) {
+        output << (first ? "[" : ",[") << day << ',' << a << ','
+               << actions[a] << ']';
+        first = false;
+      }
+    }
+    std::swap(actions, previous);
+  }
+
+  output << "]}";
+}
+
+ChangeLog read(std::istream &is) {
+  const auto j = nlohmann::json::parse(is);
+  if (!j.is_object() || !j.contains("version") ||
+      j.at("version") != VERSION) {
+    throw std::runtime_error("The change log must be an object of version " +
+                             std::to_string(VERSION));
+  }
+
+  ChangeLog log;
+  j.at("startTime").get_to(log.start_time);
+  j.at("endTime").get_to(log.end_time);
+  j.at("seed").get_to(log.seed);
+  log.precision = parse(j.at("precision").get<std::string>(),
+                        {Precision::FLOAT64, Precision::FLOAT32});
+  log.graph_format = parse(j.at("graphFormat").get<std::string>(),
+                           {GraphFormat::CSR, GraphFormat::COMPRESSED});
+  log.aggregation = parse(j.at("aggregation").get<std::string>(),
+                          {Aggregation::PULL, Aggregation::INCREMENTAL});
+  log.engine = parse(j.at("engine").get<std::string>(),
+                     {Population::Engine::DENSE, Population::Engine::SPARSE});
+
+  for (const auto &spec :
+       j.at("behaviours").get<std::vector<json::BehaviourSpec>>()) {
+    log.behaviours.push_back(spec.to_behaviour());
+  }
+  const auto behaviour_map = uuid_map(log.behaviours);
+
+  const auto belief_specs =
+      j.at("beliefs").get<std::vector<json::BeliefSpec>>();
+  for (const auto &spec : belief_specs) {
+    log.beliefs.push_back(spec.to_unlinked_belief(behaviour_map));
+  }
+  const auto belief_map = uuid_map(log.beliefs);
+  for (const auto &spec : belief_specs) {
+    spec.link_beliefs(belief_map);
+  }
+
+  const auto agent_specs = j.at("agents").get<std::vector<json::AgentSpec>>();
+  for (const auto &spec : agent_specs) {
+    log.agents.push_back(
+        spec.to_unlinked_agent(log.end_time, behaviour_map, belief_map));
+  }
+  const auto agent_map = uuid_map(log.agents);
+  for (const auto &spec : agent_specs) {
+    spec.link_agents(agent_map);
+  }
+
+  j.at("settled").get_to(log.settled);
+  for (const auto &change : j.at("changes")) {
+    log.changes.push_back({change.at(0).get<std::uint32_t>(),
+                           change.at(1).get<std::uint32_t>(),
+                           change.at(2).get<std::uint32_t>()});
+    if (log.changes.back().agent >= log.agents.size() ||
+        log.changes.back().action >= log.behaviours.size()) {
+      throw std::out_of_range("A change refers to an unknown agent or "
+                              "behaviour");
+    }
+  }
+
+  return log;
+}
+
+std::vector<summary::Snapshot>
+replay(const ChangeLog &log, const std::span<const std::uint32_t> agents,
+       const std::size_t first, const std::size_t last,
+       const Parallelism &parallelism) {
+  if (first < log.start_time || last > log.end_time || first > last) {
+    throw std::invalid_argument("The days must be within the days of the log");
+  }
+
+  // The agents asked for come first, and then their friends as ghosts.
+  std::vector<std::uint32_t> local(log.agents.size(), ABSENT);
+  std::vector<std::shared_ptr<Agent>> subset;
+  for (const auto a : agents) {
+    if (a >= log.agents.size() || local[a] != ABSENT) {
+      throw std::invalid_argument("The agents must be distinct agents of the "
+                                  "log");
+    }
+    local[a] = subset.size();
+    subset.push_back(log.agents[a]);
+  }
+  const std::size_t n_owned = subset.size();
+
+  std::unordered_map<const Agent *, std::uint32_t> agent_index;
+  for (std::size_t a = 0; a < log.agents.size(); ++a) {
+    agent_index.emplace(log.agents[a].get(), a);
+  }
+
+  // A compressed graph quantises the weights in the range of the whole
+  // population, as the run did, rather than that of the agents ticked.
+  std::optional<std::pair<double_t, double_t>> weight_range;
+  for (const auto &agent : log.agents) {
+    for (const auto &[_friend, weight] : agent->get_friends()) {
+      auto &[min, max] =
+          weight_range ? *weight_range : weight_range.emplace(weight, weight);
+      min = std::min(min, weight);
+      max = std::max(max, weight);
+    }
+  }
+  for (std::size_t i = 0; i < n_owned; ++i) {
+    for (const auto &[weak_friend, _weight] : subset[i]->get_friends()) {
+      const auto shared_friend = weak_friend.lock();
+      if (!shared_friend) {
+        throw std::runtime_error("Unable to lock weak pointer");
+      }
+      const std::uint32_t g = agent_index.at(shared_friend.get());
+      if (local[g] == ABSENT) {
+        local[g] = subset.size();
+        subset.push_back(log.agents[g]);
+      }
+    }
+  }
+
+  // The actions are set rather than selected, so there are barriers.
+  Parallelism barrier = parallelism;
+  barrier.scheduling = Scheduling::BARRIER;
+  const Configuration configuration(
+      log.behaviours, log.beliefs, subset, log.start_time, log.end_time,
+      nullptr, false, log.seed, log.precision, barrier, Ordering::INPUT,
+      log.graph_format, log.aggregation,
+      Ownership{n_owned, {}, weight_range});
+  auto population =
+      Population::create(configuration, log.start_time - 1, log.engine);
+
+  auto change = log.changes.begin();
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> actions;
+  const auto set_actions = [&](const std::size_t day) {
+    actions.clear();
+    for (; change != log.changes.end() && change->day <= day; ++change) {
+      if (change->day == day && local[change->agent] != ABSENT) {
+        actions.emplace_back(local[change->agent], change->action);
+      }
+    }
+    std::sort(actions.begin(), actions.end());
+    population->set_actions(actions);
+  };
+
+  std::vector<summary::Snapshot> days;
+  auto settled = log.settled.begin();
+  set_actions(log.start_time - 1);
+  for (std::size_t day = log.start_time; day < last; ++day) {
+    while (settled != log.settled.end() && *settled < day) {
+      ++settled;
+    }
+    population->set_settled(settled != log.settled.end() && *settled == day);
+    population->perceive(day);
+    set_actions(day);
+
+    if (day >= first) {
+      auto snapshot = population->snapshot(day);
+      snapshot.activations.resize(n_owned * log.beliefs.size());
+      snapshot.actions.resize(n_owned);
+      days.push_back(std::move(snapshot));
+    }
+  }
+
+  return days;
+}
+} // namespace contagent::replay
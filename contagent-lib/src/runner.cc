@@ -28,35 +28,94 @@
 
 #include "contagent/runner.h"
 #include "contagent/json/agent_spec.h"
+#include "contagent/json/compact_spec.h"
 #include "contagent/json/summary_spec.h"
+#include "contagent/selection.h"
 #include "contagent/summary.h"
 #include <glog/logging.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/uuid_io.hpp>
 #include <iostream>
+#include <stdexcept>
+#include <unordered_set>
 
 namespace contagent {
-Runner::Runner(std::unique_ptr<Configuration> configuration)
-    : configuration_(std::move(configuration)) {}
+Runner::Runner(std::unique_ptr<Configuration> configuration,
+               const Population::Engine engine)
+    : configuration_(std::move(configuration)),
+      population_(Population::create(
+          *configuration_, configuration_->get_start_time() - 1, engine)) {
+  if (configuration_->get_full_output() && population_->get_history()) {
+    throw std::invalid_argument("The full output cannot be written with a "
+                                "memory budget, or shared or streamed agents");
+  }
+  // The initial state is written before the first actions are stored.
+  if (configuration_->get_output_pipeline().change_log) {
+    if (configuration_->get_full_output()) {
+      throw std::invalid_argument(
+          "The full output and the change log cannot both be written");
+    }
+    if (configuration_->get_streamed_agents().index) {
+      throw std::invalid_argument(
+          "The change log writes the initial Agents, so they cannot be "
+          "streamed");
+    }
+    change_log_ = std::make_unique<replay::ChangeLogWriter>(*configuration_,
+                                                            *population_);
+  }
+  // The ring is published to by the SummaryWriter, which ::run only makes
+  // when the summary is written while ticking.
+  const auto &pipeline = configuration_->get_output_pipeline();
+  if (!pipeline.ring.name.empty() &&
+      (configuration_->get_full_output() || pipeline.change_log ||
+       pipeline.max_pending == 0 || population_->is_dataflow())) {
+    throw std::invalid_argument(
+        "The shared memory ring is only published to while the summary is "
+        "written as the days are ticked");
+  }
+}
+
+const Population &Runner::get_population() const noexcept {
+  return *population_;
+}
 
 void Runner::perceive_beliefs(const uint_fast32_t time) {
-  for (auto &a : configuration_->get_agents()) {
-    a->update_activation_for_all_beliefs(time, configuration_->get_beliefs());
-  }
+  population_->perceive(time);
+  population_->store_activations(time);
 }
 
 void Runner::perform_actions(const uint_fast32_t time) {
-  for (auto &a : configuration_->get_agents()) {
-    a->perform_action(time, configuration_->get_behaviours(),
-                      configuration_->get_beliefs());
-  }
+  population_->score();
+  population_->select(time, configuration_->get_seed());
+  population_->store_actions(time);
 }
 void Runner::tick(const uint_fast32_t time) {
-  LOG(INFO) << "[time=" << time << "] Perceiving beliefs";
+  if (population_->is_settled()) {
+    LOG(INFO) << "[time=" << time
+              << "] Perceiving beliefs, which have settled";
+    if (change_log_) {
+      change_log_->settled(time);
+    }
+  } else {
+    LOG(INFO) << "[time=" << time << "] Perceiving beliefs";
+  }
   perceive_beliefs(time);
   LOG(INFO) << "[time=" << time << "] Performing actions";
   perform_actions(time);
+  if (writer_ && selection::contains_day(*configuration_, time)) {
+    writer_->push(population_->snapshot(time));
+  }
+  population_->release();
 }
 void Runner::tick_between(const uint_fast32_t start_time,
                           const uint_fast32_t end_time) {
+  if (population_->is_dataflow()) {
+    LOG(INFO) << "[time=" << start_time << "] Ticking until " << end_time
+              << " by dataflow between the partitions";
+    population_->flow(start_time, end_time, configuration_->get_seed());
+    return;
+  }
+
   for (uint_fast32_t i = start_time; i < end_time; ++i) {
     tick(i);
   }
@@ -67,14 +126,40 @@ void Runner::run() {
             << ",\"end\":" << configuration_->get_end_time()
             << ",\"nBeliefs\":" << configuration_->get_beliefs().size()
             << ",\"nBehaviours\":" << configuration_->get_behaviours().size()
-            << ",\"nAgents\":" << configuration_->get_agents().size() << "}";
+            << ",\"nAgents\":" << configuration_->get_n_agents() << "}";
   perform_actions(configuration_->get_start_time() - 1);
+  if (!configuration_->get_full_output() && !change_log_ &&
+      configuration_->get_output_pipeline().max_pending != 0 &&
+      !population_->is_dataflow()) {
+    writer_ = std::make_unique<SummaryWriter>(*configuration_);
+  }
   tick_between(configuration_->get_start_time(),
                configuration_->get_end_time());
   LOG(INFO) << "Simulation complete; serializing output";
 
+  const auto utilisation = population_->get_partitions().get_utilisation();
+  for (std::size_t p = 0; p < utilisation.size(); ++p) {
+    LOG(INFO) << "[thread=" << p << "] Busy for " << utilisation[p].busy
+              << "s, idle for " << utilisation[p].idle << "s";
+  }
+
   if (configuration_->get_full_output()) {
     serialize_and_output_full();
+  } else if (change_log_) {
+    change_log_->finish(*population_);
+  } else if (writer_) {
+    const auto metrics = writer_->finish();
+    writer_.reset();
+    LOG(INFO) << "Ticking waited " << metrics.blocked
+              << "s for the output, which took " << metrics.encoding
+              << "s to summarise and encode, and " << metrics.writing
+              << "s to write";
+    if (!configuration_->get_output_pipeline().ring.name.empty()) {
+      LOG(INFO) << "Publishing to the shared memory ring took "
+                << metrics.publishing << "s, of which " << metrics.stalled
+                << "s waited for its readers, and " << metrics.overtaken
+                << " records were overwritten before a reader read them";
+    }
   } else {
     serialize_and_output_summary();
   }
@@ -82,29 +167,96 @@ void Runner::run() {
 }
 
 void Runner::serialize_and_output_summary() {
-  std::vector<contagent::json::SummarySpec> summary_stats(
-      configuration_->get_end_time());
+  const contagent::json::SummaryEncoder encoder(*configuration_);
+  auto &output = *configuration_->get_output_stream();
+  const History *history = population_->get_history();
+  output << encoder.begin();
+  bool first = true;
   for (uint_fast32_t i = configuration_->get_start_time();
        i < configuration_->get_end_time(); ++i) {
+    if (!selection::contains_day(*configuration_, i)) {
+      continue;
+    }
     auto stats =
-        contagent::summary::calculate_summary_stats(*configuration_, i);
-    summary_stats[i] = json::SummarySpec(*stats);
+        history ? contagent::summary::calculate_summary_stats(*configuration_,
+                                                              *history, i)
+                : contagent::summary::calculate_summary_stats(*configuration_,
+                                                              i);
+    output << (first ? "" : ",") << encoder.encode(*stats, i);
+    first = false;
   }
-
-  nlohmann::json stats = summary_stats;
-  *configuration_->get_output_stream() << stats;
+  output << encoder.end();
 }
 
 void Runner::serialize_and_output_full() {
-  std::vector<contagent::json::AgentSpec> agent_specs(
-      configuration_->get_end_time());
+  if (configuration_->get_output_pipeline().schema == OutputSchema::COMPACT) {
+    contagent::json::write_compact_agents(*configuration_,
+                                          *configuration_->get_output_stream());
+    return;
+  }
 
-  for (uint_fast32_t i = configuration_->get_start_time();
-       i < configuration_->get_end_time(); ++i) {
-    agent_specs[i] = json::AgentSpec(*configuration_->get_agents()[i]);
+  const auto &agents = configuration_->get_agents();
+  const auto &beliefs = configuration_->get_beliefs();
+  const auto &behaviours = configuration_->get_behaviours();
+  const auto &selection = configuration_->get_output_selection();
+  const auto belief_mask = selection::mask(selection.beliefs, beliefs.size());
+  std::unordered_set<std::string> belief_uuids;
+  for (std::size_t b = 0; b < beliefs.size(); ++b) {
+    if (belief_mask[b]) {
+      belief_uuids.insert(
+          boost::lexical_cast<std::string>(beliefs[b]->get_uuid()));
+    }
+  }
+  const auto behaviour_mask =
+      selection::mask(selection.behaviours, behaviours.size());
+  std::unordered_set<std::string> behaviour_uuids;
+  for (std::size_t k = 0; k < behaviours.size(); ++k) {
+    if (behaviour_mask[k]) {
+      behaviour_uuids.insert(
+          boost::lexical_cast<std::string>(behaviours[k]->get_uuid()));
+    }
   }
 
-  nlohmann::json j = agent_specs;
-  *configuration_->get_output_stream() << j;
+  // Every selected agent is written with the activations of the selected
+  // beliefs on the selected days, and no activations on the others, and with
+  // its actions on the selected days if they are of a selected behaviour, and
+  // null otherwise, so that both are still indexed by day. The days before
+  // the start time, which are inputs, are written whole. Every agent is
+  // written as soon as it is gathered, so only one is held at a time.
+  const auto start_time = configuration_->get_start_time();
+  const auto selected = [this, start_time](const std::size_t day) {
+    return day < start_time || selection::contains_day(*configuration_, day);
+  };
+  auto &output = *configuration_->get_output_stream();
+  output << '[';
+  bool first = true;
+  const auto agent_mask = selection::mask(selection.agents, agents.size());
+  for (std::size_t i = 0; i < agents.size(); ++i) {
+    if (!agent_mask[i]) {
+      continue;
+    }
+    contagent::json::AgentSpec spec(*agents[i]);
+    for (std::size_t day = 0; day < spec.activations.size(); ++day) {
+      auto &activations = spec.activations[day];
+      if (!selected(day)) {
+        activations.clear();
+        continue;
+      }
+      std::erase_if(activations, [&belief_uuids](const auto &activation) {
+        return !belief_uuids.contains(activation.first);
+      });
+    }
+
+    nlohmann::json j = spec;
+    auto &actions = j.at("actions");
+    for (std::size_t day = 0; day < spec.actions.size(); ++day) {
+      if (!selected(day) || !behaviour_uuids.contains(spec.actions[day])) {
+        actions[day] = nullptr;
+      }
+    }
+    output << (first ? "" : ",") << j;
+    first = false;
+  }
+  output << ']';
 }
 } // namespace contagent
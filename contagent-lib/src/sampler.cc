@@ -0,0 +1,61 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/sampler.h"
+
+#include <algorithm>
+
+namespace contagent {
+std::uint32_t Sampler::sample(const std::span<const double_t> scores,
+                              const double_t rv) {
+  cumulative_.resize(scores.size());
+
+  std::uint32_t best = 0;
+  double_t total = 0.0;
+  for (std::size_t k = 0; k < scores.size(); ++k) {
+    if (scores[k] >= scores[best]) {
+      best = k;
+    }
+    if (scores[k] > 0.0) {
+      total += scores[k];
+    }
+    cumulative_[k] = total;
+  }
+
+  if (total == 0.0) {
+    return best;
+  }
+
+  // The first behaviour whose range of the prefix sum holds the draw, which
+  // is never one that does not add to the sum.
+  const double_t target = rv * total;
+  const auto it = std::upper_bound(cumulative_.begin(), cumulative_.end(),
+                                   target);
+  return it != cumulative_.end() ? it - cumulative_.begin() : best;
+}
+} // namespace contagent
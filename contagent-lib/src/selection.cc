@@ -0,0 +1,90 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "contagent/selection.h"
+#include "contagent/random.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace contagent::selection {
+namespace {
+/// XORed into the seed of ::sample before it is mixed, so that its draws are
+/// not those of Population::select for the same seed, which are also drawn
+/// for every agent on a day that can be 0.
+constexpr std::uint64_t SAMPLE_SALT = 0x73616d706c655f31ULL;
+} // namespace
+
+std::vector<std::uint32_t> sample(const std::size_t n_agents,
+                                  const std::size_t k,
+                                  const std::uint64_t seed) {
+  std::vector<std::uint32_t> reservoir(std::min(n_agents, k));
+  std::iota(reservoir.begin(), reservoir.end(), 0);
+
+  const std::uint64_t sample_seed = random::mix(seed ^ SAMPLE_SALT);
+  for (std::size_t i = reservoir.size(); i < n_agents; ++i) {
+    const auto j =
+        static_cast<std::size_t>(random::uniform(sample_seed, i, 0) * (i + 1));
+    if (j < reservoir.size()) {
+      reservoir[j] = i;
+    }
+  }
+
+  std::sort(reservoir.begin(), reservoir.end());
+  return reservoir;
+}
+
+std::vector<char> mask(const std::span<const std::uint32_t> selected,
+                       const std::size_t n) {
+  std::vector<char> m(n, selected.empty());
+  for (const auto i : selected) {
+    if (i >= n) {
+      throw std::out_of_range("The output selection has an index that is "
+                              "out of range");
+    }
+    m[i] = 1;
+  }
+  return m;
+}
+
+std::size_t count_agents(const Configuration &configuration) {
+  const auto &agents = configuration.get_output_selection().agents;
+  return agents.empty() ? configuration.get_n_agents() : agents.size();
+}
+
+bool contains_day(const Configuration &configuration,
+                  const std::size_t day) noexcept {
+  const std::size_t stride =
+      std::max<std::size_t>(1, configuration.get_output_selection().day_stride);
+  return day >= configuration.get_start_time() &&
+         day < configuration.get_end_time() &&
+         (day - configuration.get_start_time()) % stride == 0;
+}
+} // namespace contagent::selection
@@ -0,0 +1,333 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "contagent/shm_ring.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+namespace contagent::shm {
+namespace {
+/// Round up to a multiple of RECORD_ALIGNMENT.
+constexpr std::uint64_t align(const std::uint64_t n) noexcept {
+  return (n + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+}
+
+/// Get whether the process of a consumer has exited.
+/// \param pid The process ID.
+/// \return Whether there is no such process.
+bool has_exited(const std::uint32_t pid) noexcept {
+  return kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH;
+}
+} // namespace
+
+Publisher::Publisher(const std::string &name, const std::size_t capacity,
+                     const std::string_view metadata,
+                     const bool wait_for_readers)
+    : name_(name) {
+  const std::uint64_t data_capacity =
+      align(std::max<std::size_t>(capacity, 2 * RECORD_ALIGNMENT));
+  const std::uint64_t metadata_offset = align(sizeof(RingHeader));
+  const std::uint64_t data_offset = align(metadata_offset + metadata.size());
+  size_ = data_offset + data_capacity;
+
+  shm_unlink(name_.c_str());
+  const int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Unable to make the shared memory " + name_);
+  }
+  if (ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+    const int error = errno;
+    close(fd);
+    shm_unlink(name_.c_str());
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to size the shared memory " + name_);
+  }
+  void *p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int error = errno;
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(name_.c_str());
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to map the shared memory " + name_);
+  }
+
+  // The object is zeroed by ftruncate, so only the constants are written, and
+  // the magic last, so that no consumer sees a ring that is half made.
+  header_ = new (p) RingHeader{};
+  header_->version = VERSION;
+  header_->wait_for_readers = wait_for_readers ? 1 : 0;
+  header_->capacity = data_capacity;
+  header_->metadata_offset = metadata_offset;
+  header_->metadata_size = metadata.size();
+  header_->data_offset = data_offset;
+  std::memcpy(static_cast<std::byte *>(p) + metadata_offset, metadata.data(),
+              metadata.size());
+  data_ = static_cast<std::byte *>(p) + data_offset;
+  header_->magic.store(MAGIC, std::memory_order_release);
+}
+
+Publisher::~Publisher() {
+  finish();
+  munmap(header_, size_);
+  shm_unlink(name_.c_str());
+}
+
+void Publisher::publish(
+    const RecordKind kind, const std::size_t day,
+    const std::initializer_list<std::span<const std::byte>> parts) {
+  const std::uint64_t capacity = header_->capacity;
+  std::uint64_t size = 0;
+  for (const auto &part : parts) {
+    size += part.size();
+  }
+  const std::uint64_t length = align(sizeof(RecordHeader) + size);
+  if (length > capacity) {
+    throw std::length_error("A record of " + std::to_string(size) +
+                            " bytes does not fit in the shared memory");
+  }
+
+  // A record that would cross the end starts at the beginning, after padding.
+  const std::uint64_t offset = head_ % capacity;
+  const std::uint64_t padding =
+      offset + length > capacity ? capacity - offset : 0;
+  reclaim(head_ + padding, head_ + padding + length);
+
+  if (padding != 0) {
+    RecordHeader filler{RecordKind::PADDING, 0, sequence_, day,
+                        padding - sizeof(RecordHeader)};
+    std::memcpy(data_ + offset, &filler, sizeof(filler));
+  }
+  std::byte *record = data_ + (head_ + padding) % capacity;
+  RecordHeader header{kind, 0, sequence_, day, size};
+  std::memcpy(record, &header, sizeof(header));
+  std::byte *payload = record + sizeof(header);
+  for (const auto &part : parts) {
+    std::memcpy(payload, part.data(), part.size());
+    payload += part.size();
+  }
+
+  head_ += padding + length;
+  ++sequence_;
+  header_->head.store(head_, std::memory_order_release);
+}
+
+void Publisher::reclaim(const std::uint64_t start, const std::uint64_t end) {
+  const std::uint64_t capacity = header_->capacity;
+  if (end <= capacity || tail_ >= end - capacity) {
+    return;
+  }
+  // A record that is longer than the space before the oldest overwrites
+  // every record that was published before it, and the padding.
+  const std::uint64_t oldest = std::min(end - capacity, head_);
+
+  if (header_->wait_for_readers != 0) {
+    const auto started = std::chrono::steady_clock::now();
+    for (auto &slot : header_->readers) {
+      while (true) {
+        const auto pid = slot.pid.load(std::memory_order_acquire);
+        if (pid == 0 ||
+            slot.cursor.load(std::memory_order_acquire) >= oldest) {
+          break;
+        }
+        if (has_exited(pid)) {
+          auto expected = pid;
+          slot.pid.compare_exchange_strong(expected, 0);
+          break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    }
+    stalled_ += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - started)
+                    .count();
+  }
+
+  // Every record that starts before the oldest position to be kept is
+  // dropped, and the consumers that had not read it are overtaken.
+  std::uint64_t tail = tail_;
+  while (tail < oldest) {
+    RecordHeader record{};
+    std::memcpy(&record, data_ + tail % capacity, sizeof(record));
+    if (record.kind != RecordKind::PADDING) {
+      for (const auto &slot : header_->readers) {
+        if (slot.pid.load(std::memory_order_relaxed) != 0 &&
+            slot.cursor.load(std::memory_order_relaxed) <= tail) {
+          ++overtaken_;
+          break;
+        }
+      }
+    }
+    tail += align(sizeof(RecordHeader) + record.size);
+  }
+  if (end - capacity > head_) {
+    tail = start;
+  }
+  tail_ = tail;
+  header_->tail.store(tail_, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Publisher::finish() noexcept {
+  header_->finished.store(1, std::memory_order_release);
+}
+
+double Publisher::get_stalled() const noexcept { return stalled_; }
+
+std::size_t Publisher::get_overtaken() const noexcept { return overtaken_; }
+
+Reader::Reader(const std::string &name, const bool from_oldest) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Unable to open the shared memory " + name);
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to size the shared memory " + name);
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+  void *p = size_ < sizeof(RingHeader)
+                ? MAP_FAILED
+                : mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                       0);
+  const int error = errno;
+  close(fd);
+  if (p == MAP_FAILED) {
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to map the shared memory " + name);
+  }
+  header_ = static_cast<RingHeader *>(p);
+
+  if (header_->magic.load(std::memory_order_acquire) != MAGIC ||
+      header_->version != VERSION ||
+      header_->data_offset + header_->capacity > size_) {
+    munmap(p, size_);
+    throw std::runtime_error(name + " is not a ring of version " +
+                             std::to_string(VERSION));
+  }
+  data_ = static_cast<const std::byte *>(p) + header_->data_offset;
+
+  // The cursor is set before the slot is taken, as the producer reads it as
+  // soon as it is, and it is then brought up to the tail by ::next.
+  position_ = from_oldest ? header_->tail.load(std::memory_order_acquire)
+                          : header_->head.load(std::memory_order_acquire);
+  for (auto &slot : header_->readers) {
+    std::uint32_t expected = 0;
+    if (slot.pid.load(std::memory_order_relaxed) != 0) {
+      continue;
+    }
+    slot.cursor.store(position_, std::memory_order_relaxed);
+    if (slot.pid.compare_exchange_strong(
+            expected, static_cast<std::uint32_t>(getpid()),
+            std::memory_order_acq_rel)) {
+      slot_ = &slot;
+      break;
+    }
+  }
+  if (!slot_) {
+    munmap(p, size_);
+    throw std::runtime_error("Every consumer of " + name + " is taken");
+  }
+}
+
+Reader::~Reader() {
+  slot_->pid.store(0, std::memory_order_release);
+  munmap(header_, size_);
+}
+
+std::string_view Reader::get_metadata() const noexcept {
+  return {reinterpret_cast<const char *>(header_) + header_->metadata_offset,
+          header_->metadata_size};
+}
+
+std::optional<Record> Reader::next() {
+  const std::uint64_t capacity = header_->capacity;
+  while (true) {
+    slot_->cursor.store(position_, std::memory_order_release);
+    if (position_ == header_->head.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+    // The records that were overwritten before they were read are skipped,
+    // and counted by their sequence.
+    const std::uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    if (position_ < tail) {
+      position_ = tail;
+      continue;
+    }
+
+    RecordHeader record{};
+    std::memcpy(&record, data_ + position_ % capacity, sizeof(record));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->tail.load(std::memory_order_relaxed) > position_ ||
+        align(sizeof(RecordHeader) + record.size) > capacity) {
+      continue;
+    }
+
+    const std::uint64_t position = position_;
+    position_ += align(sizeof(RecordHeader) + record.size);
+    if (record.kind == RecordKind::PADDING) {
+      continue;
+    }
+    if (sequence_ && record.sequence > *sequence_) {
+      lost_ += record.sequence - *sequence_;
+    }
+    sequence_ = record.sequence + 1;
+    return Record{record.kind, record.sequence, record.day,
+                  {data_ + position % capacity + sizeof(record), record.size},
+                  position};
+  }
+}
+
+bool Reader::valid(const Record &record) const noexcept {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return header_->tail.load(std::memory_order_relaxed) <= record.position;
+}
+
+bool Reader::finished() const noexcept {
+  return header_->finished.load(std::memory_order_acquire) != 0 &&
+         position_ == header_->head.load(std::memory_order_acquire);
+}
+
+std::size_t Reader::get_lost() const noexcept { return lost_; }
+} // namespace contagent::shm
@@ -0,0 +1,306 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/sparse_population.h"
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <numeric>
+#include <tuple>
+
+namespace contagent {
+SparsePopulation::SparsePopulation(const Configuration &configuration,
+                                   const AgentTable &agents)
+    : Population(configuration, agents) {
+  if (dataflow_) {
+    LOG(WARNING) << "The sparse engine perceives on one thread, so it ticks "
+                    "with barriers";
+    dataflow_ = false;
+  }
+
+  const auto &beliefs = configuration.get_beliefs();
+  const auto &behaviours = configuration.get_behaviours();
+
+  const auto &agent_beliefs = get_agent_beliefs();
+  const auto behaviour_index = index(behaviours);
+
+  // Count the perceptions of every behaviour, then place them, so that the
+  // beliefs of every column stay in ascending order.
+  perception_offsets_.assign(n_behaviours_ + 1, 0);
+  std::vector<std::tuple<std::uint32_t, std::uint32_t, double_t>> perceptions;
+
+  for (std::size_t b = 0; b < n_beliefs_; ++b) {
+    for (const auto &[weak_behaviour, perception] :
+         beliefs[b]->get_perceptions()) {
+      if (auto behaviour = weak_behaviour.lock();
+          perception != 0.0 && behaviour &&
+          behaviour_index.contains(behaviour.get())) {
+        perceptions.emplace_back(behaviour_index.at(behaviour.get()), b,
+                                 perception);
+      }
+    }
+  }
+  std::sort(perceptions.begin(), perceptions.end());
+
+  perception_beliefs_.reserve(perceptions.size());
+  perception_values_.reserve(perceptions.size());
+  for (const auto &[k, b, perception] : perceptions) {
+    ++perception_offsets_[k + 1];
+    perception_beliefs_.push_back(b);
+    perception_values_.push_back(perception);
+  }
+  std::partial_sum(perception_offsets_.begin(), perception_offsets_.end(),
+                   perception_offsets_.begin());
+
+  const auto &table = ArchetypeTable::global();
+  pr_offsets_.reserve(archetype_ids_.size() * n_beliefs_ + 1);
+  pr_offsets_.push_back(0);
+
+  for (const auto id : archetype_ids_) {
+    const auto &prs = table.at(id).performance_relationships;
+    for (const auto &belief : agent_beliefs) {
+      if (auto belief_prs = prs.find(belief); belief_prs != prs.end()) {
+        for (std::size_t k = 0; k < n_behaviours_; ++k) {
+          auto pr = belief_prs->second.find(behaviours[k]);
+          if (pr != belief_prs->second.end() && pr->second != 0.0) {
+            pr_behaviours_.push_back(k);
+            pr_values_.push_back(pr->second);
+          }
+        }
+      }
+      pr_offsets_.push_back(pr_behaviours_.size());
+    }
+  }
+
+  offsets_.reserve(n_agents_ + 1);
+  offsets_.push_back(0);
+  std::vector<std::pair<std::uint32_t, double_t>> activations;
+
+  for (std::size_t i = 0; i < n_agents_; ++i) {
+    activations.clear();
+    const std::size_t row = original_[i];
+    for (std::size_t a = agents.activation_offsets[row];
+         a < agents.activation_offsets[row + 1]; ++a) {
+      if (agents.activation_values[a] != 0.0) {
+        activations.emplace_back(agents.activation_beliefs[a],
+                                 agents.activation_values[a]);
+      }
+    }
+    std::sort(activations.begin(), activations.end());
+
+    for (const auto &[b, activation] : activations) {
+      beliefs_.push_back(b);
+      values_.push_back(activation);
+    }
+    offsets_.push_back(beliefs_.size());
+  }
+
+  pressures_.resize(n_beliefs_);
+  touched_.assign(n_beliefs_, 0);
+}
+
+double_t
+SparsePopulation::get_activation(const std::size_t agent,
+                                 const std::size_t belief) const noexcept {
+  const auto begin = beliefs_.begin() + offsets_[agent];
+  const auto end = beliefs_.begin() + offsets_[agent + 1];
+  const auto it = std::lower_bound(begin, end, belief);
+  return it != end && *it == belief ? values_[it - beliefs_.begin()] : 0.0;
+}
+
+std::size_t SparsePopulation::n_non_zero() const noexcept {
+  return values_.size();
+}
+
+void SparsePopulation::perceive(std::size_t) {
+  if (settled_) {
+    return;
+  }
+
+  if (actions_changed_ && !incremental_) {
+    count_hub_actions();
+  }
+
+  std::swap(offsets_, previous_offsets_);
+  std::swap(beliefs_, previous_beliefs_);
+  std::swap(values_, previous_values_);
+  offsets_.clear();
+  beliefs_.clear();
+  values_.clear();
+  offsets_.push_back(0);
+
+  std::vector<double_t> actions_of_friends(n_behaviours_);
+  std::vector<std::uint32_t> changing;
+
+  const auto touch = [this, &changing](const std::uint32_t b) {
+    if (!touched_[b]) {
+      touched_[b] = 1;
+      pressures_[b] = 0.0;
+      changing.push_back(b);
+    }
+  };
+
+  for (std::size_t i = 0; i < n_agents_; ++i) {
+    const std::size_t begin = previous_offsets_[i];
+    const std::size_t end = previous_offsets_[i + 1];
+
+    if (!actions_changed_ && fixed_[i]) {
+      beliefs_.insert(beliefs_.end(), previous_beliefs_.begin() + begin,
+                      previous_beliefs_.begin() + end);
+      values_.insert(values_.end(), previous_values_.begin() + begin,
+                     previous_values_.begin() + end);
+      offsets_.push_back(beliefs_.size());
+      continue;
+    }
+
+    const std::size_t n_friends =
+        count_actions_of_friends(i, actions_of_friends.data());
+    changing.clear();
+
+    // Accumulate in ascending order of behaviour, as DensePopulation does.
+    if (n_friends != 0) {
+      for (std::size_t k = 0; k < n_behaviours_; ++k) {
+        if (actions_of_friends[k] == 0.0) {
+          continue;
+        }
+        for (std::size_t e = perception_offsets_[k];
+             e < perception_offsets_[k + 1]; ++e) {
+          touch(perception_beliefs_[e]);
+          pressures_[perception_beliefs_[e]] +=
+              perception_values_[e] * actions_of_friends[k];
+        }
+      }
+    }
+
+    for (std::size_t e = begin; e < end; ++e) {
+      touch(previous_beliefs_[e]);
+    }
+
+    std::sort(changing.begin(), changing.end());
+    const double_t *deltas = deltas_.data() + archetypes_[i] * n_beliefs_;
+    std::size_t e = begin;
+
+    for (const auto b : changing) {
+      touched_[b] = 0;
+
+      double_t previous = 0.0;
+      if (e < end && previous_beliefs_[e] == b) {
+        previous = previous_values_[e++];
+      }
+
+      double_t pressure = 0.0;
+      if (n_friends != 0) {
+        pressure = pressures_[b];
+        pressure /= n_friends; // NOLINT(*-narrowing-conversions)
+      }
+
+      const double_t context = previous * mean_relationships_[b];
+      const double_t activation_change = pressure > 0.0
+                                             ? (1.0 + context) / 2.0 * pressure
+                                             : (1.0 - context) / 2.0 * pressure;
+
+      const double_t activation = std::max(
+          -1.0, std::min(1.0, deltas[b] * previous + activation_change));
+
+      if (activation != 0.0) {
+        beliefs_.push_back(b);
+        values_.push_back(activation);
+      }
+    }
+
+    offsets_.push_back(beliefs_.size());
+    fixed_[i] = std::equal(beliefs_.begin() + offsets_[i], beliefs_.end(),
+                           previous_beliefs_.begin() + begin,
+                           previous_beliefs_.begin() + end) &&
+                std::equal(values_.begin() + offsets_[i], values_.end(),
+                           previous_values_.begin() + begin,
+                           previous_values_.begin() + end);
+  }
+
+  // With the same actions of friends, the Population has reached a fixed
+  // point once no activation of any agent has changed.
+  settled_ = !actions_changed_ &&
+             std::find(fixed_.begin(), fixed_.end(), 0) == fixed_.end();
+  actions_changed_ = false;
+}
+
+void SparsePopulation::score() {
+  if (settled_) {
+    return;
+  }
+
+  for (std::size_t i = 0; i < n_agents_; ++i) {
+    if (fixed_[i]) {
+      continue;
+    }
+
+    double_t *scores = scores_.data() + i * n_behaviours_;
+    std::fill(scores, scores + n_behaviours_, 0.0);
+    const std::size_t row = archetypes_[i] * n_beliefs_;
+
+    for (std::size_t e = offsets_[i]; e < offsets_[i + 1]; ++e) {
+      const std::size_t b = row + beliefs_[e];
+      for (std::size_t f = pr_offsets_[b]; f < pr_offsets_[b + 1]; ++f) {
+        scores[pr_behaviours_[f]] += values_[e] * pr_values_[f];
+      }
+    }
+  }
+}
+
+Population::Engine SparsePopulation::get_engine() const noexcept {
+  return Engine::SPARSE;
+}
+
+bool SparsePopulation::stores_zeros() const noexcept { return false; }
+
+void SparsePopulation::store_activations(const std::size_t day) const {
+  if (history_) {
+    // The History is dense, and its pages start out zero, so only the
+    // non-zero activations are written.
+    const auto activations = history_->activations(day);
+    for (std::size_t i = 0; i < n_agents_; ++i) {
+      for (std::size_t e = offsets_[i]; e < offsets_[i + 1]; ++e) {
+        activations[i * n_beliefs_ + beliefs_[e]] = values_[e];
+      }
+    }
+    history_->release(day, 0, n_agents_);
+    return;
+  }
+
+  const auto &beliefs = configuration_.get_beliefs();
+
+  for (std::size_t i = 0; i < n_agents_; ++i) {
+    std::unordered_map<std::shared_ptr<Belief>, double_t> activations;
+    activations.reserve(offsets_[i + 1] - offsets_[i]);
+    for (std::size_t e = offsets_[i]; e < offsets_[i + 1]; ++e) {
+      activations.emplace(beliefs[beliefs_[e]], values_[e]);
+    }
+    get_agent(i)->set_activations_for_day(day, activations);
+  }
+}
+} // namespace contagent
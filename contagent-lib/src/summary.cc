@@ -27,16 +27,60 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "contagent/summary.h"
+#include "contagent/selection.h"
 
+#include <algorithm>
 #include <cmath>
+#include <numeric>
 
 namespace contagent::summary {
+namespace {
+/// Get an element of a sorted vector as though some zeros had been inserted.
+/// \param v The sorted vector.
+/// \param zeros The number of zeros.
+/// \param ix The index.
+/// \return The element.
+double_t at_with_zeros(const std::vector<double_t> &v, const std::size_t zeros,
+                       const std::size_t ix) {
+  const std::size_t n_negative =
+      std::lower_bound(v.begin(), v.end(), 0.0) - v.begin();
+
+  if (ix < n_negative) {
+    return v.at(ix);
+  } else if (ix < n_negative + zeros) {
+    return 0.0;
+  } else {
+    return v.at(ix - zeros);
+  }
+}
+
+/// Get the agents of the OutputSelection of a Configuration.
+/// \param c The configuration.
+/// \return The indices of the agents, in ascending order.
+std::vector<std::uint32_t> selected_agents(const Configuration &c) {
+  std::vector<std::uint32_t> agents = c.get_output_selection().agents;
+  if (agents.empty()) {
+    agents.resize(c.get_n_agents());
+    std::iota(agents.begin(), agents.end(), 0);
+  }
+  return agents;
+}
+} // namespace
+
+// An Agent may leave out the beliefs that it has zero activation of, as
+// SparsePopulation does, so every belief of the Configuration is counted, and
+// absent activations count as zero.
+
 std::unordered_map<std::shared_ptr<Belief>, double_t>
 calculate_mean_activation(const Configuration &c, std::size_t time) {
   std::unordered_map<std::shared_ptr<Belief>, double_t> m;
 
+  for (const auto &b : c.get_beliefs()) {
+    m[b] = 0.0;
+  }
+
   for (const std::shared_ptr<Agent> &a : c.get_agents()) {
-    auto acts = a->get_activations_for_day(time);
+    const auto acts = a->get_activations_for_day(time);
     for (const auto &[b, act] : acts) {
       if (!m.contains(b)) {
         m[b] = 0.0;
@@ -55,18 +99,26 @@ std::unordered_map<std::shared_ptr<Belief>, double_t> calculate_sd_activation(
     const Configuration &c, std::size_t time,
     std::unordered_map<std::shared_ptr<Belief>, double_t> &means) {
   std::unordered_map<std::shared_ptr<Belief>, double_t> m;
+  std::unordered_map<std::shared_ptr<Belief>, std::size_t> present;
+
+  for (const auto &b : c.get_beliefs()) {
+    m[b] = 0.0;
+  }
 
   for (const std::shared_ptr<Agent> &a : c.get_agents()) {
-    auto acts = a->get_activations_for_day(time);
+    const auto acts = a->get_activations_for_day(time);
     for (const auto &[b, act] : acts) {
       if (!m.contains(b)) {
         m[b] = 0.0;
       }
       m[b] += std::pow(act - means.at(b), 2.0);
+      ++present[b];
     }
   }
 
-  for (auto &[_b, sqdiff] : m) {
+  for (auto &[b, sqdiff] : m) {
+    const std::size_t absent = c.get_agents().size() - present[b];
+    sqdiff += absent * std::pow(means.at(b), 2.0);
     sqdiff = std::sqrt(sqdiff / (c.get_agents().size() - 1));
   }
 
@@ -77,8 +129,12 @@ std::unordered_map<std::shared_ptr<Belief>, double_t>
 calculate_median_activation(const Configuration &c, std::size_t time) {
   std::unordered_map<std::shared_ptr<Belief>, std::vector<double_t>> all_acts;
 
+  for (const auto &b : c.get_beliefs()) {
+    all_acts[b];
+  }
+
   for (const std::shared_ptr<Agent> &a : c.get_agents()) {
-    auto acts = a->get_activations_for_day(time);
+    const auto acts = a->get_activations_for_day(time);
     for (const auto &[b, act] : acts) {
       all_acts[b].push_back(act);
     }
@@ -94,7 +150,11 @@ calculate_median_activation(const Configuration &c, std::size_t time) {
   std::unordered_map<std::shared_ptr<Belief>, double_t> m;
 
   for (const auto &[b, v] : all_acts) {
-    m[b] = is_even ? (v.at(ix) + v.at(ix + 1)) / 2 : v.at(ix);
+    const std::size_t zeros = c.get_agents().size() - v.size();
+    m[b] = is_even ? (at_with_zeros(v, zeros, ix) +
+                      at_with_zeros(v, zeros, ix + 1)) /
+                         2
+                   : at_with_zeros(v, zeros, ix);
   }
 
   return m;
@@ -105,7 +165,7 @@ calculate_nonzero_activation(const Configuration &c, std::size_t time) {
   std::unordered_map<std::shared_ptr<Belief>, std::size_t> m;
 
   for (const std::shared_ptr<Agent> &a : c.get_agents()) {
-    auto acts = a->get_activations_for_day(time);
+    const auto acts = a->get_activations_for_day(time);
     for (const auto &[b, act] : acts) {
       if (act != 0) {
         if (!m.contains(b)) {
@@ -124,7 +184,7 @@ calculate_n_performers(const Configuration &c, std::size_t time) {
   std::unordered_map<std::shared_ptr<Behaviour>, std::size_t> m;
 
   for (const std::shared_ptr<Agent> &a : c.get_agents()) {
-    auto action = a->get_actions().at(time);
+    const auto &action = a->get_action_history().at(time);
     if (!m.contains(action)) {
       m[action] = 0;
     }
@@ -136,13 +196,166 @@ calculate_n_performers(const Configuration &c, std::size_t time) {
 
 [[nodiscard]] std::unique_ptr<SummaryStats>
 calculate_summary_stats(const Configuration &c, std::size_t time) {
+  // The day of every Agent is read once, as it may have to be decompressed,
+  // and summarised as the activations of each belief selected.
+  const auto &beliefs = c.get_beliefs();
+  const auto &behaviours = c.get_behaviours();
+  const auto belief_mask =
+      selection::mask(c.get_output_selection().beliefs, beliefs.size());
+  std::unordered_map<const Belief *, std::size_t> belief_index;
+  for (std::size_t b = 0; b < beliefs.size(); ++b) {
+    if (belief_mask[b]) {
+      belief_index.emplace(beliefs[b].get(), b);
+    }
+  }
+  std::unordered_map<const Behaviour *, std::size_t> behaviour_index;
+  for (std::size_t k = 0; k < behaviours.size(); ++k) {
+    behaviour_index.emplace(behaviours[k].get(), k);
+  }
+
+  std::vector<std::vector<double_t>> activations(beliefs.size());
+  std::vector<std::size_t> n_performers(behaviours.size(), 0);
+  for (const auto i : selected_agents(c)) {
+    const auto &a = c.get_agents()[i];
+    for (const auto &[b, act] : a->get_activations_for_day(time)) {
+      if (const auto ix = belief_index.find(b.get());
+          ix != belief_index.end()) {
+        activations[ix->second].push_back(act);
+      }
+    }
+    const auto &action = a->get_action_history().at(time);
+    if (const auto k = behaviour_index.find(action.get());
+        k != behaviour_index.end()) {
+      ++n_performers[k->second];
+    }
+  }
+
+  return calculate_summary_stats(c, std::move(activations), n_performers);
+}
+
+std::unique_ptr<SummaryStats>
+calculate_summary_stats(const Configuration &c,
+                        std::vector<std::vector<double_t>> activations,
+                        const std::span<const std::size_t> n_performers) {
+  const auto &beliefs = c.get_beliefs();
+  const auto &behaviours = c.get_behaviours();
+  const auto &selection = c.get_output_selection();
+  const auto belief_mask = selection::mask(selection.beliefs, beliefs.size());
+  const auto behaviour_mask =
+      selection::mask(selection.behaviours, behaviours.size());
+  const std::size_t n_agents = selection::count_agents(c);
+  const std::size_t ix = n_agents / 2 - 1;
+  const bool is_even = n_agents % 2 == 0;
   auto s = std::make_unique<SummaryStats>();
-  s->mean_activations = calculate_mean_activation(c, time);
-  s->sd_activations = calculate_sd_activation(c, time, s->mean_activations);
-  s->median_activations = calculate_median_activation(c, time);
-  s->nonzero_activations = calculate_nonzero_activation(c, time);
-  s->n_performers = calculate_n_performers(c, time);
+
+  for (std::size_t b = 0; b < beliefs.size(); ++b) {
+    if (!belief_mask[b]) {
+      continue;
+    }
+    auto &v = activations[b];
+
+    double_t mean = 0.0;
+    std::size_t nonzero = 0;
+    for (const auto act : v) {
+      mean += act;
+      if (act != 0) {
+        ++nonzero;
+      }
+    }
+    mean /= n_agents; // NOLINT(*-narrowing-conversions)
+
+    double_t sqdiff = 0.0;
+    for (const auto act : v) {
+      sqdiff += std::pow(act - mean, 2.0);
+    }
+    const std::size_t zeros = n_agents - v.size();
+    sqdiff += zeros * std::pow(mean, 2.0);
+
+    std::sort(v.begin(), v.end());
+    s->mean_activations[beliefs[b]] = mean;
+    s->sd_activations[beliefs[b]] = std::sqrt(sqdiff / (n_agents - 1));
+    s->median_activations[beliefs[b]] =
+        is_even ? (at_with_zeros(v, zeros, ix) +
+                   at_with_zeros(v, zeros, ix + 1)) /
+                      2
+                : at_with_zeros(v, zeros, ix);
+    if (nonzero != 0) {
+      s->nonzero_activations[beliefs[b]] = nonzero;
+    }
+  }
+
+  for (std::size_t k = 0; k < behaviours.size(); ++k) {
+    if (behaviour_mask[k] && n_performers[k] != 0) {
+      s->n_performers[behaviours[k]] = n_performers[k];
+    }
+  }
+
   return s;
 }
 
+std::unique_ptr<SummaryStats>
+calculate_summary_stats(const Configuration &c, const Snapshot &snapshot) {
+  const std::size_t n_beliefs = c.get_beliefs().size();
+  const auto belief_mask =
+      selection::mask(c.get_output_selection().beliefs, n_beliefs);
+  const auto agents = selected_agents(c);
+
+  std::vector<std::vector<double_t>> activations(n_beliefs);
+  for (std::size_t b = 0; b < n_beliefs; ++b) {
+    if (belief_mask[b]) {
+      activations[b].reserve(agents.size());
+    }
+  }
+  std::vector<std::size_t> n_performers(c.get_behaviours().size(), 0);
+
+  for (const auto i : agents) {
+    for (std::size_t b = 0; b < n_beliefs; ++b) {
+      const double_t activation = snapshot.activations[i * n_beliefs + b];
+      if (belief_mask[b] && (!snapshot.omit_zeros || activation != 0.0)) {
+        activations[b].push_back(activation);
+      }
+    }
+    ++n_performers[snapshot.actions[i]];
+  }
+
+  return calculate_summary_stats(c, std::move(activations), n_performers);
+}
+
+std::unique_ptr<SummaryStats>
+calculate_summary_stats(const Configuration &c, const History &history,
+                        const std::size_t time) {
+  const std::size_t n_agents = history.n_agents();
+  const std::size_t n_beliefs = history.n_beliefs();
+  const auto day_activations = history.activations(time);
+  const auto day_actions = history.actions(time);
+  const auto &selection = c.get_output_selection();
+  const auto belief_mask = selection::mask(selection.beliefs, n_beliefs);
+  const auto agent_mask = selection::mask(selection.agents, c.get_n_agents());
+  const auto rows = history.get_agents();
+
+  // The zeros are kept, so that the sums are in the same order as from the
+  // Agents.
+  std::vector<std::vector<double_t>> activations(n_beliefs);
+  for (std::size_t b = 0; b < n_beliefs; ++b) {
+    if (belief_mask[b]) {
+      activations[b].reserve(selection::count_agents(c));
+    }
+  }
+  std::vector<std::size_t> n_performers(c.get_behaviours().size(), 0);
+
+  for (std::size_t i = 0; i < n_agents; ++i) {
+    if (!agent_mask[rows[i]]) {
+      continue;
+    }
+    for (std::size_t b = 0; b < n_beliefs; ++b) {
+      if (belief_mask[b]) {
+        activations[b].push_back(day_activations[i * n_beliefs + b]);
+      }
+    }
+    ++n_performers[day_actions[i]];
+  }
+  history.release(time, 0, n_agents);
+
+  return calculate_summary_stats(c, std::move(activations), n_performers);
+}
 } // namespace contagent::summary
\ No newline at end of file
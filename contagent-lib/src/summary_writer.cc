@@ -0,0 +1,252 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/summary_writer.h"
+#include "contagent/json/summary_spec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <span>
+#include <stdexcept>
+
+namespace contagent {
+namespace {
+/// Encode the activations and actions of the agents of a Dictionary as a
+/// shm::RecordKind::STATE payload.
+/// \param configuration The configuration.
+/// \param dictionary The dictionary, which lists the agents.
+/// \param snapshot The day.
+/// \return The payload.
+std::vector<std::byte> encode_state(const Configuration &configuration,
+                                    const json::Dictionary &dictionary,
+                                    const summary::Snapshot &snapshot) {
+  const auto &agents = dictionary.get_agents();
+  const auto &beliefs = dictionary.get_beliefs();
+  const auto &behaviours = configuration.get_behaviours();
+  const std::size_t n_beliefs = configuration.get_beliefs().size();
+
+  const shm::StateHeader header{agents.size(), beliefs.size()};
+  std::vector<double_t> activations;
+  activations.reserve(agents.size() * beliefs.size());
+  std::vector<std::uint32_t> actions;
+  actions.reserve(agents.size());
+  for (const auto i : agents) {
+    for (const auto b : beliefs) {
+      activations.push_back(snapshot.activations[i * n_beliefs + b]);
+    }
+    const auto position =
+        dictionary.find(behaviours[snapshot.actions[i]].get());
+    actions.push_back(position ? *position
+                               : std::numeric_limits<std::uint32_t>::max());
+  }
+
+  std::vector<std::byte> state;
+  for (const auto part :
+       {std::as_bytes(std::span(&header, 1)),
+        std::as_bytes(std::span(activations)),
+        std::as_bytes(std::span(actions))}) {
+    state.insert(state.end(), part.begin(), part.end());
+  }
+  return state;
+}
+
+/// Get the metadata of the RingOutput.
+/// \param configuration The configuration.
+/// \param dictionary The dictionary of the ring.
+/// \return The JSON.
+std::string ring_metadata(const Configuration &configuration,
+                          const json::Dictionary &dictionary) {
+  const auto &pipeline = configuration.get_output_pipeline();
+  const nlohmann::json j = {
+      {"startTime", configuration.get_start_time()},
+      {"endTime", configuration.get_end_time()},
+      {"dayStride", configuration.get_output_selection().day_stride},
+      {"schema",
+       pipeline.schema == OutputSchema::COMPACT ? "compact" : "keyed"},
+      {"state", pipeline.ring.state}};
+  auto text = j.dump();
+  text.insert(1, "\"dictionary\":" + dictionary.get_text() + ",");
+  return text;
+}
+} // namespace
+
+SummaryWriter::SummaryWriter(const Configuration &configuration)
+    : configuration_(configuration), encoder_(configuration),
+      max_pending_(std::max<std::size_t>(
+          1, configuration.get_output_pipeline().max_pending)),
+      encoders_(std::max<std::size_t>(
+          1, configuration.get_output_pipeline().n_threads)) {
+  // The summaries are encoded and separated as Runner writes them in one go,
+  // so the output is the same.
+  *configuration_.get_output_stream() << encoder_.begin();
+
+  const auto &ring = configuration.get_output_pipeline().ring;
+  if (!ring.name.empty()) {
+    ring_dictionary_.emplace(configuration, ring.state);
+    publisher_ = std::make_unique<shm::Publisher>(
+        ring.name, ring.capacity,
+        ring_metadata(configuration, *ring_dictionary_),
+        ring.wait_for_readers);
+  }
+
+  writer_ = std::thread([this] { write(); });
+}
+
+SummaryWriter::~SummaryWriter() {
+  {
+    std::lock_guard lock(mutex_);
+    finishing_ = true;
+  }
+  cv_.notify_all();
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+void SummaryWriter::push(summary::Snapshot snapshot) {
+  {
+    const auto started = std::chrono::steady_clock::now();
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [this] { return n_pending_ < max_pending_ || error_; });
+    metrics_.blocked += std::chrono::duration<double_t>(
+                            std::chrono::steady_clock::now() - started)
+                            .count();
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    ++n_pending_;
+  }
+
+  auto day = std::make_shared<summary::Snapshot>(std::move(snapshot));
+  auto text = std::make_shared<std::string>();
+  auto state = publisher_ && configuration_.get_output_pipeline().ring.state
+                   ? std::make_shared<std::vector<std::byte>>()
+                   : nullptr;
+  const std::size_t time = day->day;
+  auto encoded = encoders_.submit([this, day, text, state] {
+    const auto started = std::chrono::steady_clock::now();
+    const auto stats = summary::calculate_summary_stats(configuration_, *day);
+    *text = encoder_.encode(*stats, day->day);
+    if (state) {
+      *state = encode_state(configuration_, *ring_dictionary_, *day);
+    }
+    std::lock_guard lock(mutex_);
+    metrics_.encoding += std::chrono::duration<double_t>(
+                             std::chrono::steady_clock::now() - started)
+                             .count();
+  });
+
+  {
+    std::lock_guard lock(mutex_);
+    queue_.push({time, std::move(encoded), std::move(text), std::move(state)});
+  }
+  cv_.notify_all();
+}
+
+SummaryWriter::Metrics SummaryWriter::finish() {
+  {
+    std::lock_guard lock(mutex_);
+    finishing_ = true;
+  }
+  cv_.notify_all();
+  writer_.join();
+
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+  *configuration_.get_output_stream() << encoder_.end();
+  if (publisher_) {
+    publisher_->finish();
+    metrics_.stalled = publisher_->get_stalled();
+    metrics_.overtaken = publisher_->get_overtaken();
+  }
+  return metrics_;
+}
+
+void SummaryWriter::write() {
+  auto &output = *configuration_.get_output_stream();
+  bool first = true;
+  bool failed = false;
+
+  while (true) {
+    Pending pending;
+    {
+      std::unique_lock lock(mutex_);
+      cv_.wait(lock, [this] { return finishing_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      pending = std::move(queue_.front());
+      queue_.pop();
+    }
+
+    // After a failure the days are still taken, so that ::push does not
+    // wait forever, but not written, so that the output does not skip one.
+    try {
+      pending.encoded.get();
+      if (failed) {
+        throw std::runtime_error("An earlier day could not be written");
+      }
+      const auto started = std::chrono::steady_clock::now();
+      output << (first ? "" : ",") << *pending.text;
+      first = false;
+      if (!output) {
+        throw std::runtime_error("Unable to write the output");
+      }
+      const auto written = std::chrono::steady_clock::now();
+      if (publisher_) {
+        publisher_->publish(shm::RecordKind::SUMMARY, pending.day,
+                            {std::as_bytes(std::span(*pending.text))});
+        if (pending.state) {
+          publisher_->publish(shm::RecordKind::STATE, pending.day,
+                              {std::span<const std::byte>(*pending.state)});
+        }
+      }
+      std::lock_guard lock(mutex_);
+      metrics_.writing +=
+          std::chrono::duration<double_t>(written - started).count();
+      metrics_.publishing += std::chrono::duration<double_t>(
+                                 std::chrono::steady_clock::now() - written)
+                                 .count();
+    } catch (...) {
+      failed = true;
+      std::lock_guard lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+
+    {
+      std::lock_guard lock(mutex_);
+      --n_pending_;
+    }
+    cv_.notify_all();
+  }
+}
+} // namespace contagent
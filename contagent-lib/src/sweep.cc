@@ -0,0 +1,160 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/sweep.h"
+#include "contagent/runner.h"
+#include <glog/logging.h>
+
+namespace contagent::sweep {
+std::vector<std::shared_ptr<Belief>>
+copy_beliefs(const std::vector<std::shared_ptr<Belief>> &beliefs,
+             const Scenario &scenario,
+             std::unordered_map<std::shared_ptr<Belief>,
+                                std::shared_ptr<Belief>> &remap) {
+  std::vector<std::shared_ptr<Belief>> copies;
+  copies.reserve(beliefs.size());
+
+  for (const auto &belief : beliefs) {
+    auto copy =
+        std::make_shared<Belief>(belief->get_uuid(), belief->get_name());
+    copy->set_perceptions(belief->get_perceptions());
+    remap[belief] = copy;
+    copies.push_back(copy);
+  }
+
+  for (const auto &belief : beliefs) {
+    auto &copy = remap.at(belief);
+
+    for (const auto &[weak_b2, relationship] : belief->get_relationships()) {
+      if (auto b2 = weak_b2.lock()) {
+        std::weak_ptr<Belief> weak_copy_b2 = remap.at(b2);
+        copy->set_relationship(weak_copy_b2, relationship);
+      } else {
+        throw std::runtime_error("Unable to lock weak pointer");
+      }
+    }
+
+    if (scenario.relationships.contains(belief)) {
+      for (const auto &[b2, relationship] :
+           scenario.relationships.at(belief)) {
+        std::weak_ptr<Belief> weak_copy_b2 = remap.at(b2);
+        copy->set_relationship(weak_copy_b2, relationship);
+      }
+    }
+
+    if (scenario.perceptions.contains(belief)) {
+      for (const auto &[behaviour, perception] :
+           scenario.perceptions.at(belief)) {
+        std::weak_ptr<Behaviour> weak_behaviour = behaviour;
+        copy->set_perception(weak_behaviour, perception);
+      }
+    }
+  }
+
+  return copies;
+}
+
+SharedAgents share_agents(const std::vector<std::shared_ptr<Belief>> &beliefs,
+                          const Scenario &scenario) {
+  SharedAgents shared{beliefs, {}};
+  shared.delta_multipliers.reserve(beliefs.size());
+
+  for (const auto &belief : beliefs) {
+    double_t multiplier = scenario.delta_multiplier;
+    if (scenario.delta_multipliers.contains(belief)) {
+      multiplier *= scenario.delta_multipliers.at(belief);
+    }
+    shared.delta_multipliers.push_back(multiplier);
+  }
+
+  return shared;
+}
+
+Sweep::Sweep(std::vector<std::shared_ptr<Behaviour>> behaviours,
+             std::vector<std::shared_ptr<Belief>> beliefs,
+             std::vector<std::shared_ptr<Agent>> agents,
+             const uint_fast32_t start_time, const uint_fast32_t end_time,
+             std::vector<Scenario> scenarios, const std::uint64_t seed,
+             const Precision precision, const Ordering ordering,
+             const GraphFormat graph_format, const Aggregation aggregation,
+             Storage storage)
+    : behaviours_(std::move(behaviours)), beliefs_(std::move(beliefs)),
+      agents_(std::move(agents)), start_time_(start_time),
+      end_time_(end_time), scenarios_(std::move(scenarios)), seed_(seed),
+      precision_(precision), ordering_(ordering), graph_format_(graph_format),
+      aggregation_(aggregation), storage_(std::move(storage)) {}
+
+std::unique_ptr<Configuration>
+Sweep::make_configuration(const Scenario &scenario,
+                          std::unique_ptr<std::ostream> output_stream) const {
+  std::unordered_map<std::shared_ptr<Belief>, std::shared_ptr<Belief>> remap;
+  auto beliefs = copy_beliefs(beliefs_, scenario, remap);
+
+  return std::make_unique<Configuration>(
+      behaviours_, beliefs, agents_, start_time_, end_time_,
+      std::move(output_stream), false, seed_, precision_, Parallelism{},
+      ordering_, graph_format_, aggregation_, Ownership{}, storage_,
+      OutputPipeline{}, OutputSelection{},
+      share_agents(beliefs_, scenario));
+}
+
+void Sweep::run(ThreadPool &pool,
+                const std::function<std::unique_ptr<std::ostream>(
+                    const Scenario &)> &make_output) const {
+  std::vector<std::future<void>> futures;
+  futures.reserve(scenarios_.size());
+
+  for (const auto &scenario : scenarios_) {
+    futures.push_back(pool.submit([this, &scenario, &make_output] {
+      LOG(INFO) << "[scenario=" << scenario.name << "] Building model";
+      Runner runner(make_configuration(scenario, make_output(scenario)));
+      runner.run();
+      LOG(INFO) << "[scenario=" << scenario.name << "] Complete";
+    }));
+  }
+
+  std::exception_ptr first_exception;
+  for (auto &future : futures) {
+    try {
+      future.get();
+    } catch (...) {
+      if (!first_exception) {
+        first_exception = std::current_exception();
+      }
+    }
+  }
+
+  if (first_exception) {
+    std::rethrow_exception(first_exception);
+  }
+}
+
+const std::vector<Scenario> &Sweep::get_scenarios() const {
+  return scenarios_;
+}
+} // namespace contagent::sweep
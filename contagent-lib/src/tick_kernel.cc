@@ -0,0 +1,70 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/tick_kernel.h"
+
+namespace contagent {
+namespace {
+template <class Real, std::size_t NB, std::size_t NK>
+constexpr TickKernels<Real> make_tick_kernels() {
+  return {NB, NK, &TickKernel<Real, NB, NK>::perceive,
+          &TickKernel<Real, NB, NK>::score};
+}
+
+/// Every TickKernel with at least one belief and behaviour, the kernel for B
+/// beliefs and K behaviours is at (B - 1) × MAX_KERNEL_BEHAVIOURS + K - 1.
+template <class Real, std::size_t... I>
+constexpr std::array<TickKernels<Real>, sizeof...(I)>
+make_all_tick_kernels(std::index_sequence<I...>) {
+  return {make_tick_kernels<Real, I / MAX_KERNEL_BEHAVIOURS + 1,
+                            I % MAX_KERNEL_BEHAVIOURS + 1>()...};
+}
+
+template <class Real>
+constexpr auto TICK_KERNELS = make_all_tick_kernels<Real>(
+    std::make_index_sequence<MAX_KERNEL_BELIEFS * MAX_KERNEL_BEHAVIOURS>{});
+} // namespace
+
+template <class Real>
+const TickKernels<Real> *
+find_tick_kernels(const std::size_t n_beliefs,
+                  const std::size_t n_behaviours) noexcept {
+  if (n_beliefs == 0 || n_beliefs > MAX_KERNEL_BELIEFS || n_behaviours == 0 ||
+      n_behaviours > MAX_KERNEL_BEHAVIOURS) {
+    return nullptr;
+  }
+
+  return &TICK_KERNELS<Real>[(n_beliefs - 1) * MAX_KERNEL_BEHAVIOURS +
+                             n_behaviours - 1];
+}
+
+template const TickKernels<double_t> *
+find_tick_kernels<double_t>(std::size_t, std::size_t) noexcept;
+template const TickKernels<float> *
+find_tick_kernels<float>(std::size_t, std::size_t) noexcept;
+} // namespace contagent
@@ -0,0 +1,141 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/validation.h"
+#include "contagent/runner.h"
+#include "contagent/summary.h"
+#include "contagent/sweep.h"
+#include <glog/logging.h>
+#include <sstream>
+
+namespace contagent::validation {
+namespace {
+/// Run a model, which shares its agents so that they are not mutated, and
+/// get the summary statistics of every day.
+std::vector<std::unique_ptr<summary::SummaryStats>>
+run(const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+    const std::vector<std::shared_ptr<Belief>> &beliefs,
+    const std::vector<std::shared_ptr<Agent>> &agents,
+    const uint_fast32_t start_time, const uint_fast32_t end_time,
+    const std::uint64_t seed, const Precision precision) {
+  auto configuration = std::make_unique<Configuration>(
+      behaviours, beliefs, agents, start_time, end_time,
+      std::make_unique<std::ostringstream>(), false, seed, precision,
+      Parallelism{}, Ordering::INPUT, GraphFormat::CSR, Aggregation::PULL,
+      Ownership{}, Storage{}, OutputPipeline{}, OutputSelection{},
+      sweep::share_agents(beliefs, sweep::Scenario()));
+  const Configuration &c = *configuration;
+
+  // The sparse engine only computes in double precision, so both runs are
+  // dense, or else they would not differ.
+  Runner runner(std::move(configuration), Population::Engine::DENSE);
+  runner.perform_actions(start_time - 1);
+  runner.tick_between(start_time, end_time);
+
+  const History &history = *runner.get_population().get_history();
+  std::vector<std::unique_ptr<summary::SummaryStats>> stats;
+  for (uint_fast32_t t = start_time; t < end_time; ++t) {
+    stats.push_back(summary::calculate_summary_stats(c, history, t));
+  }
+
+  return stats;
+}
+
+/// Accumulates the absolute differences of a statistic.
+class Accumulator {
+public:
+  void add(const double_t a, const double_t b) {
+    const double_t d = std::abs(a - b);
+    max_ = std::max(max_, d);
+    sum_ += d;
+    ++n_;
+  }
+
+  [[nodiscard]] Divergence get() const {
+    return {max_, n_ == 0 ? 0.0 : sum_ / n_}; // NOLINT(*-narrowing-conversions)
+  }
+
+private:
+  double_t max_ = 0.0;
+  double_t sum_ = 0.0;
+  std::size_t n_ = 0;
+};
+
+/// Get a value of a statistic, which is zero if it is absent.
+template <class K, class V>
+double_t get(const std::unordered_map<std::shared_ptr<K>, V> &m,
+             const std::shared_ptr<K> &k) {
+  auto it = m.find(k);
+  return it == m.end() ? 0.0 : static_cast<double_t>(it->second);
+}
+} // namespace
+
+PrecisionReport
+compare_precision(const std::vector<std::shared_ptr<Behaviour>> &behaviours,
+                  const std::vector<std::shared_ptr<Belief>> &beliefs,
+                  const std::vector<std::shared_ptr<Agent>> &agents,
+                  const uint_fast32_t start_time, const uint_fast32_t end_time,
+                  const std::uint64_t seed) {
+  LOG(INFO) << "Running in double precision";
+  const auto reference = run(behaviours, beliefs, agents, start_time,
+                             end_time, seed, Precision::FLOAT64);
+  LOG(INFO) << "Running in single precision";
+  const auto single = run(behaviours, beliefs, agents, start_time, end_time,
+                          seed, Precision::FLOAT32);
+
+  const auto n_agents = static_cast<double_t>(agents.size());
+  Accumulator mean;
+  Accumulator sd;
+  Accumulator median;
+  Accumulator nonzero;
+  Accumulator n_performers;
+
+  for (std::size_t t = 0; t < reference.size(); ++t) {
+    const auto &a = *reference[t];
+    const auto &b = *single[t];
+
+    for (const auto &belief : beliefs) {
+      mean.add(get(a.mean_activations, belief),
+               get(b.mean_activations, belief));
+      sd.add(get(a.sd_activations, belief), get(b.sd_activations, belief));
+      median.add(get(a.median_activations, belief),
+                 get(b.median_activations, belief));
+      nonzero.add(get(a.nonzero_activations, belief) / n_agents,
+                  get(b.nonzero_activations, belief) / n_agents);
+    }
+
+    for (const auto &behaviour : behaviours) {
+      n_performers.add(get(a.n_performers, behaviour) / n_agents,
+                       get(b.n_performers, behaviour) / n_agents);
+    }
+  }
+
+  return {mean.get(), sd.get(), median.get(), nonzero.get(),
+          n_performers.get()};
+}
+} // namespace contagent::validation
@@ -0,0 +1,164 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "clipp.h"
+#include "contagent/contagent.h"
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <chrono>
+#include <fstream>
+#include <glog/logging.h>
+#include <iostream>
+#include <numeric>
+#include <unordered_map>
+
+using namespace clipp;
+using namespace contagent;
+
+namespace {
+/// Read the UUIDs of some agents, one per line, as indices of the agents of a
+/// ChangeLog.
+/// \param file_path The path.
+/// \param log The ChangeLog.
+/// \return The indices, in the order of the file.
+/// \throws std::out_of_range If an agent is not in the log.
+std::vector<std::uint32_t> load_agent_indices(const std::string &file_path,
+                                              const replay::ChangeLog &log) {
+  std::unordered_map<std::string, std::uint32_t> index;
+  for (std::size_t a = 0; a < log.agents.size(); ++a) {
+    index.emplace(boost::lexical_cast<std::string>(log.agents[a]->get_uuid()),
+                  a);
+  }
+
+  std::ifstream file(file_path);
+  std::vector<std::uint32_t> agents;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      agents.push_back(index.at(line));
+    }
+  }
+  return agents;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  FLAGS_alsologtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  std::string log_path;
+  std::string output_path;
+  std::string agents_path;
+  std::size_t first = 0;
+  std::size_t last = 0;
+  std::size_t n_threads = 0;
+  uint_fast8_t compression_level = 3;
+
+  auto cli =
+      (value("log", log_path).doc("The change log .json.zst written by "
+                                  "contagent-bin --change-log"),
+       value("output", output_path).doc("The output.json.zst path"),
+       option("--agents").doc("A file of the UUIDs of the agents to "
+                              "recompute, one per line [default=all]") &
+           value("file", agents_path),
+       option("--from").doc("The first day [default=the start time]") &
+           value("day", first),
+       option("--to").doc("One past the last day [default=the end time]") &
+           value("day", last),
+       option("-j", "--threads").doc("The number of threads that tick the "
+                                     "agents [default=number of cores]") &
+           value("threads", n_threads),
+       option("-Z").doc("zstd output compression level [default=3] between 1 "
+                        "and 22 (20-22 have high mem usage).") &
+           value("level", compression_level));
+
+  if (!parse(argc, argv, cli)) {
+    std::cout << make_man_page(cli, "contagent-replay");
+    return 1;
+  }
+
+  LOG(INFO) << "Loading change log";
+  auto log_file = json::create_zstd_istream(log_path);
+  const auto log = replay::read(*log_file);
+  LOG(INFO) << "Loaded " << log.agents.size() << " agents and "
+            << log.changes.size() << " changes of action";
+
+  std::vector<std::uint32_t> agents(log.agents.size());
+  if (agents_path.empty()) {
+    std::iota(agents.begin(), agents.end(), 0);
+  } else {
+    agents = load_agent_indices(agents_path, log);
+  }
+  first = first == 0 ? log.start_time : first;
+  last = last == 0 ? log.end_time : last;
+
+  LOG(INFO) << "Replaying " << agents.size() << " agents from day " << first
+            << " until " << last;
+  const auto started = std::chrono::steady_clock::now();
+  const auto days =
+      replay::replay(log, agents, first, last, Parallelism{n_threads});
+  LOG(INFO) << "Replayed in "
+            << std::chrono::duration<double_t>(
+                   std::chrono::steady_clock::now() - started)
+                   .count()
+            << "s";
+
+  // The activations of every day are an array per agent, ordered as
+  // "beliefs", and the actions are indices of "behaviours".
+  nlohmann::json j = {{"behaviours", nlohmann::json::array()},
+                      {"beliefs", nlohmann::json::array()},
+                      {"agents", nlohmann::json::array()},
+                      {"days", nlohmann::json::array()}};
+  for (const auto &behaviour : log.behaviours) {
+    j["behaviours"].push_back(
+        boost::lexical_cast<std::string>(behaviour->get_uuid()));
+  }
+  for (const auto &belief : log.beliefs) {
+    j["beliefs"].push_back(
+        boost::lexical_cast<std::string>(belief->get_uuid()));
+  }
+  for (const auto a : agents) {
+    j["agents"].push_back(
+        boost::lexical_cast<std::string>(log.agents[a]->get_uuid()));
+  }
+  const std::size_t n_beliefs = log.beliefs.size();
+  for (const auto &day : days) {
+    nlohmann::json activations = nlohmann::json::array();
+    for (std::size_t k = 0; k < agents.size(); ++k) {
+      activations.push_back(std::vector<double_t>(
+          day.activations.begin() + k * n_beliefs,
+          day.activations.begin() + (k + 1) * n_beliefs));
+    }
+    j["days"].push_back({{"day", day.day},
+                         {"activations", std::move(activations)},
+                         {"actions", day.actions}});
+  }
+
+  *json::create_zstd_ostream(output_path, compression_level) << j;
+  LOG(INFO) << "Output successfully serialized";
+}
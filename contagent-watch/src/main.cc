@@ -0,0 +1,148 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "clipp.h"
+#include "contagent/shm_ring.h"
+#include <chrono>
+#include <cstring>
+#include <glog/logging.h>
+#include <iostream>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+using namespace clipp;
+using namespace contagent;
+
+namespace {
+/// Encode a shm::RecordKind::STATE payload as JSON.
+/// \param day The day.
+/// \param payload The payload.
+/// \return The JSON, or nothing if the payload was overwritten as it was read.
+std::optional<nlohmann::json>
+decode_state(const std::size_t day, const std::span<const std::byte> payload) {
+  shm::StateHeader header{};
+  if (payload.size() < sizeof(header)) {
+    return std::nullopt;
+  }
+  std::memcpy(&header, payload.data(), sizeof(header));
+  if (header.n_agents > payload.size() || header.n_beliefs > payload.size() ||
+      payload.size() != sizeof(header) + header.n_agents *
+                                             (header.n_beliefs *
+                                                  sizeof(double) +
+                                              sizeof(std::uint32_t))) {
+    return std::nullopt;
+  }
+  const auto *activations = reinterpret_cast<const double *>(
+      payload.data() + sizeof(header));
+  const auto *actions = reinterpret_cast<const std::uint32_t *>(
+      activations + header.n_agents * header.n_beliefs);
+
+  nlohmann::json j = {{"time", day},
+                      {"activations", nlohmann::json::array()},
+                      {"actions", nlohmann::json::array()}};
+  for (std::size_t i = 0; i < header.n_agents; ++i) {
+    j["activations"].push_back(
+        std::vector<double>(activations + i * header.n_beliefs,
+                            activations + (i + 1) * header.n_beliefs));
+    if (actions[i] == std::numeric_limits<std::uint32_t>::max()) {
+      j["actions"].push_back(nullptr);
+    } else {
+      j["actions"].push_back(actions[i]);
+    }
+  }
+  return j;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  FLAGS_alsologtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  std::string name;
+  bool latest = false;
+  bool state = false;
+  std::size_t poll_ms = 10;
+
+  auto cli =
+      (value("name", name).doc("The name of the shared memory ring written "
+                               "by contagentsim --shm-output"),
+       option("--latest")
+           .set(latest)
+           .doc("Start at the next day to be published, rather than the "
+                "oldest that has not been overwritten"),
+       option("--state")
+           .set(state)
+           .doc("Write the activations and actions of the agents as well as "
+                "the summaries, if they are published"),
+       option("--poll").doc("The milliseconds to wait for a day to be "
+                            "published [default=10]") &
+           value("ms", poll_ms));
+
+  if (!parse(argc, argv, cli)) {
+    std::cout << make_man_page(cli, "contagent-watch");
+    return 1;
+  }
+
+  shm::Reader reader(name, !latest);
+  LOG(INFO) << "Reading " << name << " " << reader.get_metadata();
+
+  // Every day is written as a line of JSON as soon as it is published. The
+  // payload is only copied once it is known to be intact, as the simulation
+  // may overwrite it if it does not wait for its readers.
+  std::string line;
+  while (!reader.finished()) {
+    const auto record = reader.next();
+    if (!record) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+      continue;
+    }
+    if (record->kind == shm::RecordKind::SUMMARY) {
+      line.assign(reinterpret_cast<const char *>(record->payload.data()),
+                  record->payload.size());
+    } else if (state && record->kind == shm::RecordKind::STATE) {
+      const auto j = decode_state(record->day, record->payload);
+      if (!j) {
+        continue;
+      }
+      line = j->dump();
+    } else {
+      continue;
+    }
+    if (reader.valid(*record)) {
+      std::cout << line << '\n' << std::flush;
+    }
+  }
+  if (reader.get_lost() != 0) {
+    LOG(WARNING) << reader.get_lost()
+                 << " records were overwritten before they were read";
+  }
+}
@@ -0,0 +1,235 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/agent_history.h"
+#include <bit>
+#include <glog/logging.h>
+#include <limits>
+#include <stdexcept>
+
+using namespace contagent;
+
+namespace {
+/// Check that two days hold the same activations, bit for bit.
+void check_same(const ActivationHistory::Day &actual,
+                const ActivationHistory::Day &expected) {
+  CHECK_EQ(actual.size(), expected.size());
+  for (const auto &[belief, activation] : expected) {
+    const auto found = actual.find(belief);
+    CHECK(found != actual.end()) << belief->get_name();
+    CHECK_EQ(std::bit_cast<std::uint64_t>(found->second),
+             std::bit_cast<std::uint64_t>(activation))
+        << belief->get_name();
+  }
+}
+
+/// Check every day of an ActivationHistory, both one at a time and all at
+/// once.
+void check_same(const ActivationHistory &history,
+                const std::vector<ActivationHistory::Day> &expected) {
+  CHECK_EQ(history.size(), expected.size());
+  const auto days = history.to_vector();
+  CHECK_EQ(days.size(), expected.size());
+  for (std::size_t day = 0; day < expected.size(); ++day) {
+    check_same(history.at(day), expected[day]);
+    check_same(days[day], expected[day]);
+    for (const auto &[belief, activation] : expected[day]) {
+      const auto found = history.find(day, belief);
+      CHECK(found.has_value());
+      CHECK_EQ(std::bit_cast<std::uint64_t>(*found),
+               std::bit_cast<std::uint64_t>(activation));
+    }
+  }
+}
+
+/// Get whether reading a day throws std::out_of_range.
+template <class History>
+bool is_out_of_range(const History &history, const std::size_t day) {
+  try {
+    static_cast<void>(history.at(day));
+  } catch (const std::out_of_range &) {
+    return true;
+  }
+  return false;
+}
+
+/// The runs of an ActionHistory, and ActionHistory::set forgetting the days
+/// after the one it records.
+void test_action_history() {
+  const auto walk = std::make_shared<Behaviour>("Walk");
+  const auto cycle = std::make_shared<Behaviour>("Cycle");
+  const auto drive = std::make_shared<Behaviour>("Drive");
+
+  std::vector<std::shared_ptr<Behaviour>> actions;
+  for (std::size_t day = 0; day < 40; ++day) {
+    actions.push_back(day < 10 ? walk : day < 25 ? cycle : day % 2 ? drive
+                                                                   : walk);
+  }
+  ActionHistory history(actions);
+  CHECK_EQ(history.size(), actions.size());
+  CHECK(history.to_vector() == actions);
+  for (std::size_t day = 0; day < actions.size(); ++day) {
+    CHECK(history.at(day) == actions[day]) << day;
+  }
+  CHECK(is_out_of_range(history, actions.size()));
+
+  // Within a run, the run is cut short and the later runs are dropped.
+  history.set(15, drive);
+  actions.resize(15);
+  actions.push_back(drive);
+  CHECK_EQ(history.size(), 16);
+  CHECK(history.to_vector() == actions);
+  CHECK(is_out_of_range(history, 16));
+
+  // At the start of a run, the run is dropped, and the same behaviour as the
+  // run before extends it.
+  history.set(10, walk);
+  actions.resize(10);
+  actions.push_back(walk);
+  CHECK_EQ(history.size(), 11);
+  CHECK(history.to_vector() == actions);
+
+  history.set(11, cycle);
+  actions.push_back(cycle);
+  CHECK(history.to_vector() == actions);
+
+  history.set(0, drive);
+  CHECK_EQ(history.size(), 1);
+  CHECK(history.at(0) == drive);
+
+  bool threw = false;
+  try {
+    history.set(2, walk);
+  } catch (const std::out_of_range &) {
+    threw = true;
+  }
+  CHECK(threw);
+  CHECK_EQ(history.size(), 1);
+}
+
+/// The XOR byte packing of ActivationHistory, for activations that change
+/// smoothly, that jump, that are special values, and days whose beliefs
+/// differ from the day before.
+void test_activation_codec() {
+  std::vector<std::shared_ptr<Belief>> beliefs;
+  for (const auto *name : {"A", "B", "C", "D"}) {
+    beliefs.push_back(std::make_shared<Belief>(name));
+  }
+
+  const double_t special[] = {0.0,
+                              -0.0,
+                              1.0,
+                              -1.0,
+                              std::numeric_limits<double_t>::denorm_min(),
+                              std::numeric_limits<double_t>::max(),
+                              std::numeric_limits<double_t>::quiet_NaN()};
+
+  std::vector<ActivationHistory::Day> days;
+  for (std::size_t day = 0; day < 5 * ActivationHistory::BLOCK_DAYS + 3;
+       ++day) {
+    ActivationHistory::Day activations;
+    activations[beliefs[0]] = 0.5 + 1e-9 * static_cast<double_t>(day);
+    activations[beliefs[1]] = day % 7 == 0 ? -0.25 : 0.75;
+    if (day % 5 != 0) {
+      activations[beliefs[2]] = special[day % std::size(special)];
+    }
+    if (day >= 20 && day < 40) {
+      activations[beliefs[3]] = static_cast<double_t>(day) / 3.0;
+    }
+    days.push_back(std::move(activations));
+  }
+
+  ActivationHistory history(days);
+  check_same(history, days);
+
+  // A day that has no activation of a belief finds none.
+  CHECK(!history.find(5, beliefs[2]).has_value());
+  CHECK(!history.find(0, std::make_shared<Belief>("E")).has_value());
+  CHECK(is_out_of_range(history, days.size()));
+
+  // An empty history, and a day of no activations, round-trip too.
+  CHECK_EQ(ActivationHistory().size(), 0);
+  CHECK(is_out_of_range(ActivationHistory(), 0));
+  std::vector<ActivationHistory::Day> empty_days(
+      2 * ActivationHistory::BLOCK_DAYS + 2);
+  check_same(ActivationHistory(empty_days), empty_days);
+}
+
+/// Changing a day that has been compressed decompresses the blocks from it
+/// on, which are compressed again afterwards, and setting a day past the end
+/// adds days with no activations.
+void test_activation_reseal() {
+  const auto a = std::make_shared<Belief>("A");
+  const auto b = std::make_shared<Belief>("B");
+  const auto c = std::make_shared<Belief>("C");
+
+  std::vector<ActivationHistory::Day> days;
+  for (std::size_t day = 0; day < 4 * ActivationHistory::BLOCK_DAYS; ++day) {
+    days.push_back({{a, 0.01 * static_cast<double_t>(day)},
+                    {b, -0.02 * static_cast<double_t>(day)}});
+  }
+  ActivationHistory history(days);
+
+  // The whole day, in the first block.
+  days[3] = {{b, 0.125}, {c, -0.5}};
+  history.set(3, days[3]);
+  check_same(history, days);
+
+  // One belief of a day in a middle block, both one it has and a new one.
+  days[ActivationHistory::BLOCK_DAYS + 1][a] = -0.75;
+  history.set(ActivationHistory::BLOCK_DAYS + 1, a, -0.75);
+  days[2 * ActivationHistory::BLOCK_DAYS][c] = 0.3;
+  history.set(2 * ActivationHistory::BLOCK_DAYS, c, 0.3);
+  check_same(history, days);
+
+  // The last days, which are not compressed.
+  days.back()[a] = 1.0;
+  history.set(days.size() - 1, a, 1.0);
+  check_same(history, days);
+
+  // Past the end, with days of no activations between.
+  days.resize(days.size() + 2 * ActivationHistory::BLOCK_DAYS);
+  days.push_back({{c, 0.9}});
+  history.set(days.size() - 1, days.back());
+  check_same(history, days);
+
+  // Every day, in turn, after the history has been sealed again.
+  for (std::size_t day = 0; day < days.size(); ++day) {
+    days[day][b] = static_cast<double_t>(day) / 7.0;
+    history.set(day, b, days[day][b]);
+  }
+  check_same(history, days);
+}
+} // namespace
+
+int main() {
+  test_action_history();
+  test_activation_codec();
+  test_activation_reseal();
+  return 0;
+}
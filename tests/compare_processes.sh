@@ -0,0 +1,51 @@
+#!/bin/sh
+# Copyright (c) 2024, Robert Greener
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+#    this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its
+#    contributors may be used to endorse or promote products derived from
+#    this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Run a simulation in one process and divided between processes with
+# --processes, and check that the outputs are the same byte for byte.
+# Usage: compare_processes.sh <contagent-bin> <agents> <beliefs> <behaviours>
+#                             <processes> [options...]
+# The options are passed to both runs.
+
+set -eu
+
+bin=$1
+agents=$2
+beliefs=$3
+behaviours=$4
+processes=$5
+shift 5
+
+directory=$(mktemp -d)
+trap 'rm -rf "$directory"' EXIT
+
+"$bin" 1 30 "$agents" "$beliefs" "$behaviours" "$directory/one.json.zst" "$@"
+"$bin" 1 30 "$agents" "$beliefs" "$behaviours" "$directory/divided.json.zst" \
+  --processes "$processes" "$@"
+cmp "$directory/one.json.zst" "$directory/divided.json.zst"
@@ -0,0 +1,131 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/shm_ring.h"
+#include <chrono>
+#include <cstring>
+#include <glog/logging.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace contagent;
+
+namespace {
+/// The payload of the record of a sequence, which is between 8 and about
+/// 600 bytes, so that the records wrap at different offsets.
+std::vector<std::byte> payload(const std::uint64_t sequence) {
+  std::vector<std::byte> bytes(sizeof(sequence) + sequence * 37 % 600);
+  std::memcpy(bytes.data(), &sequence, sizeof(sequence));
+  for (std::size_t i = sizeof(sequence); i < bytes.size(); ++i) {
+    bytes[i] = static_cast<std::byte>(sequence + i);
+  }
+  return bytes;
+}
+
+/// Check that a record is the one that was published with its sequence.
+void check_record(const shm::Record &record) {
+  CHECK(record.kind == shm::RecordKind::SUMMARY);
+  CHECK_EQ(record.day, record.sequence / 2);
+  const auto expected = payload(record.sequence);
+  CHECK_EQ(record.payload.size(), expected.size());
+  CHECK(std::memcmp(record.payload.data(), expected.data(), expected.size()) ==
+        0)
+      << record.sequence;
+}
+
+/// Publish records of varied sizes from one thread and read them from
+/// another, which reads slowly every so often.
+/// \param wait_for_readers Whether the publisher waits for the reader, which
+/// then must read every record, or overwrites those it has not read.
+void test_ring(const bool wait_for_readers) {
+  constexpr std::uint64_t N_RECORDS = 50000;
+  const std::string name = "/contagent-test-" + std::to_string(getpid());
+  shm::Publisher publisher(name, 8192, "{\"test\":true}", wait_for_readers);
+  shm::Reader reader(name);
+  CHECK(reader.get_metadata() == "{\"test\":true}");
+
+  std::uint64_t n_read = 0;
+  std::uint64_t n_invalid = 0;
+  std::optional<std::uint64_t> first;
+  std::uint64_t last = 0;
+  std::thread consumer([&] {
+    while (!reader.finished()) {
+      const auto record = reader.next();
+      if (!record) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (first) {
+        CHECK_GT(record->sequence, last);
+      } else {
+        first = record->sequence;
+      }
+      last = record->sequence;
+      if (record->sequence % 1000 == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      // Without waiting, a record that was overwritten while it was read is
+      // discarded, and only an intact one must match.
+      std::vector<std::byte> copy(record->payload.begin(),
+                                  record->payload.end());
+      if (!reader.valid(*record)) {
+        ++n_invalid;
+        continue;
+      }
+      check_record({record->kind, record->sequence, record->day,
+                    {copy.data(), copy.size()}, record->position});
+      ++n_read;
+    }
+  });
+
+  for (std::uint64_t sequence = 0; sequence < N_RECORDS; ++sequence) {
+    const auto bytes = payload(sequence);
+    publisher.publish(shm::RecordKind::SUMMARY, sequence / 2, {bytes});
+  }
+  publisher.finish();
+  consumer.join();
+
+  // Every record is read, discarded or counted as lost, and the last is
+  // always read, as nothing overwrites it.
+  CHECK(first.has_value());
+  CHECK_EQ(last, N_RECORDS - 1);
+  CHECK_EQ(*first + n_read + n_invalid + reader.get_lost(), N_RECORDS);
+  if (wait_for_readers) {
+    CHECK_EQ(n_read, N_RECORDS);
+    CHECK_EQ(publisher.get_overtaken(), 0);
+  }
+}
+} // namespace
+
+int main() {
+  test_ring(true);
+  test_ring(false);
+  return 0;
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2024, Robert Greener
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "contagent/spsc_queue.h"
+#include <glog/logging.h>
+#include <memory>
+#include <thread>
+
+using namespace contagent;
+
+namespace {
+/// Pass many values through a small queue, so that it fills and empties
+/// often, and check that they arrive once each and in order.
+/// \param capacity The capacity of the queue.
+/// \param n_values The number of values.
+void test_order(const std::size_t capacity, const std::uint64_t n_values) {
+  SpscQueue<std::unique_ptr<std::uint64_t>> queue(capacity);
+
+  std::thread producer([&queue, n_values] {
+    for (std::uint64_t i = 0; i < n_values; ++i) {
+      CHECK(queue.push(std::make_unique<std::uint64_t>(i)));
+    }
+    queue.close();
+  });
+
+  std::uint64_t expected = 0;
+  while (auto value = queue.pop()) {
+    CHECK(*value != nullptr);
+    CHECK_EQ(**value, expected);
+    ++expected;
+  }
+  producer.join();
+  CHECK_EQ(expected, n_values);
+
+  // A closed queue stays empty.
+  CHECK(!queue.pop().has_value());
+}
+
+/// A consumer that cancels part way releases a producer that is waiting on a
+/// full queue, and every later push fails.
+void test_cancel() {
+  constexpr std::uint64_t N_TAKEN = 10000;
+  SpscQueue<std::uint64_t> queue(4);
+  std::uint64_t n_pushed = 0;
+
+  std::thread producer([&queue, &n_pushed] {
+    while (queue.push(n_pushed)) {
+      ++n_pushed;
+    }
+    CHECK(!queue.push(0));
+  });
+
+  for (std::uint64_t i = 0; i < N_TAKEN; ++i) {
+    const auto value = queue.pop();
+    CHECK(value.has_value());
+    CHECK_EQ(*value, i);
+  }
+  queue.cancel();
+  producer.join();
+
+  // The producer can get at most the capacity ahead of the consumer.
+  CHECK_GE(n_pushed, N_TAKEN);
+  CHECK_LE(n_pushed, N_TAKEN + 4);
+}
+
+/// Closing an empty queue wakes a consumer that is waiting on it.
+void test_close_empty() {
+  SpscQueue<int> queue(2);
+  std::thread consumer([&queue] { CHECK(!queue.pop().has_value()); });
+  queue.close();
+  consumer.join();
+}
+} // namespace
+
+int main() {
+  test_order(1, 200000);
+  test_order(3, 1000000);
+  test_order(64, 1000000);
+  test_cancel();
+  test_close_empty();
+  return 0;
+}